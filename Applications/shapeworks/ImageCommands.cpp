@@ -548,6 +548,8 @@ void ComputeDT::buildParser()
   parser.prog(prog).description(desc);
 
   parser.add_option("--isovalue").action("store").type("double").set_default(0.0).help("Level set value that defines the interface between foreground and background [default: %default].");
+  parser.add_option("--exact").action("store").type("bool").set_default(false).help("Use an exact, multithreaded Euclidean distance transform instead of fast marching [default: false].");
+  parser.add_option("--narrowband").action("store").type("double").set_default(0.0).help("Clamp distances to +/- this value in physical units, 0 for no clamping [default: %default].");
 
   Command::buildParser();
 }
@@ -561,8 +563,10 @@ bool ComputeDT::execute(const optparse::Values &options, SharedCommandData &shar
   }
 
   double isoValue = static_cast<double>(options.get("isovalue"));
+  bool exact = static_cast<bool>(options.get("exact"));
+  double narrowBand = static_cast<double>(options.get("narrowband"));
 
-  sharedData.image.computeDT(isoValue);
+  sharedData.image.computeDT(isoValue, exact ? Image::Exact : Image::FastMarching, narrowBand);
   return true;
 }
 
@@ -1458,7 +1458,22 @@ bool WarpMesh::execute(const optparse::Values &options, SharedCommandData &share
       boost::filesystem::create_directories(saveDir);
     }
 
+    // warp a batch of shapes at a time, sharing one pass over the warp matrix
+    const int batch_size = 32;
+    std::vector<vtkSmartPointer<vtkPolyData>> batch;
+
     for (int i = 0; i < targetPointsFilenames.size() - 1; i++) {
+      if (i % batch_size == 0) {
+        std::vector<Eigen::MatrixXd> batch_points;
+        for (int j = i; j < std::min<int>(i + batch_size, targetPointsFilenames.size() - 1); j++) {
+          Eigen::MatrixXd movingPoints = allPts.col(j);
+          movingPoints.resize(3, numParticles);
+          movingPoints.transposeInPlace();
+          batch_points.push_back(movingPoints);
+        }
+        batch = warper.build_meshes(batch_points);
+      }
+
       filenm = targetPointsFilenames[i];
       filenm.replace(static_cast<int>(filenm.rfind('.')) + 1, filenm.length(), "vtk");
       if (saveDir.length() > 0) {
@@ -1466,10 +1481,7 @@ bool WarpMesh::execute(const optparse::Values &options, SharedCommandData &share
         filenm.replace(0, idx, saveDir);
       }
 
-      Eigen::MatrixXd movingPoints = allPts.col(i);
-      movingPoints.resize(3, numParticles);
-      movingPoints.transposeInPlace();
-      Mesh output = warper.build_mesh(movingPoints);
+      Mesh output = batch[i % batch_size];
       SW_DEBUG("Writing mesh {} with {} points", filenm, output.numPoints());
       output.write(filenm);
       if (warp_along_with_landmarks) {
@@ -21,12 +21,127 @@
 #endif  // ifndef __APPLE__
 #endif  // ifdef _WIN32
 
+#include <CacheUtils.h>
 #include <Logging.h>
 #include <MeshCache.h>
 #include <vtkPolyData.h>
+#include <vtkXMLPolyDataReader.h>
+#include <vtkXMLPolyDataWriter.h>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
 
 namespace shapeworks {
 
+namespace {
+//-----------------------------------------------------------------------------
+uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+//-----------------------------------------------------------------------------
+uint64_t fmix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdull;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ull;
+  k ^= k >> 33;
+  return k;
+}
+
+//-----------------------------------------------------------------------------
+// MurmurHash3 x64 128
+MeshCacheKey murmur3_128(const std::string& data, uint64_t seed) {
+  const auto* bytes = reinterpret_cast<const uint8_t*>(data.data());
+  const size_t len = data.size();
+  const size_t num_blocks = len / 16;
+  const uint64_t c1 = 0x87c37b91114253d5ull;
+  const uint64_t c2 = 0x4cf5ad432745937full;
+  uint64_t h1 = seed;
+  uint64_t h2 = seed;
+
+  for (size_t i = 0; i < num_blocks; i++) {
+    uint64_t k1, k2;
+    std::memcpy(&k1, bytes + i * 16, 8);
+    std::memcpy(&k2, bytes + i * 16 + 8, 8);
+
+    k1 *= c1;
+    k1 = rotl64(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+    h1 = rotl64(h1, 27);
+    h1 += h2;
+    h1 = h1 * 5 + 0x52dce729;
+
+    k2 *= c2;
+    k2 = rotl64(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+    h2 = rotl64(h2, 31);
+    h2 += h1;
+    h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  const uint8_t* tail = bytes + num_blocks * 16;
+  uint64_t k1 = 0;
+  uint64_t k2 = 0;
+  for (size_t i = len & 15; i > 8; i--) {
+    k2 ^= uint64_t(tail[i - 1]) << ((i - 9) * 8);
+  }
+  if ((len & 15) > 8) {
+    k2 *= c2;
+    k2 = rotl64(k2, 33);
+    k2 *= c1;
+    h2 ^= k2;
+  }
+  for (size_t i = std::min<size_t>(len & 15, 8); i > 0; i--) {
+    k1 ^= uint64_t(tail[i - 1]) << ((i - 1) * 8);
+  }
+  if ((len & 15) > 0) {
+    k1 *= c1;
+    k1 = rotl64(k1, 31);
+    k1 *= c2;
+    h1 ^= k1;
+  }
+
+  h1 ^= len;
+  h2 ^= len;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix64(h1);
+  h2 = fmix64(h2);
+  h1 += h2;
+  h2 += h1;
+  return {h1, h2};
+}
+
+//-----------------------------------------------------------------------------
+template <class T>
+void append_value(std::string& data, const T& value) {
+  data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+//-----------------------------------------------------------------------------
+size_t get_memory_size(MeshHandle mesh) {
+  size_t size = sizeof(StudioMesh);
+  if (mesh && mesh->get_poly_data()) {
+    size += mesh->get_poly_data()->GetActualMemorySize() * 1024;  // given in kb
+  }
+  return size;
+}
+}  // namespace
+
+//-----------------------------------------------------------------------------
+std::string MeshCacheKey::to_string() const {
+  char buffer[33];
+  snprintf(buffer, sizeof(buffer), "%016llx%016llx", (unsigned long long)high, (unsigned long long)low);
+  return buffer;
+}
+
 //-----------------------------------------------------------------------------
 long long MeshCache::get_total_physical_memory() {
 #ifdef _WIN32
@@ -79,69 +194,240 @@ long long MeshCache::get_total_addressable_physical_memory() {
 MeshCache::MeshCache() {
   max_memory_ = MeshCache::get_total_addressable_physical_memory();
   current_memory_size_ = 0;
+  disk_writer_.setMaxThreadCount(1);
 }
 
 //-----------------------------------------------------------------------------
-MeshHandle MeshCache::get_mesh(const MeshWorkItem& shape) {
+MeshCache::~MeshCache() { disk_writer_.waitForDone(); }
+
+//-----------------------------------------------------------------------------
+MeshCacheKey MeshCache::compute_key(const MeshWorkItem& item) {
+  std::string data;
+  data.reserve(item.filename.size() + item.points.size() * sizeof(double) + 32);
+  append_value(data, int64_t(item.domain));
+  append_value(data, item.reconstruction_id);
+  append_value(data, uint64_t(item.filename.size()));
+  data.append(item.filename);
+  append_value(data, uint64_t(item.points.size()));
+  data.append(reinterpret_cast<const char*>(item.points.data()), item.points.size() * sizeof(double));
+  return murmur3_128(data, 0x5357);
+}
+
+//-----------------------------------------------------------------------------
+void MeshCache::set_disk_cache_directory(const std::string& directory) {
+  disk_writer_.waitForDone();
   QMutexLocker locker(&mutex_);
+  if (directory == disk_directory_) {
+    return;
+  }
+  disk_directory_ = directory;
+  current_disk_size_ = 0;
+  if (directory.empty()) {
+    return;
+  }
+  QDir dir(QString::fromStdString(directory));
+  if (!dir.mkpath(".")) {
+    SW_WARN("Unable to create mesh cache directory: {}", directory);
+    disk_directory_ = "";
+    return;
+  }
+  current_disk_size_ = CacheUtils::directory_size(directory, ".vtp");
+}
 
+//-----------------------------------------------------------------------------
+MeshHandle MeshCache::get_mesh(const MeshWorkItem& item) {
   if (!cache_enabled_) {
     return nullptr;
   }
 
-  // search the cache for this shape
-  CacheMap::iterator it = mesh_cache_.find(shape);
-  if (it == mesh_cache_.end()) {
-    return nullptr;
+  auto key = compute_key(item);
+  {
+    QMutexLocker locker(&mutex_);
+    auto it = mesh_cache_.find(key);
+    if (it != mesh_cache_.end()) {
+      // most recently used
+      entries_.splice(entries_.begin(), entries_, it->second);
+      hits_++;
+      return it->second->mesh;
+    }
+  }
+
+  if (item.reconstruction_id != 0 && item.filename.empty()) {
+    if (auto mesh = read_from_disk(key)) {
+      QMutexLocker locker(&mutex_);
+      disk_hits_++;
+      insert_entry(key, mesh);
+      return mesh;
+    }
   }
 
-  return mesh_cache_[shape];
+  QMutexLocker locker(&mutex_);
+  misses_++;
+  return nullptr;
 }
 
 //-----------------------------------------------------------------------------
 void MeshCache::insert_mesh(const MeshWorkItem& item, MeshHandle mesh) {
-  if (!cache_enabled_) {
+  if (!cache_enabled_ || !mesh) {
     return;
   }
 
-  QMutexLocker locker(&mutex_);
-
-  if (mesh->get_poly_data()) {
-    // compute the memory size of this shape
-    size_t shape_size = item.points.size() * sizeof(double);
-    size_t mesh_size = mesh->get_poly_data()->GetActualMemorySize() * 1024;  // given in kb
-    size_t combined_size = (shape_size * 2) + mesh_size;
-    current_memory_size_ += combined_size;
+  auto key = compute_key(item);
+  {
+    QMutexLocker locker(&mutex_);
+    insert_entry(key, mesh);
   }
 
-  freeSpaceForAmount(item.memory_size);
-
-  mesh_cache_[item] = mesh;
-
-  // std::cerr << "Cache now holds " << mesh_cache_.size() << " items\n";
-
-  // add to LRC list
-  cache_list_.push_back(item);
+  if (item.reconstruction_id != 0 && item.filename.empty() && mesh->get_error_message().empty()) {
+    write_to_disk(key, mesh);
+  }
 }
 
 //-----------------------------------------------------------------------------
 void MeshCache::clear() {
   QMutexLocker locker(&mutex_);
 
+  log_statistics();
   mesh_cache_.clear();
+  entries_.clear();
   current_memory_size_ = 0;
 }
 
 //-----------------------------------------------------------------------------
-void MeshCache::freeSpaceForAmount(size_t allocation) {
+size_t MeshCache::get_memory_size() {
+  QMutexLocker locker(&mutex_);
+  return current_memory_size_;
+}
+
+//-----------------------------------------------------------------------------
+void MeshCache::insert_entry(const MeshCacheKey& key, MeshHandle mesh) {
+  auto existing = mesh_cache_.find(key);
+  if (existing != mesh_cache_.end()) {
+    current_memory_size_ -= existing->second->memory_size;
+    entries_.erase(existing->second);
+    mesh_cache_.erase(existing);
+  }
+
+  const size_t size = get_memory_size(mesh);
+  free_space_for_amount(size);
+
+  entries_.push_front({key, mesh, size});
+  mesh_cache_[key] = entries_.begin();
+  current_memory_size_ += size;
+}
+
+//-----------------------------------------------------------------------------
+void MeshCache::free_space_for_amount(size_t allocation) {
   size_t memory_limit = (cache_memory_percent_ / 100.0) * max_memory_;
 
-  while (!cache_list_.empty() && current_memory_size_ + allocation > memory_limit) {
-    auto item = cache_list_.back();
-    current_memory_size_ -= item.memory_size;
-    cache_list_.pop_back();
-    SW_LOG("erasing item for {}kb savings", item.memory_size / 1024);
-    mesh_cache_.erase(item);
+  // evict the least recently used
+  while (!entries_.empty() && current_memory_size_ + allocation > memory_limit) {
+    const auto& entry = entries_.back();
+    current_memory_size_ -= entry.memory_size;
+    SW_DEBUG("erasing item for {}kb savings", entry.memory_size / 1024);
+    mesh_cache_.erase(entry.key);
+    entries_.pop_back();
+    evictions_++;
+  }
+}
+
+//-----------------------------------------------------------------------------
+std::string MeshCache::get_disk_filename(const MeshCacheKey& key) const {
+  return disk_directory_ + "/" + key.to_string() + ".vtp";
+}
+
+//-----------------------------------------------------------------------------
+MeshHandle MeshCache::read_from_disk(const MeshCacheKey& key) {
+  std::string filename;
+  {
+    QMutexLocker locker(&mutex_);
+    if (disk_directory_.empty()) {
+      return nullptr;
+    }
+    filename = get_disk_filename(key);
+  }
+
+  if (!QFile::exists(QString::fromStdString(filename))) {
+    return nullptr;
+  }
+
+  auto reader = vtkSmartPointer<vtkXMLPolyDataReader>::New();
+  reader->SetFileName(filename.c_str());
+  reader->Update();
+  auto poly_data = reader->GetOutput();
+  if (!poly_data || poly_data->GetNumberOfPoints() == 0) {
+    // corrupt or truncated (e.g. written by an older version that did not write atomically), remove it so that the
+    // mesh is written again
+    SW_DEBUG("removing unreadable mesh cache file: {}", filename);
+    QFile::remove(QString::fromStdString(filename));
+    return nullptr;
+  }
+
+  // mark as recently used for trimming
+  CacheUtils::touch(filename);
+
+  MeshHandle mesh(new StudioMesh);
+  mesh->set_poly_data(poly_data);
+  return mesh;
+}
+
+//-----------------------------------------------------------------------------
+void MeshCache::write_to_disk(const MeshCacheKey& key, MeshHandle mesh) {
+  std::string filename;
+  {
+    QMutexLocker locker(&mutex_);
+    if (disk_directory_.empty() || !mesh->get_poly_data() || mesh->get_poly_data()->GetNumberOfPoints() == 0) {
+      return;
+    }
+    filename = get_disk_filename(key);
+  }
+  if (QFile::exists(QString::fromStdString(filename))) {
+    return;
+  }
+
+  // the displayed mesh gets scalars attached, write a copy of it as it is now
+  auto poly_data = vtkSmartPointer<vtkPolyData>::New();
+  poly_data->DeepCopy(mesh->get_poly_data());
+
+  disk_writer_.start([this, poly_data, filename]() {
+    // readers never see a partial file
+    const bool written = CacheUtils::write_atomically(filename, [&](const std::string& temp_filename) {
+      auto writer = vtkSmartPointer<vtkXMLPolyDataWriter>::New();
+      writer->SetFileName(temp_filename.c_str());
+      writer->SetInputData(poly_data);
+      writer->SetDataModeToBinary();
+      writer->SetCompressorTypeToZLib();
+      return writer->Write() != 0;
+    });
+    if (!written) {
+      return;
+    }
+
+    QMutexLocker locker(&mutex_);
+    current_disk_size_ += QFileInfo(QString::fromStdString(filename)).size();
+    if (current_disk_size_ > max_disk_size_) {
+      trim_disk_cache();
+    }
+  });
+}
+
+//-----------------------------------------------------------------------------
+void MeshCache::trim_disk_cache() {
+  // remove the least recently used files until the cache is back under 90% of its size
+  current_disk_size_ = CacheUtils::trim_directory(disk_directory_, ".vtp", max_disk_size_ / 10 * 9);
+}
+
+//-----------------------------------------------------------------------------
+void MeshCache::log_statistics() {
+  const size_t lookups = hits_ + disk_hits_ + misses_;
+  if (lookups == 0) {
+    return;
   }
+  SW_LOG("Mesh cache: {} hits, {} from disk, {} misses, {} evictions, {} meshes ({}mb) in memory", hits_, disk_hits_,
+         misses_, evictions_, entries_.size(), current_memory_size_ / (1024 * 1024));
+  hits_ = 0;
+  disk_hits_ = 0;
+  misses_ = 0;
+  evictions_ = 0;
 }
 }  // namespace shapeworks
@@ -5,51 +5,105 @@
 
 // qt
 #include <QMutex>
+#include <QThreadPool>
 
 // std
+#include <cstdint>
 #include <list>
-#include <map>
+#include <string>
+#include <unordered_map>
 
 namespace shapeworks {
 
-// mesh cache type
-using CacheMap = std::map<MeshWorkItem, MeshHandle>;
+//! 128 bit content hash identifying a cached mesh
+struct MeshCacheKey {
+  uint64_t high = 0;
+  uint64_t low = 0;
 
-// LRU list
-using CacheList = std::list<MeshWorkItem>;
+  bool operator==(const MeshCacheKey& other) const { return high == other.high && low == other.low; }
+
+  //! 32 hex digits, used as the file name in the disk cache
+  std::string to_string() const;
+};
+
+struct MeshCacheKeyHash {
+  size_t operator()(const MeshCacheKey& key) const { return static_cast<size_t>(key.low); }
+};
 
 /**
  * @brief Thread safe cache for meshes index by shape
  *
- * The MeshCache implements a std::map keyed by shape (list of points) with MeshHandle values.
+ * The MeshCache maps a 128 bit hash of the mesh request (domain, points or file name, and reconstruction) to a
+ * MeshHandle.  Meshes are evicted in least recently used order once they exceed the memory budget, in constant time.
+ *
+ * Optionally, reconstructed meshes are also written (zlib compressed, on a background thread) to a disk cache
+ * directory, so that they survive restarting Studio.  Only requests with a reconstruction_id are written, since the
+ * hash has to identify the mesh across sessions.
+ *
  * It is thread-safe and can be used from any thread.
  */
 class MeshCache {
  public:
   MeshCache();
+  ~MeshCache();
 
   void set_cache_enabled(bool enabled) { cache_enabled_ = enabled; }
 
   void set_memory_percent(int percent) { cache_memory_percent_ = percent; }
 
-  MeshHandle get_mesh(const MeshWorkItem& vector);
+  //! Memory the percentage applies to, the addressable physical memory by default
+  void set_max_memory(long long bytes) { max_memory_ = bytes; }
+
+  //! Memory held by the cached meshes
+  size_t get_memory_size();
+
+  //! Directory of the disk cache, empty to disable it
+  void set_disk_cache_directory(const std::string& directory);
+
+  //! Maximum size of the disk cache, the least recently used files are removed beyond it
+  void set_disk_cache_size(size_t bytes) { max_disk_size_ = bytes; }
+
+  MeshHandle get_mesh(const MeshWorkItem& item);
 
   void insert_mesh(const MeshWorkItem& item, MeshHandle mesh);
 
+  //! Clear the memory cache (the disk cache is content addressed and stays valid)
   void clear();
 
+  //! Hash of the request
+  static MeshCacheKey compute_key(const MeshWorkItem& item);
+
  private:
-  void freeSpaceForAmount(size_t allocation);
+  struct Entry {
+    MeshCacheKey key;
+    MeshHandle mesh;
+    size_t memory_size = 0;
+  };
+  using EntryList = std::list<Entry>;
+
+  void insert_entry(const MeshCacheKey& key, MeshHandle mesh);
+
+  void free_space_for_amount(size_t allocation);
+
+  std::string get_disk_filename(const MeshCacheKey& key) const;
+
+  MeshHandle read_from_disk(const MeshCacheKey& key);
+
+  void write_to_disk(const MeshCacheKey& key, MeshHandle mesh);
+
+  void trim_disk_cache();
+
+  void log_statistics();
 
   static long long get_total_physical_memory();
   static long long get_total_addressable_memory();
   static long long get_total_addressable_physical_memory();
 
-  // mesh cache
-  CacheMap mesh_cache_;
+  // most recently used first
+  EntryList entries_;
 
-  // lrc list
-  CacheList cache_list_;
+  // mesh cache
+  std::unordered_map<MeshCacheKey, EntryList::iterator, MeshCacheKeyHash> mesh_cache_;
 
   // size of memory in use by the cache
   size_t current_memory_size_ = 0;
@@ -62,5 +116,17 @@ class MeshCache {
 
   bool cache_enabled_ = true;
   int cache_memory_percent_ = 0;
+
+  // disk tier
+  std::string disk_directory_;
+  size_t max_disk_size_ = size_t(2) << 30;
+  size_t current_disk_size_ = 0;
+  QThreadPool disk_writer_;
+
+  // statistics, logged when the cache is cleared
+  size_t hits_ = 0;
+  size_t disk_hits_ = 0;
+  size_t misses_ = 0;
+  size_t evictions_ = 0;
 };
 }  // namespace shapeworks
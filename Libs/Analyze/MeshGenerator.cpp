@@ -17,9 +17,21 @@
 
 #include <QFileInfo>
 #include <limits>
+#include <map>
 
 namespace shapeworks {
 
+namespace {
+//---------------------------------------------------------------------------
+Eigen::MatrixXd points_to_matrix(const Eigen::VectorXd& shape) {
+  // x y z per particle to one row per particle
+  Eigen::MatrixXd points = shape;
+  points.resize(3, shape.size() / 3);
+  points.transposeInPlace();
+  return points;
+}
+}  // namespace
+
 const std::string MeshGenerator::RECONSTRUCTION_LEGACY_C("legacy");
 const std::string MeshGenerator::RECONSTRUCTION_DISTANCE_TRANSFORM_C("distance_transform");
 const std::string MeshGenerator::RECONSTRUCTION_MESH_WARPER_C("mesh_warper");
@@ -39,6 +51,57 @@ MeshHandle MeshGenerator::build_mesh(const MeshWorkItem& item) {
   }
 }
 
+//---------------------------------------------------------------------------
+std::vector<MeshHandle> MeshGenerator::build_meshes(const std::vector<MeshWorkItem>& items) {
+  std::vector<MeshHandle> meshes(items.size());
+
+  // the items to warp, per domain
+  std::map<int, std::vector<size_t>> warped_items;
+  for (size_t i = 0; i < items.size(); i++) {
+    if (items[i].filename == "" && this->use_mesh_warper(items[i].domain)) {
+      warped_items[items[i].domain].push_back(i);
+    } else {
+      meshes[i] = this->build_mesh(items[i]);
+    }
+  }
+
+  for (const auto& [domain, indices] : warped_items) {
+    std::vector<Eigen::MatrixXd> points;
+    for (auto i : indices) {
+      points.push_back(points_to_matrix(items[i].points));
+    }
+    auto poly_data = this->reconstructors_->mesh_warpers_[domain]->build_meshes(points);
+    for (size_t j = 0; j < indices.size(); j++) {
+      meshes[indices[j]] = this->create_warped_mesh(poly_data[j]);
+    }
+  }
+  return meshes;
+}
+
+//---------------------------------------------------------------------------
+bool MeshGenerator::use_mesh_warper(int domain) {
+  auto& mesh_warpers = this->reconstructors_->mesh_warpers_;
+  return this->reconstruction_method_ == RECONSTRUCTION_MESH_WARPER_C && mesh_warpers.size() > domain &&
+         mesh_warpers[domain] && !mesh_warpers[domain]->is_contour() && mesh_warpers[domain]->get_warp_available();
+}
+
+//---------------------------------------------------------------------------
+MeshHandle MeshGenerator::create_warped_mesh(vtkSmartPointer<vtkPolyData> poly_data) {
+  MeshHandle mesh(new StudioMesh);
+  if (!poly_data) {
+    std::string message = "Unable to warp mesh";
+    SW_ERROR(message);
+    mesh->set_poly_data(vtkSmartPointer<vtkPolyData>::New());
+    mesh->set_error_message(message);
+    return mesh;
+  }
+  auto polydata_normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+  polydata_normals->SetInputData(poly_data);
+  polydata_normals->Update();
+  mesh->set_poly_data(polydata_normals->GetOutput());
+  return mesh;
+}
+
 //---------------------------------------------------------------------------
 MeshHandle MeshGenerator::build_mesh_from_points(const Eigen::VectorXd& shape, int domain) {
   MeshHandle mesh(new StudioMesh);
@@ -64,28 +127,8 @@ MeshHandle MeshGenerator::build_mesh_from_points(const Eigen::VectorXd& shape, i
     poly_data = polydata_normals->GetOutput();
 
     mesh->set_poly_data(poly_data);
-  } else if (this->reconstruction_method_ == RECONSTRUCTION_MESH_WARPER_C && mesh_warpers.size() > domain &&
-             mesh_warpers[domain] && mesh_warpers[domain]->get_warp_available()) {
-    Eigen::MatrixXd points = Eigen::Map<const Eigen::VectorXd>((double*)shape.data(), shape.size());
-    points.resize(3, shape.size() / 3);
-    points.transposeInPlace();
-
-    auto poly_data = mesh_warpers[domain]->build_mesh(points);
-
-    if (!poly_data) {
-      std::string message = "Unable to warp mesh";
-      SW_ERROR(message);
-      poly_data = vtkSmartPointer<vtkPolyData>::New();
-      mesh->set_poly_data(poly_data);
-      mesh->set_error_message(message);
-      return mesh;
-    }
-    auto polydata_normals = vtkSmartPointer<vtkPolyDataNormals>::New();
-    polydata_normals->SetInputData(poly_data);
-    polydata_normals->Update();
-    poly_data = polydata_normals->GetOutput();
-
-    mesh->set_poly_data(poly_data);
+  } else if (this->use_mesh_warper(domain)) {
+    return this->create_warped_mesh(mesh_warpers[domain]->build_mesh(points_to_matrix(shape)));
   } else {
     LegacyMeshGenerator legacy;
     mesh->set_poly_data(legacy.buildMesh(shape));
@@ -35,6 +35,10 @@ public:
 
   MeshHandle build_mesh(const MeshWorkItem& item);
 
+  //! Build the meshes of several items.  Items of a domain that is reconstructed by mesh warping are warped together
+  //! with one product per domain, the others are built one by one
+  std::vector<MeshHandle> build_meshes(const std::vector<MeshWorkItem>& items);
+
   MeshHandle build_mesh_from_points(const Eigen::VectorXd& shape, int domain);
 
   MeshHandle build_mesh_from_image(ImageType::Pointer image, float iso_value = 0.0001);
@@ -52,6 +56,12 @@ public:
 
 private:
 
+  //! whether the points of this domain are reconstructed by mesh warping
+  bool use_mesh_warper(int domain);
+
+  //! finish a mesh from the mesh warper, poly_data may be null if the warp failed
+  MeshHandle create_warped_mesh(vtkSmartPointer<vtkPolyData> poly_data);
+
   std::shared_ptr<MeshReconstructors> reconstructors_ = std::make_shared<MeshReconstructors>();
 
   std::string reconstruction_method_ = RECONSTRUCTION_MESH_WARPER_C;
@@ -3,6 +3,7 @@
 #include <QThread>
 
 // vtk
+#include <CacheUtils.h>
 #include <MeshManager.h>
 #include <QMeshWarper.h>
 #include <Logging.h>
@@ -34,6 +35,19 @@ void MeshManager::set_cache_enabled(bool enabled) {
 //---------------------------------------------------------------------------
 void MeshManager::set_cache_memory_percent(int percent) { mesh_cache_.set_memory_percent(percent); }
 
+//---------------------------------------------------------------------------
+void MeshManager::set_disk_cache_directory(const std::string& directory) {
+  mesh_cache_.set_disk_cache_directory(directory);
+}
+
+//---------------------------------------------------------------------------
+void MeshManager::set_warp_cache_directory(const std::string& directory) {
+  warp_cache_directory_ = directory;
+  for (auto& warper : reconstructors_->mesh_warpers_) {
+    warper->set_cache_directory(directory);
+  }
+}
+
 //---------------------------------------------------------------------------
 void MeshManager::clear_cache() { mesh_cache_.clear(); }
 
@@ -51,7 +65,12 @@ void MeshManager::generate_mesh(const MeshWorkItem item) {
 }
 
 //---------------------------------------------------------------------------
-MeshHandle MeshManager::get_mesh(const MeshWorkItem& item, bool wait) {
+MeshHandle MeshManager::get_mesh(const MeshWorkItem& request, bool wait) {
+  MeshWorkItem item = request;
+  if (item.filename == "") {
+    item.reconstruction_id = get_reconstruction_id(item.domain);
+  }
+
   MeshHandle mesh;
 
   // check cache first
@@ -90,6 +109,30 @@ void MeshManager::handle_thread_complete(const MeshWorkItem& item, MeshHandle me
   Q_EMIT new_mesh();
 }
 
+//---------------------------------------------------------------------------
+uint64_t MeshManager::get_reconstruction_id(int domain) {
+  // hash of the method and what the mesh depends on besides the particles
+  Fnv1aHash hash;
+  auto method = mesh_generator_->get_reconstruction_method();
+  hash.add_bytes(method.data(), method.size());
+  if (method == MeshGenerator::RECONSTRUCTION_MESH_WARPER_C) {
+    if (domain >= reconstructors_->mesh_warpers_.size() || !reconstructors_->mesh_warpers_[domain] ||
+        !reconstructors_->mesh_warpers_[domain]->get_warp_available()) {
+      return 0;  // falls back to another method
+    }
+    // the warp is defined by the reference mesh, which is picked by (and carries) the reference particles
+    const auto& reference = reconstructors_->mesh_warpers_[domain]->get_reference_particles();
+    if (reference.size() == 0) {
+      return 0;
+    }
+    hash.add_bytes(reference.data(), reference.size() * sizeof(double));
+  } else if (method != MeshGenerator::RECONSTRUCTION_LEGACY_C) {
+    // depends on the trained reconstruction, which has no stable identity
+    return 0;
+  }
+  return hash.value();
+}
+
 //---------------------------------------------------------------------------
 void MeshManager::check_error_status(MeshHandle mesh) {
   if (mesh->get_error_message() != "" && !error_emitted_) {
@@ -104,6 +147,7 @@ void MeshManager::check_error_status(MeshHandle mesh) {
 std::shared_ptr<MeshWarper> MeshManager::get_mesh_warper(int domain) {
   while (domain >= reconstructors_->mesh_warpers_.size()) {
     auto warper = std::make_shared<QMeshWarper>(this);
+    warper->set_cache_directory(warp_cache_directory_);
     connect(warper.get(), &QMeshWarper::progress, this, &MeshManager::handle_warper_progress);
     reconstructors_->mesh_warpers_.push_back(warper);
   }
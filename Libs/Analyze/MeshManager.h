@@ -36,6 +36,12 @@ class MeshManager : public QObject {
   //! Set the memory cache size
   void set_cache_memory_percent(int percent);
 
+  //! Set the directory where reconstructed meshes are kept across sessions, empty to disable
+  void set_disk_cache_directory(const std::string& directory);
+
+  //! Set the directory where warp matrices are kept across sessions, empty to disable
+  void set_warp_cache_directory(const std::string& directory);
+
   //! Set if parallel reconstruction should be enabled
   void set_parallel_enabled(bool enabled) { parallel_enabled_ = enabled; }
 
@@ -83,6 +89,9 @@ class MeshManager : public QObject {
 
   void check_error_status(MeshHandle mesh);
 
+  //! identifies the current reconstruction of a domain for the cache key, 0 if it can not be identified
+  uint64_t get_reconstruction_id(int domain);
+
   // cache of shape meshes
   MeshCache mesh_cache_;
 
@@ -94,6 +103,8 @@ class MeshManager : public QObject {
 
   QThreadPool thread_pool_;
 
+  std::string warp_cache_directory_;
+
   bool cache_enabled_ = true;
   bool parallel_enabled_ = true;
   int num_threads_ = 1;
@@ -87,6 +87,34 @@ MeshWorkItem* MeshWorkQueue::get_next_work_item() {
   return mesh_item;
 }
 
+//---------------------------------------------------------------------------
+std::vector<MeshWorkItem> MeshWorkQueue::get_next_work_items(int max_items) {
+  QMutexLocker locker(&this->mutex_);
+
+  std::vector<MeshWorkItem> items;
+  if (this->work_list_.empty()) {
+    return items;
+  }
+
+  items.push_back(this->work_list_.back());
+  this->work_list_.pop_back();
+  const int domain = items.front().domain;
+  if (items.front().filename == "") {
+    // newest first, as for single items
+    auto it = this->work_list_.end();
+    while (it != this->work_list_.begin() && static_cast<int>(items.size()) < max_items) {
+      --it;
+      if (it->filename == "" && it->domain == domain) {
+        items.push_back(*it);
+        it = this->work_list_.erase(it);
+      }
+    }
+  }
+
+  this->processing_list_.insert(this->processing_list_.end(), items.begin(), items.end());
+  return items;
+}
+
 //---------------------------------------------------------------------------
 bool MeshWorkQueue::is_inside(const MeshWorkItem& item) {
   QMutexLocker locker(&this->mutex_);
@@ -1,7 +1,9 @@
 #pragma once
 
 // stl
+#include <cstdint>
 #include <list>
+#include <vector>
 
 // qt
 #include <QMetaType>
@@ -22,7 +24,9 @@ class MeshWorkItem {
   Eigen::VectorXd points;
   int domain{0};
 
-  size_t memory_size{0};
+  //! identifies how meshes are reconstructed from points (method and its inputs), 0 if that is not known.  Part of the
+  //! cache key, and required for a mesh to be kept in the disk cache
+  uint64_t reconstruction_id{0};
 
   friend bool operator<(const MeshWorkItem &a, const MeshWorkItem &b);
 
@@ -40,6 +44,10 @@ class MeshWorkQueue {
 
   MeshWorkItem *get_next_work_item();
 
+  //! Take the next item plus up to max_items - 1 further point items of the same domain, so that they can be built
+  //! together.  Empty if there is no work left
+  std::vector<MeshWorkItem> get_next_work_items(int max_items);
+
   bool is_inside(const MeshWorkItem &item);
 
   void remove(const MeshWorkItem &item);
@@ -17,19 +17,15 @@ MeshWorker::~MeshWorker()
 //---------------------------------------------------------------------------
 void MeshWorker::run()
 {
-  // build the mesh using our MeshGenerator
-  auto item = this->queue_->get_next_work_item();
+  // build the meshes using our MeshGenerator.  A worker is started per queued item, but takes several items of a
+  // domain at once so that warped meshes share one product, leaving later workers with nothing to do
+  auto items = this->queue_->get_next_work_items(MAX_ITEMS_PER_RUN);
 
-  MeshHandle mesh = this->mesh_generator_->build_mesh(*item);
+  auto meshes = this->mesh_generator_->build_meshes(items);
 
-  if (mesh->get_poly_data()) {
-    // compute the memory size of this shape
-    size_t shape_size = item->points.size() * sizeof(double);
-    size_t mesh_size = mesh->get_poly_data()->GetActualMemorySize() * 1024; // given in kb
-    size_t combined_size = (shape_size * 2) + mesh_size;
-    item->memory_size = combined_size;
+  for (size_t i = 0; i < items.size(); i++) {
+    Q_EMIT result_ready(items[i], meshes[i]);
   }
-  Q_EMIT result_ready(*item, mesh);
   Q_EMIT finished();
 }
 
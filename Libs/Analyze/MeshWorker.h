@@ -34,6 +34,9 @@ Q_SIGNALS:
   void finished();
 
 private:
+  //! most items built by one run
+  static constexpr int MAX_ITEMS_PER_RUN = 8;
+
   std::shared_ptr<MeshGenerator> mesh_generator_;
   MeshWorkQueue* queue_;
 };
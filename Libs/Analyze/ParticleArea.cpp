@@ -2,16 +2,23 @@
 
 #include <Logging.h>
 #include <Mesh/Mesh.h>
+#include <tbb/blocked_range.h>
+#include <tbb/combinable.h>
+#include <tbb/parallel_for.h>
+#include <vtkCellArray.h>
+#include <vtkCellArrayIterator.h>
 #include <vtkFloatArray.h>
+#include <vtkIntArray.h>
 #include <vtkLookupTable.h>
 #include <vtkMassProperties.h>
 #include <vtkPointData.h>
 #include <vtkTriangle.h>
 
-// geometry central
-#include <geometrycentral/surface/heat_method_distance.h>
-#include <geometrycentral/surface/surface_mesh.h>
-#include <geometrycentral/surface/surface_mesh_factories.h>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
 
 namespace shapeworks {
 
@@ -19,57 +26,105 @@ namespace shapeworks {
 void ParticleArea::assign_vertex_particles(vtkSmartPointer<vtkPolyData> poly_data,
                                            std::vector<itk::Point<double>> particles) {
   SW_DEBUG("Assigning vertex particles");
-  // geodesics enabled mesh
+  if (particles.empty()) {
+    throw std::runtime_error("Unable to assign vertices to particles, there are no particles");
+  }
   Mesh mesh(poly_data);
+  const int num_vertices = poly_data->GetNumberOfPoints();
 
   // create "closest_particle" array
   auto closest_particle_array = vtkSmartPointer<vtkIntArray>::New();
   closest_particle_array->SetName("closest_particle");
   closest_particle_array->SetNumberOfComponents(1);
-  closest_particle_array->SetNumberOfTuples(poly_data->GetNumberOfPoints());
+  closest_particle_array->SetNumberOfTuples(num_vertices);
   poly_data->GetPointData()->AddArray(closest_particle_array);
-
-  // set up geometry central for geodesic distances
+  int* closest_particle = closest_particle_array->GetPointer(0);
 
   // Extract mesh vertices and faces
   Eigen::MatrixXd V;
   Eigen::MatrixXi F;
-  vtkSmartPointer<vtkPoints> points;
-  points = mesh.getIGLMesh(V, F);
+  mesh.getIGLMesh(V, F);
 
-  using namespace geometrycentral::surface;
-  std::unique_ptr<SurfaceMesh> gcmesh;
-  std::unique_ptr<VertexPositionGeometry> gcgeometry;
-  std::tie(gcmesh, gcgeometry) = makeSurfaceMeshAndGeometry(V, F);
-  HeatMethodDistanceSolver heat_solver(*gcgeometry, 1.0, true);
+  // vertex adjacency (compressed rows), edges counted from both sides
+  std::vector<int> offsets(num_vertices + 1, 0);
+  for (int f = 0; f < F.rows(); f++) {
+    for (int k = 0; k < 3; k++) {
+      offsets[F(f, k) + 1] += 2;
+    }
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  std::vector<int> neighbors(offsets.back());
+  std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+  for (int f = 0; f < F.rows(); f++) {
+    for (int k = 0; k < 3; k++) {
+      neighbors[fill[F(f, k)]++] = F(f, (k + 1) % 3);
+      neighbors[fill[F(f, k)]++] = F(f, (k + 2) % 3);
+    }
+  }
 
-  std::vector<double> min_dists(poly_data->GetNumberOfPoints(), std::numeric_limits<double>::max());
+  // Geodesic Voronoi regions of the particles from a single multi-source Dijkstra: every particle seeds the vertices
+  // of the face it lies on and the fronts of all particles grow together, each vertex keeping the particle whose front
+  // reaches it first.  Paths are restricted to mesh edges, which slightly overestimates geodesic distances on coarse
+  // meshes, but only the ordering matters here.
+  std::vector<double> distances(num_vertices, std::numeric_limits<double>::infinity());
+  std::fill(closest_particle, closest_particle + num_vertices, -1);
+  using QueueEntry = std::pair<double, int>;
+  std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
 
   for (int i = 0; i < particles.size(); ++i) {
     auto point = particles[i];
-    // construct SurfacePoint from face and barycentric coordinates
     auto face = mesh.getClosestFace(point);
+    if (face < 0) {
+      continue;
+    }
     Eigen::Vector3d pt;
     pt[0] = point[0];
     pt[1] = point[1];
     pt[2] = point[2];
     auto bary = mesh.computeBarycentricCoordinates(pt, face);
-    Face f = gcmesh->face(face);
-    geometrycentral::Vector3 bary_vec;
-    bary_vec[0] = bary[0];
-    bary_vec[1] = bary[1];
-    bary_vec[2] = bary[2];
-
-    auto targetP = SurfacePoint(f, bary_vec);
-
-    VertexData<double> distToSource = heat_solver.computeDistance(targetP);
-
-    for (int j = 0; j < poly_data->GetNumberOfPoints(); j++) {
-      auto dist = distToSource[gcmesh->vertex(j)];
-      if (dist < min_dists[j]) {
-        min_dists[j] = dist;
-        // assign the particle id
-        closest_particle_array->SetTuple1(j, i);
+    // the particle projected onto its face
+    Eigen::RowVector3d on_face =
+        bary[0] * V.row(F(face, 0)) + bary[1] * V.row(F(face, 1)) + bary[2] * V.row(F(face, 2));
+    for (int k = 0; k < 3; k++) {
+      const int vertex = F(face, k);
+      const double distance = (V.row(vertex) - on_face).norm();
+      if (distance < distances[vertex]) {
+        distances[vertex] = distance;
+        closest_particle[vertex] = i;
+        queue.push({distance, vertex});
+      }
+    }
+  }
+
+  while (!queue.empty()) {
+    const auto [distance, vertex] = queue.top();
+    queue.pop();
+    if (distance > distances[vertex]) {
+      continue;
+    }
+    for (int n = offsets[vertex]; n < offsets[vertex + 1]; n++) {
+      const int neighbor = neighbors[n];
+      const double neighbor_distance = distance + (V.row(neighbor) - V.row(vertex)).norm();
+      if (neighbor_distance < distances[neighbor]) {
+        distances[neighbor] = neighbor_distance;
+        closest_particle[neighbor] = closest_particle[vertex];
+        queue.push({neighbor_distance, neighbor});
+      }
+    }
+  }
+
+  // vertices on pieces of the mesh without particles take the particle closest in space
+  for (int j = 0; j < num_vertices; j++) {
+    if (closest_particle[j] < 0) {
+      double closest = std::numeric_limits<double>::max();
+      closest_particle[j] = 0;
+      for (int i = 0; i < particles.size(); ++i) {
+        const Eigen::RowVector3d particle(particles[i][0], particles[i][1], particles[i][2]);
+        const double distance = (V.row(j) - particle).norm();
+        if (distance < closest) {
+          closest = distance;
+          closest_particle[j] = i;
+        }
       }
     }
   }
@@ -128,28 +183,41 @@ std::vector<QColor> ParticleArea::colors_from_lut(vtkSmartPointer<vtkLookupTable
 //-----------------------------------------------------------------------------
 Eigen::VectorXd ParticleArea::compute_particle_triangle_areas(vtkSmartPointer<vtkPolyData> poly_data,
                                                               std::vector<itk::Point<double>> particles) {
-  auto closest_particles = poly_data->GetPointData()->GetArray("closest_particle");
-
-  // for each cell
-  Eigen::VectorXd areas(particles.size());
-  areas.setZero();
-  for (int i = 0; i < poly_data->GetNumberOfCells(); ++i) {
-    // get the area of this cell
-    auto cell = poly_data->GetCell(i);
-    auto points = cell->GetPoints();
-    double p0[3], p1[3], p2[3];
-    points->GetPoint(0, p0);
-    points->GetPoint(1, p1);
-    points->GetPoint(2, p2);
-    auto area = vtkTriangle::TriangleArea(p0, p1, p2);
-
-    // for each vertex of the cell, give 1/3 of the area to the particle
-    for (int j = 0; j < 3; ++j) {
-      auto vertex_id = cell->GetPointId(j);
-      auto particle_id = closest_particles->GetTuple1(vertex_id);
-      areas[particle_id] += area / 3.0;
-    }
+  if (particles.empty()) {
+    throw std::runtime_error("Unable to compute particle areas, there are no particles");
   }
+  auto closest_particles = vtkIntArray::SafeDownCast(poly_data->GetPointData()->GetArray("closest_particle"));
+  const int* closest_particle = closest_particles->GetPointer(0);
+  auto polys = poly_data->GetPolys();
+
+  // for each cell, in parallel with an area vector per thread
+  tbb::combinable<Eigen::VectorXd> thread_areas([&] { return Eigen::VectorXd::Zero(particles.size()).eval(); });
+  using Range = tbb::blocked_range<vtkIdType>;
+  tbb::parallel_for(Range{0, polys->GetNumberOfCells()}, [&](const Range& r) {
+    auto& areas = thread_areas.local();
+    auto iter = vtk::TakeSmartPointer(polys->NewIterator());
+    vtkIdType num_points;
+    const vtkIdType* point_ids;
+    for (vtkIdType i = r.begin(); i < r.end(); ++i) {
+      iter->GetCellAtId(i, num_points, point_ids);
+      if (num_points != 3) {
+        continue;
+      }
+      // get the area of this cell
+      double p0[3], p1[3], p2[3];
+      poly_data->GetPoint(point_ids[0], p0);
+      poly_data->GetPoint(point_ids[1], p1);
+      poly_data->GetPoint(point_ids[2], p2);
+      auto area = vtkTriangle::TriangleArea(p0, p1, p2);
+
+      // for each vertex of the cell, give 1/3 of the area to the particle
+      for (int j = 0; j < 3; ++j) {
+        areas[closest_particle[point_ids[j]]] += area / 3.0;
+      }
+    }
+  });
+  Eigen::VectorXd areas = Eigen::VectorXd::Zero(particles.size());
+  thread_areas.combine_each([&](const Eigen::VectorXd& thread) { areas += thread; });
 
   // ideally each particle has 1/num_particles of the total area
   // scale based on this value
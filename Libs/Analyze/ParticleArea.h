@@ -11,7 +11,8 @@ namespace shapeworks {
 
 class ParticleArea {
  public:
-  //! assign particle ids for each vertex based on closest geodesic distance
+  //! assign particle ids for each vertex based on closest geodesic distance (along mesh edges, one pass for all
+  //! particles).  Throws std::runtime_error if there are no particles
   static void assign_vertex_particles(vtkSmartPointer<vtkPolyData> poly_data,
                                       std::vector<itk::Point<double>> particles);
 
@@ -24,7 +25,8 @@ class ParticleArea {
   //! convert lut to array of colors
   static std::vector<QColor> colors_from_lut(vtkSmartPointer<vtkLookupTable> lut);
 
-  //! compute the area assigned to each particle
+  //! compute the area assigned to each particle (requires assign_vertex_particles).  Throws std::runtime_error if
+  //! there are no particles
   static Eigen::VectorXd compute_particle_triangle_areas(vtkSmartPointer<vtkPolyData> poly_data,
                                                          std::vector<itk::Point<double>> particles);
 };
@@ -3,6 +3,8 @@
 
 #include <StringUtils.h>
 
+#include "SurfaceInterpolation.h"
+
 // itk
 #include <itkImageRegionIteratorWithIndex.h>
 #include <itkLinearInterpolateImageFunction.h>
@@ -11,7 +13,6 @@
 #include <vtkFloatArray.h>
 #include <vtkKdTreePointLocator.h>
 #include <vtkPointData.h>
-#include <vtkPointLocator.h>
 #include <vtkStaticPointLocator.h>
 
 using LinearInterpolatorType = itk::LinearInterpolateImageFunction<ImageType, double>;
@@ -102,70 +103,19 @@ void StudioMesh::interpolate_scalars_to_mesh(std::string name, Eigen::VectorXd p
     return;
   }
 
-  vtkSmartPointer<vtkPolyData> point_data = vtkSmartPointer<vtkPolyData>::New();
-  point_data->SetPoints(vtk_points);
-
-  vtkSmartPointer<vtkPointLocator> point_locator = vtkPointLocator::New();
-  point_locator->SetDataSet(point_data);
-  point_locator->SetDivisions(100, 100, 100);
-  point_locator->BuildLocator();
-
   if (!poly_data_ || poly_data_->GetNumberOfPoints() == 0) {
     return;
   }
 
-  auto points = poly_data_->GetPoints();
+  // the neighbors are found once per topology, so another shape only recomputes the weights, and the features of a
+  // shape share one interpolation
+  auto interpolation = SurfaceInterpolation::get("feature", poly_data_, vtk_points);
 
+  Eigen::VectorXf values = scalar_values.cast<float>();
   vtkFloatArray* scalars = vtkFloatArray::New();
-  scalars->SetNumberOfValues(points->GetNumberOfPoints());
+  scalars->SetNumberOfValues(poly_data_->GetNumberOfPoints());
   scalars->SetName(name.c_str());
-
-  for (int i = 0; i < points->GetNumberOfPoints(); i++) {
-    double pt[3];
-    points->GetPoint(i, pt);
-
-    // find the 8 closest correspondence points the to current point
-    vtkSmartPointer<vtkIdList> closest_points = vtkSmartPointer<vtkIdList>::New();
-    point_locator->FindClosestNPoints(8, pt, closest_points);
-
-    // assign scalar value based on a weighted scheme
-    float weighted_scalar = 0.0f;
-    float distanceSum = 0.0f;
-    float distance[8];
-    bool exactly_on_point = false;
-    float exact_scalar = 0.0f;
-    for (unsigned int p = 0; p < closest_points->GetNumberOfIds(); p++) {
-      // get a particle position
-      vtkIdType id = closest_points->GetId(p);
-
-      // compute distance to current particle
-      double x = pt[0] - point_data->GetPoint(id)[0];
-      double y = pt[1] - point_data->GetPoint(id)[1];
-      double z = pt[2] - point_data->GetPoint(id)[2];
-
-      if (x == 0 && y == 0 && z == 0) {
-        distance[p] = 0;
-        exactly_on_point = true;
-        exact_scalar = scalar_values[id];
-      } else {
-        distance[p] = 1.0f / (x * x + y * y + z * z);
-      }
-
-      // multiply scalar value by weight and add to running sum
-      distanceSum += distance[p];
-    }
-
-    for (unsigned int p = 0; p < closest_points->GetNumberOfIds(); p++) {
-      vtkIdType current_id = closest_points->GetId(p);
-      weighted_scalar += distance[p] / distanceSum * scalar_values[current_id];
-    }
-
-    if (exactly_on_point) {
-      weighted_scalar = exact_scalar;
-    }
-
-    scalars->SetValue(i, weighted_scalar);
-  }
+  interpolation->apply(values.data(), 1, scalars->GetPointer(0));
 
   poly_data_->GetPointData()->AddArray(scalars);
 }
@@ -0,0 +1,239 @@
+#include "SurfaceInterpolation.h"
+
+#include <CacheUtils.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <vtkCellArray.h>
+#include <vtkCellArrayIterator.h>
+#include <vtkIdList.h>
+#include <vtkStaticPointLocator.h>
+
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace shapeworks {
+
+namespace {
+// an interpolation takes around 140 bytes per vertex (neighbors and weights), keep a few meshes worth
+constexpr size_t MAX_CACHED_INTERPOLATIONS = 8;
+
+struct CacheEntry {
+  std::string tag;
+  uint64_t topology_key;
+  vtkIdType num_particles;
+  // positions the weights of interpolation were computed for
+  uint64_t vertices_key;
+  uint64_t particles_key;
+  std::shared_ptr<const SurfaceInterpolation> interpolation;
+};
+
+std::mutex cache_mutex;
+std::list<CacheEntry> cache;  // most recently used first
+
+//---------------------------------------------------------------------------
+void hash_cells(Fnv1aHash& hash, vtkCellArray* cells) {
+  hash.add(int64_t(cells ? cells->GetNumberOfCells() : 0));
+  if (!cells) {
+    return;
+  }
+  auto iter = vtk::TakeSmartPointer(cells->NewIterator());
+  vtkIdType num_points;
+  const vtkIdType* points;
+  for (iter->GoToFirstCell(); !iter->IsDoneWithTraversal(); iter->GoToNextCell()) {
+    iter->GetCurrentCell(num_points, points);
+    hash.add(int64_t(num_points));
+    for (vtkIdType i = 0; i < num_points; i++) {
+      hash.add(int64_t(points[i]));
+    }
+  }
+}
+}  // namespace
+
+//---------------------------------------------------------------------------
+SurfaceInterpolation::SurfaceInterpolation(vtkSmartPointer<vtkPolyData> poly_data,
+                                           vtkSmartPointer<vtkPoints> particles, int num_neighbors) {
+  const vtkIdType num_vertices = poly_data->GetNumberOfPoints();
+
+  auto particle_data = vtkSmartPointer<vtkPolyData>::New();
+  particle_data->SetPoints(particles);
+  auto locator = vtkSmartPointer<vtkStaticPointLocator>::New();
+  locator->SetDataSet(particle_data);
+  locator->BuildLocator();
+
+  auto neighbors = std::make_shared<Neighbors>();
+  neighbors->num_neighbors = num_neighbors;
+  neighbors->counts.resize(num_vertices, 0);
+  neighbors->ids.resize(num_vertices * num_neighbors);
+
+  // vtkStaticPointLocator queries are thread safe once built
+  tbb::parallel_for(tbb::blocked_range<vtkIdType>{0, num_vertices}, [&](const tbb::blocked_range<vtkIdType>& r) {
+    auto closest_points = vtkSmartPointer<vtkIdList>::New();
+    for (vtkIdType i = r.begin(); i < r.end(); i++) {
+      double vertex[3];
+      poly_data->GetPoint(i, vertex);
+      locator->FindClosestNPoints(num_neighbors, vertex, closest_points);
+      neighbors->counts[i] = closest_points->GetNumberOfIds();
+      for (int p = 0; p < neighbors->counts[i]; p++) {
+        neighbors->ids[i * num_neighbors + p] = closest_points->GetId(p);
+      }
+    }
+  });
+  neighbors_ = neighbors;
+
+  compute_weights(poly_data, particles);
+}
+
+//---------------------------------------------------------------------------
+SurfaceInterpolation::SurfaceInterpolation(const SurfaceInterpolation& reference,
+                                           vtkSmartPointer<vtkPolyData> poly_data,
+                                           vtkSmartPointer<vtkPoints> particles)
+    : neighbors_(reference.neighbors_) {
+  if (poly_data->GetNumberOfPoints() != reference.get_num_vertices() ||
+      particles->GetNumberOfPoints() != reference.get_num_particles()) {
+    throw std::runtime_error("mesh or particles do not match the reference interpolation");
+  }
+  compute_weights(poly_data, particles);
+}
+
+//---------------------------------------------------------------------------
+void SurfaceInterpolation::compute_weights(vtkSmartPointer<vtkPolyData> poly_data,
+                                           vtkSmartPointer<vtkPoints> particles) {
+  const vtkIdType num_vertices = poly_data->GetNumberOfPoints();
+  const vtkIdType num_particles = particles->GetNumberOfPoints();
+  const int num_neighbors = neighbors_->num_neighbors;
+  const auto& ids = neighbors_->ids;
+
+  std::vector<int> counts(num_vertices, 0);
+  std::vector<vtkIdType> weight_ids(num_vertices * num_neighbors);
+  std::vector<float> weights(num_vertices * num_neighbors);
+  tbb::parallel_for(tbb::blocked_range<vtkIdType>{0, num_vertices}, [&](const tbb::blocked_range<vtkIdType>& r) {
+    for (vtkIdType i = r.begin(); i < r.end(); i++) {
+      double vertex[3];
+      poly_data->GetPoint(i, vertex);
+
+      const vtkIdType* vertex_neighbors = &ids[i * num_neighbors];
+      vtkIdType* vertex_ids = &weight_ids[i * num_neighbors];
+      float* vertex_weights = &weights[i * num_neighbors];
+      const int count = neighbors_->counts[i];
+      float weight_sum = 0.0f;
+      bool exactly_on_point = false;
+      for (int p = 0; p < count; p++) {
+        vertex_ids[p] = vertex_neighbors[p];
+        double particle[3];
+        particles->GetPoint(vertex_ids[p], particle);
+        const double x = vertex[0] - particle[0];
+        const double y = vertex[1] - particle[1];
+        const double z = vertex[2] - particle[2];
+        if (x == 0 && y == 0 && z == 0) {
+          // the vertex takes the value of the particle it sits on
+          vertex_ids[0] = vertex_ids[p];
+          vertex_weights[0] = 1.0f;
+          counts[i] = 1;
+          exactly_on_point = true;
+          break;
+        }
+        vertex_weights[p] = 1.0f / (x * x + y * y + z * z);
+        weight_sum += vertex_weights[p];
+      }
+      if (!exactly_on_point) {
+        for (int p = 0; p < count; p++) {
+          vertex_weights[p] /= weight_sum;
+        }
+        counts[i] = count;
+      }
+    }
+  });
+
+  weights_.resize(num_vertices, num_particles);
+  weights_.reserve(counts);
+  for (vtkIdType i = 0; i < num_vertices; i++) {
+    for (int p = 0; p < counts[i]; p++) {
+      weights_.insert(i, weight_ids[i * num_neighbors + p]) = weights[i * num_neighbors + p];
+    }
+  }
+  weights_.makeCompressed();
+}
+
+//---------------------------------------------------------------------------
+std::shared_ptr<const SurfaceInterpolation> SurfaceInterpolation::get(const std::string& tag,
+                                                                      vtkSmartPointer<vtkPolyData> poly_data,
+                                                                      vtkSmartPointer<vtkPoints> particles) {
+  const uint64_t topology_key = compute_topology_key(poly_data);
+  const vtkIdType num_particles = particles->GetNumberOfPoints();
+  const uint64_t vertices_key = compute_points_key(poly_data->GetPoints());
+  const uint64_t particles_key = compute_points_key(particles);
+  const auto matches = [&](const CacheEntry& entry) {
+    return entry.tag == tag && entry.topology_key == topology_key && entry.num_particles == num_particles;
+  };
+
+  std::shared_ptr<const SurfaceInterpolation> reference;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto it = std::find_if(cache.begin(), cache.end(), matches);
+    if (it != cache.end()) {
+      cache.splice(cache.begin(), cache, it);
+      if (it->vertices_key == vertices_key && it->particles_key == particles_key) {
+        return it->interpolation;
+      }
+      reference = it->interpolation;
+    }
+  }
+
+  // built outside of the lock, a concurrent request for the same mesh and particles at worst builds it twice
+  auto interpolation = reference ? std::make_shared<const SurfaceInterpolation>(*reference, poly_data, particles)
+                                 : std::make_shared<const SurfaceInterpolation>(poly_data, particles);
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  cache.remove_if(matches);
+  cache.push_front({tag, topology_key, num_particles, vertices_key, particles_key, interpolation});
+  if (cache.size() > MAX_CACHED_INTERPOLATIONS) {
+    cache.pop_back();
+  }
+  return interpolation;
+}
+
+//---------------------------------------------------------------------------
+void SurfaceInterpolation::apply(const float* values, int num_components, float* output) const {
+  using Range = tbb::blocked_range<Eigen::Index>;
+  tbb::parallel_for(Range{0, weights_.rows()}, [&](const Range& r) {
+    for (Eigen::Index i = r.begin(); i < r.end(); i++) {
+      float* out = output + i * num_components;
+      std::fill(out, out + num_components, 0.0f);
+      for (Eigen::SparseMatrix<float, Eigen::RowMajor>::InnerIterator it(weights_, i); it; ++it) {
+        const float* value = values + it.col() * num_components;
+        for (int c = 0; c < num_components; c++) {
+          out[c] += it.value() * value[c];
+        }
+      }
+    }
+  });
+}
+
+//---------------------------------------------------------------------------
+uint64_t SurfaceInterpolation::compute_topology_key(vtkSmartPointer<vtkPolyData> poly_data) {
+  Fnv1aHash hash;
+  hash.add(int64_t(poly_data->GetNumberOfPoints()));
+  hash_cells(hash, poly_data->GetVerts());
+  hash_cells(hash, poly_data->GetLines());
+  hash_cells(hash, poly_data->GetPolys());
+  hash_cells(hash, poly_data->GetStrips());
+  return hash.value();
+}
+
+//---------------------------------------------------------------------------
+uint64_t SurfaceInterpolation::compute_points_key(vtkPoints* points) {
+  Fnv1aHash hash;
+  const vtkIdType num_points = points ? points->GetNumberOfPoints() : 0;
+  hash.add(int64_t(num_points));
+  for (vtkIdType i = 0; i < num_points; i++) {
+    double point[3];
+    points->GetPoint(i, point);
+    hash.add(point);
+  }
+  return hash.value();
+}
+
+}  // namespace shapeworks
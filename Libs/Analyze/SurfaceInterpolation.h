@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include <Eigen/Sparse>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace shapeworks {
+
+/**
+ * \class SurfaceInterpolation
+ * \ingroup Group-Analyze
+ *
+ * Interpolation of per-particle values onto the vertices of a surface, as a sparse vertex x particle matrix.  Each
+ * vertex takes the inverse squared distance weighted average of its 8 closest particles (or the value of a particle it
+ * coincides with).
+ *
+ * Finding the neighbors is by far the expensive part, and it does not need to be repeated for meshes that share a
+ * topology: reconstructed meshes are all warped from the same reference mesh, so moving through the PCA modes or
+ * between subjects moves the vertices along with the particles and keeps the neighbors of each vertex.  get() therefore
+ * keys its cache on the mesh topology and the number of particles only.  The neighbors are found once, for the first
+ * shape seen, and each shape after that (another subject, another step along a mode) only recomputes the weights,
+ * which is a few distances per vertex.  Recoloring the same shape (another feature, another difference or scalar
+ * range, a redraw) reuses the matrix as is.  Applying a matrix is a parallel sparse product.
+ */
+class SurfaceInterpolation {
+ public:
+  //! Find the neighbors of each vertex of poly_data among particles and compute the weights
+  SurfaceInterpolation(vtkSmartPointer<vtkPolyData> poly_data, vtkSmartPointer<vtkPoints> particles,
+                       int num_neighbors = 8);
+
+  //! Reuse the neighbors of reference, which must have the same topology and number of particles, and compute the
+  //! weights for these vertex and particle positions
+  SurfaceInterpolation(const SurfaceInterpolation& reference, vtkSmartPointer<vtkPolyData> poly_data,
+                       vtkSmartPointer<vtkPoints> particles);
+
+  //! Cached interpolation for poly_data and particles.  The neighbors are shared by all meshes with this topology and
+  //! number of particles, the weights are recomputed when the vertex or particle positions changed.  tag names the
+  //! use (e.g. "feature"), so that uses do not evict each other's entries
+  static std::shared_ptr<const SurfaceInterpolation> get(const std::string& tag, vtkSmartPointer<vtkPolyData> poly_data,
+                                                         vtkSmartPointer<vtkPoints> particles);
+
+  //! Interpolate values (num_particles x num_components, interleaved) to the vertices (num_vertices x num_components)
+  void apply(const float* values, int num_components, float* output) const;
+
+  vtkIdType get_num_vertices() const { return weights_.rows(); }
+  vtkIdType get_num_particles() const { return weights_.cols(); }
+
+  //! Hash of the number of points and the cells of poly_data
+  static uint64_t compute_topology_key(vtkSmartPointer<vtkPolyData> poly_data);
+
+  //! Hash of the coordinates of points
+  static uint64_t compute_points_key(vtkPoints* points);
+
+ private:
+  //! Closest particles of each vertex, num_neighbors slots per vertex of which the first counts[i] are used
+  struct Neighbors {
+    int num_neighbors;
+    std::vector<int> counts;
+    std::vector<vtkIdType> ids;
+  };
+
+  //! Inverse squared distance weights of the neighbors for these vertex and particle positions
+  void compute_weights(vtkSmartPointer<vtkPolyData> poly_data, vtkSmartPointer<vtkPoints> particles);
+
+  std::shared_ptr<const Neighbors> neighbors_;
+  Eigen::SparseMatrix<float, Eigen::RowMajor> weights_;
+};
+
+}  // namespace shapeworks
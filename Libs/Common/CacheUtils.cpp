@@ -0,0 +1,97 @@
+#include "CacheUtils.h"
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <ctime>
+#include <utility>
+#include <vector>
+
+namespace shapeworks {
+
+namespace fs = boost::filesystem;
+
+static const std::string TEMP_PREFIX = ".tmp_";
+
+//-----------------------------------------------------------------------------
+/// the cached files of a directory, oldest first
+static std::vector<std::pair<std::time_t, fs::path>> list_files(const std::string& directory,
+                                                               const std::string& extension, uintmax_t& total_size) {
+  std::vector<std::pair<std::time_t, fs::path>> files;
+  total_size = 0;
+  boost::system::error_code ec;
+  for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+    const auto& path = it->path();
+    if (path.extension() != extension || path.filename().string().rfind(TEMP_PREFIX, 0) == 0) {
+      continue;
+    }
+    boost::system::error_code file_ec;
+    const auto size = fs::file_size(path, file_ec);
+    if (file_ec) {
+      continue;
+    }
+    files.emplace_back(fs::last_write_time(path, file_ec), path);
+    total_size += size;
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+//-----------------------------------------------------------------------------
+bool CacheUtils::write_atomically(const std::string& filename,
+                                  const std::function<bool(const std::string&)>& write) {
+  // unique, since several writers may produce the same file at once
+  const fs::path path(filename);
+  boost::system::error_code ec;
+  const auto temp_path =
+      path.parent_path() / (TEMP_PREFIX + fs::unique_path("%%%%%%%%", ec).string() + "_" + path.filename().string());
+
+  bool written = false;
+  try {
+    written = write(temp_path.string());
+  } catch (...) {
+    fs::remove(temp_path, ec);
+    throw;
+  }
+
+  if (written) {
+    fs::rename(temp_path, path, ec);
+    written = !ec;
+  }
+  if (!written) {
+    fs::remove(temp_path, ec);
+  }
+  return written;
+}
+
+//-----------------------------------------------------------------------------
+void CacheUtils::touch(const std::string& filename) {
+  boost::system::error_code ec;
+  fs::last_write_time(filename, std::time(nullptr), ec);
+}
+
+//-----------------------------------------------------------------------------
+uintmax_t CacheUtils::directory_size(const std::string& directory, const std::string& extension) {
+  uintmax_t total_size = 0;
+  list_files(directory, extension, total_size);
+  return total_size;
+}
+
+//-----------------------------------------------------------------------------
+uintmax_t CacheUtils::trim_directory(const std::string& directory, const std::string& extension,
+                                     uintmax_t max_bytes) {
+  uintmax_t total_size = 0;
+  const auto files = list_files(directory, extension, total_size);
+  boost::system::error_code ec;
+  for (const auto& file : files) {
+    if (total_size <= max_bytes) {
+      break;
+    }
+    const auto size = fs::file_size(file.second, ec);
+    if (!ec && fs::remove(file.second, ec)) {
+      total_size -= size;
+    }
+  }
+  return total_size;
+}
+
+}  // namespace shapeworks
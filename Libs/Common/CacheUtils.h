@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <type_traits>
+
+namespace shapeworks {
+
+/// 64 bit FNV-1a hash, built up incrementally.  Used for cache keys: it is stable across runs and platforms of the
+/// same endianness, but not collision resistant, so caches should verify what they load
+class Fnv1aHash {
+ public:
+  Fnv1aHash& add_bytes(const void* data, size_t size) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash_ ^= bytes[i];
+      hash_ *= 1099511628211ull;
+    }
+    return *this;
+  }
+
+  template <class T>
+  Fnv1aHash& add(const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "hash the contents instead");
+    return add_bytes(&value, sizeof(T));
+  }
+
+  /// length, then characters, so that consecutive strings can not run into each other
+  Fnv1aHash& add(const std::string& value) {
+    add(uint64_t(value.size()));
+    return add_bytes(value.data(), value.size());
+  }
+
+  uint64_t value() const { return hash_; }
+
+ private:
+  uint64_t hash_ = 14695981039346656037ull;
+};
+
+/// File helpers shared by the on-disk caches (warp matrices, meshes) and checkpoint files
+class CacheUtils {
+ public:
+  /// Calls write(temp_filename) and renames the result over filename, so that readers never see a partial file.  The
+  /// temporary file is in the same directory, keeps the extension and is ignored by directory_size and
+  /// trim_directory.  Returns false, and removes the temporary file, if write returns false or the rename fails
+  static bool write_atomically(const std::string& filename, const std::function<bool(const std::string&)>& write);
+
+  /// Marks a file as recently used for trim_directory
+  static void touch(const std::string& filename);
+
+  /// Total size of the files of the directory with the given extension (e.g. ".vtp")
+  static uintmax_t directory_size(const std::string& directory, const std::string& extension);
+
+  /// Removes the least recently used files of the directory with the given extension until they take at most
+  /// max_bytes.  Returns the size of the files that are left
+  static uintmax_t trim_directory(const std::string& directory, const std::string& extension, uintmax_t max_bytes);
+};
+
+}  // namespace shapeworks
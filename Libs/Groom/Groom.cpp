@@ -262,7 +262,8 @@ bool Groom::run_image_pipeline(Image& image, GroomParameters params) {
 
   // create distance transform
   if (params.get_fast_marching()) {
-    image.computeDT();
+    auto type = params.get_exact_dt() ? Image::DistanceTransformType::Exact : Image::DistanceTransformType::FastMarching;
+    image.computeDT(0.0, type, params.get_dt_narrow_band());
     increment_progress(10);
   }
 
@@ -32,6 +32,8 @@ const std::string ANTIALIAS_AMOUNT = "antialias_amount";
 const std::string BLUR = "blur";
 const std::string BLUR_SIGMA = "blur_sigma";
 const std::string FASTMARCHING = "fastmarching";
+const std::string EXACT_DT = "exact_dt";
+const std::string DT_NARROW_BAND = "dt_narrow_band";
 
 const std::string MESH_SMOOTH = "mesh_smooth";
 const std::string MESH_SMOOTHING_METHOD = "mesh_smoothing_method";
@@ -79,6 +81,8 @@ const int antialias_amount = 10;
 const bool blur = true;
 const double blur_sigma = 2.0;
 const bool fastmarching = true;
+const bool exact_dt = false;
+const double dt_narrow_band = 0.0;
 const char* groom_output_prefix = "groomed";
 const bool mesh_smooth = false;
 const std::string mesh_smoothing_method = GroomParameters::GROOM_SMOOTH_VTK_LAPLACIAN_C;
@@ -125,6 +129,8 @@ GroomParameters::GroomParameters(ProjectHandle project, std::string domain_name)
                                          Keys::BLUR,
                                          Keys::BLUR_SIGMA,
                                          Keys::FASTMARCHING,
+                                         Keys::EXACT_DT,
+                                         Keys::DT_NARROW_BAND,
                                          Keys::MESH_SMOOTH,
                                          Keys::MESH_SMOOTHING_METHOD,
                                          Keys::MESH_SMOOTHING_VTK_LAPLACIAN_ITERATIONS,
@@ -231,6 +237,18 @@ bool GroomParameters::get_fast_marching() { return params_.get(Keys::FASTMARCHIN
 //---------------------------------------------------------------------------
 void GroomParameters::set_fast_marching(bool value) { params_.set(Keys::FASTMARCHING, value); }
 
+//---------------------------------------------------------------------------
+bool GroomParameters::get_exact_dt() { return params_.get(Keys::EXACT_DT, Defaults::exact_dt); }
+
+//---------------------------------------------------------------------------
+void GroomParameters::set_exact_dt(bool value) { params_.set(Keys::EXACT_DT, value); }
+
+//---------------------------------------------------------------------------
+double GroomParameters::get_dt_narrow_band() { return params_.get(Keys::DT_NARROW_BAND, Defaults::dt_narrow_band); }
+
+//---------------------------------------------------------------------------
+void GroomParameters::set_dt_narrow_band(double value) { params_.set(Keys::DT_NARROW_BAND, value); }
+
 //---------------------------------------------------------------------------
 void GroomParameters::save_to_project() { project_->set_parameters(Parameters::GROOM_PARAMS, params_, domain_name_); }
 
@@ -71,6 +71,12 @@ class GroomParameters {
   bool get_fast_marching();
   void set_fast_marching(bool value);
 
+  bool get_exact_dt();
+  void set_exact_dt(bool value);
+
+  double get_dt_narrow_band();
+  void set_dt_narrow_band(double value);
+
   bool get_mesh_smooth();
   void set_mesh_smooth(bool value);
 
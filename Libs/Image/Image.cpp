@@ -31,22 +31,231 @@
 #include <itkThresholdImageFilter.h>
 #include <itkVTKImageExport.h>
 #include <itkVTKImageToImageFilter.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 #include <vtkContourFilter.h>
 #include <vtkImageCast.h>
 #include <vtkImageData.h>
 #include <vtkImageImport.h>
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <cmath>
+#include <cstdint>
 #include <exception>
+#include <vector>
 
 #include "Exception.h"
+#include "ImageExpression.h"
 #include "MeshUtils.h"
 #include "ShapeworksUtils.h"
 #include "itkTPGACLevelSetImageFilter.h"  // actually a shapeworks class, not itk
 
 namespace shapeworks {
 
+namespace {
+
+//! A voxel next to the iso surface and the point on the surface closest to it (physical units, index aligned axes)
+struct SurfaceSample {
+  size_t index;
+  double point[3];
+};
+
+//! Squared distance along the given axis to the nearest finite sample of each line, carrying along which surface
+//! sample it came from.  One pass of the separable lower envelope of parabolas (Felzenszwalb & Huttenlocher).
+void distanceAlongAxis(Image::PixelType* squared, uint32_t* samples, const size_t dims[3], const double spacing[3],
+                       int axis) {
+  const size_t strides[3] = {1, dims[0], dims[0] * dims[1]};
+  const int axis1 = axis == 0 ? 1 : 0;
+  const int axis2 = axis == 2 ? 1 : 2;
+  const size_t length = dims[axis];
+  const size_t stride = strides[axis];
+  const double h = spacing[axis];
+
+  using Range = tbb::blocked_range<size_t>;
+  tbb::parallel_for(Range{0, dims[axis2]}, [&](const Range& r) {
+    std::vector<double> f(length), boundaries(length);
+    std::vector<uint32_t> line_samples(length);
+    std::vector<size_t> sites(length);
+    for (size_t j = r.begin(); j < r.end(); j++) {
+      for (size_t i = 0; i < dims[axis1]; i++) {
+        const size_t start = i * strides[axis1] + j * strides[axis2];
+
+        size_t num_sites = 0;
+        for (size_t q = 0; q < length; q++) {
+          const Image::PixelType value = squared[start + q * stride];
+          if (value == std::numeric_limits<Image::PixelType>::infinity()) {
+            continue;
+          }
+          f[q] = value;
+          line_samples[q] = samples[start + q * stride];
+          const double x = q * h;
+          double boundary = -std::numeric_limits<double>::infinity();
+          while (num_sites > 0) {
+            const double p = sites[num_sites - 1] * h;
+            boundary = ((f[q] + x * x) - (f[sites[num_sites - 1]] + p * p)) / (2 * (x - p));
+            if (boundary > boundaries[num_sites - 1]) {
+              break;
+            }
+            num_sites--;
+          }
+          if (num_sites == 0) {
+            boundary = -std::numeric_limits<double>::infinity();
+          }
+          sites[num_sites] = q;
+          boundaries[num_sites] = boundary;
+          num_sites++;
+        }
+        if (num_sites == 0) {
+          continue;
+        }
+
+        size_t site = 0;
+        for (size_t q = 0; q < length; q++) {
+          const double x = q * h;
+          while (site + 1 < num_sites && boundaries[site + 1] < x) {
+            site++;
+          }
+          const double d = x - sites[site] * h;
+          squared[start + q * stride] = d * d + f[sites[site]];
+          samples[start + q * stride] = line_samples[sites[site]];
+        }
+      }
+    }
+  });
+}
+
+//! Signed distance from each voxel to the isoValue surface of data, in place.  Every voxel with a neighbor on the
+//! other side of the surface gets a surface point from linear interpolation along the axes (the same estimate
+//! itk::LevelSetNeighborhoodExtractor uses to start fast marching), an exact separable EDT finds the nearest of these
+//! voxels for the rest of the volume, and the distance is measured to the surface points found in the 3x3x3
+//! neighborhood.  Negative where data <= isoValue, clamped to +/- narrowBand if it is positive.
+void computeExactSignedDistance(Image::PixelType* data, const size_t dims[3], const double spacing[3],
+                                Image::PixelType isoValue, double narrowBand) {
+  const size_t strides[3] = {1, dims[0], dims[0] * dims[1]};
+  const size_t num_voxels = dims[0] * dims[1] * dims[2];
+  using Range = tbb::blocked_range<size_t>;
+
+  std::vector<uint8_t> inside(num_voxels);
+  tbb::parallel_for(Range{0, num_voxels}, [&](const Range& r) {
+    for (size_t i = r.begin(); i < r.end(); i++) {
+      inside[i] = data[i] <= isoValue;
+    }
+  });
+
+  std::vector<std::vector<SurfaceSample>> slice_samples(dims[2]);
+  tbb::parallel_for(Range{0, dims[2]}, [&](const Range& r) {
+    for (size_t z = r.begin(); z < r.end(); z++) {
+      for (size_t y = 0; y < dims[1]; y++) {
+        for (size_t x = 0; x < dims[0]; x++) {
+          const size_t coord[3] = {x, y, z};
+          const size_t index = x + y * strides[1] + z * strides[2];
+          const double value = data[index] - isoValue;
+
+          // signed distance to the crossing along each axis, the closer one if it crosses on both sides
+          double crossings[3] = {0.0, 0.0, 0.0};
+          bool near_surface = false;
+          bool on_surface = false;
+          double inverse_sum = 0.0;
+          for (int axis = 0; axis < 3; axis++) {
+            for (int step : {-1, 1}) {
+              if (step < 0 ? coord[axis] == 0 : coord[axis] + 1 == dims[axis]) {
+                continue;
+              }
+              const size_t neighbor = step < 0 ? index - strides[axis] : index + strides[axis];
+              if (inside[neighbor] == inside[index]) {
+                continue;
+              }
+              const double distance = value / (value - (data[neighbor] - isoValue)) * spacing[axis];
+              if (crossings[axis] == 0.0 || distance < std::abs(crossings[axis])) {
+                crossings[axis] = step * distance;
+              }
+              near_surface = true;
+              on_surface = on_surface || distance == 0.0;
+            }
+            if (crossings[axis] != 0.0) {
+              inverse_sum += 1.0 / (crossings[axis] * crossings[axis]);
+            }
+          }
+          if (!near_surface) {
+            continue;
+          }
+
+          // closest point on the plane through the crossings
+          SurfaceSample sample{index, {x * spacing[0], y * spacing[1], z * spacing[2]}};
+          for (int axis = 0; axis < 3; axis++) {
+            if (!on_surface && crossings[axis] != 0.0) {
+              sample.point[axis] += 1.0 / (inverse_sum * crossings[axis]);
+            }
+          }
+          slice_samples[z].push_back(sample);
+        }
+      }
+    }
+  });
+
+  std::vector<SurfaceSample> surface;
+  for (const auto& samples : slice_samples) {
+    surface.insert(surface.end(), samples.begin(), samples.end());
+  }
+  const uint32_t none = std::numeric_limits<uint32_t>::max();
+  if (surface.size() >= none) {
+    throw std::invalid_argument("too many voxels on the surface for an exact distance transform");
+  }
+
+  // the image buffer holds squared distances to the nearest surface voxel while the EDT runs
+  std::vector<uint32_t> nearest(num_voxels, none);
+  std::fill(data, data + num_voxels, std::numeric_limits<Image::PixelType>::infinity());
+  for (uint32_t i = 0; i < surface.size(); i++) {
+    data[surface[i].index] = 0;
+    nearest[surface[i].index] = i;
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    distanceAlongAxis(data, nearest.data(), dims, spacing, axis);
+  }
+
+  // the nearest surface voxel is not always the one with the nearest surface point, so check the neighbors' as well
+  const double max_distance = narrowBand > 0.0 ? narrowBand : std::numeric_limits<Image::PixelType>::max();
+  tbb::parallel_for(Range{0, dims[2]}, [&](const Range& r) {
+    for (size_t z = r.begin(); z < r.end(); z++) {
+      for (size_t y = 0; y < dims[1]; y++) {
+        for (size_t x = 0; x < dims[0]; x++) {
+          const size_t coord[3] = {x, y, z};
+          const double position[3] = {x * spacing[0], y * spacing[1], z * spacing[2]};
+          size_t lower[3], upper[3];
+          for (int axis = 0; axis < 3; axis++) {
+            lower[axis] = coord[axis] > 0 ? coord[axis] - 1 : 0;
+            upper[axis] = std::min(coord[axis] + 1, dims[axis] - 1);
+          }
+
+          double closest = std::numeric_limits<double>::infinity();
+          for (size_t k = lower[2]; k <= upper[2]; k++) {
+            for (size_t j = lower[1]; j <= upper[1]; j++) {
+              for (size_t i = lower[0]; i <= upper[0]; i++) {
+                const uint32_t sample = nearest[i + j * strides[1] + k * strides[2]];
+                if (sample == none) {
+                  continue;
+                }
+                const double* point = surface[sample].point;
+                const double dx = position[0] - point[0];
+                const double dy = position[1] - point[1];
+                const double dz = position[2] - point[2];
+                closest = std::min(closest, dx * dx + dy * dy + dz * dz);
+              }
+            }
+          }
+
+          const size_t index = x + y * strides[1] + z * strides[2];
+          const double distance = std::min(std::sqrt(closest), max_distance);
+          data[index] = inside[index] ? -distance : distance;
+        }
+      }
+    }
+  });
+}
+
+}  // namespace
+
 Image::Image(const Dims dims) : itk_image_(ImageType::New()) {
   ImageType::RegionType region;
   region.SetSize(dims);
@@ -135,93 +344,23 @@ Image::ImageType::Pointer Image::read(const std::string& pathname) {
   return img;
 }
 
-Image& Image::operator-() {
-  itk::ImageRegionIteratorWithIndex<ImageType> iter(this->itk_image_, itk_image_->GetLargestPossibleRegion());
-  while (!iter.IsAtEnd()) {
-    iter.Set(-iter.Value());
-    ++iter;
-  }
+Image& Image::operator-() { return assign(*this, -expr(*this)); }
 
-  return *this;
-}
+Image Image::operator+(const Image& other) const { return expr(*this) + other; }
 
-Image Image::operator+(const Image& other) const {
-  Image ret(*this);
-  ret += other;
-  return ret;
-}
+Image& Image::operator+=(const Image& other) { return assign(*this, expr(*this) + other); }
 
-Image& Image::operator+=(const Image& other) {
-  if (dims() != other.dims()) {
-    throw std::invalid_argument("images must have same logical dims");
-  }
+Image Image::operator-(const Image& other) const { return expr(*this) - other; }
 
-  itk::ImageRegionIteratorWithIndex<ImageType> iter(this->itk_image_, itk_image_->GetLargestPossibleRegion());
-  itk::ImageRegionIteratorWithIndex<ImageType> otherIter(other.itk_image_,
-                                                         other.itk_image_->GetLargestPossibleRegion());
-  while (!iter.IsAtEnd() && !otherIter.IsAtEnd()) {
-    iter.Set(iter.Value() + otherIter.Value());
-    ++iter;
-    ++otherIter;
-  }
+Image& Image::operator-=(const Image& other) { return assign(*this, expr(*this) - other); }
 
-  return *this;
-}
+Image Image::operator+(const PixelType x) const { return expr(*this) + x; }
 
-Image Image::operator-(const Image& other) const {
-  Image ret(*this);
-  ret -= other;
-  return ret;
-}
+Image& Image::operator+=(const PixelType x) { return assign(*this, expr(*this) + x); }
 
-Image& Image::operator-=(const Image& other) {
-  if (dims() != other.dims()) {
-    throw std::invalid_argument("images must have same logical dims");
-  }
+Image Image::operator-(const PixelType x) const { return expr(*this) - x; }
 
-  itk::ImageRegionIteratorWithIndex<ImageType> iter(this->itk_image_, itk_image_->GetLargestPossibleRegion());
-  itk::ImageRegionIteratorWithIndex<ImageType> otherIter(other.itk_image_,
-                                                         other.itk_image_->GetLargestPossibleRegion());
-  while (!iter.IsAtEnd() && !otherIter.IsAtEnd()) {
-    iter.Set(iter.Value() - otherIter.Value());
-    ++iter;
-    ++otherIter;
-  }
-
-  return *this;
-}
-
-Image Image::operator+(const PixelType x) const {
-  Image ret(*this);
-  ret += x;
-  return ret;
-}
-
-Image& Image::operator+=(const PixelType x) {
-  itk::ImageRegionIteratorWithIndex<ImageType> iter(this->itk_image_, itk_image_->GetLargestPossibleRegion());
-  while (!iter.IsAtEnd()) {
-    iter.Set(iter.Value() + x);
-    ++iter;
-  }
-
-  return *this;
-}
-
-Image Image::operator-(const PixelType x) const {
-  Image ret(*this);
-  ret -= x;
-  return ret;
-}
-
-Image& Image::operator-=(const PixelType x) {
-  itk::ImageRegionIteratorWithIndex<ImageType> iter(this->itk_image_, itk_image_->GetLargestPossibleRegion());
-  while (!iter.IsAtEnd()) {
-    iter.Set(iter.Value() - x);
-    ++iter;
-  }
-
-  return *this;
-}
+Image& Image::operator-=(const PixelType x) { return assign(*this, expr(*this) - x); }
 
 Image Image::operator*(const Image& other) const {
   using FilterType = itk::MultiplyImageFilter<ImageType, ImageType>;
@@ -234,37 +373,13 @@ Image Image::operator*(const Image& other) const {
   return Image(filter->GetOutput());
 }
 
-Image Image::operator*(const PixelType x) const {
-  Image ret(*this);
-  ret *= x;
-  return ret;
-}
-
-Image& Image::operator*=(const PixelType x) {
-  itk::ImageRegionIteratorWithIndex<ImageType> iter(this->itk_image_, itk_image_->GetLargestPossibleRegion());
-  while (!iter.IsAtEnd()) {
-    iter.Set(iter.Value() * x);
-    ++iter;
-  }
-
-  return *this;
-}
+Image Image::operator*(const PixelType x) const { return expr(*this) * x; }
 
-Image Image::operator/(const PixelType x) const {
-  Image ret(*this);
-  ret /= x;
-  return ret;
-}
+Image& Image::operator*=(const PixelType x) { return assign(*this, expr(*this) * x); }
 
-Image& Image::operator/=(const PixelType x) {
-  itk::ImageRegionIteratorWithIndex<ImageType> iter(this->itk_image_, itk_image_->GetLargestPossibleRegion());
-  while (!iter.IsAtEnd()) {
-    iter.Set(iter.Value() / x);
-    ++iter;
-  }
+Image Image::operator/(const PixelType x) const { return expr(*this) / x; }
 
-  return *this;
-}
+Image& Image::operator/=(const PixelType x) { return assign(*this, expr(*this) / x); }
 
 template <>
 Image operator*(const Image& img, const double x) {
@@ -618,7 +733,19 @@ Image& Image::binarize(PixelType minVal, PixelType maxVal, PixelType innerVal, P
   return *this;
 }
 
-Image& Image::computeDT(PixelType isoValue) {
+Image& Image::computeDT(PixelType isoValue, DistanceTransformType type, double narrowBand) {
+  if (narrowBand < 0.0) {
+    throw std::invalid_argument("narrowBand must be >= 0");
+  }
+
+  if (type == Exact) {
+    const size_t dims[3] = {this->dims()[0], this->dims()[1], this->dims()[2]};
+    const double spacing[3] = {this->spacing()[0], this->spacing()[1], this->spacing()[2]};
+    computeExactSignedDistance(this->itk_image_->GetBufferPointer(), dims, spacing, isoValue, narrowBand);
+    this->itk_image_->Modified();
+    return *this;
+  }
+
   using FilterType = itk::ReinitializeLevelSetImageFilter<ImageType>;
   FilterType::Pointer filter = FilterType::New();
 
@@ -628,6 +755,14 @@ Image& Image::computeDT(PixelType isoValue) {
   filter->Update();
   this->itk_image_ = filter->GetOutput();
 
+  if (narrowBand > 0.0) {
+    PixelType* data = this->itk_image_->GetBufferPointer();
+    const size_t num_voxels = this->itk_image_->GetBufferedRegion().GetNumberOfPixels();
+    std::transform(data, data + num_voxels, data, [narrowBand](PixelType value) {
+      return static_cast<PixelType>(std::clamp<double>(value, -narrowBand, narrowBand));
+    });
+  }
+
   return *this;
 }
 
@@ -27,6 +27,7 @@ class Mesh;
 class Image {
  public:
   enum InterpolationType { Linear, NearestNeighbor };
+  enum DistanceTransformType { FastMarching, Exact };
 
   using PixelType = float;
   using ImageType = itk::Image<PixelType, 3>;
@@ -158,8 +159,10 @@ class Image {
   Image& binarize(PixelType minVal = 0.0, PixelType maxVal = std::numeric_limits<PixelType>::max(),
                   PixelType innerVal = 1.0, PixelType outerVal = 0.0);
 
-  /// computes distance transform volume from a (preferably antialiased) binary image using the specified isovalue
-  Image& computeDT(PixelType isoValue = 0.0);
+  /// computes distance transform volume from a (preferably antialiased) binary image using the specified isovalue,
+  /// either by fast marching or by an exact, multithreaded Euclidean distance transform; if narrowBand is positive,
+  /// distances are clamped to +/- narrowBand (physical units)
+  Image& computeDT(PixelType isoValue = 0.0, DistanceTransformType type = FastMarching, double narrowBand = 0.0);
 
   /// denoises an image using curvature driven flow using curvature flow image filter
   Image& applyCurvatureFilter(unsigned iterations = 10);
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <stdexcept>
+#include <type_traits>
+
+#include "Image.h"
+
+namespace shapeworks {
+
+/**
+ * \class ImageExpression
+ * \ingroup Group-Image
+ *
+ * Lazily evaluated element-wise arithmetic on Images.  Wrapping an Image with expr() makes +, -, * and / build an
+ * expression instead of a new Image per operator, so a chain such as (expr(a) + b) * s - c is computed in one pass
+ * over the raw buffers when it is converted to an Image or assign()ed into one.  The pass is split across threads and
+ * its inner loop is a plain indexed loop the compiler can vectorize.
+ *
+ * Images in an expression must have the same logical dims.  A new Image takes its header (origin, spacing, direction)
+ * from the first image in the expression.  Expressions refer to their images, so they should be evaluated before any
+ * of those go away.
+ */
+template <typename Derived>
+class ImageExpression {
+ public:
+  const Derived& derived() const { return static_cast<const Derived&>(*this); }
+
+  /// evaluates the expression into a new image
+  operator Image() const;
+};
+
+namespace expression {
+
+/// the voxels of an image
+class Term : public ImageExpression<Term> {
+ public:
+  explicit Term(const Image& image) : image_(&image), data_(image.getITKImage()->GetBufferPointer()) {}
+
+  Image::PixelType operator[](size_t i) const { return data_[i]; }
+  const Image* image() const { return image_; }
+
+ private:
+  const Image* image_;
+  const Image::PixelType* data_;
+};
+
+/// a constant for every voxel
+class Scalar : public ImageExpression<Scalar> {
+ public:
+  explicit Scalar(Image::PixelType value) : value_(value) {}
+
+  Image::PixelType operator[](size_t) const { return value_; }
+  const Image* image() const { return nullptr; }
+
+ private:
+  Image::PixelType value_;
+};
+
+struct Add {
+  static Image::PixelType apply(Image::PixelType a, Image::PixelType b) { return a + b; }
+};
+struct Subtract {
+  static Image::PixelType apply(Image::PixelType a, Image::PixelType b) { return a - b; }
+};
+struct Multiply {
+  static Image::PixelType apply(Image::PixelType a, Image::PixelType b) { return a * b; }
+};
+struct Divide {
+  static Image::PixelType apply(Image::PixelType a, Image::PixelType b) { return a / b; }
+};
+
+/// Op applied to each pair of voxels of two expressions (held by value, they are only a few pointers)
+template <typename Op, typename L, typename R>
+class Binary : public ImageExpression<Binary<Op, L, R>> {
+ public:
+  Binary(const L& left, const R& right) : left_(left), right_(right) {
+    if (left_.image() && right_.image() && left_.image()->dims() != right_.image()->dims()) {
+      throw std::invalid_argument("images must have same logical dims");
+    }
+  }
+
+  Image::PixelType operator[](size_t i) const { return Op::apply(left_[i], right_[i]); }
+  const Image* image() const { return left_.image() ? left_.image() : right_.image(); }
+
+ private:
+  const L left_;
+  const R right_;
+};
+
+template <typename E>
+class Negate : public ImageExpression<Negate<E>> {
+ public:
+  explicit Negate(const E& operand) : operand_(operand) {}
+
+  Image::PixelType operator[](size_t i) const { return -operand_[i]; }
+  const Image* image() const { return operand_.image(); }
+
+ private:
+  const E operand_;
+};
+
+template <typename T>
+constexpr bool is_expression = std::is_base_of<ImageExpression<T>, T>::value;
+
+template <typename T>
+constexpr bool is_operand = is_expression<T> || std::is_same<T, Image>::value || std::is_arithmetic<T>::value;
+
+/// operands of the arithmetic operators: at least one expression, the other an expression, Image or number
+template <typename L, typename R>
+constexpr bool are_operands = (is_expression<L> || is_expression<R>) && is_operand<L> && is_operand<R>;
+
+template <typename E>
+const E& operand(const ImageExpression<E>& expression) {
+  return expression.derived();
+}
+inline Term operand(const Image& image) { return Term(image); }
+inline Scalar operand(double value) { return Scalar(static_cast<Image::PixelType>(value)); }
+
+template <typename Op, typename L, typename R>
+auto binary(const L& left, const R& right) {
+  using LeftType = std::decay_t<decltype(operand(left))>;
+  using RightType = std::decay_t<decltype(operand(right))>;
+  return Binary<Op, LeftType, RightType>(operand(left), operand(right));
+}
+
+}  // namespace expression
+
+/// starts an expression on an image, e.g. Image result = (expr(a) + b) * 0.5 - c;
+inline expression::Term expr(const Image& image) { return expression::Term(image); }
+
+template <typename L, typename R, typename = std::enable_if_t<expression::are_operands<L, R>>>
+auto operator+(const L& left, const R& right) {
+  return expression::binary<expression::Add>(left, right);
+}
+
+template <typename L, typename R, typename = std::enable_if_t<expression::are_operands<L, R>>>
+auto operator-(const L& left, const R& right) {
+  return expression::binary<expression::Subtract>(left, right);
+}
+
+template <typename L, typename R, typename = std::enable_if_t<expression::are_operands<L, R>>>
+auto operator*(const L& left, const R& right) {
+  return expression::binary<expression::Multiply>(left, right);
+}
+
+template <typename L, typename R, typename = std::enable_if_t<expression::are_operands<L, R>>>
+auto operator/(const L& left, const R& right) {
+  return expression::binary<expression::Divide>(left, right);
+}
+
+template <typename E>
+expression::Negate<E> operator-(const ImageExpression<E>& operand) {
+  return expression::Negate<E>(operand.derived());
+}
+
+/// evaluates the expression into an existing image of the same dims, which may itself appear in the expression
+template <typename E>
+Image& assign(Image& image, const ImageExpression<E>& expression) {
+  const E& e = expression.derived();
+  if (e.image() && e.image()->dims() != image.dims()) {
+    throw std::invalid_argument("images must have same logical dims");
+  }
+
+  Image::PixelType* output = image.getITKImage()->GetBufferPointer();
+  const size_t size = image.getITKImage()->GetBufferedRegion().GetNumberOfPixels();
+  using Range = tbb::blocked_range<size_t>;
+  tbb::parallel_for(Range{0, size, 1 << 14}, [&](const Range& r) {
+    for (size_t i = r.begin(); i < r.end(); i++) {
+      output[i] = e[i];
+    }
+  });
+  image.getITKImage()->Modified();
+
+  return image;
+}
+
+template <typename Derived>
+ImageExpression<Derived>::operator Image() const {
+  const Image::ImageType* reference = derived().image()->getITKImage();
+
+  Image::ImageType::Pointer output = Image::ImageType::New();
+  output->CopyInformation(reference);
+  output->SetRegions(reference->GetLargestPossibleRegion());
+  output->Allocate();
+
+  Image image(output);
+  assign(image, *this);
+  return image;
+}
+
+}  // namespace shapeworks
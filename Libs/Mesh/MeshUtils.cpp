@@ -31,6 +31,7 @@
 #include <igl/AABB.h>
 #include <igl/remove_unreferenced.h>
 
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -41,8 +42,17 @@
 
 namespace shapeworks {
 
-// locking to handle non-thread-safe code
-static std::mutex mesh_mutex;
+// vtkPLY parses and writes through static buffers, so PLY files are read and written one at a time.  The readers and
+// writers of the other formats only keep per-instance state and run concurrently.
+static std::mutex ply_mutex;
+
+//! Lock whatever is needed to safely read or write filename
+static std::unique_lock<std::mutex> lock_mesh_format(const std::string& filename) {
+  if (StringUtils::hasSuffix(filename, ".ply")) {
+    return std::unique_lock<std::mutex>(ply_mutex);
+  }
+  return std::unique_lock<std::mutex>();
+}
 
 //! Return a random subset of size num from 0 to max-1
 static std::vector<int> get_random_subset(int num, int max) {
@@ -129,13 +139,13 @@ Mesh MeshUtils::create_mesh_from_file(std::string filename, double iso_value) {
 }
 
 Mesh MeshUtils::threadSafeReadMesh(std::string filename) {
-  std::scoped_lock lock(mesh_mutex);
+  auto lock = lock_mesh_format(filename);
   Mesh mesh(filename);
   return mesh;
 }
 
 void MeshUtils::threadSafeWriteMesh(std::string filename, Mesh mesh) {
-  std::scoped_lock lock(mesh_mutex);
+  auto lock = lock_mesh_format(filename);
   mesh.write(filename);
 }
 
@@ -27,10 +27,10 @@ class MeshUtils {
   /// Mesh from mesh or image file
   static Mesh create_mesh_from_file(std::string filename, double iso_value = 0.5);
 
-  /// Thread safe reading of a mesh, uses a lock
+  /// Thread safe reading of a mesh, formats with non-thread-safe readers (PLY) are read one at a time
   static Mesh threadSafeReadMesh(std::string filename);
 
-  /// Thread safe writing of a mesh, uses a lock
+  /// Thread safe writing of a mesh, formats with non-thread-safe writers (PLY) are written one at a time
   static void threadSafeWriteMesh(std::string filename, Mesh mesh);
 
   /// calculate bounding box incrementally for meshes
@@ -1,3 +1,4 @@
+#include <CacheUtils.h>
 #include <Logging.h>
 #include <Mesh/Mesh.h>
 #include <Mesh/MeshWarper.h>
@@ -6,49 +7,75 @@
 #include <igl/remove_unreferenced.h>
 #include <vtkCellLocator.h>
 #include <vtkCleanPolyData.h>
+#include <vtkDoubleArray.h>
+#include <vtkIdTypeArray.h>
 #include <vtkKdTreePointLocator.h>
 #include <vtkLine.h>
 #include <vtkPointLocator.h>
 #include <vtkPolyDataConnectivityFilter.h>
 #include <vtkTriangleFilter.h>
 
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <ctime>
+#include <fstream>
 #include <set>
 
 namespace shapeworks {
 
-// for concurrent access
-static std::mutex mutex;
+namespace {
+// warp matrices are large (vertices x particles), keep at most this many bytes of them on disk
+constexpr uintmax_t MAX_WARP_CACHE_SIZE = uintmax_t(4) * 1024 * 1024 * 1024;
+constexpr char WARP_FILE_MAGIC[8] = {'S', 'W', 'W', 'A', 'R', 'P', '0', '1'};
+
+//---------------------------------------------------------------------------
+template <typename Matrix>
+void hash_matrix(Fnv1aHash& hash, const Matrix& matrix) {
+  const int64_t dims[2] = {matrix.rows(), matrix.cols()};
+  hash.add(dims);
+  hash.add_bytes(matrix.data(), matrix.size() * sizeof(typename Matrix::Scalar));
+}
+}  // namespace
 
 //---------------------------------------------------------------------------
 vtkSmartPointer<vtkPolyData> MeshWarper::build_mesh(const Eigen::MatrixXd& particles) {
+  return build_meshes({particles})[0];
+}
+
+//---------------------------------------------------------------------------
+std::vector<vtkSmartPointer<vtkPolyData>> MeshWarper::build_meshes(const std::vector<Eigen::MatrixXd>& particles) {
+  std::vector<vtkSmartPointer<vtkPolyData>> meshes(particles.size());
   if (!this->warp_available_) {
-    return nullptr;
+    return meshes;
   }
 
   if (!this->check_warp_ready()) {
-    return nullptr;
+    return meshes;
   }
 
-  if (particles.size() != reference_particles_.size()) {
-    // This may be a stale mesh warper
-    // don't return nullptr or the user will get an error
-    auto blank = vtkSmartPointer<vtkPolyData>::New();
-    return blank;
+  // the good particles of every shape side by side, so that all are warped with one product
+  std::vector<int> shapes;
+  Eigen::MatrixXd points(this->good_particles_.size(), 3 * particles.size());
+  for (int i = 0; i < particles.size(); i++) {
+    if (particles[i].size() != reference_particles_.size()) {
+      // This may be a stale mesh warper
+      // don't return nullptr or the user will get an error
+      meshes[i] = vtkSmartPointer<vtkPolyData>::New();
+      continue;
+    }
+    points.middleCols(3 * shapes.size(), 3) = this->remove_bad_particles(particles[i]);
+    shapes.push_back(i);
   }
+  if (shapes.empty()) {
+    return meshes;
+  }
+  points.conservativeResize(Eigen::NoChange, 3 * shapes.size());
 
-  auto points = this->remove_bad_particles(particles);
-
-  vtkSmartPointer<vtkPolyData> poly_data = MeshWarper::warp_mesh(points);
-
-  for (int i = 0; i < poly_data->GetNumberOfPoints(); i++) {
-    double* p = poly_data->GetPoint(i);
-    if (std::isnan(p[0]) || std::isnan(p[1]) || std::isnan(p[2])) {
-      this->warp_available_ = false;  // failed
-      SW_ERROR("Reconstruction failed. NaN detected in mesh.");
-      return nullptr;
-    }
+  auto warped = MeshWarper::warp_meshes(points);
+  for (int i = 0; i < shapes.size(); i++) {
+    meshes[shapes[i]] = warped[i];
   }
-  return poly_data;
+  return meshes;
 }
 
 //---------------------------------------------------------------------------
@@ -82,12 +109,18 @@ void MeshWarper::set_reference_mesh(vtkSmartPointer<vtkPolyData> reference_mesh,
   }
 }
 
+//---------------------------------------------------------------------------
+void MeshWarper::set_cache_directory(const std::string& directory) {
+  std::scoped_lock lock(cache_directory_mutex_);
+  cache_directory_ = directory;
+}
+
 //---------------------------------------------------------------------------
 bool MeshWarper::get_warp_available() { return this->warp_available_; }
 
 //---------------------------------------------------------------------------
 bool MeshWarper::check_warp_ready() {
-  std::scoped_lock lock(mutex);
+  std::scoped_lock lock(warp_mutex_);
 
   if (!this->needs_warp_) {
     // warp already done
@@ -461,17 +494,112 @@ bool MeshWarper::generate_warp() {
   Eigen::MatrixXd vertices = referenceMesh.points();
   this->faces_ = referenceMesh.faces();
 
+  // connectivity of the reference mesh, built once and shared by all warped meshes
+  this->cell_connectivity_ = vtkSmartPointer<vtkIdTypeArray>::New();
+  this->cell_connectivity_->SetNumberOfValues(this->faces_.size());
+  Eigen::Map<Eigen::Matrix<vtkIdType, Eigen::Dynamic, 3, Eigen::RowMajor>>(this->cell_connectivity_->GetPointer(0),
+                                                                            this->faces_.rows(), 3) =
+      this->faces_.cast<vtkIdType>();
+  this->cell_offsets_ = vtkSmartPointer<vtkIdTypeArray>::New();
+  this->cell_offsets_->SetNumberOfValues(this->faces_.rows() + 1);
+  for (vtkIdType i = 0; i <= this->faces_.rows(); i++) {
+    this->cell_offsets_->SetValue(i, 3 * i);
+  }
+
   // perform warp
-  if (!MeshWarper::generate_warp_matrix(vertices, this->faces_, this->vertices_, this->warp_)) {
-    this->update_progress(1.0);
-    this->warp_available_ = false;
-    return false;
+  std::string cache_directory;
+  {
+    std::scoped_lock lock(cache_directory_mutex_);
+    cache_directory = cache_directory_;
+  }
+  const uint64_t key = compute_warp_key(vertices, this->faces_, this->vertices_);
+  if (!load_warp_matrix(cache_directory, key)) {
+    if (!MeshWarper::generate_warp_matrix(vertices, this->faces_, this->vertices_, this->warp_)) {
+      this->update_progress(1.0);
+      this->warp_available_ = false;
+      return false;
+    }
+    save_warp_matrix(cache_directory, key);
   }
   this->update_progress(1.0);
   this->needs_warp_ = false;
   return true;
 }
 
+//---------------------------------------------------------------------------
+uint64_t MeshWarper::compute_warp_key(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TF,
+                                      const Eigen::MatrixXd& Vref) {
+  Fnv1aHash hash;
+  hash.add(WARP_FILE_MAGIC);
+  hash_matrix(hash, TV);
+  hash_matrix(hash, TF);
+  hash_matrix(hash, Vref);
+  return hash.value();
+}
+
+//---------------------------------------------------------------------------
+bool MeshWarper::load_warp_matrix(const std::string& directory, uint64_t key) {
+  if (directory.empty()) {
+    return false;
+  }
+  const auto filename = boost::filesystem::path(directory) / fmt::format("{:016x}.warp", key);
+  std::ifstream file(filename.string(), std::ios::binary);
+  if (!file) {
+    return false;
+  }
+
+  char magic[sizeof(WARP_FILE_MAGIC)];
+  int64_t dims[3];  // faces, warp rows, warp columns
+  file.read(magic, sizeof(magic));
+  file.read(reinterpret_cast<char*>(dims), sizeof(dims));
+  if (!file || !std::equal(magic, magic + sizeof(magic), WARP_FILE_MAGIC) || dims[0] != faces_.rows() ||
+      dims[2] != vertices_.rows()) {
+    return false;
+  }
+
+  // the faces are stored too, so that a hash collision can not hand out the warp of a different mesh
+  Eigen::MatrixXi faces(dims[0], 3);
+  Eigen::MatrixXd warp(dims[1], dims[2]);
+  file.read(reinterpret_cast<char*>(faces.data()), faces.size() * sizeof(int));
+  file.read(reinterpret_cast<char*>(warp.data()), warp.size() * sizeof(double));
+  if (!file || faces != faces_) {
+    return false;
+  }
+  warp_ = std::move(warp);
+
+  // mark as recently used for trimming
+  CacheUtils::touch(filename.string());
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void MeshWarper::save_warp_matrix(const std::string& directory, uint64_t key) {
+  if (directory.empty()) {
+    return;
+  }
+  namespace fs = boost::filesystem;
+  boost::system::error_code ec;
+  fs::create_directories(directory, ec);
+  const auto filename = fs::path(directory) / fmt::format("{:016x}.warp", key);
+
+  // other warpers never read a partial file
+  const bool written = CacheUtils::write_atomically(filename.string(), [&](const std::string& temp_filename) {
+    std::ofstream file(temp_filename, std::ios::binary);
+    const int64_t dims[3] = {faces_.rows(), warp_.rows(), warp_.cols()};
+    file.write(WARP_FILE_MAGIC, sizeof(WARP_FILE_MAGIC));
+    file.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+    file.write(reinterpret_cast<const char*>(faces_.data()), faces_.size() * sizeof(int));
+    file.write(reinterpret_cast<const char*>(warp_.data()), warp_.size() * sizeof(double));
+    file.close();
+    return !file.fail();
+  });
+  if (!written) {
+    SW_WARN("Unable to write warp matrix to cache: {}", filename.string());
+    return;
+  }
+  CacheUtils::trim_directory(directory, ".warp", MAX_WARP_CACHE_SIZE);
+}
+
 //---------------------------------------------------------------------------
 bool MeshWarper::generate_warp_matrix(Eigen::MatrixXd TV, Eigen::MatrixXi TF, const Eigen::MatrixXd& Vref,
                                       Eigen::MatrixXd& W) {
@@ -524,26 +652,57 @@ bool MeshWarper::find_landmarks_vertices_on_ref_mesh() {
 }
 
 //---------------------------------------------------------------------------
-vtkSmartPointer<vtkPolyData> MeshWarper::warp_mesh(const Eigen::MatrixXd& points) {
-  int num_vertices = this->warp_.rows();
-  int num_faces = this->faces_.rows();
-  Eigen::MatrixXd v_out = this->warp_ * (points.rowwise() + Eigen::RowVector3d(0, 0, 0));
-  vtkSmartPointer<vtkPolyData> poly_data = vtkSmartPointer<vtkPolyData>::New();
-  vtkSmartPointer<vtkPoints> out_points = vtkSmartPointer<vtkPoints>::New();
-  out_points->SetNumberOfPoints(num_vertices);
-  for (vtkIdType i = 0; i < num_vertices; i++) {
-    out_points->SetPoint(i, v_out(i, 0), v_out(i, 1), v_out(i, 2));
-  }
-  vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
-  for (vtkIdType i = 0; i < num_faces; i++) {
-    polys->InsertNextCell(3);
-    polys->InsertCellPoint(this->faces_(i, 0));
-    polys->InsertCellPoint(this->faces_(i, 1));
-    polys->InsertCellPoint(this->faces_(i, 2));
-  }
-  poly_data->SetPoints(out_points);
-  poly_data->SetPolys(polys);
+std::vector<vtkSmartPointer<vtkPolyData>> MeshWarper::warp_meshes(const Eigen::MatrixXd& points) {
+  using RowMajorPoints = Eigen::Matrix<double, Eigen::Dynamic, 3, Eigen::RowMajor>;
+  const int num_vertices = this->warp_.rows();
+  const int num_shapes = points.cols() / 3;
+  std::vector<vtkSmartPointer<vtkPolyData>> meshes;
+
+  // the vtkPoints buffers hold interleaved x y z, which is a row major [V x 3] matrix per shape
+  std::vector<vtkSmartPointer<vtkDoubleArray>> arrays(num_shapes);
+  for (auto& array : arrays) {
+    array = vtkSmartPointer<vtkDoubleArray>::New();
+    array->SetNumberOfComponents(3);
+    array->SetNumberOfTuples(num_vertices);
+  }
+
+  if (num_vertices == 0) {
+    // nothing to warp (e.g. contours)
+  } else if (num_shapes == 1) {
+    // straight into the buffer
+    Eigen::Map<RowMajorPoints>(arrays[0]->GetPointer(0), num_vertices, 3).noalias() = this->warp_ * points;
+  } else {
+    // one product for all shapes streams the warp matrix once, instead of once per shape
+    Eigen::MatrixXd warped = this->warp_ * points;
+    for (int i = 0; i < num_shapes; i++) {
+      Eigen::Map<RowMajorPoints>(arrays[i]->GetPointer(0), num_vertices, 3) = warped.middleCols(3 * i, 3);
+    }
+  }
 
+  for (int i = 0; i < num_shapes; i++) {
+    auto vertices = Eigen::Map<const Eigen::VectorXd>(arrays[i]->GetPointer(0), 3 * num_vertices);
+    if (vertices.hasNaN()) {
+      this->warp_available_ = false;  // failed
+      SW_ERROR("Reconstruction failed. NaN detected in mesh.");
+      return std::vector<vtkSmartPointer<vtkPolyData>>(num_shapes);
+    }
+    auto vtk_points = vtkSmartPointer<vtkPoints>::New();
+    vtk_points->SetData(arrays[i]);
+    meshes.push_back(create_warped_poly_data(vtk_points));
+  }
+  return meshes;
+}
+
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> MeshWarper::create_warped_poly_data(vtkSmartPointer<vtkPoints> points) {
+  vtkSmartPointer<vtkPolyData> poly_data = vtkSmartPointer<vtkPolyData>::New();
+  poly_data->SetPoints(points);
+  if (this->cell_connectivity_) {
+    // a cell array per mesh, since iterating one moves its cursor, but over the same arrays
+    auto cells = vtkSmartPointer<vtkCellArray>::New();
+    cells->SetData(this->cell_offsets_, this->cell_connectivity_);
+    poly_data->SetPolys(cells);
+  }
   return poly_data;
 }
 
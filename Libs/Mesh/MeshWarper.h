@@ -7,9 +7,13 @@
  * The MeshWarper provides an object to warp meshes for surface reconstruction
  */
 
+#include <vtkCellArray.h>
+#include <vtkIdTypeArray.h>
 #include <vtkPolyData.h>
 
 #include <Eigen/Eigen>
+#include <mutex>
+#include <string>
 #include <vector>
 
 namespace shapeworks {
@@ -24,6 +28,10 @@ namespace shapeworks {
  *
  * It can optionally be used to warp landmarks along with the mesh by embedding them as vertices
  *
+ * Computing the biharmonic weights is by far the slowest step.  When a cache directory is set, the warp matrix is
+ * stored there keyed by a hash of the prepared reference mesh and particles, and reused the next time the same
+ * reference is warped (e.g. when a project is reopened).
+ *
  */
 class MeshWarper {
  public:
@@ -42,6 +50,11 @@ class MeshWarper {
   //! Build a mesh for a given set of particles
   vtkSmartPointer<vtkPolyData> build_mesh(const Eigen::MatrixXd& particles);
 
+  //! Build meshes for many sets of particles (e.g. every subject, or every frame of a mode animation) with a single
+  //! matrix product.  The meshes share one connectivity array, so their cells must not be modified in place.  Entries
+  //! are null if the warp is not available
+  std::vector<vtkSmartPointer<vtkPolyData>> build_meshes(const std::vector<Eigen::MatrixXd>& particles);
+
   //! Return the landmarks (matrix [Nx3]) from the warped builded mesh
   Eigen::MatrixXd extract_landmarks(vtkSmartPointer<vtkPolyData> warped_mesh);
 
@@ -66,6 +79,9 @@ class MeshWarper {
   //! Return the reference particles
   const Eigen::MatrixXd& get_reference_particles() const { return this->reference_particles_; }
 
+  //! Set the directory where warp matrices are kept across sessions, empty to disable
+  void set_cache_directory(const std::string& directory);
+
   //! Prep incoming mesh
   static vtkSmartPointer<vtkPolyData> prep_mesh(vtkSmartPointer<vtkPolyData> mesh);
 
@@ -99,17 +115,40 @@ class MeshWarper {
   //! Recreate mesh, dropping deleted cells
   static vtkSmartPointer<vtkPolyData> recreate_mesh(vtkSmartPointer<vtkPolyData> mesh);
 
+  //! Hash of the inputs of the warp matrix, names its file in the cache directory
+  static uint64_t compute_warp_key(const Eigen::MatrixXd& TV, const Eigen::MatrixXi& TF, const Eigen::MatrixXd& Vref);
+
+  //! Read the warp matrix for key from directory, return false if it is not there
+  bool load_warp_matrix(const std::string& directory, uint64_t key);
+
+  //! Write the warp matrix for key to directory
+  void save_warp_matrix(const std::string& directory, uint64_t key);
+
   //! Generate the warp matrix
   bool generate_warp_matrix(Eigen::MatrixXd TV, Eigen::MatrixXi TF, const Eigen::MatrixXd& Vref, Eigen::MatrixXd& W);
 
-  //! Generate a polydata from a set of points (e.g. warp the reference mesh)
-  vtkSmartPointer<vtkPolyData> warp_mesh(const Eigen::MatrixXd& points);
+  //! Generate polydata from sets of points stacked side by side ([N x 3K], e.g. warp the reference mesh)
+  std::vector<vtkSmartPointer<vtkPolyData>> warp_meshes(const Eigen::MatrixXd& points);
+
+  //! Polydata with the given points and a cell array over the shared connectivity of the warped meshes
+  vtkSmartPointer<vtkPolyData> create_warped_poly_data(vtkSmartPointer<vtkPoints> points);
 
   //! Return the number of bad particles
   size_t bad_particle_count() const { return size_t(reference_particles_.rows()) - good_particles_.size(); }
 
   // Members
+  //! Guards generating the warp, each warper (domain) can generate its own concurrently
+  std::mutex warp_mutex_;
+
+  //! The cache directory may be changed while a warp is being generated
+  std::mutex cache_directory_mutex_;
+  std::string cache_directory_;
+
   Eigen::MatrixXi faces_;
+  //! faces_ as VTK cell offsets and connectivity.  Every warped mesh gets its own vtkCellArray (which keeps traversal
+  //! state) over these two arrays, which are never modified once built
+  vtkSmartPointer<vtkIdTypeArray> cell_offsets_;
+  vtkSmartPointer<vtkIdTypeArray> cell_connectivity_;
   Eigen::MatrixXd vertices_;
   Eigen::MatrixXd warp_;
   Eigen::MatrixXd landmarks_points_;
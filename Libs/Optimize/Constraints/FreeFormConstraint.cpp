@@ -9,6 +9,7 @@
 #include <vtkPointData.h>
 #include <vtkSelectPolyData.h>
 
+#include "FreeFormConstraintCache.h"
 #include "Libs/Common/Logging.h"
 
 // libigl
@@ -39,6 +40,33 @@ bool FreeFormConstraint::isViolated(const Eigen::Vector3d& pt) const {
   }
 }
 
+//-----------------------------------------------------------------------------
+Eigen::Vector3d FreeFormConstraint::constraintGradient(const Eigen::Vector3d& pt) const {
+  Eigen::Vector3d gradient;
+  if (voxelCache_ && voxelCache_->sampleGradient(pt, gradient)) {
+    return gradient;
+  }
+  return mesh_->getFFCGradient(pt);
+}
+
+//-----------------------------------------------------------------------------
+double FreeFormConstraint::constraintEval(const Eigen::Vector3d& pt) const {
+  double value;
+  if (voxelCache_ && voxelCache_->sampleValue(pt, value)) {
+    return value;
+  }
+  return mesh_->getFFCValue(pt);
+}
+
+//-----------------------------------------------------------------------------
+void FreeFormConstraint::bakeVoxelCache(double voxelSize, int bandVoxels) {
+  if (!mesh_) {
+    return;
+  }
+  voxelCache_ = std::make_shared<FreeFormConstraintCache>(*mesh_, voxelSize, bandVoxels);
+  SW_DEBUG("FFC voxel cache: {} voxels of size {}", voxelCache_->getNumVoxels(), voxelCache_->getVoxelSize());
+}
+
 //-----------------------------------------------------------------------------
 void FreeFormConstraint::setDefinition(vtkSmartPointer<vtkPolyData> polyData) {
   // ownership of the free form constraint is now held in the definitionPolyData_
@@ -7,6 +7,8 @@ class vtkFloatArray;
 
 namespace shapeworks {
 
+class FreeFormConstraintCache;
+
 /**
  * \class FreeFormConstraint
  * \ingroup Group-Constraints
@@ -19,7 +21,10 @@ class FreeFormConstraint : public Constraint {
   FreeFormConstraint() {}
 
   /// Sets the mesh that defines the FFC
-  void setMesh(std::shared_ptr<shapeworks::Mesh> mesh) { mesh_ = mesh; }
+  void setMesh(std::shared_ptr<shapeworks::Mesh> mesh) {
+    mesh_ = mesh;
+    voxelCache_ = nullptr;
+  }
 
   /// Returns the mesh that defines the FFC
   std::shared_ptr<shapeworks::Mesh> getMesh() { return mesh_; }
@@ -31,9 +36,19 @@ class FreeFormConstraint : public Constraint {
 
   void print() const override { std::cout << "FF" << std::endl; }
 
-  Eigen::Vector3d constraintGradient(const Eigen::Vector3d& pt) const override { return mesh_->getFFCGradient(pt); }
+  Eigen::Vector3d constraintGradient(const Eigen::Vector3d& pt) const override;
+
+  double constraintEval(const Eigen::Vector3d& pt) const override;
+
+  //! Bake the FFC value and gradient of the mesh into a narrow band voxel grid so that constraint queries near the
+  //! surface become trilinear lookups.  Must be called after computeGradientFields.  See FreeFormConstraintCache
+  void bakeVoxelCache(double voxelSize = 0.0, int bandVoxels = 2);
+
+  //! Return if constraint queries use a voxel cache
+  bool hasVoxelCache() const { return voxelCache_ != nullptr; }
 
-  double constraintEval(const Eigen::Vector3d& pt) const override { return mesh_->getFFCValue(pt); }
+  //! Return the voxel cache, null if there is none
+  std::shared_ptr<const FreeFormConstraintCache> getVoxelCache() const { return voxelCache_; }
 
   //! Set polydata where per-vertex free form constraint definition exists
   void setDefinition(vtkSmartPointer<vtkPolyData> polyData);
@@ -96,6 +111,7 @@ class FreeFormConstraint : public Constraint {
   vtkFloatArray* createFFCPaint(vtkSmartPointer<vtkPolyData> polyData);
 
   std::shared_ptr<shapeworks::Mesh> mesh_;
+  std::shared_ptr<FreeFormConstraintCache> voxelCache_;
 
   vtkSmartPointer<vtkPolyData> definitionPolyData_;
   bool painted_ = false;
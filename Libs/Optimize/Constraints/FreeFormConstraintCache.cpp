@@ -0,0 +1,99 @@
+#include "FreeFormConstraintCache.h"
+
+#undef foreach
+#ifndef Q_MOC_RUN
+#include <openvdb/math/Transform.h>
+#include <openvdb/tools/Interpolation.h>
+#endif
+
+namespace shapeworks {
+
+//-----------------------------------------------------------------------------
+static double mean_edge_length(const Mesh& mesh) {
+  double total = 0.0;
+  size_t count = 0;
+  for (int i = 0; i < mesh.numFaces(); i++) {
+    const auto face = mesh.getFace(i);
+    for (int j = 0; j < 3; j++) {
+      total += mesh.getPoint(face[j]).EuclideanDistanceTo(mesh.getPoint(face[(j + 1) % 3]));
+      count++;
+    }
+  }
+  return count > 0 ? total / count : 1.0;
+}
+
+//-----------------------------------------------------------------------------
+FreeFormConstraintCache::FreeFormConstraintCache(const Mesh& mesh, double voxel_size, int band_voxels) {
+  openvdb::initialize();  // It is safe to initialize multiple times.
+
+  voxel_size_ = voxel_size > 0.0 ? voxel_size : mean_edge_length(mesh);
+
+  value_grid_ = openvdb::FloatGrid::create(0.0);
+  value_grid_->setTransform(openvdb::math::Transform::createLinearTransform(voxel_size_));
+  gradient_grid_ = openvdb::Vec3SGrid::create(openvdb::Vec3s(0.0));
+  gradient_grid_->setTransform(value_grid_->transform().copy());
+
+  // activate the band around the surface
+  auto value_accessor = value_grid_->getAccessor();
+  for (int i = 0; i < mesh.numPoints(); i++) {
+    const auto p = mesh.getPoint(i);
+    const auto center = openvdb::Coord::round(value_grid_->worldToIndex(openvdb::Vec3R(p[0], p[1], p[2])));
+    for (int x = -band_voxels; x <= band_voxels; x++) {
+      for (int y = -band_voxels; y <= band_voxels; y++) {
+        for (int z = -band_voxels; z <= band_voxels; z++) {
+          value_accessor.setValueOn(center.offsetBy(x, y, z));
+        }
+      }
+    }
+  }
+
+  // sample the fields at the voxel centers
+  auto gradient_accessor = gradient_grid_->getAccessor();
+  for (auto iter = value_grid_->beginValueOn(); iter; ++iter) {
+    const auto world = value_grid_->indexToWorld(iter.getCoord());
+    const Eigen::Vector3d query(world.x(), world.y(), world.z());
+    iter.setValue(mesh.getFFCValue(query));
+    const Eigen::Vector3d gradient = mesh.getFFCGradient(query);
+    gradient_accessor.setValue(iter.getCoord(), openvdb::Vec3s(gradient.x(), gradient.y(), gradient.z()));
+  }
+}
+
+//-----------------------------------------------------------------------------
+bool FreeFormConstraintCache::toIndex(const Eigen::Vector3d& pt, openvdb::Vec3R& index) const {
+  index = value_grid_->worldToIndex(openvdb::Vec3R(pt.x(), pt.y(), pt.z()));
+  const auto base = openvdb::Coord::floor(index);
+  auto accessor = value_grid_->getConstAccessor();
+  for (int i = 0; i < 8; i++) {
+    if (!accessor.isValueOn(base.offsetBy(i & 1, (i >> 1) & 1, (i >> 2) & 1))) {
+      misses_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  hits_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool FreeFormConstraintCache::sampleValue(const Eigen::Vector3d& pt, double& value) const {
+  openvdb::Vec3R index;
+  if (!toIndex(pt, index)) {
+    return false;
+  }
+  auto accessor = value_grid_->getConstAccessor();
+  value = openvdb::tools::BoxSampler::sample(accessor, index);
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+bool FreeFormConstraintCache::sampleGradient(const Eigen::Vector3d& pt, Eigen::Vector3d& gradient) const {
+  openvdb::Vec3R index;
+  if (!toIndex(pt, index)) {
+    return false;
+  }
+  auto accessor = gradient_grid_->getConstAccessor();
+  const auto sample = openvdb::tools::BoxSampler::sample(accessor, index);
+  gradient = Eigen::Vector3d(sample.x(), sample.y(), sample.z());
+  return true;
+}
+
+}  // namespace shapeworks
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <atomic>
+
+#include "Libs/Mesh/Mesh.h"
+
+// we have to undef foreach here because both Qt and OpenVDB define foreach
+#undef foreach
+#ifndef Q_MOC_RUN
+#include <openvdb/openvdb.h>
+#endif
+
+namespace shapeworks {
+
+/**
+ * \class FreeFormConstraintCache
+ * \ingroup Group-Constraints
+ *
+ *  Narrow band voxel cache of the free-form constraint fields of a mesh.  The FFC value and gradient
+ *  (Mesh::getFFCValue, Mesh::getFFCGradient) are sampled once at the centers of all voxels within a band around the
+ *  mesh surface and stored in sparse OpenVDB grids.  Queries are then trilinear lookups instead of closest point
+ *  searches on the mesh.  Queries whose interpolation stencil is not fully inside the band report a miss, and the
+ *  caller falls back to the exact mesh query.
+ */
+class FreeFormConstraintCache {
+ public:
+  /// Bakes the FFC fields of mesh.  voxel_size <= 0 uses the mean edge length of the mesh.  band_voxels is the
+  /// half width of the band in voxels.
+  FreeFormConstraintCache(const Mesh& mesh, double voxel_size = 0.0, int band_voxels = 2);
+
+  /// Interpolated FFC value at pt.  Returns false if pt is outside the band.
+  bool sampleValue(const Eigen::Vector3d& pt, double& value) const;
+
+  /// Interpolated FFC gradient at pt.  Returns false if pt is outside the band.
+  bool sampleGradient(const Eigen::Vector3d& pt, Eigen::Vector3d& gradient) const;
+
+  /// Number of voxels in the band
+  size_t getNumVoxels() const { return value_grid_->activeVoxelCount(); }
+
+  double getVoxelSize() const { return voxel_size_; }
+
+  /// Number of queries answered from the band, and of queries outside it, since construction
+  size_t getNumHits() const { return hits_; }
+  size_t getNumMisses() const { return misses_; }
+
+ private:
+  /// Index space coordinate of pt, if all 8 voxels around it are in the band
+  bool toIndex(const Eigen::Vector3d& pt, openvdb::Vec3R& index) const;
+
+  double voxel_size_;
+  openvdb::FloatGrid::Ptr value_grid_;
+  openvdb::Vec3SGrid::Ptr gradient_grid_;
+
+  // queries run concurrently, and only the totals matter
+  mutable std::atomic<size_t> hits_{0};
+  mutable std::atomic<size_t> misses_{0};
+};
+
+}  // namespace shapeworks
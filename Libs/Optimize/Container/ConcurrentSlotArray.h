@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+namespace shapeworks {
+/*!
+ * @class ConcurrentSlotArray
+ * @brief Per particle array that grows on demand and may be used from several threads at once
+ *
+ * Storage is a fixed table of chunks of doubling size (1024, 1024, 2048, 4096, ...), so growing never moves an
+ * element and a lookup is a compare and one atomic load for the first 1024 indices.  Missing chunks are allocated
+ * under a mutex the first time an index inside them is touched.
+ *
+ * Only the storage is thread safe; access to the elements themselves must be synchronized by T (e.g. atomics).
+ */
+template <class T>
+class ConcurrentSlotArray {
+ public:
+  ConcurrentSlotArray() {
+    for (auto& chunk : m_Chunks) {
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  ~ConcurrentSlotArray() { this->Clear(); }
+
+  ConcurrentSlotArray(const ConcurrentSlotArray&) = delete;
+  ConcurrentSlotArray& operator=(const ConcurrentSlotArray&) = delete;
+
+  /** Element idx, allocating its chunk if necessary. */
+  T& operator[](size_t idx) const {
+    size_t chunk, offset;
+    Locate(idx, chunk, offset);
+    T* data = m_Chunks[chunk].load(std::memory_order_acquire);
+    if (data == nullptr) {
+      data = this->Allocate(chunk);
+    }
+    return data[offset];
+  }
+
+  /** Release all elements.  Not thread safe. */
+  void Clear() {
+    for (auto& chunk : m_Chunks) {
+      delete[] chunk.load(std::memory_order_relaxed);
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  static constexpr size_t FirstChunkBits = 10;
+  static constexpr size_t NumChunks = 40;
+
+  static size_t ChunkSize(size_t chunk) {
+    return chunk == 0 ? (size_t(1) << FirstChunkBits) : (size_t(1) << (FirstChunkBits + chunk - 1));
+  }
+
+  /** Chunk 0 holds [0, 1024) and chunk c > 0 holds [1024 * 2^(c-1), 1024 * 2^c). */
+  static void Locate(size_t idx, size_t& chunk, size_t& offset) {
+    const size_t high = idx >> FirstChunkBits;
+    if (high == 0) {
+      chunk = 0;
+      offset = idx;
+      return;
+    }
+    chunk = 1;
+    while ((high >> chunk) != 0) {
+      chunk++;
+    }
+    offset = idx - ChunkSize(chunk);
+  }
+
+  T* Allocate(size_t chunk) const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    T* data = m_Chunks[chunk].load(std::memory_order_relaxed);
+    if (data == nullptr) {
+      data = new T[ChunkSize(chunk)]();
+      m_Chunks[chunk].store(data, std::memory_order_release);
+    }
+    return data;
+  }
+
+  mutable std::array<std::atomic<T*>, NumChunks> m_Chunks;
+  mutable std::mutex m_Mutex;
+};
+
+}  // namespace shapeworks
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+
+#include "itkDataObject.h"
+#include "itkPoint.h"
+#include "itkWeakPointer.h"
+
+namespace shapeworks {
+/*!
+ * @class ParticlePositionStore
+ * @brief Structure-of-arrays copy of the particle positions of one domain
+ *
+ * The x, y and z coordinates are kept in three contiguous arrays indexed by particle, so that loops over many
+ * particles (neighborhood candidate tests, gradient sums) stream through memory instead of visiting one point object
+ * at a time.  The ParticleSystem keeps one store per domain, holding the positions as the neighborhood sees them, and
+ * hands it to the domain's neighborhood.  Like GenericContainer, setting an index past the end grows the store.
+ */
+class ParticlePositionStore : public itk::DataObject {
+ public:
+  /** Standard class typedefs */
+  typedef ParticlePositionStore Self;
+  typedef DataObject Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+  typedef itk::WeakPointer<const Self> ConstWeakPointer;
+
+  typedef itk::Point<double, 3> PointType;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ParticlePositionStore, itk::DataObject);
+
+  /** Store the coordinates of particle k. */
+  inline void Set(size_t k, const PointType& p) {
+    if (k >= m_X.size()) {
+      m_X.resize(k + 1);
+      m_Y.resize(k + 1);
+      m_Z.resize(k + 1);
+    }
+    m_X[k] = p[0];
+    m_Y[k] = p[1];
+    m_Z[k] = p[2];
+  }
+
+  /** Coordinates of particle k as a point. */
+  inline PointType Get(size_t k) const {
+    PointType p;
+    p[0] = m_X[k];
+    p[1] = m_Y[k];
+    p[2] = m_Z[k];
+    return p;
+  }
+
+  /** Number of particles stored. */
+  size_t GetSize() const { return m_X.size(); }
+
+  /** The contiguous coordinate arrays, GetSize() entries each. */
+  const double* GetX() const { return m_X.data(); }
+  const double* GetY() const { return m_Y.data(); }
+  const double* GetZ() const { return m_Z.data(); }
+
+ protected:
+  ParticlePositionStore() {}
+  void PrintSelf(std::ostream& os, itk::Indent indent) const {
+    Superclass::PrintSelf(os, indent);
+    os << indent << "size: " << m_X.size() << std::endl;
+  }
+  virtual ~ParticlePositionStore(){};
+
+ private:
+  ParticlePositionStore(const Self&);  // purposely not implemented
+  void operator=(const Self&);         // purposely not implemented
+
+  std::vector<double> m_X;
+  std::vector<double> m_Y;
+  std::vector<double> m_Z;
+};
+
+}  // end namespace shapeworks
@@ -1,7 +1,6 @@
 #include "ContourDomain.h"
 
-#include <vtkDijkstraGraphGeodesicPath.h>
-#include <vtkDoubleArray.h>
+#include <limits>
 #include <numeric>
 
 #include <fstream>
@@ -189,7 +188,7 @@ double ContourDomain::Distance(const PointType &a, int idx_a, const PointType &b
       const auto bj = this->GetPoint(bi_idx);
       const double dist_to_bj = (pt_b - bj).norm();
 
-      const double dist = dist_to_ai + geodesics_(ai_idx, bi_idx) + dist_to_bj;
+      const double dist = dist_to_ai + geodesics_.Distance(ai_idx, bi_idx) + dist_to_bj;
       if (dist < shortest_dist) {
         shortest_dist = dist;
         chosen_dir = i;
@@ -223,27 +222,15 @@ void ContourDomain::ComputeBounds() {
 }
 
 void ContourDomain::ComputeGeodesics(vtkSmartPointer<vtkPolyData> poly_data) {
-  const auto N = this->NumberOfPoints();
-
-  geodesics_.resize(N, N);
-  geodesics_.fill(std::numeric_limits<double>::infinity());
-
-  for (int i = 0; i < N; i++) {
-    auto dijkstra = vtkSmartPointer<vtkDijkstraGraphGeodesicPath>::New();
-    dijkstra->SetInputData(poly_data);
-    dijkstra->SetStartVertex(i);
-    dijkstra->Update();
-
-    auto out = vtkSmartPointer<vtkDoubleArray>::New();
-    dijkstra->GetCumulativeWeights(out);
-    out->SetArrayFreeFunction([](void *ptr) {
-      delete[] reinterpret_cast<uint8_t *>(ptr);
-    });
-
-    for (int j = 0; j < N; j++) {
-      geodesics_(i, j) = out->GetValue(j);
-    }
+  Eigen::MatrixXd points(poly_data->GetNumberOfPoints(), 3);
+  for (int i = 0; i < points.rows(); i++) {
+    points.row(i) = GetPoint(i).transpose();
+  }
+  std::vector<std::array<int, 2>> lines;
+  for (const auto &line : lines_) {
+    lines.push_back({static_cast<int>(line->GetPointId(0)), static_cast<int>(line->GetPointId(1))});
   }
+  geodesics_ = ContourGeodesics(points, lines);
 }
 
 int ContourDomain::NumberOfLines() const { return poly_data_->GetNumberOfCells(); }
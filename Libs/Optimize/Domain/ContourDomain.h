@@ -8,6 +8,7 @@
 
 #include <Eigen/Dense>
 
+#include "ContourGeodesics.h"
 #include "ParticleDomain.h"
 
 namespace shapeworks {
@@ -119,8 +120,8 @@ class ContourDomain : public ParticleDomain {
   vtkSmartPointer<vtkCellLocator> cell_locator_;
   std::vector<vtkSmartPointer<vtkLine>> lines_;
 
-  // Geodesics between all point pairs. Assumes the number of points is very small
-  Eigen::MatrixXd geodesics_;
+  // Geodesics between vertices, from arc lengths along the chains of the contour
+  ContourGeodesics geodesics_;
 
   // cache which line a particle is on
   mutable std::vector<int> particle_lines_;
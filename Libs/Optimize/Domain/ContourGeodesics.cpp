@@ -0,0 +1,146 @@
+#include "ContourGeodesics.h"
+
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace shapeworks {
+
+//---------------------------------------------------------------------------
+ContourGeodesics::ContourGeodesics(const Eigen::MatrixXd& points, const std::vector<std::array<int, 2>>& lines) {
+  const int num_points = points.rows();
+  const double infinity = std::numeric_limits<double>::infinity();
+
+  std::vector<std::vector<int>> incident_lines(num_points);
+  for (int i = 0; i < lines.size(); i++) {
+    if (lines[i][0] != lines[i][1]) {
+      incident_lines[lines[i][0]].push_back(i);
+      incident_lines[lines[i][1]].push_back(i);
+    }
+  }
+
+  locations_.resize(num_points);
+  std::vector<int> junction_ids(num_points, -1);
+  int num_junctions = 0;
+  auto add_junction = [&](int vertex) {
+    junction_ids[vertex] = num_junctions;
+    locations_[vertex].junctions[0] = num_junctions++;
+  };
+  for (int i = 0; i < num_points; i++) {
+    if (incident_lines[i].size() != 2) {
+      add_junction(i);
+    }
+  }
+
+  // walk every chain leaving a junction, recording the arc length of the vertices along the way
+  struct ChainEdge {
+    int from, to;
+    double length;
+  };
+  std::vector<ChainEdge> edges;
+  std::vector<bool> visited(lines.size(), false);
+  auto trace_chains = [&](int start) {
+    for (int first_line : incident_lines[start]) {
+      if (visited[first_line]) {
+        continue;
+      }
+      const int chain = chain_lengths_.size();
+      std::vector<int> vertices;
+      int previous = start;
+      int line = first_line;
+      double arc_length = 0;
+      while (true) {
+        visited[line] = true;
+        const int next = lines[line][0] == previous ? lines[line][1] : lines[line][0];
+        arc_length += (points.row(next) - points.row(previous)).norm();
+        if (junction_ids[next] >= 0) {
+          previous = next;
+          break;
+        }
+        locations_[next].chain = chain;
+        locations_[next].arc_length = arc_length;
+        vertices.push_back(next);
+        line = incident_lines[next][0] == line ? incident_lines[next][1] : incident_lines[next][0];
+        previous = next;
+      }
+
+      const int end = previous;
+      chain_lengths_.push_back(arc_length);
+      edges.push_back({junction_ids[start], junction_ids[end], arc_length});
+      for (int vertex : vertices) {
+        auto& location = locations_[vertex];
+        location.junctions = {junction_ids[start], junction_ids[end]};
+        location.distances = {location.arc_length, arc_length - location.arc_length};
+      }
+    }
+  };
+
+  for (int i = 0; i < num_points; i++) {
+    if (junction_ids[i] >= 0) {
+      trace_chains(i);
+    }
+  }
+  // whatever is left are closed loops without junctions, start each one at an arbitrary vertex
+  for (int i = 0; i < num_points; i++) {
+    if (junction_ids[i] < 0 && locations_[i].chain < 0) {
+      add_junction(i);
+      trace_chains(i);
+    }
+  }
+
+  // distances between all junctions over the chains
+  std::vector<std::vector<std::pair<int, double>>> neighbors(num_junctions);
+  for (const auto& edge : edges) {
+    neighbors[edge.from].push_back({edge.to, edge.length});
+    neighbors[edge.to].push_back({edge.from, edge.length});
+  }
+  junction_distances_.setConstant(num_junctions, num_junctions, infinity);
+  using QueueEntry = std::pair<double, int>;
+  for (int source = 0; source < num_junctions; source++) {
+    auto distances = junction_distances_.col(source);
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+    distances[source] = 0;
+    queue.push({0, source});
+    while (!queue.empty()) {
+      const auto [distance, junction] = queue.top();
+      queue.pop();
+      if (distance > distances[junction]) {
+        continue;
+      }
+      for (const auto& [neighbor, length] : neighbors[junction]) {
+        if (distance + length < distances[neighbor]) {
+          distances[neighbor] = distance + length;
+          queue.push({distances[neighbor], neighbor});
+        }
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+double ContourGeodesics::Distance(int i, int j) const {
+  if (i == j) {
+    return 0;
+  }
+  const auto& a = locations_[i];
+  const auto& b = locations_[j];
+
+  double shortest = std::numeric_limits<double>::infinity();
+  if (a.chain >= 0 && a.chain == b.chain) {
+    shortest = std::abs(a.arc_length - b.arc_length);
+  }
+
+  // otherwise leave through either end of each chain
+  const int ends_a = a.chain >= 0 ? 2 : 1;
+  const int ends_b = b.chain >= 0 ? 2 : 1;
+  for (int end_a = 0; end_a < ends_a; end_a++) {
+    for (int end_b = 0; end_b < ends_b; end_b++) {
+      const double distance =
+          a.distances[end_a] + junction_distances_(a.junctions[end_a], b.junctions[end_b]) + b.distances[end_b];
+      shortest = std::min(shortest, distance);
+    }
+  }
+  return shortest;
+}
+
+}  // namespace shapeworks
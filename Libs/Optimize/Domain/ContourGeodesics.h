@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <array>
+#include <vector>
+
+namespace shapeworks {
+
+/**
+ * \class ContourGeodesics
+ *
+ * Exact shortest path distances between the vertices of a polyline network (e.g. a contour), along its lines.
+ *
+ * The lines are split into chains: maximal runs between junctions, where a junction is any vertex that does not
+ * have exactly two lines (ends and branch points).  A closed loop without junctions gets one of its vertices as a
+ * junction.  Each vertex stores its chain and its arc length along it, and the junctions are connected by a small
+ * graph whose edges are the chains.  Distances between all junctions are computed up front, after which the distance
+ * between any two vertices is the direct arc length along a shared chain or the best of at most four routes through
+ * the ends of their chains.  Memory is linear in the number of vertices plus quadratic in the number of junctions,
+ * instead of quadratic in the number of vertices.
+ */
+class ContourGeodesics {
+ public:
+  ContourGeodesics() = default;
+
+  //! Build for points ([N x 3]) connected by lines (pairs of point ids)
+  ContourGeodesics(const Eigen::MatrixXd& points, const std::vector<std::array<int, 2>>& lines);
+
+  //! Shortest distance along the lines from vertex i to vertex j, infinity if they are not connected
+  double Distance(int i, int j) const;
+
+  int NumberOfJunctions() const { return junction_distances_.rows(); }
+
+ private:
+  //! Where a vertex sits: on a chain at an arc length, or on a junction (chain -1)
+  struct Location {
+    int chain = -1;
+    double arc_length = 0;
+    //! Junction at each end of the chain and the distance to it (a junction vertex only uses the first)
+    std::array<int, 2> junctions{{-1, -1}};
+    std::array<double, 2> distances{{0, 0}};
+  };
+
+  std::vector<Location> locations_;
+  std::vector<double> chain_lengths_;
+  Eigen::MatrixXd junction_distances_;
+};
+
+}  // namespace shapeworks
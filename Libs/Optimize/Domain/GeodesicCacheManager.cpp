@@ -0,0 +1,51 @@
+#include "GeodesicCacheManager.h"
+
+#include <algorithm>
+
+namespace shapeworks {
+
+//---------------------------------------------------------------------------
+GeodesicCacheManager& GeodesicCacheManager::Instance() {
+  static GeodesicCacheManager instance;
+  return instance;
+}
+
+//---------------------------------------------------------------------------
+size_t GeodesicCacheManager::GetFairShare() const { return budget_ / std::max<size_t>(1, num_meshes_); }
+
+//---------------------------------------------------------------------------
+bool GeodesicCacheManager::IsOverBudget() const {
+  const size_t budget = budget_;
+  return budget > 0 && bytes_in_use_ > budget;
+}
+
+//---------------------------------------------------------------------------
+void GeodesicCacheManager::AddBytes(size_t bytes) {
+  const size_t in_use = bytes_in_use_ += bytes;
+  size_t peak = peak_bytes_;
+  while (in_use > peak && !peak_bytes_.compare_exchange_weak(peak, in_use)) {
+  }
+}
+
+//---------------------------------------------------------------------------
+GeodesicCacheManager::Stats GeodesicCacheManager::GetStats() const {
+  Stats stats;
+  stats.hits = hits_;
+  stats.misses = misses_;
+  stats.evictions = evictions_;
+  stats.bytes_in_use = bytes_in_use_;
+  stats.peak_bytes = peak_bytes_;
+  stats.budget = budget_;
+  stats.num_meshes = num_meshes_;
+  return stats;
+}
+
+//---------------------------------------------------------------------------
+void GeodesicCacheManager::ResetStats() {
+  hits_ = 0;
+  misses_ = 0;
+  evictions_ = 0;
+  peak_bytes_ = size_t(bytes_in_use_);
+}
+
+}  // namespace shapeworks
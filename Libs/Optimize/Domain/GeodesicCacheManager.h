@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace shapeworks {
+
+/**
+ * \class GeodesicCacheManager
+ *
+ * Process-wide bookkeeping for the geodesic distance caches of all MeshWrapper instances.
+ *
+ * Each MeshWrapper owns its cache and evicts its own least recently used entries, so no mesh ever touches another
+ * mesh's cache while the shapes are optimized in parallel.  The manager holds the global byte budget and the totals
+ * that the meshes report: when the total exceeds the budget, every mesh that adds an entry evicts down to its fair
+ * share (budget / number of meshes).  This bounds the memory of the whole process regardless of how many shapes are
+ * optimized at once.
+ */
+class GeodesicCacheManager {
+ public:
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t bytes_in_use = 0;
+    size_t peak_bytes = 0;
+    size_t budget = 0;
+    size_t num_meshes = 0;
+  };
+
+  static GeodesicCacheManager& Instance();
+
+  //! Set the global budget in bytes.  0 disables the global budget, leaving only the per mesh limits
+  void SetBudget(size_t bytes) { budget_ = bytes; }
+  size_t GetBudget() const { return budget_; }
+
+  //! Bytes a single mesh may keep while the process is over budget
+  size_t GetFairShare() const;
+
+  bool IsOverBudget() const;
+
+  void RegisterMesh() { num_meshes_++; }
+  void UnregisterMesh() { num_meshes_--; }
+
+  void AddBytes(size_t bytes);
+  void RemoveBytes(size_t bytes) { bytes_in_use_ -= bytes; }
+
+  //! Meshes count lookups locally and publish them in batches to keep atomics out of the hot path
+  void AddLookups(size_t hits, size_t misses) {
+    hits_ += hits;
+    misses_ += misses;
+  }
+  void AddEvictions(size_t evictions) { evictions_ += evictions; }
+
+  Stats GetStats() const;
+
+  //! Reset the counters and the peak (bytes in use are left untouched)
+  void ResetStats();
+
+ private:
+  GeodesicCacheManager() = default;
+
+  std::atomic<size_t> budget_{0};
+  std::atomic<size_t> num_meshes_{0};
+  std::atomic<size_t> bytes_in_use_{0};
+  std::atomic<size_t> peak_bytes_{0};
+  std::atomic<size_t> hits_{0};
+  std::atomic<size_t> misses_{0};
+  std::atomic<size_t> evictions_{0};
+};
+
+}  // namespace shapeworks
@@ -77,6 +77,19 @@ class MeshDomain : public ParticleDomain {
 
   std::shared_ptr<Mesh> GetSWMesh() const { return sw_mesh_; }
 
+  //! Return the mesh wrapper, null for a fixed domain
+  std::shared_ptr<MeshWrapper> GetMeshWrapper() const { return mesh_wrapper_; }
+
+  //! Publish the geodesic cache statistics of the meshes of this domain (see MeshWrapper::FlushGeodesicCacheStats)
+  void FlushGeodesicCacheStats() const {
+    if (mesh_wrapper_) {
+      mesh_wrapper_->FlushGeodesicCacheStats();
+    }
+    if (geodesics_mesh_ && geodesics_mesh_ != mesh_wrapper_) {
+      geodesics_mesh_->FlushGeodesicCacheStats();
+    }
+  }
+
   void UpdateZeroCrossingPoint() override {}
 
  private:
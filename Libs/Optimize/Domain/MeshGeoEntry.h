@@ -44,6 +44,17 @@ struct MeshGeoEntry {
     max_dist = std::max({max0, max1, max2});
   }
 
+  // approximate heap memory held by this entry. The flat map stores its slots inline, plus one info byte per slot
+  size_t memory_bytes() const {
+    if (is_full_mode()) {
+      return 3 * data_full[0].size() * sizeof(double);
+    }
+    if (data_partial.empty()) {
+      return 0;
+    }
+    return (data_partial.mask() + 1) * (sizeof(std::pair<int, Eigen::Vector3d>) + 1);
+  }
+
   bool has_entry(int target) {
     return is_full_mode() || data_partial.find(target) != data_partial.end();
   }
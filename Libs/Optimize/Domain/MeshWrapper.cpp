@@ -15,6 +15,7 @@
 #include <vtkTriangleFilter.h>
 
 #include "ExternalLibs/robin_hood/robin_hood.h"
+#include "GeodesicCacheManager.h"
 
 namespace shapeworks {
 
@@ -111,9 +112,31 @@ MeshWrapper::MeshWrapper(vtkSmartPointer<vtkPolyData> poly_data, bool is_geodesi
     // the caller provides how many times the number of triangles entries should be stored in cache
     this->geo_max_cache_entries_ = geodesics_cache_size_multiplier * this->triangles_.size();
     this->PrecomputeGeodesics(V, F);
+    GeodesicCacheManager::Instance().RegisterMesh();
   }
 }
 
+//---------------------------------------------------------------------------
+MeshWrapper::~MeshWrapper() {
+  if (is_geodesics_enabled_) {
+    auto& manager = GeodesicCacheManager::Instance();
+    manager.AddLookups(geo_hits_, geo_misses_);
+    manager.RemoveBytes(geo_cache_bytes_);
+    manager.UnregisterMesh();
+  }
+}
+
+//---------------------------------------------------------------------------
+void MeshWrapper::FlushGeodesicCacheStats() const {
+  if (!is_geodesics_enabled_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(geo_mutex_);
+  GeodesicCacheManager::Instance().AddLookups(geo_hits_, geo_misses_);
+  geo_hits_ = 0;
+  geo_misses_ = 0;
+}
+
 //---------------------------------------------------------------------------
 double MeshWrapper::ComputeDistance(const PointType& pt_a, int idx_a, const PointType& pt_b, int idx_b,
                                     VectorType* out_grad) const {
@@ -153,19 +176,27 @@ double MeshWrapper::ComputeDistance(const PointType& pt_a, int idx_a, const Poin
   const auto vb1 = faces[face_b]->GetPointId(1);
   const auto vb2 = faces[face_b]->GetPointId(2);
 
-  // Ensure we have geodesics available in the cache. This will resize the cache to fit face_b or max_dist, whichever
-  // is greater. We do this pre-emptively since GeodesicsFromTriangleToTriangle would pull geodesics to every point
-  // into the cache if face_b is not found. 1.5 is an heuristic to pull in a little more than we need
-  if (!geo_dist_cache_[face_a].has_entry(face_b)) {
-    const double max_dist =
-        idx_a >= 0 ? this->particle_neighboorhood_[idx_a] * 1.5 : std::numeric_limits<double>::infinity();
-    GeodesicsFromTriangle(face_a, max_dist, face_b);
-  }
+  Eigen::Matrix3d geo_from_a;
+  {
+    std::lock_guard<std::mutex> lock(geo_mutex_);
+
+    // Ensure we have geodesics available in the cache. This will resize the cache to fit face_b or max_dist,
+    // whichever is greater. We do this pre-emptively since GeodesicsFromTriangleToTriangle would pull geodesics to
+    // every point into the cache if face_b is not found. 1.5 is an heuristic to pull in a little more than we need
+    if (!geo_dist_cache_[face_a].has_entry(face_b)) {
+      const double max_dist = idx_a >= 0 ? particle_cache_[idx_a].neighborhood.load(std::memory_order_relaxed) * 1.5
+                                         : std::numeric_limits<double>::infinity();
+      GeodesicsFromTriangle(face_a, max_dist, face_b);
+    } else {
+      geo_hits_++;
+      TouchGeoEntry(face_a);
+    }
 
-  // Compute geodesic distance via barycentric approximation
-  // Geometric Correspondence for Ensembles of Nonregular Shapes, Datar et al
-  // https://www.ncbi.nlm.nih.gov/pmc/articles/PMC3346950/
-  const Eigen::Matrix3d geo_from_a = GeodesicsFromTriangleToTriangle(face_a, face_b);
+    // Compute geodesic distance via barycentric approximation
+    // Geometric Correspondence for Ensembles of Nonregular Shapes, Datar et al
+    // https://www.ncbi.nlm.nih.gov/pmc/articles/PMC3346950/
+    geo_from_a = GeodesicsFromTriangleToTriangle(face_a, face_b);
+  }
   const Eigen::Vector3d geo_to_b = geo_from_a * bary_b;
   const double geo_dist = bary_a.dot(geo_to_b);
 
@@ -191,16 +222,19 @@ double MeshWrapper::ComputeDistance(const PointType& pt_a, int idx_a, const Poin
 // Fetches face/triangle index and barycentric coordinates of point in face,
 // caching or retrieving results from cache if already cached.
 void MeshWrapper::FetchAndCacheFirstPoint(const PointType pt_a, int idx_a, int& face_a, vec3& bary_a) const {
-  if (geo_lq_cached_ && pt_a == geo_lq_pt_a_) {
-    face_a = geo_lq_face_;
-    bary_a = geo_lq_bary_;
+  auto& context = query_contexts_.local();
+  const size_t epoch = geo_lq_epoch_.load(std::memory_order_acquire);
+  if (context.geo_lq_cached && context.geo_lq_epoch == epoch && pt_a == context.geo_lq_pt_a) {
+    face_a = context.geo_lq_face;
+    bary_a = context.geo_lq_bary;
   } else {
     face_a = ComputeFaceAndWeights(pt_a, idx_a, bary_a);
 
-    geo_lq_cached_ = true;
-    geo_lq_face_ = face_a;
-    geo_lq_bary_ = bary_a;
-    geo_lq_pt_a_ = pt_a;
+    context.geo_lq_cached = true;
+    context.geo_lq_epoch = epoch;
+    context.geo_lq_face = face_a;
+    context.geo_lq_bary = bary_a;
+    context.geo_lq_pt_a = pt_a;
   }
 }
 
@@ -213,10 +247,7 @@ bool MeshWrapper::IsWithinDistance(const PointType& pt_a, int idx_a, const Point
   }
 
   if (idx_a != -1) {
-    if (particle_neighboorhood_.size() <= idx_a) {
-      particle_neighboorhood_.resize(idx_a + 1);
-    }
-    particle_neighboorhood_[idx_a] = test_dist;
+    particle_cache_[idx_a].neighborhood.store(test_dist, std::memory_order_relaxed);
   }
 
   int face_a, face_b;
@@ -234,6 +265,8 @@ bool MeshWrapper::IsWithinDistance(const PointType& pt_a, int idx_a, const Point
   const auto vb1 = this->triangles_[face_b]->GetPointId(1);
   const auto vb2 = this->triangles_[face_b]->GetPointId(2);
 
+  std::lock_guard<std::mutex> lock(geo_mutex_);
+
   // 1.5 is an heuristic to pull in a little more than we need
   const auto& geo_entry = GeodesicsFromTriangle(face_a, test_dist * 1.5);
 
@@ -285,12 +318,8 @@ PointType MeshWrapper::GeodesicWalk(PointType p, int idx, VectorType vector) con
 
   // update cache
   if (idx >= 0 && ending_face >= 0) {
-    if (idx >= particle_triangles_.size()) {
-      particle_triangles_.resize(idx + 1, -1);
-    }
-
-    particle_triangles_[idx] = ending_face;
-    geo_lq_cached_ = false;
+    particle_cache_[idx].triangle.store(ending_face, std::memory_order_relaxed);
+    geo_lq_epoch_++;
 
     this->CalculateNormalAtPoint(new_point_pt, idx);
   }
@@ -318,9 +347,7 @@ VectorType MeshWrapper::ProjectVectorToSurfaceTangent(const PointType& pointa, i
 
   int faceIndex = this->GetTriangleForPoint(point, idx, closest_point);
 
-  double* normal = this->poly_data_->GetCellData()->GetNormals()->GetTuple(faceIndex);
-
-  Eigen::Vector3d vec_normal = convert<double*, vec3>(normal);
+  Eigen::Vector3d vec_normal = GetFaceNormal(faceIndex);
   Eigen::Vector3d vec_vector = convert<VectorType&, vec3>(vector);
 
   Eigen::Vector3d result = this->ProjectVectorToFace(vec_normal, vec_vector);
@@ -331,10 +358,11 @@ VectorType MeshWrapper::ProjectVectorToSurfaceTangent(const PointType& pointa, i
 //---------------------------------------------------------------------------
 NormalType MeshWrapper::SampleNormalAtPoint(PointType p, int idx) const {
   // if the particle is not in the cache or it has changed position, we must recompute
-  if (idx < 0 || idx >= this->particle_normals_.size() || p != this->particle_positions_[idx]) {
-    return this->CalculateNormalAtPoint(p, idx);
+  NormalType normal;
+  if (idx >= 0 && particle_cache_[idx].GetNormal(p, normal)) {
+    return normal;
   }
-  return this->particle_normals_[idx];
+  return this->CalculateNormalAtPoint(p, idx);
 }
 
 //---------------------------------------------------------------------------
@@ -371,12 +399,7 @@ PointType MeshWrapper::GetPointOnMesh() const {
 int MeshWrapper::GetTriangleForPoint(const double pt[3], int idx, double closest_point[3]) const {
   // given a guess, just check whether it is still valid.
   if (idx >= 0) {
-    // ensure that the cache has enough elements. this will never be resized to more than the number of particles,
-    if (idx >= particle_triangles_.size()) {
-      particle_triangles_.resize(idx + 1, -1);
-    }
-
-    const int guess = particle_triangles_[idx];
+    const int guess = particle_cache_[idx].triangle.load(std::memory_order_relaxed);
 
     if (guess != -1 && this->IsInTriangle(pt, guess)) {
       closest_point[0] = pt[0];
@@ -391,11 +414,14 @@ int MeshWrapper::GetTriangleForPoint(const double pt[3], int idx, double closest
   vtkIdType cell_id;           // the cell id of the cell containing the closest point will be returned here
   int sub_id;                  // this is rarely used (in triangle strips only, I believe)
 
-  this->cell_locator_->FindClosestPoint(pt, closest_point, cell_id, sub_id, closest_point_dist2);
+  {
+    std::lock_guard<std::mutex> lock(cell_locator_mutex_);
+    this->cell_locator_->FindClosestPoint(pt, closest_point, cell_id, sub_id, closest_point_dist2);
+  }
 
   if (idx >= 0) {
-    // update cache, no need to check size as it was already checked above
-    particle_triangles_[idx] = cell_id;
+    // update cache
+    particle_cache_[idx].triangle.store(cell_id, std::memory_order_relaxed);
   }
 
   assert(cell_id >= 0);
@@ -509,9 +535,9 @@ Eigen::Vector3d MeshWrapper::ComputeBarycentricCoordinates(const Eigen::Vector3d
 
 //---------------------------------------------------------------------------
 const Eigen::Vector3d MeshWrapper::GetFaceNormal(int face_index) const {
-  auto normals = this->poly_data_->GetCellData()->GetNormals();
-  double* normal = normals->GetTuple(face_index);
-  Eigen::Vector3d n(normal[0], normal[1], normal[2]);
+  // the pointer returning GetTuple shares a scratch buffer between callers, so copy into our own
+  Eigen::Vector3d n;
+  this->poly_data_->GetCellData()->GetNormals()->GetTuple(face_index, n.data());
   return n;
 }
 
@@ -646,12 +672,13 @@ Eigen::Vector3d MeshWrapper::GetBarycentricIntersection(Eigen::Vector3d start, E
   double ratio = -start[edge] / delta[edge];
   vec3 intersect = start + delta * ratio;
 
-  auto cell = this->poly_data_->GetCell(currentFace);
+  // use the cached triangle, vtkPolyData::GetCell returns a cell object shared between callers
+  const auto& points = this->triangles_[currentFace]->GetPoints();
 
   vec3 inter(0, 0, 0);
   for (int q = 0; q < 3; q++) {
-    auto point = cell->GetPoints()->GetPoint(q);
-    vec3 p(point[0], point[1], point[2]);
+    vec3 p;
+    points->GetPoint(q, p.data());
     inter += p * intersect[q];
   }
   return inter;
@@ -717,14 +744,13 @@ int MeshWrapper::SlideAlongEdge(Eigen::Vector3d& point, Eigen::Vector3d& remaini
 }
 
 //---------------------------------------------------------------------------
-int MeshWrapper::GetFacePointID(int face, int point_id) const {
-  return this->poly_data_->GetCell(face)->GetPointId(point_id);
-}
+int MeshWrapper::GetFacePointID(int face, int point_id) const { return this->triangles_[face]->GetPointId(point_id); }
 
 //---------------------------------------------------------------------------
 Eigen::Vector3d MeshWrapper::GetVertexCoords(int vertex_id) const {
-  double* p = this->poly_data_->GetPoint(vertex_id);
-  return Eigen::Vector3d(p[0], p[1], p[2]);
+  Eigen::Vector3d p;
+  this->poly_data_->GetPoint(vertex_id, p.data());
+  return p;
 }
 
 //---------------------------------------------------------------------------
@@ -748,21 +774,18 @@ NormalType MeshWrapper::CalculateNormalAtPoint(PointType p, int idx) const {
 
   NormalType weighted_normal(0, 0, 0);
 
+  auto normals = this->poly_data_->GetPointData()->GetNormals();
   for (int i = 0; i < 3; i++) {
     auto id = this->triangles_[face_index]->GetPointId(i);
-    double* normal = this->poly_data_->GetPointData()->GetNormals()->GetTuple(id);
+    double normal[3];
+    normals->GetTuple(id, normal);
     weighted_normal[0] = weighted_normal[0] + normal[0] * weights[i];
     weighted_normal[1] = weighted_normal[1] + normal[1] * weights[i];
     weighted_normal[2] = weighted_normal[2] + normal[2] * weights[i];
   }
 
   if (idx >= 0) {  // cache
-    if (idx >= this->particle_normals_.size()) {
-      this->particle_normals_.resize(idx + 1);
-      this->particle_positions_.resize(idx + 1);
-    }
-    this->particle_positions_[idx] = p;
-    this->particle_normals_[idx] = weighted_normal;
+    particle_cache_[idx].SetNormal(p, weighted_normal);
   }
 
   return weighted_normal;
@@ -771,11 +794,8 @@ NormalType MeshWrapper::CalculateNormalAtPoint(PointType p, int idx) const {
 //---------------------------------------------------------------------------
 void MeshWrapper::InvalidateParticle(int idx) {
   assert(idx >= 0);  // should always be passed a valid particle
-  if (idx >= particle_triangles_.size()) {
-    particle_triangles_.resize(idx + 1, -1);
-  }
-  this->particle_triangles_[idx] = -1;
-  this->geo_lq_cached_ = false;
+  particle_cache_[idx].triangle.store(-1, std::memory_order_relaxed);
+  geo_lq_epoch_++;
 }
 
 //---------------------------------------------------------------------------
@@ -816,6 +836,8 @@ void MeshWrapper::GetIGLMesh(Eigen::MatrixXd& V, Eigen::MatrixXi& F) const {
 void MeshWrapper::PrecomputeGeodesics(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F) {
   // Resize cache to correct size
   geo_dist_cache_.resize(F.rows());
+  geo_lru_prev_.assign(F.rows(), -2);
+  geo_lru_next_.assign(F.rows(), -1);
 
   // Compute gradient operator
   Eigen::SparseMatrix<double> G;
@@ -864,22 +886,28 @@ bool MeshWrapper::AreFacesInKRing(int f_a, int f_b) const {
 
 //---------------------------------------------------------------------------
 const MeshGeoEntry& MeshWrapper::GeodesicsFromTriangle(int f, double max_dist, int req_target_f) const {
-  if (geo_cache_size_ >= geo_max_cache_entries_) {
-    this->ClearGeodesicCache();
-  }
-
   auto& entry = geo_dist_cache_[f];
-  if (entry.is_full_mode()) {
+  if (entry.is_full_mode() || entry.max_dist >= max_dist) {
+    geo_hits_++;
+    TouchGeoEntry(f);
     return entry;
   }
 
-  if (entry.max_dist >= max_dist) {
-    return entry;
-  }
-
-  geo_cache_size_ -= entry.data_partial.size();
+  geo_misses_++;
+  UntrackGeoEntry(f);
   entry.data_partial.clear();
 
+  // account for the new entry, then make room for it. The entry itself is never evicted here since the caller is
+  // about to read it
+  const auto finish = [&]() -> const MeshGeoEntry& {
+    TrackGeoEntry(f);
+    EvictGeodesics(f);
+    GeodesicCacheManager::Instance().AddLookups(geo_hits_, geo_misses_);
+    geo_hits_ = 0;
+    geo_misses_ = 0;
+    return entry;
+  };
+
   const auto n_verts = this->poly_data_->GetNumberOfPoints();
 
   const auto which_vert_of_tri = [&](int tri, int v) {
@@ -933,8 +961,7 @@ const MeshGeoEntry& MeshWrapper::GeodesicsFromTriangle(int f, double max_dist, i
     entry.data_full[1] = std::move(dists[1]);
     entry.data_full[2] = std::move(dists[2]);
     entry.update_max_dist();
-    geo_cache_size_ += n_verts;
-    return entry;
+    return finish();
   }
 
   if (req_target_f >= 0) {
@@ -979,8 +1006,7 @@ const MeshGeoEntry& MeshWrapper::GeodesicsFromTriangle(int f, double max_dist, i
     entry.data_full[1] = std::move(dists[1]);
     entry.data_full[2] = std::move(dists[2]);
     entry.update_max_dist();
-    geo_cache_size_ += n_verts;
-    return entry;
+    return finish();
   }
 
   for (auto v : needed_points) {
@@ -991,9 +1017,8 @@ const MeshGeoEntry& MeshWrapper::GeodesicsFromTriangle(int f, double max_dist, i
     entry.data_partial[v] = {d0, d1, d2};
   }
 
-  geo_cache_size_ += entry.data_partial.size();
   entry.max_dist = new_max_dist;
-  return entry;
+  return finish();
 }
 
 //---------------------------------------------------------------------------
@@ -1033,37 +1058,95 @@ const Eigen::Matrix3d MeshWrapper::GeodesicsFromTriangleToTriangle(int f_a, int
 }
 
 //---------------------------------------------------------------------------
-void MeshWrapper::ClearGeodesicCache() const {
-  const auto n_verts = this->poly_data_->GetNumberOfPoints();
+static size_t num_geo_records(const MeshGeoEntry& entry) {
+  return entry.is_full_mode() ? entry.data_full[0].size() : entry.data_partial.size();
+}
 
-  // figure out which triangle each particle is on
-  robin_hood::unordered_set<int> active_triangles(particle_triangles_.begin(), particle_triangles_.end());
-  size_t new_cache_size = 0;
+//---------------------------------------------------------------------------
+void MeshWrapper::TrackGeoEntry(int f) const {
+  const auto& entry = geo_dist_cache_[f];
+  const size_t bytes = entry.memory_bytes();
+  geo_cache_size_ += num_geo_records(entry);
+  geo_cache_bytes_ += bytes;
+  GeodesicCacheManager::Instance().AddBytes(bytes);
+
+  geo_lru_prev_[f] = -1;
+  geo_lru_next_[f] = geo_lru_head_;
+  if (geo_lru_head_ >= 0) {
+    geo_lru_prev_[geo_lru_head_] = f;
+  } else {
+    geo_lru_tail_ = f;
+  }
+  geo_lru_head_ = f;
+}
 
-  // clear entries only if no particle is on that triangle. (this is significantly more performant than clearing
-  // everything)
-  for (int i = 0; i < geo_dist_cache_.size(); i++) {
-    auto& entry = geo_dist_cache_[i];
-    if (active_triangles.find(i) == active_triangles.end()) {
-      entry.clear();
-    } else {
-      new_cache_size += entry.is_full_mode() ? n_verts : entry.data_partial.size();
-    }
+//---------------------------------------------------------------------------
+void MeshWrapper::UntrackGeoEntry(int f) const {
+  if (geo_lru_prev_[f] == -2) {
+    return;
+  }
+  const auto& entry = geo_dist_cache_[f];
+  const size_t bytes = entry.memory_bytes();
+  geo_cache_size_ -= num_geo_records(entry);
+  geo_cache_bytes_ -= bytes;
+  GeodesicCacheManager::Instance().RemoveBytes(bytes);
+
+  const int prev = geo_lru_prev_[f];
+  const int next = geo_lru_next_[f];
+  if (prev >= 0) {
+    geo_lru_next_[prev] = next;
+  } else {
+    geo_lru_head_ = next;
+  }
+  if (next >= 0) {
+    geo_lru_prev_[next] = prev;
+  } else {
+    geo_lru_tail_ = prev;
   }
+  geo_lru_prev_[f] = -2;
+  geo_lru_next_[f] = -1;
+}
 
-  // the cache is not large enough to store the subset that we know is required. we are forced to clear everything
-  if (new_cache_size > geo_max_cache_entries_) {
-    std::cerr << "Warning: Cache entries too small, clearing everything. Consider increasing cache size if this "
-                 "happens repeatedly\n";
-    for (auto i : active_triangles) {
-      if (i >= 0) {
-        geo_dist_cache_[i].clear();
-      }
-    }
-    new_cache_size = 0;
+//---------------------------------------------------------------------------
+void MeshWrapper::TouchGeoEntry(int f) const {
+  if (geo_lru_prev_[f] < 0) {
+    // already at the head, or not cached
+    return;
   }
 
-  geo_cache_size_ = new_cache_size;
+  // unlink (f is not the head, so prev is valid) and relink at the head
+  const int prev = geo_lru_prev_[f];
+  const int next = geo_lru_next_[f];
+  geo_lru_next_[prev] = next;
+  if (next >= 0) {
+    geo_lru_prev_[next] = prev;
+  } else {
+    geo_lru_tail_ = prev;
+  }
+  geo_lru_prev_[f] = -1;
+  geo_lru_next_[f] = geo_lru_head_;
+  geo_lru_prev_[geo_lru_head_] = f;
+  geo_lru_head_ = f;
+}
+
+//---------------------------------------------------------------------------
+void MeshWrapper::EvictGeodesics(int keep_f) const {
+  auto& manager = GeodesicCacheManager::Instance();
+  size_t evictions = 0;
+  while (geo_lru_tail_ >= 0 && geo_lru_tail_ != keep_f) {
+    const bool over_limit = geo_cache_size_ > geo_max_cache_entries_;
+    const bool over_budget = manager.IsOverBudget() && geo_cache_bytes_ > manager.GetFairShare();
+    if (!over_limit && !over_budget) {
+      break;
+    }
+    const int f = geo_lru_tail_;
+    UntrackGeoEntry(f);
+    geo_dist_cache_[f].clear();
+    evictions++;
+  }
+  if (evictions > 0) {
+    manager.AddEvictions(evictions);
+  }
 }
 
 //---------------------------------------------------------------------------
@@ -6,9 +6,13 @@
 #include <vtkPolyData.h>
 #include <vtkSmartPointer.h>
 
+#include <atomic>
+#include <mutex>
+#include <tbb/enumerable_thread_specific.h>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "Libs/Optimize/Container/ConcurrentSlotArray.h"
 #include "Libs/Optimize/Domain/ParticleDomain.h"
 #include "MeshGeoEntry.h"
 #include "MeshWrapper.h"
@@ -17,6 +21,12 @@ class vtkCellLocator;
 
 namespace shapeworks {
 
+/**
+ * The query API (ComputeDistance, IsWithinDistance, SampleNormalAtPoint, SampleGradNAtPoint, GeodesicWalk,
+ * ProjectVectorToSurfaceTangent, SnapToMesh) is re-entrant: several threads may query the same mesh at once, as long as
+ * no two threads move the same particle index at the same time.  Geodesic lookups are re-entrant but not concurrent:
+ * the geodesic cache is shared per mesh and guarded by a single lock.
+ */
 class MeshWrapper {
  public:
   using PointType = ParticleDomain::PointType;
@@ -28,7 +38,7 @@ class MeshWrapper {
   explicit MeshWrapper(vtkSmartPointer<vtkPolyData> mesh, bool geodesics_enabled = false,
                        size_t geodesics_cache_multiplier_size = 0);  // 0 => MeshWrapper will choose a heuristic
 
-  ~MeshWrapper() = default;
+  ~MeshWrapper();
 
   double ComputeDistance(const PointType& pointa, int idxa, const PointType& pointb, int idxb,
                          VectorType* out_grad = nullptr) const;
@@ -57,6 +67,9 @@ class MeshWrapper {
 
   bool IsGeodesicsEnabled() const { return this->is_geodesics_enabled_; }
 
+  //! Publish the geodesic cache hits and misses counted since the last miss to the GeodesicCacheManager
+  void FlushGeodesicCacheStats() const;
+
  private:
   void ComputeMeshBounds();
   void ComputeGradN(const Eigen::MatrixXd& V, const Eigen::MatrixXi& F);
@@ -95,12 +108,38 @@ class MeshWrapper {
 
   NormalType CalculateNormalAtPoint(MeshWrapper::PointType p, int idx) const;
 
-  // Caches of triangle, normal and position
-  // Has to be mutable because all of the accessor APIs are const
-  mutable std::vector<int> particle_triangles_;
-  mutable std::vector<NormalType> particle_normals_;
-  mutable std::vector<PointType> particle_positions_;
-  mutable std::vector<double> particle_neighboorhood_;
+  // Per particle cache of triangle, normal (at the position it was computed for) and neighborhood radius, shared by
+  // all threads. The triangle is only a hint that is verified before use, so it is a relaxed atomic; the normal and
+  // position must be read and written together and are guarded by a per particle spin lock
+  struct ParticleCacheEntry {
+    std::atomic<int> triangle{-1};
+    std::atomic<double> neighborhood{0.0};
+    std::atomic_flag normal_lock = ATOMIC_FLAG_INIT;
+    bool has_normal{false};
+    PointType position;
+    NormalType normal;
+
+    bool GetNormal(const PointType& p, NormalType& n) {
+      while (normal_lock.test_and_set(std::memory_order_acquire)) {
+      }
+      const bool found = has_normal && position == p;
+      if (found) {
+        n = normal;
+      }
+      normal_lock.clear(std::memory_order_release);
+      return found;
+    }
+
+    void SetNormal(const PointType& p, const NormalType& n) {
+      while (normal_lock.test_and_set(std::memory_order_acquire)) {
+      }
+      has_normal = true;
+      position = p;
+      normal = n;
+      normal_lock.clear(std::memory_order_release);
+    }
+  };
+  ConcurrentSlotArray<ParticleCacheEntry> particle_cache_;
 
   std::vector<GradNType> grad_normals_;
 
@@ -111,8 +150,10 @@ class MeshWrapper {
   PointType mesh_lower_bound_;
   PointType mesh_upper_bound_;
 
-  // cell locator to find closest point on mesh
+  // cell locator to find closest point on mesh. vtkCellLocator keeps per query scratch state (VTK 9.1), so searches
+  // are serialized. The particle triangle hints make them rare during optimization
   vtkSmartPointer<vtkCellLocator> cell_locator_;
+  mutable std::mutex cell_locator_mutex_;
 
   /////////////////////////
   // Geodesic distances
@@ -126,15 +167,32 @@ class MeshWrapper {
 
   size_t geo_max_cache_entries_{0};
   mutable size_t geo_cache_size_{0};
+  mutable size_t geo_cache_bytes_{0};
 
   // Flattened version of libigl's gradient operator
   std::vector<Eigen::Matrix3d> face_grad_;
 
   std::vector<std::unordered_set<int>> face_kring_;
 
+  // Guards the geodesic cache, its LRU list and the heat solver. Taken once per query at the public entry points, so
+  // geodesic queries on one mesh run one at a time even during the intra-shape parallel sweep; only the euclidean
+  // shortcut for nearby faces and the triangle/normal lookups run concurrently
+  mutable std::mutex geo_mutex_;
+
   // Cache for geodesic distances from a triangle
   mutable std::vector<MeshGeoEntry> geo_dist_cache_;
 
+  // Intrusive LRU list over the non-empty entries of geo_dist_cache_, most recently used at the head.
+  // Unlinked entries have geo_lru_prev_ == -2
+  mutable std::vector<int> geo_lru_prev_;
+  mutable std::vector<int> geo_lru_next_;
+  mutable int geo_lru_head_{-1};
+  mutable int geo_lru_tail_{-1};
+
+  // Lookups not yet published to the GeodesicCacheManager
+  mutable size_t geo_hits_{0};
+  mutable size_t geo_misses_{0};
+
   // Returns true if face f_a is in the K-ring of face f_b
   bool AreFacesInKRing(int f_a, int f_b) const;
   const size_t kring_{1};
@@ -150,15 +208,29 @@ class MeshWrapper {
   const MeshGeoEntry& GeodesicsFromTriangle(int f, double max_dist = std::numeric_limits<double>::max(),
                                             int req_target_f = -1) const;
   const Eigen::Matrix3d GeodesicsFromTriangleToTriangle(int f_a, int f_b) const;
-  void ClearGeodesicCache() const;
 
-  // Store some info about the last query. This accelerates the computation
+  // Add entry f to the accounting and to the head of the LRU list, or remove it from both
+  void TrackGeoEntry(int f) const;
+  void UntrackGeoEntry(int f) const;
+  void TouchGeoEntry(int f) const;
+
+  // Evict least recently used entries (never keep_f) until this mesh is within its own limit and, if the process is
+  // over the global budget, within its fair share of it
+  void EvictGeodesics(int keep_f) const;
+
+  // Store some info about the last query of each thread. This accelerates the computation
   // because the optimizer generally asks for the distances _from_ the same
-  // point as the previous query.
-  mutable bool geo_lq_cached_{false};
-  mutable PointType geo_lq_pt_a_{-1};
-  mutable int geo_lq_face_{-1};
-  mutable Eigen::Vector3d geo_lq_bary_;
+  // point as the previous query. Moving or invalidating any particle bumps the epoch,
+  // which invalidates the last query of every thread
+  struct QueryContext {
+    bool geo_lq_cached{false};
+    size_t geo_lq_epoch{0};
+    PointType geo_lq_pt_a{-1};
+    int geo_lq_face{-1};
+    Eigen::Vector3d geo_lq_bary;
+  };
+  mutable tbb::enumerable_thread_specific<QueryContext> query_contexts_;
+  mutable std::atomic<size_t> geo_lq_epoch_{0};
   void FetchAndCacheFirstPoint(const PointType pt_a, int idx_a, int& face_a, Eigen::Vector3d& bary_a) const;
 };
 }  // namespace shapeworks
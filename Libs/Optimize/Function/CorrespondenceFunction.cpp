@@ -2,6 +2,9 @@
 #include "CorrespondenceFunction.h"
 
 #include <math.h>
+#include <tbb/parallel_for.h>
+
+#include <Eigen/Eigenvalues>
 
 #include "Libs/Utils/Utils.h"
 #include "vnl/algo/vnl_svd.h"
@@ -23,16 +26,17 @@ void CorrespondenceFunction::ComputeUpdates(const ParticleSystem* c) {
 
   m_PointsUpdate->fill(0.0);
 
-  vnl_matrix_type points_minus_mean(num_dims, num_samples, 0.0);
+  // vnl matrices are row major, so they are viewed through row major maps below
+  using RowMajorMap = Eigen::Map<FactorMatrixType>;
 
-  m_points_mean->clear();
+  vnl_matrix_type points_minus_mean(num_dims, num_samples);
   m_points_mean->set_size(num_dims, 1);
-  m_points_mean->fill(0.0);
 
-  for (unsigned int i = 0; i < num_dims; i++) {
-    m_points_mean->put(i, 0, (m_ShapeData->get_n_rows(i, 1)).mean());
-    points_minus_mean.set_row(i, m_ShapeData->get_row(i) - m_points_mean->get(i, 0));
-  }
+  const auto shape_data = m_ShapeData->GetEigenMap();
+  RowMajorMap mean(m_points_mean->data_block(), num_dims, 1);
+  RowMajorMap X(points_minus_mean.data_block(), num_dims, num_samples);
+  mean = shape_data.rowwise().mean();
+  X = shape_data.colwise() - mean.col(0);
 
   vnl_diag_matrix<double> W;
 
@@ -44,6 +48,33 @@ void CorrespondenceFunction::ComputeUpdates(const ParticleSystem* c) {
 
     m_InverseCovMatrix->setZero();
 
+  } else if (m_UseFactoredInverseCovariance) {
+    // The gram matrix is symmetric, so its eigendecomposition gives the same factors as the SVD.  Eigenvalues are
+    // sorted in decreasing order to match vnl_svd.
+    const Eigen::MatrixXd gram = X.transpose() * X;
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen_solver(gram);
+    const Eigen::VectorXd values = eigen_solver.eigenvalues().reverse().cwiseAbs();
+    const Eigen::MatrixXd UG = eigen_solver.eigenvectors().rowwise().reverse();
+
+    vnl_vector<double> w(num_samples);
+    for (int i = 0; i < num_samples; i++) {
+      w[i] = values(i);
+    }
+    W = vnl_diag_matrix<double>(w);
+
+    const Eigen::VectorXd invLambda =
+        ((values / (double)(num_samples - 1)).array() + m_MinimumVariance).inverse().matrix();
+
+    RowMajorMap(pinvMat.data_block(), num_samples, num_samples) =
+        UG * invLambda.asDiagonal() * UG.transpose();
+
+    // inverse covariance = (X * UG * invLambda) * (X * UG * invLambda)^T, only the left factor is kept
+    *m_InverseCovFactor = X * UG * invLambda.asDiagonal();
+
+    // release the dense matrix in case the mode was switched during the run
+    if (m_InverseCovMatrix->size() != 0) {
+      m_InverseCovMatrix->resize(0, 0);
+    }
   } else {
     gramMat = points_minus_mean.transpose() * points_minus_mean;
 
@@ -74,12 +105,15 @@ void CorrespondenceFunction::ComputeUpdates(const ParticleSystem* c) {
 
   // Compute the update matrix in coordinate space by multiplication with the
   // Jacobian.  Each shape gradient must be transformed by a different Jacobian
-  // so we have to do this individually for each shape (sample).
-
-  {
-    vnl_matrix_type Jmatrix;
-    vnl_matrix_type v;
-    for (int j = 0; j < num_samples; j++) {
+  // so we have to do this individually for each shape (sample).  Samples write
+  // disjoint columns of the update matrix, so they are processed in parallel.
+  const RowMajorMap Q_map(Q.data_block(), num_dims, num_samples);
+  const auto shape_gradient = m_ShapeGradient->GetEigenMap();
+  RowMajorMap points_update(m_PointsUpdate->data_block(), rows, num_samples);
+
+  tbb::parallel_for(tbb::blocked_range<int>{0, num_samples}, [&](const tbb::blocked_range<int>& r) {
+    for (int j = r.begin(); j < r.end(); j++) {
+      const auto q = Q_map.col(j);
       int num = 0;
       int num2 = 0;
       for (unsigned int d = 0; d < m_DomainsPerShape; d++) {
@@ -101,26 +135,22 @@ void CorrespondenceFunction::ComputeUpdates(const ParticleSystem* c) {
             num_attr += 3;
           }
 
-          Jmatrix.clear();
-          Jmatrix.set_size(num_attr, VDimension);
-          Jmatrix.fill(0.0);
-          v.clear();
-          v.set_size(num_attr, 1);
-          v.fill(0.0);
-
+          // dx = J^T * v for the num_attr x 3 Jacobian J and the num_attr entries v of each particle
+          Eigen::Vector3d dx;
           for (unsigned int p = 0; p < c->GetNumberOfParticles(dom); p++) {
-            v = Q.extract(num_attr, 1, num + p * num_attr, j);
-            Jmatrix = m_ShapeGradient->extract(num_attr, 3, num + p * num_attr, 3 * j);
-
-            vnl_matrix_type dx = Jmatrix.transpose() * v;
-            for (unsigned int vd = 0; vd < VDimension; vd++) {
-              m_PointsUpdate->put(num2 + p * VDimension + vd, j, dx(vd, 0));
+            const int row = num + p * num_attr;
+            if (num_attr == VDimension) {
+              dx.noalias() = shape_gradient.block<3, 3>(row, 3 * j).transpose() * q.segment<3>(row);
+            } else {
+              dx.noalias() = shape_gradient.block(row, 3 * j, num_attr, 3).transpose() * q.segment(row, num_attr);
             }
+            points_update.block<3, 1>(num2 + p * VDimension, j) = dx;
           }
         }
       }
     }
-  }
+  });
+
   m_CurrentEnergy = 0.0;
 
   if (m_UseMeanEnergy) {
@@ -167,30 +197,25 @@ CorrespondenceFunction::VectorType CorrespondenceFunction::Evaluate(unsigned int
     num += num1 * system->GetNumberOfParticles(i);
   }
 
-  vnl_matrix_type tmp1(sz_Yidx, sz_Yidx, 0.0);
+  const auto shape_data = m_ShapeData->GetEigenMap();
+  const Eigen::Map<const Eigen::VectorXd> mean(m_points_mean->data_block(), m_points_mean->rows());
 
   if (this->m_UseMeanEnergy) {
-    tmp1.set_identity();
+    // identity weighting
+    energy = (shape_data.col(sampNum).segment(num, sz_Yidx) - mean.segment(num, sz_Yidx)).squaredNorm();
   } else {
-    // extract 3x3 submatrix at k,k
-    Eigen::MatrixXd region = m_InverseCovMatrix->block(sz_Yidx, sz_Yidx, 3, 3);
-    // convert to vnl
-    for (unsigned int i = 0; i < 3; i++) {
-      for (unsigned int j = 0; j < 3; j++) {
-        tmp1(i, j) = region(i, j);
-      }
+    // only the 3x3 submatrix at k,k of the inverse covariance is used
+    Eigen::Matrix3d region;
+    if (m_UseFactoredInverseCovariance) {
+      const auto factor_rows = m_InverseCovFactor->middleRows(sz_Yidx, 3);
+      region.noalias() = factor_rows * factor_rows.transpose();
+    } else {
+      region = m_InverseCovMatrix->block<3, 3>(sz_Yidx, sz_Yidx);
     }
+    const Eigen::Vector3d y = shape_data.col(sampNum).segment<3>(num) - mean.segment<3>(num);
+    energy = y.dot(region * y);
   }
 
-  vnl_matrix_type Y_dom_idx(sz_Yidx, 1, 0.0);
-
-  Y_dom_idx = m_ShapeData->extract(sz_Yidx, 1, num, sampNum) - m_points_mean->extract(sz_Yidx, 1, num);
-
-  vnl_matrix_type tmp = Y_dom_idx.transpose() * tmp1;
-  tmp *= Y_dom_idx;
-
-  energy = tmp(0, 0);
-
   maxdt = m_MinimumEigenValue;
 
   num = 0;
@@ -107,6 +107,11 @@ class CorrespondenceFunction : public VectorFunction {
   void UseMeanEnergy() { m_UseMeanEnergy = true; }
   void UseEntropy() { m_UseMeanEnergy = false; }
 
+  /** Keep the inverse covariance as a D x N factor F with inverse covariance = F * F^T instead of the dense D x D
+      matrix.  Memory goes from O(D^2) to O(D*N) for D shape dimensions and N samples. */
+  void SetUseFactoredInverseCovariance(bool b) { m_UseFactoredInverseCovariance = b; }
+  bool GetUseFactoredInverseCovariance() const { return m_UseFactoredInverseCovariance; }
+
   void SetXYZ(int i, bool val) {
     if (m_UseXYZ.size() != m_DomainsPerShape) m_UseXYZ.resize(m_DomainsPerShape);
     m_UseXYZ[i] = val;
@@ -129,34 +134,37 @@ class CorrespondenceFunction : public VectorFunction {
     return flag;
   }
 
-  virtual VectorFunction::Pointer Clone() {
-    auto copy = CorrespondenceFunction::New();
-
-    // from itkParticleVectorFunction
-    copy->m_DomainNumber = this->m_DomainNumber;
-    copy->m_ParticleSystem = this->m_ParticleSystem;
+  virtual void UpdateFrom(const VectorFunction* function) {
+    Superclass::UpdateFrom(function);
+    auto other = static_cast<const CorrespondenceFunction*>(function);
 
     // local
-    copy->m_AttributeScales = this->m_AttributeScales;
-    copy->m_Counter = this->m_Counter;
-    copy->m_CurrentEnergy = this->m_CurrentEnergy;
-    copy->m_HoldMinimumVariance = this->m_HoldMinimumVariance;
-    copy->m_MinimumEigenValue = this->m_MinimumEigenValue;
-    copy->m_MinimumVariance = this->m_MinimumVariance;
-    copy->m_MinimumVarianceDecayConstant = this->m_MinimumVarianceDecayConstant;
-    copy->m_PointsUpdate = this->m_PointsUpdate;
-    copy->m_RecomputeCovarianceInterval = this->m_RecomputeCovarianceInterval;
-    copy->m_AttributesPerDomain = this->m_AttributesPerDomain;
-    copy->m_DomainsPerShape = this->m_DomainsPerShape;
-    copy->m_UseMeanEnergy = this->m_UseMeanEnergy;
-    copy->m_points_mean = this->m_points_mean;
-    copy->m_UseNormals = this->m_UseNormals;
-    copy->m_UseXYZ = this->m_UseXYZ;
-    copy->m_InverseCovMatrix = this->m_InverseCovMatrix;
-
-    copy->m_ShapeData = this->m_ShapeData;
-    copy->m_ShapeGradient = this->m_ShapeGradient;
+    m_AttributeScales = other->m_AttributeScales;
+    m_Counter = other->m_Counter;
+    m_CurrentEnergy = other->m_CurrentEnergy;
+    m_HoldMinimumVariance = other->m_HoldMinimumVariance;
+    m_MinimumEigenValue = other->m_MinimumEigenValue;
+    m_MinimumVariance = other->m_MinimumVariance;
+    m_MinimumVarianceDecayConstant = other->m_MinimumVarianceDecayConstant;
+    m_PointsUpdate = other->m_PointsUpdate;
+    m_RecomputeCovarianceInterval = other->m_RecomputeCovarianceInterval;
+    m_AttributesPerDomain = other->m_AttributesPerDomain;
+    m_DomainsPerShape = other->m_DomainsPerShape;
+    m_UseMeanEnergy = other->m_UseMeanEnergy;
+    m_points_mean = other->m_points_mean;
+    m_UseNormals = other->m_UseNormals;
+    m_UseXYZ = other->m_UseXYZ;
+    m_InverseCovMatrix = other->m_InverseCovMatrix;
+    m_UseFactoredInverseCovariance = other->m_UseFactoredInverseCovariance;
+    m_InverseCovFactor = other->m_InverseCovFactor;
+
+    m_ShapeData = other->m_ShapeData;
+    m_ShapeGradient = other->m_ShapeGradient;
+  }
 
+  virtual VectorFunction::Pointer Clone() {
+    auto copy = CorrespondenceFunction::New();
+    copy->UpdateFrom(this);
     return (VectorFunction::Pointer)copy;
   }
 
@@ -176,6 +184,7 @@ class CorrespondenceFunction : public VectorFunction {
     num_samples = 0;
     m_PointsUpdate = std::make_shared<vnl_matrix_type>(10, 10);
     m_InverseCovMatrix = std::make_shared<Eigen::MatrixXd>(10, 10);
+    m_InverseCovFactor = std::make_shared<FactorMatrixType>();
     m_points_mean = std::make_shared<vnl_matrix_type>(10, 10);
   }
   virtual ~CorrespondenceFunction() {}
@@ -204,6 +213,11 @@ class CorrespondenceFunction : public VectorFunction {
   std::vector<bool> m_UseNormals;
   std::shared_ptr<vnl_matrix_type> m_points_mean;
   std::shared_ptr<Eigen::MatrixXd> m_InverseCovMatrix;
+
+  // row major so that the rows belonging to one particle are contiguous
+  using FactorMatrixType = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+  bool m_UseFactoredInverseCovariance{false};
+  std::shared_ptr<FactorMatrixType> m_InverseCovFactor;
   int num_dims, num_samples;
 };
 }  // namespace shapeworks
@@ -108,11 +108,13 @@ void CurvatureSamplingFunction::BeforeEvaluate(unsigned int idx, unsigned int d,
   // Determine the extent of the neighborhood that will be used in the Parzen
   // windowing estimation.  The neighborhood extent is based on the optimal
   // sigma calculation and limited to a user supplied maximum radius (probably
-  // the size of the domain).
+  // the size of the domain), or to the limit set on the neighborhood while the domain is swept in parallel.
+  const double maximum_radius =
+      std::min(this->GetMaximumNeighborhoodRadius(), system->GetNeighborhood(d)->GetQueryRadiusLimit());
   double neighborhood_radius = (m_CurrentSigma / myKappa) * 1.3 * this->GetNeighborhoodToSigmaRatio();
 
-  if (neighborhood_radius > this->GetMaximumNeighborhoodRadius()) {
-    neighborhood_radius = this->GetMaximumNeighborhoodRadius();
+  if (neighborhood_radius > maximum_radius) {
+    neighborhood_radius = maximum_radius;
   }
 
   // Get the neighborhood surrounding the point "pos".
@@ -133,9 +135,9 @@ void CurvatureSamplingFunction::BeforeEvaluate(unsigned int idx, unsigned int d,
 
     // Constrain the neighborhood size.  If we have reached a maximum
     // possible neighborhood size, we'll just go with that.
-    if (neighborhood_radius > this->GetMaximumNeighborhoodRadius()) {
-      m_CurrentSigma = this->GetMaximumNeighborhoodRadius() / this->GetNeighborhoodToSigmaRatio();
-      neighborhood_radius = this->GetMaximumNeighborhoodRadius();
+    if (neighborhood_radius > maximum_radius) {
+      m_CurrentSigma = maximum_radius / this->GetNeighborhoodToSigmaRatio();
+      neighborhood_radius = maximum_radius;
       break;
     } else {
       m_CurrentSigma = neighborhood_radius / this->GetNeighborhoodToSigmaRatio();
@@ -148,9 +150,9 @@ void CurvatureSamplingFunction::BeforeEvaluate(unsigned int idx, unsigned int d,
 
   // Constrain sigma to a maximum reasonable size based on the user-supplied
   // limit to neighborhood size.
-  if (m_CurrentSigma > this->GetMaximumNeighborhoodRadius()) {
-    m_CurrentSigma = this->GetMaximumNeighborhoodRadius() / this->GetNeighborhoodToSigmaRatio();
-    neighborhood_radius = this->GetMaximumNeighborhoodRadius();
+  if (m_CurrentSigma > maximum_radius) {
+    m_CurrentSigma = maximum_radius / this->GetNeighborhoodToSigmaRatio();
+    neighborhood_radius = maximum_radius;
     UpdateNeighborhood(pos, idx, d, neighborhood_radius, system);
   }
 
@@ -195,11 +197,14 @@ CurvatureSamplingFunction::VectorType CurvatureSamplingFunction::Evaluate(unsign
       system->GetDomain(d)->Distance(pos, idx, m_CurrentNeighborhood[i].pi_pair.Point,
                                      m_CurrentNeighborhood[i].pi_pair.Index, &r);
     } else {
-      for (unsigned int n = 0; n < VDimension; n++) {
-        // Note that the Neighborhood object has already filtered the
-        // neighborhood for points whose normals differ by > 90 degrees.
-        r[n] = (pos[n] - m_CurrentNeighborhood[i].pi_pair.Point[n]) * kappa;
-      }
+      // Note that the Neighborhood object has already filtered the
+      // neighborhood for points whose normals differ by > 90 degrees.
+      // The coordinates come from the contiguous position store of the other domain.
+      const auto store = system->GetPositionStore(m_CurrentNeighborhood[i].dom);
+      const auto j = m_CurrentNeighborhood[i].pi_pair.Index;
+      r[0] = (pos[0] - store->GetX()[j]) * kappa;
+      r[1] = (pos[1] - store->GetY()[j]) * kappa;
+      r[2] = (pos[2] - store->GetZ()[j]) * kappa;
     }
     r *= kappa;
 
@@ -242,6 +247,11 @@ void CurvatureSamplingFunction::UpdateNeighborhood(const CurvatureSamplingFuncti
   const auto domain_base = d / domains_per_shape;
   const auto domain_sub = d % domains_per_shape;
 
+  // the workspace and m_CurrentNeighborhood keep their storage from one particle to the next
+  auto& res = m_Workspace.neighborhood;
+  auto& weights = m_Workspace.weights;
+  auto& distances = m_Workspace.distances;
+
   m_CurrentNeighborhood.clear();
   for (int offset = 0; offset < domains_per_shape; offset++) {
     const auto domain_t = domain_base * domains_per_shape + offset;
@@ -268,12 +278,9 @@ void CurvatureSamplingFunction::UpdateNeighborhood(const CurvatureSamplingFuncti
     // * Both domains are the same
     // * This is not a contour, but the other domain is a contour
 
-    std::vector<double> weights;
-    std::vector<double> distances;
-    std::vector<ParticlePointIndexPair> res;
     if (domain_t == d) {
       // same domain
-      res = neighborhood->FindNeighborhoodPoints(pos, idx, weights, distances, radius);
+      neighborhood->FindNeighborhoodPoints(pos, idx, weights, distances, radius, res);
     } else {
       // cross domain
 
@@ -282,7 +289,7 @@ void CurvatureSamplingFunction::UpdateNeighborhood(const CurvatureSamplingFuncti
       neighborhood->SetWeightingEnabled(false);
       neighborhood->SetForceEuclidean(true);
 
-      res = neighborhood->FindNeighborhoodPoints(pos, -1, weights, distances, radius);
+      neighborhood->FindNeighborhoodPoints(pos, -1, weights, distances, radius, res);
 
       neighborhood->SetForceEuclidean(false);
       neighborhood->SetWeightingEnabled(weighting_state);
@@ -296,6 +303,9 @@ void CurvatureSamplingFunction::UpdateNeighborhood(const CurvatureSamplingFuncti
       m_CurrentNeighborhood.emplace_back(res[i], weight, distances[i], domain_t);
     }
   }
+
+  m_Workspace.TrackAllocations();
+  TrackCapacity(m_CurrentNeighborhood.capacity(), m_CurrentNeighborhoodCapacity);
 }
 double CurvatureSamplingFunction::ComputeKappa(double mc, unsigned int d) const {
   double mean = m_MeanCurvatureCache->GetMeanCurvature(d);
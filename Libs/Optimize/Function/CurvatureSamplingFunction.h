@@ -93,30 +93,28 @@ class CurvatureSamplingFunction : public SamplingFunction {
   void SetSharedBoundaryEnabled(bool enabled) { m_IsSharedBoundaryEnabled = enabled; }
   bool GetSharedBoundaryEnabled() const { return m_IsSharedBoundaryEnabled; }
 
-  virtual VectorFunction::Pointer Clone() {
-    // todo Do we really need to clone all of this?
+  virtual void UpdateFrom(const VectorFunction* function) {
+    Superclass::UpdateFrom(function);
+    auto other = static_cast<const CurvatureSamplingFunction*>(function);
+
+    m_Counter = other->m_Counter;
+    m_Rho = other->m_Rho;
+    m_avgKappa = other->m_avgKappa;
+    m_IsSharedBoundaryEnabled = other->m_IsSharedBoundaryEnabled;
+    m_SharedBoundaryWeight = other->m_SharedBoundaryWeight;
+    m_CurrentSigma = other->m_CurrentSigma;
+    m_MeanCurvatureCache = other->m_MeanCurvatureCache;
+
+    // m_CurrentNeighborhood is rebuilt by every BeforeEvaluate, so only its storage is kept.  It may gather the
+    // neighbors of every domain of a shape.
+    if (m_ParticleSystem) {
+      m_CurrentNeighborhood.reserve(GetMaximumParticlesPerDomain() * m_ParticleSystem->GetDomainsPerShape());
+    }
+  }
 
+  virtual VectorFunction::Pointer Clone() {
     CurvatureSamplingFunction::Pointer copy = CurvatureSamplingFunction::New();
-    copy->SetParticleSystem(this->GetParticleSystem());
-    copy->m_Counter = this->m_Counter;
-    copy->m_Rho = this->m_Rho;
-    copy->m_avgKappa = this->m_avgKappa;
-    copy->m_IsSharedBoundaryEnabled = this->m_IsSharedBoundaryEnabled;
-    copy->m_SharedBoundaryWeight = this->m_SharedBoundaryWeight;
-    copy->m_CurrentSigma = this->m_CurrentSigma;
-    copy->m_CurrentNeighborhood = this->m_CurrentNeighborhood;
-
-    copy->m_MinimumNeighborhoodRadius = this->m_MinimumNeighborhoodRadius;
-    copy->m_MaximumNeighborhoodRadius = this->m_MaximumNeighborhoodRadius;
-    copy->m_FlatCutoff = this->m_FlatCutoff;
-    copy->m_NeighborhoodToSigmaRatio = this->m_NeighborhoodToSigmaRatio;
-
-    copy->m_SpatialSigmaCache = this->m_SpatialSigmaCache;
-    copy->m_MeanCurvatureCache = this->m_MeanCurvatureCache;
-
-    copy->m_DomainNumber = this->m_DomainNumber;
-    copy->m_ParticleSystem = this->m_ParticleSystem;
-
+    copy->UpdateFrom(this);
     return (VectorFunction::Pointer)copy;
   }
 
@@ -146,6 +144,7 @@ class CurvatureSamplingFunction : public SamplingFunction {
         : pi_pair(pi_pair_), weight(weight_), distance(distance_), dom(dom_) {}
   };
   std::vector<CrossDomainNeighborhood> m_CurrentNeighborhood;
+  size_t m_CurrentNeighborhoodCapacity{0};
   void UpdateNeighborhood(const PointType& pos, int idx, int d, double radius, const ParticleSystem* system);
 
   float m_MaxMoveFactor = 0;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 #include "ParticleSystemEvaluation.h"
 #include "itkLightObject.h"
 #include "itkObjectFactory.h"
@@ -342,28 +344,31 @@ class DualVectorFunction : public VectorFunction {
       return 0.0;
   }
 
-  virtual typename VectorFunction::Pointer Clone() {
-    typename DualVectorFunction::Pointer copy = DualVectorFunction::New();
-    copy->m_AOn = this->m_AOn;
-    copy->m_BOn = this->m_BOn;
+  virtual void UpdateFrom(const VectorFunction* function) {
+    Superclass::UpdateFrom(function);
+    auto other = static_cast<const DualVectorFunction*>(function);
 
-    copy->m_RelativeGradientScaling = this->m_RelativeGradientScaling;
-    copy->m_RelativeEnergyScaling = this->m_RelativeEnergyScaling;
-    copy->m_AverageGradMagA = this->m_AverageGradMagA;
-    copy->m_AverageGradMagB = this->m_AverageGradMagB;
-    copy->m_AverageEnergyA = this->m_AverageEnergyA;
-    copy->m_AverageEnergyB = this->m_AverageEnergyB;
-    copy->m_Counter = this->m_Counter;
+    m_AOn = other->m_AOn;
+    m_BOn = other->m_BOn;
 
-    if (this->m_FunctionA) copy->m_FunctionA = this->m_FunctionA->Clone();
-    if (this->m_FunctionB) copy->m_FunctionB = this->m_FunctionB->Clone();
+    m_RelativeGradientScaling = other->m_RelativeGradientScaling;
+    m_RelativeEnergyScaling = other->m_RelativeEnergyScaling;
+    m_AverageGradMagA = other->m_AverageGradMagA;
+    m_AverageGradMagB = other->m_AverageGradMagB;
+    m_AverageEnergyA = other->m_AverageEnergyA;
+    m_AverageEnergyB = other->m_AverageEnergyB;
+    m_Counter = other->m_Counter;
 
-    if (!copy->m_FunctionA) copy->m_AOn = false;
-    if (!copy->m_FunctionB) copy->m_BOn = false;
+    UpdateSubFunction(m_FunctionA, other->m_FunctionA);
+    UpdateSubFunction(m_FunctionB, other->m_FunctionB);
 
-    copy->m_DomainNumber = this->m_DomainNumber;
-    copy->m_ParticleSystem = this->m_ParticleSystem;
+    if (!m_FunctionA) m_AOn = false;
+    if (!m_FunctionB) m_BOn = false;
+  }
 
+  virtual typename VectorFunction::Pointer Clone() {
+    typename DualVectorFunction::Pointer copy = DualVectorFunction::New();
+    copy->UpdateFrom(this);
     return (VectorFunction::Pointer)copy;
   }
 
@@ -387,6 +392,18 @@ class DualVectorFunction : public VectorFunction {
 
   VectorFunction::Pointer m_FunctionA;
   VectorFunction::Pointer m_FunctionB;
+
+ private:
+  /** Refresh our copy of a sub-function in place when it is of the same class, so it keeps its scratch buffers. */
+  static void UpdateSubFunction(VectorFunction::Pointer& mine, const VectorFunction::Pointer& theirs) {
+    if (!theirs) {
+      mine = nullptr;
+    } else if (mine && mine != theirs && std::string(mine->GetNameOfClass()) == theirs->GetNameOfClass()) {
+      mine->UpdateFrom(theirs);
+    } else {
+      mine = theirs->Clone();
+    }
+  }
 };
 
 }  // namespace shapeworks
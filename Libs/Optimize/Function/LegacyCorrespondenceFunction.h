@@ -110,26 +110,29 @@ class LegacyCorrespondenceFunction : public VectorFunction {
   void SetRecomputeCovarianceInterval(int i) { m_RecomputeCovarianceInterval = i; }
   int GetRecomputeCovarianceInterval() const { return m_RecomputeCovarianceInterval; }
 
-  virtual VectorFunction::Pointer Clone() {
-    LegacyCorrespondenceFunction::Pointer copy = LegacyCorrespondenceFunction::New();
-
-    copy->m_PointsUpdate = this->m_PointsUpdate;
-    copy->m_MinimumVariance = this->m_MinimumVariance;
-    copy->m_MinimumEigenValue = this->m_MinimumEigenValue;
-    copy->m_CurrentEnergy = this->m_CurrentEnergy;
-    copy->m_HoldMinimumVariance = this->m_HoldMinimumVariance;
-    copy->m_MinimumVarianceDecayConstant = this->m_MinimumVarianceDecayConstant;
-    copy->m_RecomputeCovarianceInterval = this->m_RecomputeCovarianceInterval;
-    copy->m_Counter = m_Counter;
-
-    copy->m_DomainNumber = this->m_DomainNumber;
-    copy->m_ParticleSystem = this->m_ParticleSystem;
-    copy->m_ShapeMatrix = this->m_ShapeMatrix;
-
-    copy->m_InverseCovMatrix = this->m_InverseCovMatrix;
-    copy->m_points_mean = this->m_points_mean;
-    copy->m_UseMeanEnergy = this->m_UseMeanEnergy;
+  virtual void UpdateFrom(const VectorFunction* function) {
+    Superclass::UpdateFrom(function);
+    auto other = static_cast<const LegacyCorrespondenceFunction*>(function);
+
+    m_PointsUpdate = other->m_PointsUpdate;
+    m_MinimumVariance = other->m_MinimumVariance;
+    m_MinimumEigenValue = other->m_MinimumEigenValue;
+    m_CurrentEnergy = other->m_CurrentEnergy;
+    m_HoldMinimumVariance = other->m_HoldMinimumVariance;
+    m_MinimumVarianceDecayConstant = other->m_MinimumVarianceDecayConstant;
+    m_RecomputeCovarianceInterval = other->m_RecomputeCovarianceInterval;
+    m_Counter = other->m_Counter;
+
+    m_ShapeMatrix = other->m_ShapeMatrix;
+
+    m_InverseCovMatrix = other->m_InverseCovMatrix;
+    m_points_mean = other->m_points_mean;
+    m_UseMeanEnergy = other->m_UseMeanEnergy;
+  }
 
+  virtual VectorFunction::Pointer Clone() {
+    auto copy = LegacyCorrespondenceFunction::New();
+    copy->UpdateFrom(this);
     return (VectorFunction::Pointer)copy;
   }
 
@@ -7,6 +7,8 @@
 
 namespace shapeworks {
 
+std::atomic<size_t> SamplingFunction::s_WorkspaceAllocations{0};
+
 SamplingFunction::TGradientNumericType SamplingFunction::AngleCoefficient(
     const GradientVectorType& p_i_normal, const GradientVectorType& p_j_normal) const {
   // get the cosine of the angle between the two particles' normals
@@ -23,7 +25,13 @@ SamplingFunction::TGradientNumericType SamplingFunction::AngleCoefficient(
 void SamplingFunction::ComputeAngularWeights(
     const PointType& pos, int idx, const typename ParticleSystem::PointVectorType& neighborhood,
     const shapeworks::ParticleDomain* domain, std::vector<double>& weights) const {
-  GradientVectorType posnormal = domain->SampleNormalAtPoint(pos, idx);
+  this->ComputeAngularWeights(domain->SampleNormalAtPoint(pos, idx), neighborhood, domain, weights);
+}
+
+void SamplingFunction::ComputeAngularWeights(const GradientVectorType& posnormal,
+                                             const typename ParticleSystem::PointVectorType& neighborhood,
+                                             const shapeworks::ParticleDomain* domain,
+                                             std::vector<double>& weights) const {
   weights.resize(neighborhood.size());
 
   for (unsigned int i = 0; i < neighborhood.size(); i++) {
@@ -128,21 +136,26 @@ SamplingFunction::VectorType SamplingFunction::Evaluate(unsigned int idx, unsign
   // Determine the extent of the neighborhood that will be used in the Parzen
   // windowing estimation.  The neighborhood extent is based on the optimal
   // sigma calculation and limited to a user supplied maximum radius (probably
-  // the size of the domain).
+  // the size of the domain), or to the limit set on the neighborhood while the domain is swept in parallel.
+  const double maximum_radius =
+      std::min(m_MaximumNeighborhoodRadius, system->GetNeighborhood(d)->GetQueryRadiusLimit());
   double neighborhood_radius = sigma * m_NeighborhoodToSigmaRatio;
-  if (neighborhood_radius > m_MaximumNeighborhoodRadius) {
-    neighborhood_radius = m_MaximumNeighborhoodRadius;
+  if (neighborhood_radius > maximum_radius) {
+    neighborhood_radius = maximum_radius;
   }
 
   // Get the position for which we are computing the gradient.
   PointType pos = system->GetPosition(idx, d);
 
-  // Get the neighborhood surrounding the point "pos".
-  ParticleSystem::PointVectorType neighborhood = system->FindNeighborhoodPoints(pos, idx, neighborhood_radius, d);
+  // Get the neighborhood surrounding the point "pos".  The workspace buffers are reused across calls.
+  auto& neighborhood = m_Workspace.neighborhood;
+  auto& weights = m_Workspace.weights;
+  system->FindNeighborhoodPoints(pos, idx, neighborhood_radius, neighborhood, d);
 
-  // Compute the weights based on angle between the neighbors and the center.
-  std::vector<double> weights;
-  this->ComputeAngularWeights(pos, idx, neighborhood, domain, weights);
+  // Compute the weights based on angle between the neighbors and the center.  The normal at "pos" does not change
+  // while the neighborhood grows below, so it is sampled once.
+  m_Workspace.normal = domain->SampleNormalAtPoint(pos, idx);
+  this->ComputeAngularWeights(m_Workspace.normal, neighborhood, domain, weights);
 
   // Estimate the best sigma for Parzen windowing.  In some cases, such as when
   // the neighborhood does not include enough points, the value will be bogus.
@@ -155,27 +168,28 @@ SamplingFunction::VectorType SamplingFunction::Evaluate(unsigned int idx, unsign
     neighborhood_radius *= 2.0;
     // Constrain the neighborhood size.  If we have reached a maximum
     // possible neighborhood size, we'll just go with that.
-    if (neighborhood_radius > this->GetMaximumNeighborhoodRadius()) {
-      sigma = this->GetMaximumNeighborhoodRadius() / this->GetNeighborhoodToSigmaRatio();
-      neighborhood_radius = this->GetMaximumNeighborhoodRadius();
+    if (neighborhood_radius > maximum_radius) {
+      sigma = maximum_radius / this->GetNeighborhoodToSigmaRatio();
+      neighborhood_radius = maximum_radius;
       break;
     } else {
       sigma = neighborhood_radius / this->GetNeighborhoodToSigmaRatio();
     }
 
-    neighborhood = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
-    this->ComputeAngularWeights(pos, idx, neighborhood, domain, weights);
+    system->FindNeighborhoodPoints(pos, idx, neighborhood_radius, neighborhood, d);
+    this->ComputeAngularWeights(m_Workspace.normal, neighborhood, domain, weights);
     sigma = this->EstimateSigma(idx, neighborhood, domain, weights, pos, sigma, epsilon, err);
   }  // done while err
 
   // Constrain sigma to a maximum reasonable size based on the user-supplied
   // limit to neighborhood size.
-  if (sigma > this->GetMaximumNeighborhoodRadius()) {
-    sigma = this->GetMaximumNeighborhoodRadius() / this->GetNeighborhoodToSigmaRatio();
-    neighborhood_radius = this->GetMaximumNeighborhoodRadius();
-    neighborhood = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
-    this->ComputeAngularWeights(pos, idx, neighborhood, domain, weights);
+  if (sigma > maximum_radius) {
+    sigma = maximum_radius / this->GetNeighborhoodToSigmaRatio();
+    neighborhood_radius = maximum_radius;
+    system->FindNeighborhoodPoints(pos, idx, neighborhood_radius, neighborhood, d);
+    this->ComputeAngularWeights(m_Workspace.normal, neighborhood, domain, weights);
   }
+  m_Workspace.TrackAllocations();
 
   //  std::cout << idx <<  "\t SIGMA = " << sigma << "\t NEIGHBORHOOD SIZE = " << neighborhood.size()
   //            << "\t NEIGHBORHOOD RADIUS= " << neighborhood_radius << std::endl;
@@ -196,16 +210,24 @@ SamplingFunction::VectorType SamplingFunction::Evaluate(unsigned int idx, unsign
     gradE[n] = 0.0;
   }
 
+  // Neighbor coordinates are read from the contiguous position store of the domain, which holds the positions the
+  // neighborhood was built from.
+  const auto store = system->GetPositionStore(d);
+  const double* x = store->GetX();
+  const double* y = store->GetY();
+  const double* z = store->GetZ();
+
   double A = 0.0;
   for (unsigned int i = 0; i < neighborhood.size(); i++) {
     //    if ( neighborhood[i].Index == idx) continue;
     if (weights[i] < epsilon) continue;
 
-    for (unsigned int n = 0; n < VDimension; n++) {
-      // Note that the Neighborhood object has already filtered the
-      // neighborhood for points whose normals differ by > 90 degrees.
-      r[n] = pos[n] - neighborhood[i].Point[n];
-    }
+    // Note that the Neighborhood object has already filtered the
+    // neighborhood for points whose normals differ by > 90 degrees.
+    const auto j = neighborhood[i].Index;
+    r[0] = pos[0] - x[j];
+    r[1] = pos[1] - y[j];
+    r[2] = pos[2] - z[j];
 
     double q = exp(-dot_product(r, r) * sigma2inv);
     A += q;
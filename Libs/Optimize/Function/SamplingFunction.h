@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 
 #include "Libs/Optimize/Container/GenericContainerArray.h"
@@ -147,23 +149,33 @@ class SamplingFunction : public VectorFunction {
       results in a weight of 0. */
   void ComputeAngularWeights(const PointType&, int, const typename ParticleSystem::PointVectorType&,
                              const shapeworks::ParticleDomain*, std::vector<double>&) const;
+  /** Same as above, with the normal at the central point already sampled. */
+  void ComputeAngularWeights(const GradientVectorType& posnormal, const typename ParticleSystem::PointVectorType&,
+                             const shapeworks::ParticleDomain*, std::vector<double>&) const;
+
+  /** Number of times a scratch buffer of a sampling function had to grow since the last reset.  Once the buffers
+      have warmed up this should stay at zero.  It is reported in the verbose iteration log. */
+  static size_t GetWorkspaceAllocationCount() { return s_WorkspaceAllocations; }
+  static void ResetWorkspaceAllocationCount() { s_WorkspaceAllocations = 0; }
 
   //  void ComputeNeighborho0d();
 
-  virtual VectorFunction::Pointer Clone() {
-    SamplingFunction::Pointer copy = SamplingFunction::New();
+  virtual void UpdateFrom(const VectorFunction* function) {
+    Superclass::UpdateFrom(function);
+    auto other = static_cast<const SamplingFunction*>(function);
 
-    // from itkParticleVectorFunction
-    copy->m_DomainNumber = this->m_DomainNumber;
-    copy->m_ParticleSystem = this->m_ParticleSystem;
+    m_FlatCutoff = other->m_FlatCutoff;
+    m_MaximumNeighborhoodRadius = other->m_MaximumNeighborhoodRadius;
+    m_MinimumNeighborhoodRadius = other->m_MinimumNeighborhoodRadius;
+    m_NeighborhoodToSigmaRatio = other->m_NeighborhoodToSigmaRatio;
+    m_SpatialSigmaCache = other->m_SpatialSigmaCache;
 
-    // local
-    copy->m_FlatCutoff = this->m_FlatCutoff;
-    copy->m_MaximumNeighborhoodRadius = this->m_MaximumNeighborhoodRadius;
-    copy->m_MinimumNeighborhoodRadius = this->m_MinimumNeighborhoodRadius;
-    copy->m_NeighborhoodToSigmaRatio = this->m_NeighborhoodToSigmaRatio;
-    copy->m_SpatialSigmaCache = this->m_SpatialSigmaCache;
+    m_Workspace.Reserve(this->GetMaximumParticlesPerDomain());
+  }
 
+  virtual VectorFunction::Pointer Clone() {
+    SamplingFunction::Pointer copy = SamplingFunction::New();
+    copy->UpdateFrom(this);
     return (typename VectorFunction::Pointer)copy;
   }
 
@@ -173,11 +185,66 @@ class SamplingFunction : public VectorFunction {
   void operator=(const SamplingFunction&);
   SamplingFunction(const SamplingFunction&);
 
+  /** Scratch buffers reused from one particle to the next (and across BeforeEvaluate/Evaluate/Energy), so that
+      evaluating the function does not allocate.  Every clone owns its own workspace, so there is one per thread. */
+  struct Workspace {
+    ParticleSystem::PointVectorType neighborhood;
+    std::vector<double> weights;
+    std::vector<double> distances;
+
+    /** Normal at the particle being evaluated. */
+    GradientVectorType normal;
+
+    /** A neighborhood never holds more points than its domain, so reserving for the largest domain means the
+        buffers do not grow while the particle count stays the same. */
+    void Reserve(size_t n) {
+      neighborhood.reserve(n);
+      weights.reserve(n);
+      distances.reserve(n);
+    }
+
+    /** Count each buffer whose storage was reallocated since the last call. */
+    void TrackAllocations() {
+      TrackCapacity(neighborhood.capacity(), m_NeighborhoodCapacity);
+      TrackCapacity(weights.capacity(), m_WeightsCapacity);
+      TrackCapacity(distances.capacity(), m_DistancesCapacity);
+    }
+
+   private:
+    size_t m_NeighborhoodCapacity{0};
+    size_t m_WeightsCapacity{0};
+    size_t m_DistancesCapacity{0};
+  };
+
+  /** Count an allocation if capacity differs from the last recorded one, and record it. */
+  static void TrackCapacity(size_t capacity, size_t& last_capacity) {
+    if (capacity != last_capacity) {
+      s_WorkspaceAllocations++;
+      last_capacity = capacity;
+    }
+  }
+
+  /** Largest particle count of any domain in the particle system (0 without one). */
+  size_t GetMaximumParticlesPerDomain() const {
+    size_t n = 0;
+    if (m_ParticleSystem) {
+      for (unsigned int d = 0; d < m_ParticleSystem->GetNumberOfDomains(); d++) {
+        n = std::max<size_t>(n, m_ParticleSystem->GetNumberOfParticles(d));
+      }
+    }
+    return n;
+  }
+
+  mutable Workspace m_Workspace;
+
   double m_MinimumNeighborhoodRadius;
   double m_MaximumNeighborhoodRadius;
   double m_FlatCutoff;
   double m_NeighborhoodToSigmaRatio;
   typename SigmaCacheType::Pointer m_SpatialSigmaCache;
+
+ private:
+  static std::atomic<size_t> s_WorkspaceAllocations;
 };
 
 }  // namespace shapeworks
@@ -69,6 +69,13 @@ class VectorFunction : public itk::LightObject {
   virtual void SetDomainNumber(unsigned int i) { m_DomainNumber = i; }
   virtual int GetDomainNumber() const { return m_DomainNumber; }
 
+  /** Copy the settings and state of a function of the same type into this one, keeping this object's scratch
+      buffers.  Clone() is built on it, and solvers use it to refresh their per-thread clones between iterations. */
+  virtual void UpdateFrom(const VectorFunction* function) {
+    m_ParticleSystem = function->m_ParticleSystem;
+    m_DomainNumber = function->m_DomainNumber;
+  }
+
   virtual VectorFunction::Pointer Clone() {
     std::cerr << "Error: base class VectorFunction Clone method called!\n";
     std::cerr << "Threaded run of current parameters not supported!\n";
@@ -4,18 +4,26 @@
 
 const int global_iteration = 1;
 
+#include <tbb/concurrent_queue.h>
 #include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 #include <time.h>
 
 #include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <ctime>
 #include <fstream>
+#include <limits>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "Libs/Optimize/Domain/ImageDomainWithGradients.h"
+#include "Libs/Optimize/Function/SamplingFunction.h"
 #include "Libs/Optimize/Utils/MemoryUsage.h"
 
 namespace shapeworks {
@@ -53,8 +61,6 @@ void GradientDescentOptimizer::StartAdaptiveGaussSeidelOptimization() {
   if (this->m_AbortProcessing) {
     return;
   }
-  const double factor = 1.1;
-
   // NOTE: THIS METHOD WILL NOT WORK AS WRITTEN IF PARTICLES ARE
   // ADDED TO THE SYSTEM DURING OPTIMIZATION.
 
@@ -74,6 +80,20 @@ void GradientDescentOptimizer::StartAdaptiveGaussSeidelOptimization() {
 
   unsigned int counter = 0;
 
+  // Clones of the gradient function handed out to the shapes of an iteration.  A task takes a clone from the pool
+  // (or makes one if the pool is empty) and returns it when done, so there is about one clone per thread instead of
+  // one per shape.  The pool lives for the whole optimization: Before/AfterIteration update state on the master
+  // function (e.g. the correspondence eigenvalues and the annealed minimum variance), which is copied into every
+  // clone at the start of each iteration with UpdateFrom, so the clones keep their scratch buffers.
+  FunctionPoolType function_pool;
+  m_GradientFunction->SetParticleSystem(m_ParticleSystem);
+  for (int i = 0; i < tbb::this_task_arena::max_concurrency(); i++) {
+    function_pool.push(m_GradientFunction->Clone());
+  }
+
+  // statistics of each shape, merged in shape order after the parallel loop
+  std::vector<IterationStats> shape_stats;
+
   double maxchange = 0.0;
   while (m_StopOptimization == false)  // iterations loop
   {
@@ -85,20 +105,24 @@ void GradientDescentOptimizer::StartAdaptiveGaussSeidelOptimization() {
     }
     minimumTimeStep = dampening;
 
-    maxchange = 0.0;
-
     const auto accTimerBegin = std::chrono::steady_clock::now();
+    SamplingFunction::ResetWorkspaceAllocationCount();
     m_GradientFunction->SetParticleSystem(m_ParticleSystem);
     if (counter % global_iteration == 0) m_GradientFunction->BeforeIteration();
     counter++;
+    for (auto it = function_pool.unsafe_begin(); it != function_pool.unsafe_end(); ++it) {
+      (*it)->UpdateFrom(m_GradientFunction);
+    }
 
     // Iterate over each domain
     const auto domains_per_shape = m_ParticleSystem->GetDomainsPerShape();
+    shape_stats.assign(numdomains / domains_per_shape, IterationStats());
     tbb::parallel_for(
         tbb::blocked_range<size_t>{0, numdomains / domains_per_shape}, [&](const tbb::blocked_range<size_t>& r) {
           for (size_t shape = r.begin(); shape < r.end(); ++shape) {
             for (int shape_dom_idx = 0; shape_dom_idx < domains_per_shape; shape_dom_idx++) {
               auto dom = shape * domains_per_shape + shape_dom_idx;
+              auto& stats = shape_stats[shape];
 
               // skip any flagged domains
               if (m_ParticleSystem->GetDomainFlag(dom) == true) {
@@ -107,85 +131,33 @@ void GradientDescentOptimizer::StartAdaptiveGaussSeidelOptimization() {
                 return;
               }
 
-              const shapeworks::ParticleDomain* domain = m_ParticleSystem->GetDomain(dom);
+              // Iterate over each particle position
+              const auto neighborhood = m_ParticleSystem->GetNeighborhood(dom);
+              const double interaction_radius = neighborhood->GetMaxQueryRadius();
+              neighborhood->ResetMaxQueryRadius();
+              if (m_UseIntraShapeParallelism && interaction_radius > 0.0 && CanSweepInParallel(dom)) {
+                SweepDomainInParallel(dom, interaction_radius, minimumTimeStep, function_pool, stats);
+              } else {
+                // must use a clone as we are in a thread and the gradient function is not thread-safe
+                typename GradientFunctionType::Pointer localGradientFunction;
+                if (!function_pool.try_pop(localGradientFunction)) {
+                  localGradientFunction = m_GradientFunction->Clone();
+                }
 
-              typename GradientFunctionType::Pointer localGradientFunction = m_GradientFunction;
+                // Tell function which domain we are working on.
+                localGradientFunction->SetDomainNumber(dom);
 
-              // must clone this as we are in a thread and the gradient function is not thread-safe
-              localGradientFunction = m_GradientFunction->Clone();
+                for (auto k = 0; k < m_ParticleSystem->GetPositions(dom)->GetSize(); k++) {
+                  UpdateParticle(localGradientFunction, dom, k, minimumTimeStep, stats);
+                }
 
-              // Tell function which domain we are working on.
-              localGradientFunction->SetDomainNumber(dom);
+                function_pool.push(localGradientFunction);
+              }
 
-              // Iterate over each particle position
-              for (auto k = 0; k < m_ParticleSystem->GetPositions(dom)->GetSize(); k++) {
-                if (m_TimeSteps[dom][k] < minimumTimeStep) {
-                  m_TimeSteps[dom][k] = minimumTimeStep;
-                }
-                // Compute gradient update.
-                double energy = 0.0;
-                localGradientFunction->BeforeEvaluate(k, dom, m_ParticleSystem);
-                // maximumUpdateAllowed is set based on some fraction of the distance between particles
-                // This is to avoid particles shooting past their neighbors
-                double maximumUpdateAllowed;
-                VectorType original_gradient =
-                    localGradientFunction->Evaluate(k, dom, m_ParticleSystem, maximumUpdateAllowed, energy);
-
-                PointType pt = m_ParticleSystem->GetPositions(dom)->Get(k);
-
-                // Step 1 Project the gradient vector onto the tangent plane
-                VectorType original_gradient_projectedOntoTangentSpace =
-                    domain->ProjectVectorToSurfaceTangent(original_gradient, pt, k);
-
-                double newenergy, gradmag;
-                while (true) {
-                  // Step A scale the projected gradient by the current time step
-                  VectorType gradient = original_gradient_projectedOntoTangentSpace * m_TimeSteps[dom][k];
-
-                  // Step B Constrain the gradient so that the resulting position will not violate any domain
-                  // constraints
-                  if (m_ParticleSystem->GetDomain(dom)->GetConstraints()->GetActive()) {
-                    AugmentedLagrangianConstraints(gradient, pt, dom, maximumUpdateAllowed, k);
-                  }
-
-                  gradmag = gradient.magnitude();
-
-                  // Step C if the magnitude is larger than the Sampler allows, scale the gradient down to an acceptable
-                  // magnitude
-                  if (gradmag > maximumUpdateAllowed) {
-                    gradient = gradient * maximumUpdateAllowed / gradmag;
-                    gradmag = gradient.magnitude();
-                  }
-
-                  // Step D compute the new point position
-                  PointType newpoint = domain->UpdateParticlePosition(pt, k, gradient);
-
-                  // Step F update the point position in the particle system
-                  m_ParticleSystem->SetPosition(newpoint, k, dom);
-
-                  // Step G compute the new energy of the particle system
-                  newenergy = localGradientFunction->Energy(k, dom, m_ParticleSystem);
-
-                  if (newenergy < energy)  // good move, increase timestep for next time
-                  {
-                    m_TimeSteps[dom][k] *= factor;
-                    if (gradmag > maxchange) maxchange = gradmag;
-                    break;
-                  } else {  // bad move, reset point position and back off on timestep
-                    if (m_TimeSteps[dom][k] > minimumTimeStep) {
-                      domain->ApplyConstraints(pt, k);
-                      m_ParticleSystem->SetPosition(pt, k, dom);
-                      domain->InvalidateParticlePosition(k);
-
-                      m_TimeSteps[dom][k] /= factor;
-                    } else  // keep the move with timestep 1.0 anyway
-                    {
-                      if (gradmag > maxchange) maxchange = gradmag;
-                      break;
-                    }
-                  }
-                }  // end while(true)
-              }    // for each particle
+              // with batched position events, the events for this domain are sent once per sweep
+              if (m_ParticleSystem->GetBatchPositionEvents()) {
+                m_ParticleSystem->FlushPositionEvents(dom);
+              }
             }
           }  // for each domain
         });
@@ -193,11 +165,25 @@ void GradientDescentOptimizer::StartAdaptiveGaussSeidelOptimization() {
     m_NumberOfIterations++;
     m_GradientFunction->AfterIteration();
 
+    // reduce in shape order so that the result does not depend on scheduling
+    m_IterationStats = IterationStats();
+    m_IterationStats.iteration = m_NumberOfIterations;
+    m_IterationStats.minimum_time_step = minimumTimeStep;
+    m_IterationStats.workspace_allocations = SamplingFunction::GetWorkspaceAllocationCount();
+    for (const auto& stats : shape_stats) {
+      m_IterationStats.Merge(stats);
+    }
+    m_IterationStats.Finalize();
+    maxchange = m_IterationStats.max_step;
+
     const auto accTimerEnd = std::chrono::steady_clock::now();
     const auto msElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(accTimerEnd - accTimerBegin).count();
 
     if (m_verbosity > 2) {
       std::cout << m_NumberOfIterations << ". " << msElapsed << "ms";
+      std::cout << " | Allocs=" << m_IterationStats.workspace_allocations;
+      std::cout << " | MaxStep=" << m_IterationStats.max_step << " MeanStep=" << m_IterationStats.mean_step
+                << " Accepted=" << m_IterationStats.num_accepted << " Rejected=" << m_IterationStats.num_rejected;
 #ifdef LOG_MEMORY_USAGE
       double vmUsage, residentSet;
       process_mem_usage(vmUsage, residentSet);
@@ -211,7 +197,7 @@ void GradientDescentOptimizer::StartAdaptiveGaussSeidelOptimization() {
       }
     }
 
-    this->InvokeEvent(itk::IterationEvent());
+    this->InvokeEvent(IterationStatsEvent(m_IterationStats));
 
     // Check for convergence.  Optimization is considered to have converged if
     // max number of iterations is reached or maximum distance moved by any
@@ -228,6 +214,198 @@ void GradientDescentOptimizer::StartAdaptiveGaussSeidelOptimization() {
   }  // end while stop optimization
 }
 
+void GradientDescentOptimizer::UpdateParticle(GradientFunctionType* function, unsigned int dom, unsigned int k,
+                                              double minimumTimeStep, IterationStats& stats) {
+  const double factor = 1.1;
+  const shapeworks::ParticleDomain* domain = m_ParticleSystem->GetDomain(dom);
+
+  if (m_TimeSteps[dom][k] < minimumTimeStep) {
+    m_TimeSteps[dom][k] = minimumTimeStep;
+  }
+  // Compute gradient update.
+  double energy = 0.0;
+  function->BeforeEvaluate(k, dom, m_ParticleSystem);
+  // maximumUpdateAllowed is set based on some fraction of the distance between particles
+  // This is to avoid particles shooting past their neighbors
+  double maximumUpdateAllowed;
+  VectorType original_gradient = function->Evaluate(k, dom, m_ParticleSystem, maximumUpdateAllowed, energy);
+
+  PointType pt = m_ParticleSystem->GetPositions(dom)->Get(k);
+
+  // Step 1 Project the gradient vector onto the tangent plane
+  VectorType original_gradient_projectedOntoTangentSpace =
+      domain->ProjectVectorToSurfaceTangent(original_gradient, pt, k);
+
+  double newenergy, gradmag;
+  while (true) {
+    // Step A scale the projected gradient by the current time step
+    VectorType gradient = original_gradient_projectedOntoTangentSpace * m_TimeSteps[dom][k];
+
+    // Step B Constrain the gradient so that the resulting position will not violate any domain
+    // constraints
+    if (domain->GetConstraints()->GetActive()) {
+      AugmentedLagrangianConstraints(gradient, pt, dom, maximumUpdateAllowed, k);
+    }
+
+    gradmag = gradient.magnitude();
+
+    // Step C if the magnitude is larger than the Sampler allows, scale the gradient down to an acceptable
+    // magnitude
+    if (gradmag > maximumUpdateAllowed) {
+      gradient = gradient * maximumUpdateAllowed / gradmag;
+      gradmag = gradient.magnitude();
+    }
+
+    // Step D compute the new point position
+    PointType newpoint = domain->UpdateParticlePosition(pt, k, gradient);
+
+    // Step F update the point position in the particle system
+    m_ParticleSystem->SetPosition(newpoint, k, dom);
+
+    // Step G compute the new energy of the particle system
+    newenergy = function->Energy(k, dom, m_ParticleSystem);
+
+    if (newenergy < energy)  // good move, increase timestep for next time
+    {
+      m_TimeSteps[dom][k] *= factor;
+      stats.num_accepted++;
+      break;
+    } else {  // bad move, reset point position and back off on timestep
+      if (m_TimeSteps[dom][k] > minimumTimeStep) {
+        domain->ApplyConstraints(pt, k);
+        m_ParticleSystem->SetPosition(pt, k, dom);
+        domain->InvalidateParticlePosition(k);
+
+        m_TimeSteps[dom][k] /= factor;
+        stats.num_rejected++;
+      } else  // keep the move with timestep 1.0 anyway
+      {
+        stats.num_accepted++;
+        break;
+      }
+    }
+  }  // end while(true)
+  stats.AddParticle(gradmag, newenergy, m_TimeSteps[dom][k]);
+}
+
+bool GradientDescentOptimizer::CanSweepInParallel(unsigned int dom) const {
+  // Only mesh domains are re-entrant (MeshWrapper).  Active constraints fall back to exact mesh queries and update
+  // per particle multipliers shared with the constraint objects, so those domains are swept serially as well.
+  const auto domain = m_ParticleSystem->GetDomain(dom);
+  return domain->GetDomainType() == shapeworks::DomainType::Mesh && !domain->GetConstraints()->GetActive() &&
+         m_ParticleSystem->GetNumberOfParticles(dom) >= MinParallelParticles;
+}
+
+std::vector<std::vector<unsigned int>> GradientDescentOptimizer::ColorConflictGraph(unsigned int dom,
+                                                                                    double conflict_radius) const {
+  // bin the particles into cells as large as the conflict radius, so that conflicting particles are in the same or in
+  // adjacent cells
+  const auto num_particles = m_ParticleSystem->GetNumberOfParticles(dom);
+  const double inverse_cell_size = 1.0 / conflict_radius;
+  auto cell_key = [](int64_t i, int64_t j, int64_t k) {
+    constexpr uint64_t mask = (uint64_t(1) << 21) - 1;
+    return ((uint64_t(i) & mask) << 42) | ((uint64_t(j) & mask) << 21) | (uint64_t(k) & mask);
+  };
+  std::vector<std::array<int64_t, VDimension>> particle_cells(num_particles);
+  std::unordered_map<uint64_t, std::vector<unsigned int>> cells;
+  for (unsigned int k = 0; k < num_particles; k++) {
+    const auto& p = m_ParticleSystem->GetPosition(k, dom);
+    for (unsigned int i = 0; i < VDimension; i++) {
+      particle_cells[k][i] = static_cast<int64_t>(std::floor(p[i] * inverse_cell_size));
+    }
+    cells[cell_key(particle_cells[k][0], particle_cells[k][1], particle_cells[k][2])].push_back(k);
+  }
+
+  // greedy coloring in index order: each particle takes the smallest color not used by a conflicting particle that
+  // is already colored
+  const double squared_radius = conflict_radius * conflict_radius;
+  const unsigned int uncolored = std::numeric_limits<unsigned int>::max();
+  std::vector<unsigned int> particle_colors(num_particles, uncolored);
+  std::vector<std::vector<unsigned int>> colors;
+  std::vector<char> taken;
+  for (unsigned int k = 0; k < num_particles; k++) {
+    const auto& p = m_ParticleSystem->GetPosition(k, dom);
+    const auto& c = particle_cells[k];
+    taken.assign(colors.size() + 1, 0);
+    for (int64_t i = c[0] - 1; i <= c[0] + 1; i++) {
+      for (int64_t j = c[1] - 1; j <= c[1] + 1; j++) {
+        for (int64_t l = c[2] - 1; l <= c[2] + 1; l++) {
+          const auto it = cells.find(cell_key(i, j, l));
+          if (it == cells.end()) {
+            continue;
+          }
+          for (auto other : it->second) {
+            if (particle_colors[other] != uncolored &&
+                p.SquaredEuclideanDistanceTo(m_ParticleSystem->GetPosition(other, dom)) < squared_radius) {
+              taken[particle_colors[other]] = 1;
+            }
+          }
+        }
+      }
+    }
+    const auto color = static_cast<unsigned int>(std::find(taken.begin(), taken.end(), 0) - taken.begin());
+    if (color == colors.size()) {
+      colors.emplace_back();
+    }
+    colors[color].push_back(k);
+    particle_colors[k] = color;
+  }
+  return colors;
+}
+
+void GradientDescentOptimizer::SweepDomainInParallel(unsigned int dom, double interaction_radius,
+                                                     double minimumTimeStep, FunctionPoolType& function_pool,
+                                                     IterationStats& stats) {
+  // Multi-colored Gauss-Seidel: two particles conflict when they are close enough for one to read the other's
+  // position, i.e. closer than the largest neighborhood query of the previous iteration plus a margin for this
+  // iteration's moves.  Distances are euclidean, a lower bound on the geodesic distances the neighborhoods may use, so
+  // no interacting pair is missed.  The conflict graph is colored so that no two particles of the same color
+  // interact, and the colors are swept one after the other.  Within a color, blocks of particles are updated in
+  // parallel against the neighborhood as it was left by the previous colors (deferred updates), which is the same as
+  // updating them one after the other since none of them sees another's move.
+  //
+  // A sampling function whose sigma estimate fails retries with a doubled neighborhood, which could reach past the
+  // conflict radius, so the queries are limited to it for the duration of the sweep.  Queries that hit the limit
+  // record it as their radius, so the next iteration colors with a radius ConflictRadiusFactor larger.
+  const double conflict_radius = interaction_radius * ConflictRadiusFactor;
+  const auto colors = this->ColorConflictGraph(dom, conflict_radius);
+
+  const auto neighborhood = m_ParticleSystem->GetNeighborhood(dom);
+  neighborhood->SetQueryRadiusLimit(conflict_radius);
+
+  std::vector<IterationStats> block_stats;
+  m_ParticleSystem->SetDeferredUpdates(dom, true);
+  for (const auto& particles : colors) {
+    const size_t num_blocks = (particles.size() + ParallelBlockSize - 1) / ParallelBlockSize;
+    block_stats.assign(num_blocks, IterationStats());
+    tbb::parallel_for(tbb::blocked_range<size_t>{0, num_blocks, 1}, [&](const tbb::blocked_range<size_t>& r) {
+      typename GradientFunctionType::Pointer function;
+      if (!function_pool.try_pop(function)) {
+        function = m_GradientFunction->Clone();
+      }
+      function->SetDomainNumber(dom);
+
+      for (size_t block = r.begin(); block < r.end(); ++block) {
+        const size_t end = std::min(particles.size(), (block + 1) * ParallelBlockSize);
+        for (size_t i = block * ParallelBlockSize; i < end; i++) {
+          UpdateParticle(function, dom, particles[i], minimumTimeStep, block_stats[block]);
+        }
+      }
+
+      function_pool.push(function);
+    });
+
+    // apply the moves of this color before the next one is swept
+    m_ParticleSystem->FlushDeferredUpdates(dom);
+
+    for (const auto& s : block_stats) {
+      stats.Merge(s);
+    }
+  }
+  m_ParticleSystem->SetDeferredUpdates(dom, false);
+  neighborhood->ResetQueryRadiusLimit();
+}
+
 void GradientDescentOptimizer::AugmentedLagrangianConstraints(VectorType& gradient, const PointType& pt,
                                                               const size_t& dom, const double& maximumUpdateAllowed, size_t index) {
   // Step B 2: Augmented lagrangian constraint method
@@ -1,11 +1,14 @@
 #pragma once
 
+#include <tbb/concurrent_queue.h>
+
 #include <algorithm>
 #include <limits>
 #include <vector>
 
 #include "Libs/Optimize/Domain/ImageDomainWithGradients.h"
 #include "Libs/Optimize/Function/VectorFunction.h"
+#include "IterationStats.h"
 #include "ParticleSystem.h"
 #include "itkObject.h"
 #include "itkObjectFactory.h"
@@ -114,6 +117,15 @@ class GradientDescentOptimizer : public itk::Object {
   /// Sets the scaling factor at the beginning of the initialization
   void SetInitializationStartScalingFactor(double si) { m_initialization_start_scaling_factor = si; }
 
+  /// Statistics of the most recent iteration, also sent with each IterationStatsEvent
+  const IterationStats& GetIterationStats() const { return m_IterationStats; }
+
+  /// Sets whether the particles of a (mesh) domain are also updated in parallel, color by color of a coloring of
+  /// their interactions, instead of only parallelizing across shapes.  Helps projects with few but large domains.
+  /// Geodesic distance queries of a mesh are serialized (see MeshWrapper), so domains using geodesics gain little.
+  void SetUseIntraShapeParallelism(bool enabled) { m_UseIntraShapeParallelism = enabled; }
+  bool GetUseIntraShapeParallelism() const { return m_UseIntraShapeParallelism; }
+
  protected:
   GradientDescentOptimizer();
   GradientDescentOptimizer(const GradientDescentOptimizer&);
@@ -132,13 +144,43 @@ class GradientDescentOptimizer : public itk::Object {
   double m_TimeStep;
   std::vector<std::vector<double> > m_TimeSteps;
   unsigned int m_verbosity;
+  IterationStats m_IterationStats;
 
   // Adaptive Initialization variables
   bool m_initialization_mode = false;
   size_t m_check_iterations = 50;
   double m_initialization_start_scaling_factor;
 
+  bool m_UseIntraShapeParallelism = false;
+
+  /// Number of particles updated by one task of the intra-shape parallel sweep.  Small, since a color only holds the
+  /// particles that are far enough apart
+  static constexpr unsigned int ParallelBlockSize = 8;
+
+  /// Domains with fewer particles are swept serially
+  static constexpr unsigned int MinParallelParticles = 64;
+
+  /// Particles closer than this times the previous iteration's largest neighborhood query may interact during the
+  /// intra-shape parallel sweep.  The margin covers the moves and sigma updates of the current iteration
+  static constexpr double ConflictRadiusFactor = 1.5;
+
+  using FunctionPoolType = tbb::concurrent_queue<typename GradientFunctionType::Pointer>;
+
   void ResetTimeStepVectors();
+
+  /// Adaptive gradient step of particle k of domain dom
+  void UpdateParticle(GradientFunctionType* function, unsigned int dom, unsigned int k, double minimumTimeStep,
+                      IterationStats& stats);
+
+  bool CanSweepInParallel(unsigned int dom) const;
+
+  /// Greedy coloring of the particles of domain dom such that particles of the same color are at least
+  /// conflict_radius apart.  Returns the particle indices of each color, in index order
+  std::vector<std::vector<unsigned int>> ColorConflictGraph(unsigned int dom, double conflict_radius) const;
+
+  /// Colored Gauss-Seidel sweep over the particles of domain dom, see the implementation for details
+  void SweepDomainInParallel(unsigned int dom, double interaction_radius, double minimumTimeStep,
+                             FunctionPoolType& function_pool, IterationStats& stats);
 };
 
 }  // namespace shapeworks
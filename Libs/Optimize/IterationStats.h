@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include "itkEventObject.h"
+
+namespace shapeworks {
+
+/**
+ * \struct IterationStats
+ *
+ * Statistics of a single iteration of the GradientDescentOptimizer.  Each
+ * shape accumulates its own IterationStats and the optimizer merges them in
+ * shape order, so the result does not depend on the number of threads or on
+ * how TBB schedules the shapes.
+ */
+struct IterationStats {
+  /** Time steps are binned by decade: bin i holds time steps in [10^(i-3), 10^(i-2)), the first and last bins also
+      hold everything below and above. */
+  static constexpr int NumTimeStepBins = 6;
+
+  unsigned int iteration = 0;
+
+  /** Lower bound on the per particle time step during this iteration (decays in the second half of the run). */
+  double minimum_time_step = 1.0;
+
+  /** Number of particles updated, and the largest and mean magnitude of the step applied to them. */
+  size_t num_particles = 0;
+  double max_step = 0.0;
+  double mean_step = 0.0;
+
+  /** Sum over the updated particles of their energy right after their step. */
+  double energy = 0.0;
+
+  /** Steps that were kept, and trial steps that increased the energy and were undone. */
+  size_t num_accepted = 0;
+  size_t num_rejected = 0;
+
+  /** Distribution of the per particle time steps at the end of the iteration. */
+  double min_time_step = 0.0;
+  double max_time_step = 0.0;
+  double mean_time_step = 0.0;
+  std::array<size_t, NumTimeStepBins> time_step_histogram{};
+
+  /** Number of times a scratch buffer of a sampling function had to grow during this iteration.  The buffers are
+      sized on the first iteration, so this should be zero afterwards.  Set by the optimizer, not merged. */
+  size_t workspace_allocations = 0;
+
+  /** Record the step finally taken by one particle, its resulting energy and its time step for the next iteration. */
+  void AddParticle(double step, double particle_energy, double time_step) {
+    if (num_particles == 0) {
+      min_time_step = time_step;
+      max_time_step = time_step;
+    } else {
+      min_time_step = std::min(min_time_step, time_step);
+      max_time_step = std::max(max_time_step, time_step);
+    }
+    num_particles++;
+    max_step = std::max(max_step, step);
+    energy += particle_energy;
+    sum_step_ += step;
+    sum_time_step_ += time_step;
+    time_step_histogram[TimeStepBin(time_step)]++;
+  }
+
+  /** Fold the statistics of another shape into this one. */
+  void Merge(const IterationStats& other) {
+    if (other.num_particles == 0) {
+      num_rejected += other.num_rejected;
+      return;
+    }
+    if (num_particles == 0) {
+      min_time_step = other.min_time_step;
+      max_time_step = other.max_time_step;
+    } else {
+      min_time_step = std::min(min_time_step, other.min_time_step);
+      max_time_step = std::max(max_time_step, other.max_time_step);
+    }
+    num_particles += other.num_particles;
+    num_accepted += other.num_accepted;
+    num_rejected += other.num_rejected;
+    max_step = std::max(max_step, other.max_step);
+    energy += other.energy;
+    sum_step_ += other.sum_step_;
+    sum_time_step_ += other.sum_time_step_;
+    for (int i = 0; i < NumTimeStepBins; i++) {
+      time_step_histogram[i] += other.time_step_histogram[i];
+    }
+  }
+
+  /** Compute the means once all shapes have been merged. */
+  void Finalize() {
+    mean_step = num_particles > 0 ? sum_step_ / num_particles : 0.0;
+    mean_time_step = num_particles > 0 ? sum_time_step_ / num_particles : 0.0;
+  }
+
+  static int TimeStepBin(double time_step) {
+    if (!(time_step > 0.0)) {
+      return 0;
+    }
+    const int bin = static_cast<int>(std::floor(std::log10(time_step))) + 3;
+    return std::clamp(bin, 0, NumTimeStepBins - 1);
+  }
+
+ private:
+  double sum_step_ = 0.0;
+  double sum_time_step_ = 0.0;
+};
+
+/**
+ * \class IterationStatsEvent
+ *
+ * IterationEvent that also carries the statistics of the iteration that just
+ * finished.  Observers registered for itk::IterationEvent receive it as well
+ * and may dynamic_cast the event to get at the statistics.
+ */
+class IterationStatsEvent : public itk::IterationEvent {
+ public:
+  typedef IterationStatsEvent Self;
+  typedef itk::IterationEvent Superclass;
+
+  IterationStatsEvent() {}
+  explicit IterationStatsEvent(const IterationStats& stats) : m_Stats(stats) {}
+  IterationStatsEvent(const Self& s) : itk::IterationEvent(s), m_Stats(s.m_Stats) {}
+  virtual ~IterationStatsEvent() {}
+
+  virtual const char* GetEventName() const { return "IterationStatsEvent"; }
+
+  virtual bool CheckEvent(const ::itk::EventObject* e) const { return dynamic_cast<const Self*>(e); }
+
+  virtual ::itk::EventObject* MakeObject() const { return new Self; }
+
+  const IterationStats& GetStats() const { return m_Stats; }
+
+ private:
+  void operator=(const Self&);  // purposely not implemented
+
+  IterationStats m_Stats;
+};
+
+}  // namespace shapeworks
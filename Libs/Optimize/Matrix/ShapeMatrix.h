@@ -1,5 +1,6 @@
 #pragma once
 
+#include <Eigen/Core>
 #include <cmath>
 
 #include "Domain/MeshDomain.h"
@@ -61,6 +62,12 @@ class ShapeMatrix : public vnl_matrix<double>, public Observer {
 
   virtual void SetMatrix(const vnl_matrix<double>& m) { vnl_matrix<double>::operator=(m); }
 
+  /** Row major Eigen view of the matrix data.  No copy is made, so the view is invalidated by a resize. */
+  using EigenMapType = Eigen::Map<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>;
+  using ConstEigenMapType = Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>>;
+  EigenMapType GetEigenMap() { return EigenMapType(this->data_block(), this->rows(), this->cols()); }
+  ConstEigenMapType GetEigenMap() const { return ConstEigenMapType(this->data_block(), this->rows(), this->cols()); }
+
   virtual void ResizeMatrix(int rs, int cs) {
     vnl_matrix<double> tmp(*this);  // copy existing  matrix
 
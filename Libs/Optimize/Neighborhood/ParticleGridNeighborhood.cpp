@@ -0,0 +1,227 @@
+#include "ParticleGridNeighborhood.h"
+
+#include <algorithm>
+
+namespace shapeworks {
+
+void ParticleGridNeighborhood::SetDomain(ParticleDomain::Pointer d) {
+  ParticleNeighborhood::SetDomain(d);
+
+  // Start from a fraction of the domain extent.  The cell size is adapted to the query radius once sampling starts.
+  double extent = 0.0;
+  for (unsigned int i = 0; i < Dimension; i++) {
+    extent = std::max(extent, d->GetUpperBound()[i] - d->GetLowerBound()[i]);
+  }
+  if (extent > 0.0) {
+    this->SetCellSize(extent / 16.0);
+  }
+}
+
+void ParticleGridNeighborhood::SetPositionStore(PositionStoreType* store) {
+  if (store == nullptr || store == m_Store.GetPointer()) {
+    return;
+  }
+  for (unsigned int idx = 0; idx < m_Present.size(); idx++) {
+    if (m_Present[idx]) {
+      store->Set(idx, m_Store->Get(idx));
+    }
+  }
+  m_Store = store;
+  Superclass::SetPositionStore(store);
+}
+
+void ParticleGridNeighborhood::SetCellSize(double cell_size) {
+  if (cell_size <= 0.0) {
+    return;
+  }
+  m_CellSize = cell_size;
+  m_InverseCellSize = 1.0 / cell_size;
+  this->Rebuild();
+}
+
+void ParticleGridNeighborhood::Rebuild() {
+  m_Cells.clear();
+  for (unsigned int idx = 0; idx < m_Present.size(); idx++) {
+    if (m_Present[idx]) {
+      this->InsertIntoCell(idx, this->CellKey(m_Store->Get(idx)));
+    }
+  }
+}
+
+void ParticleGridNeighborhood::UpdateCellSize() {
+  const double radius = m_QueryRadiusEstimate;
+  if (radius <= 0.0) {
+    return;
+  }
+  if (m_CellSize < 0.5 * radius || m_CellSize > 2.0 * radius) {
+    this->SetCellSize(radius);
+  }
+}
+
+void ParticleGridNeighborhood::InsertIntoCell(unsigned int idx, CellKeyType key) {
+  auto& cell = m_Cells[key];
+  m_ParticleCells[idx] = key;
+  m_ParticleSlots[idx] = cell.size();
+  cell.push_back(idx);
+}
+
+void ParticleGridNeighborhood::RemoveFromCell(unsigned int idx) {
+  // swap with the last entry of the cell.  Empty cells are kept so that particles moving back and forth between
+  // cells do not reallocate.
+  auto& cell = m_Cells[m_ParticleCells[idx]];
+  const auto slot = m_ParticleSlots[idx];
+  const auto last = cell.back();
+  cell[slot] = last;
+  m_ParticleSlots[last] = slot;
+  cell.pop_back();
+}
+
+void ParticleGridNeighborhood::AddPosition(const PointType& p, unsigned int idx, int) {
+  if (idx >= m_Present.size()) {
+    m_ParticleCells.resize(idx + 1);
+    m_ParticleSlots.resize(idx + 1);
+    m_Present.resize(idx + 1, 0);
+  }
+
+  if (m_Present[idx]) {
+    this->RemoveFromCell(idx);
+  }
+  m_Store->Set(idx, p);
+  m_Present[idx] = 1;
+  this->InsertIntoCell(idx, this->CellKey(p));
+}
+
+void ParticleGridNeighborhood::SetPosition(const PointType& p, unsigned int idx, int threadId) {
+  this->UpdateCellSize();
+
+  if (idx >= m_Present.size() || !m_Present[idx]) {
+    this->AddPosition(p, idx, threadId);
+    return;
+  }
+
+  // Only move between cells if the particle left its current cell.
+  m_Store->Set(idx, p);
+  const auto key = this->CellKey(p);
+  if (key != m_ParticleCells[idx]) {
+    this->RemoveFromCell(idx);
+    this->InsertIntoCell(idx, key);
+  }
+}
+
+void ParticleGridNeighborhood::RemovePosition(unsigned int idx, int) {
+  if (idx < m_Present.size() && m_Present[idx]) {
+    this->RemoveFromCell(idx);
+    m_Present[idx] = 0;
+  }
+}
+
+template <class Function>
+void ParticleGridNeighborhood::ForEachCandidate(const PointType& center, double radius, Function f) const {
+  this->RecordQueryRadius(radius);
+  const double estimate = m_QueryRadiusEstimate;
+  m_QueryRadiusEstimate = estimate > 0.0 ? 0.95 * estimate + 0.05 * radius : radius;
+
+  int64_t lo[3], hi[3];
+  double num_cells = 1.0;
+  for (unsigned int i = 0; i < Dimension; i++) {
+    lo[i] = this->CellCoordinate(center[i] - radius);
+    hi[i] = this->CellCoordinate(center[i] + radius);
+    num_cells *= static_cast<double>(hi[i] - lo[i] + 1);
+  }
+
+  // Same candidate set as the bounding box query of the point tree
+  const double* x = m_Store->GetX();
+  const double* y = m_Store->GetY();
+  const double* z = m_Store->GetZ();
+  auto in_box = [&](unsigned int idx) {
+    return std::abs(x[idx] - center[0]) <= radius && std::abs(y[idx] - center[1]) <= radius &&
+           std::abs(z[idx] - center[2]) <= radius;
+  };
+
+  if (num_cells > static_cast<double>(m_Cells.size())) {
+    // the radius covers more cells than are occupied, stream through the coordinate arrays instead
+    for (unsigned int idx = 0; idx < m_Present.size(); idx++) {
+      if (m_Present[idx] && in_box(idx)) {
+        f(idx);
+      }
+    }
+    return;
+  }
+
+  for (int64_t i = lo[0]; i <= hi[0]; i++) {
+    for (int64_t j = lo[1]; j <= hi[1]; j++) {
+      for (int64_t k = lo[2]; k <= hi[2]; k++) {
+        const auto it = m_Cells.find(CellKey(i, j, k));
+        if (it == m_Cells.end()) {
+          continue;
+        }
+        for (auto idx : it->second) {
+          if (in_box(idx)) {
+            f(idx);
+          }
+        }
+      }
+    }
+  }
+}
+
+unsigned int ParticleGridNeighborhood::FindNeighborhoodPoints(const PointType& center, int idx, double radius,
+                                                              PointVectorType& neighbors) const {
+  const auto domain = this->GetDomain();
+  neighbors.clear();
+  this->ForEachCandidate(center, radius, [&](unsigned int idx_b) {
+    const auto point = m_Store->Get(idx_b);
+    const double distance = domain->Distance(center, idx, point, idx_b);
+    if (distance < radius && distance > 0 && static_cast<int>(idx_b) != idx) {
+      neighbors.emplace_back(point, idx_b);
+    }
+  });
+  return neighbors.size();
+}
+
+ParticleGridNeighborhood::PointVectorType ParticleGridNeighborhood::FindNeighborhoodPoints(const PointType& center,
+                                                                                           int idx,
+                                                                                           double radius) const {
+  PointVectorType ret;
+  this->FindNeighborhoodPoints(center, idx, radius, ret);
+  return ret;
+}
+
+void ParticleGridNeighborhood::FindNeighborhoodPoints(const PointType& center, int idx, std::vector<double>& weights,
+                                                      std::vector<double>& distances, double radius,
+                                                      PointVectorType& neighbors) const {
+  GradientVectorType posnormal;
+  if (this->IsWeightingEnabled()) {
+    posnormal = this->GetDomain()->SampleNormalAtPoint(center, idx);
+  }
+
+  neighbors.clear();
+  weights.clear();
+  distances.clear();
+
+  this->ForEachCandidate(center, radius, [&](unsigned int idx_b) {
+    const auto point = m_Store->Get(idx_b);
+    double distance, weight;
+    if (this->TestNeighbor(center, idx, posnormal, point, idx_b, radius, distance, weight)) {
+      neighbors.emplace_back(point, idx_b);
+      distances.push_back(distance);
+      weights.push_back(weight);
+    }
+  });
+}
+
+ParticleGridNeighborhood::PointVectorType ParticleGridNeighborhood::FindNeighborhoodPoints(
+    const PointType& center, int idx, std::vector<double>& weights, std::vector<double>& distances,
+    double radius) const {
+  PointVectorType ret;
+  this->FindNeighborhoodPoints(center, idx, weights, distances, radius, ret);
+  return ret;
+}
+
+ParticleGridNeighborhood::PointVectorType ParticleGridNeighborhood::FindNeighborhoodPoints(
+    const PointType& center, int idx, std::vector<double>& weights, double radius) const {
+  std::vector<double> distances;
+  return this->FindNeighborhoodPoints(center, idx, weights, distances, radius);
+}
+
+}  // namespace shapeworks
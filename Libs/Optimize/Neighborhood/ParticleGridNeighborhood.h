@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "ParticleSurfaceNeighborhood.h"
+
+namespace shapeworks {
+/** \class ParticleGridNeighborhood
+ *
+ * ParticleGridNeighborhood computes the same neighborhoods as
+ * ParticleSurfaceNeighborhood (including normal based weighting), but caches
+ * points in a hashed uniform grid instead of a PowerOfTwoPointTree.  Moving a
+ * particle only touches the cells it leaves and enters, and queries visit the
+ * cells overlapping the search radius directly, writing into a caller-supplied
+ * buffer.  Coordinates are read from a structure-of-arrays position store,
+ * the one the particle system shares with its neighborhoods (see
+ * SetPositionStore) or one of its own when used on its own.
+ *
+ * The cell size follows the query radius, which the sampling function derives
+ * from the current sigma.  A running estimate of the radius is kept and the
+ * grid is rebuilt when the cell size drifts more than a factor of two away
+ * from it.
+ */
+class ParticleGridNeighborhood : public ParticleSurfaceNeighborhood {
+ public:
+  /** Standard class typedefs */
+  typedef ParticleGridNeighborhood Self;
+  typedef ParticleSurfaceNeighborhood Superclass;
+  typedef itk::SmartPointer<Self> Pointer;
+  typedef itk::SmartPointer<const Self> ConstPointer;
+  typedef itk::WeakPointer<const Self> ConstWeakPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ParticleGridNeighborhood, ParticleSurfaceNeighborhood);
+
+  /** Inherited typedefs from parent class. */
+  typedef typename Superclass::PointType PointType;
+  typedef typename Superclass::PointVectorType PointVectorType;
+  typedef typename Superclass::GradientVectorType GradientVectorType;
+  typedef typename Superclass::PositionStoreType PositionStoreType;
+
+  virtual PointVectorType FindNeighborhoodPoints(const PointType&, int idx, double) const override;
+  virtual unsigned int FindNeighborhoodPoints(const PointType&, int idx, double, PointVectorType&) const override;
+  virtual PointVectorType FindNeighborhoodPoints(const PointType&, int idx, std::vector<double>&, std::vector<double>&,
+                                                 double) const override;
+  virtual PointVectorType FindNeighborhoodPoints(const PointType&, int idx, std::vector<double>&,
+                                                 double) const override;
+  void FindNeighborhoodPoints(const PointType&, int idx, std::vector<double>&, std::vector<double>&, double,
+                              PointVectorType&) const override;
+
+  /** The grid does not need the region extent, so the point tree is not constructed. */
+  void SetDomain(ParticleDomain::Pointer p) override;
+
+  /** Read coordinates from the given store.  The particles added so far are copied into it. */
+  void SetPositionStore(PositionStoreType* store) override;
+
+  virtual void AddPosition(const PointType& p, unsigned int idx, int threadId = 0) override;
+  virtual void SetPosition(const PointType& p, unsigned int idx, int threadId = 0) override;
+  virtual void RemovePosition(unsigned int idx, int threadId = 0) override;
+
+  /** Set the cell size and rebuild the grid. */
+  void SetCellSize(double cell_size);
+  double GetCellSize() const { return m_CellSize; }
+
+  void PrintSelf(std::ostream& os, itk::Indent indent) const {
+    os << indent << "m_CellSize = " << m_CellSize << std::endl;
+    os << indent << "number of cells = " << m_Cells.size() << std::endl;
+  }
+
+ protected:
+  ParticleGridNeighborhood() : m_Store(PositionStoreType::New()) {}
+  virtual ~ParticleGridNeighborhood(){};
+
+ private:
+  ParticleGridNeighborhood(const Self&);  // purposely not implemented
+  void operator=(const Self&);            // purposely not implemented
+
+  using CellKeyType = uint64_t;
+
+  /** Integer cell coordinate of x along one axis. */
+  inline int64_t CellCoordinate(double x) const { return static_cast<int64_t>(std::floor(x * m_InverseCellSize)); }
+
+  /** Hash key of a cell.  21 bits per axis; cells that alias are harmless since every candidate is distance tested. */
+  static inline CellKeyType CellKey(int64_t i, int64_t j, int64_t k) {
+    constexpr uint64_t mask = (uint64_t(1) << 21) - 1;
+    return ((uint64_t(i) & mask) << 42) | ((uint64_t(j) & mask) << 21) | (uint64_t(k) & mask);
+  }
+
+  inline CellKeyType CellKey(const PointType& p) const {
+    return CellKey(CellCoordinate(p[0]), CellCoordinate(p[1]), CellCoordinate(p[2]));
+  }
+
+  void InsertIntoCell(unsigned int idx, CellKeyType key);
+  void RemoveFromCell(unsigned int idx);
+
+  /** Re-bin all particles after a cell size change. */
+  void Rebuild();
+
+  /** Rebuild if the running query radius estimate no longer matches the cell size. */
+  void UpdateCellSize();
+
+  /** Calls f(index) for every particle whose cell overlaps the box of the given radius around center. */
+  template <class Function>
+  void ForEachCandidate(const PointType& center, double radius, Function f) const;
+
+  double m_CellSize{1.0};
+  double m_InverseCellSize{1.0};
+
+  /** Running estimate of the query radius, updated by (const) queries and acted upon by position updates, which
+      happen on the thread that owns this domain.  Queries of the same domain may run concurrently during the intra-shape
+      parallel sweep, where a lost update only nudges the estimate. */
+  mutable std::atomic<double> m_QueryRadiusEstimate{0.0};
+
+  std::unordered_map<CellKeyType, std::vector<unsigned int>> m_Cells;
+
+  /** Particle coordinates, by index.  Positions are written here too, which is a no-op when the store is shared with
+      the particle system since it writes the same value first. */
+  typename PositionStoreType::Pointer m_Store;
+
+  /** Per particle index: cell, slot within that cell, and whether the index is present. */
+  std::vector<CellKeyType> m_ParticleCells;
+  std::vector<unsigned int> m_ParticleSlots;
+  std::vector<char> m_Present;
+};
+
+}  // end namespace shapeworks
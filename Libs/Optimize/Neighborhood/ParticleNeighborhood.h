@@ -1,8 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <limits>
 #include <vector>
 
 #include "Libs/Optimize/Container/GenericContainer.h"
+#include "Libs/Optimize/Container/ParticlePositionStore.h"
 #include "Libs/Optimize/Domain/ParticleDomain.h"
 #include "ParticlePointIndexPair.h"
 #include "itkDataObject.h"
@@ -50,6 +53,9 @@ class ParticleNeighborhood : public itk::DataObject {
       type. */
   typedef GenericContainer<PointType> PointContainerType;
 
+  /** Structure-of-arrays position store type.  This matches the itkParticleSystem position store type. */
+  typedef ParticlePositionStore PositionStoreType;
+
   /** Point list (vector) type.  This is the type of list returned by FindNeighborhoodPoints. */
   typedef std::vector<ParticlePointIndexPair> PointVectorType;
 
@@ -58,6 +64,11 @@ class ParticleNeighborhood : public itk::DataObject {
   itkSetObjectMacro(PointContainer, PointContainerType);
   itkGetConstObjectMacro(PointContainer, PointContainerType);
 
+  /** Set/Get the structure-of-arrays copy of the positions kept by the particle system.  Neighborhoods that scan many
+      candidates may read coordinates from it instead of keeping their own copy of every point. */
+  itkSetObjectMacro(PositionStore, PositionStoreType);
+  itkGetConstObjectMacro(PositionStore, PositionStoreType);
+
   /** Compile a list of points that are within a specified radius of a given
       point.  The default implementation will throw an exception. */
   virtual PointVectorType FindNeighborhoodPoints(const PointType&, int idx, double) const {
@@ -78,6 +89,12 @@ class ParticleNeighborhood : public itk::DataObject {
     itkExceptionMacro("No algorithm for finding neighbors has been specified.");
     return 0;
   }
+  /** Same as the weights and distances version above, but fills a caller-supplied list of neighbors so that
+      repeated queries can reuse its storage. */
+  virtual void FindNeighborhoodPoints(const PointType& p, int idx, std::vector<double>& w,
+                                      std::vector<double>& distances, double r, PointVectorType& neighbors) const {
+    neighbors = this->FindNeighborhoodPoints(p, idx, w, distances, r);
+  }
 
   /** Set the Domain that this neighborhood will use.  The Domain object is
       important because it defines bounds and distance measures. */
@@ -98,8 +115,27 @@ class ParticleNeighborhood : public itk::DataObject {
   virtual void SetPosition(const PointType& p, unsigned int idx, int threadId = 0) {}
   virtual void RemovePosition(unsigned int idx, int threadId = 0) {}
 
+  /** Largest radius queried since the last ResetMaxQueryRadius.  The optimizer uses it as the interaction range of a
+      particle when it partitions a domain for its intra-shape parallel sweep. */
+  double GetMaxQueryRadius() const { return m_MaxQueryRadius; }
+  void ResetMaxQueryRadius() const { m_MaxQueryRadius = 0.0; }
+
+  /** Largest radius the sampling functions may query, on top of their own maximum neighborhood radius.  Unlimited
+      by default; the optimizer lowers it to the coloring radius while it sweeps the domain in parallel. */
+  double GetQueryRadiusLimit() const { return m_QueryRadiusLimit; }
+  void SetQueryRadiusLimit(double radius) const { m_QueryRadiusLimit = radius; }
+  void ResetQueryRadiusLimit() const { m_QueryRadiusLimit = std::numeric_limits<double>::max(); }
+
  protected:
   ParticleNeighborhood() {}
+
+  /** Called by the FindNeighborhoodPoints implementations.  Queries may run concurrently. */
+  void RecordQueryRadius(double radius) const {
+    double current = m_MaxQueryRadius;
+    while (radius > current && !m_MaxQueryRadius.compare_exchange_weak(current, radius)) {
+    }
+  }
+
   void PrintSelf(std::ostream& os, itk::Indent indent) const { Superclass::PrintSelf(os, indent); }
   virtual ~ParticleNeighborhood(){};
 
@@ -108,7 +144,10 @@ class ParticleNeighborhood : public itk::DataObject {
   void operator=(const Self&);        // purposely not implemented
 
   typename PointContainerType::Pointer m_PointContainer;
+  typename PositionStoreType::Pointer m_PositionStore;
   typename DomainType::Pointer m_Domain;
+  mutable std::atomic<double> m_MaxQueryRadius{0.0};
+  mutable double m_QueryRadiusLimit{std::numeric_limits<double>::max()};
 };
 
 }  // end namespace shapeworks
@@ -11,6 +11,15 @@ void ParticleRegionNeighborhood::SetDomain(DomainType::Pointer d) {
 ParticleRegionNeighborhood::PointVectorType ParticleRegionNeighborhood::FindNeighborhoodPoints(const PointType& center,
                                                                                                int idx,
                                                                                                double radius) const {
+  PointVectorType ret;
+  this->FindNeighborhoodPoints(center, idx, radius, ret);
+  return ret;
+}
+
+unsigned int ParticleRegionNeighborhood::FindNeighborhoodPoints(const PointType& center, int idx, double radius,
+                                                                PointVectorType& neighbors) const {
+  this->RecordQueryRadius(radius);
+
   // Compute bounding box of the given hypersphere.
   PointType l, u;
   for (unsigned int i = 0; i < VDimension; i++) {
@@ -21,21 +30,22 @@ ParticleRegionNeighborhood::PointVectorType ParticleRegionNeighborhood::FindNeig
   // Grab the list of points in this bounding box.
   typename PointTreeType::PointIteratorListType pointlist = m_Tree->FindPointsInRegion(l, u);
 
-  // Allocate return vector.  Reserve ensures no extra copies occur.
-  PointVectorType ret;
-  ret.reserve(pointlist.size());
+  neighbors.clear();
+  neighbors.reserve(pointlist.size());
 
   // Add any point whose distance from center is less than radius to the return
   // list.
   for (typename PointTreeType::PointIteratorListType::const_iterator it = pointlist.begin(); it != pointlist.end();
        it++) {
     double distance = this->GetDomain()->Distance(center, idx, (*it)->Point, (*it)->Index);
-    if (distance < radius && distance > 0) {
-      ret.push_back(**it);
+    // particles are excluded by index as well, since a neighborhood with deferred updates may still hold the old
+    // position of the particle being moved
+    if (distance < radius && distance > 0 && (*it)->Index != idx) {
+      neighbors.push_back(**it);
     }
   }
 
-  return ret;
+  return neighbors.size();
 }
 
 void ParticleRegionNeighborhood::AddPosition(const PointType& p, unsigned int idx, int) {
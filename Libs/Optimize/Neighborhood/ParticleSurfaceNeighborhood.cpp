@@ -1,17 +1,17 @@
-
 #include "ParticleSurfaceNeighborhood.h"
 
 namespace shapeworks {
-ParticleSurfaceNeighborhood::PointVectorType ParticleSurfaceNeighborhood::FindNeighborhoodPoints(
-    const PointType& center, int idx, std::vector<double>& weights, std::vector<double>& distances,
-    double radius) const {
-  const auto domain = this->GetDomain();
+void ParticleSurfaceNeighborhood::FindNeighborhoodPoints(const PointType& center, int idx,
+                                                         std::vector<double>& weights, std::vector<double>& distances,
+                                                         double radius, PointVectorType& neighbors) const {
+  this->RecordQueryRadius(radius);
 
   GradientVectorType posnormal;
   if (m_WeightingEnabled) {  // uninitialized otherwise, but we're trying to avoid looking up the normal if we can
-    posnormal = domain->SampleNormalAtPoint(center, idx);
+    posnormal = this->GetDomain()->SampleNormalAtPoint(center, idx);
   }
 
+  neighbors.clear();
   weights.clear();
   distances.clear();
 
@@ -25,54 +25,25 @@ ParticleSurfaceNeighborhood::PointVectorType ParticleSurfaceNeighborhood::FindNe
   // Grab the list of points in this bounding box.
   typename PointTreeType::PointIteratorListType pointlist = Superclass::m_Tree->FindPointsInRegion(l, u);
 
-  // Allocate return vector.  Reserve ensures no extra copies occur.
-  PointVectorType ret;
-  ret.reserve(pointlist.size());  // todo investigate performance here: does it actually help?
+  neighbors.reserve(pointlist.size());
   weights.reserve(pointlist.size());
 
   // Add any point whose distance from center is less than radius to the return list
   for (auto it = pointlist.begin(); it != pointlist.end(); it++) {
-    const auto& pt_b = (*it)->Point;
-    const auto& idx_b = (*it)->Index;
-
-    // we are not a neighbor of ourself.
-    if (idx_b == idx) {
-      continue;
-    }
-
-    double distance;
-    bool is_within_distance;
-
-    if (m_ForceEuclidean) {
-      distance = center.EuclideanDistanceTo(pt_b);
-      is_within_distance = distance < radius;
-    } else {
-      is_within_distance = domain->IsWithinDistance(center, idx, pt_b, idx_b, radius, distance);
-    }
-
-    if (is_within_distance) {
-      ret.push_back(**it);
+    double distance, weight;
+    if (this->TestNeighbor(center, idx, posnormal, (*it)->Point, (*it)->Index, radius, distance, weight)) {
+      neighbors.push_back(**it);
       distances.push_back(distance);
-
-      // todo change the APIs so don't have to pass a std::vector<double> of 1s whenever weighting is disabled
-      if (!m_WeightingEnabled) {
-        weights.push_back(1.0);
-        continue;
-      }
-
-      const GradientVectorType pn = domain->SampleNormalAtPoint((*it)->Point, (*it)->Index);
-      const double cosine = dot_product(posnormal, pn);  // normals already normalized
-      if (cosine >= m_FlatCutoff) {
-        weights.push_back(1.0);
-      } else {
-        // Drop to zero influence over 90 degrees.
-        weights.push_back(cos((m_FlatCutoff - cosine) / (1.0 + m_FlatCutoff) * 1.5708));
-
-        // More quickly drop to zero influence
-        // weights.push_back( exp((cosine - m_FlatCutoff) / (1.0 + m_FlatCutoff) * 4.0) );
-      }
+      weights.push_back(weight);
     }
   }
+}
+
+ParticleSurfaceNeighborhood::PointVectorType ParticleSurfaceNeighborhood::FindNeighborhoodPoints(
+    const PointType& center, int idx, std::vector<double>& weights, std::vector<double>& distances,
+    double radius) const {
+  PointVectorType ret;
+  this->FindNeighborhoodPoints(center, idx, weights, distances, radius, ret);
   return ret;
 }
 
@@ -82,4 +53,46 @@ ParticleSurfaceNeighborhood::PointVectorType ParticleSurfaceNeighborhood::FindNe
   return this->FindNeighborhoodPoints(center, idx, weights, distances, radius);
 }
 
+bool ParticleSurfaceNeighborhood::TestNeighbor(const PointType& center, int idx, const GradientVectorType& posnormal,
+                                               const PointType& pt_b, int idx_b, double radius, double& distance,
+                                               double& weight) const {
+  // we are not a neighbor of ourself.
+  if (idx_b == idx) {
+    return false;
+  }
+
+  const auto domain = this->GetDomain();
+
+  bool is_within_distance;
+  if (m_ForceEuclidean) {
+    distance = center.EuclideanDistanceTo(pt_b);
+    is_within_distance = distance < radius;
+  } else {
+    is_within_distance = domain->IsWithinDistance(center, idx, pt_b, idx_b, radius, distance);
+  }
+
+  if (!is_within_distance) {
+    return false;
+  }
+
+  // todo change the APIs so don't have to pass a std::vector<double> of 1s whenever weighting is disabled
+  if (!m_WeightingEnabled) {
+    weight = 1.0;
+    return true;
+  }
+
+  const GradientVectorType pn = domain->SampleNormalAtPoint(pt_b, idx_b);
+  const double cosine = dot_product(posnormal, pn);  // normals already normalized
+  if (cosine >= m_FlatCutoff) {
+    weight = 1.0;
+  } else {
+    // Drop to zero influence over 90 degrees.
+    weight = cos((m_FlatCutoff - cosine) / (1.0 + m_FlatCutoff) * 1.5708);
+
+    // More quickly drop to zero influence
+    // weight = exp((cosine - m_FlatCutoff) / (1.0 + m_FlatCutoff) * 4.0);
+  }
+  return true;
+}
+
 }  // namespace shapeworks
@@ -51,6 +51,9 @@ class ParticleSurfaceNeighborhood : public ParticleRegionNeighborhood {
                                                  double) const override;
   virtual PointVectorType FindNeighborhoodPoints(const PointType&, int idx, std::vector<double>&,
                                                  double) const override;
+  /** Same as above, but fills a caller-supplied list of neighbors. */
+  void FindNeighborhoodPoints(const PointType&, int idx, std::vector<double>&, std::vector<double>&, double,
+                              PointVectorType&) const override;
   //  virtual unsigned int  FindNeighborhoodPoints(const PointType &, double, PointVectorType &) const;
 
   void SetWeightingEnabled(bool is_enabled) { m_WeightingEnabled = is_enabled; }
@@ -67,6 +70,11 @@ class ParticleSurfaceNeighborhood : public ParticleRegionNeighborhood {
   ParticleSurfaceNeighborhood() : m_FlatCutoff(0.30) {}
   virtual ~ParticleSurfaceNeighborhood(){};
 
+  /** Returns true if point pt_b (index idx_b) lies within radius of center (index idx), and computes its distance
+      and weight.  posnormal is the normal at center, and is only used when weighting is enabled. */
+  bool TestNeighbor(const PointType& center, int idx, const GradientVectorType& posnormal, const PointType& pt_b,
+                    int idx_b, double radius, double& distance, double& weight) const;
+
  private:
   ParticleSurfaceNeighborhood(const Self&);  // purposely not implemented
   void operator=(const Self&);               // purposely not implemented
@@ -23,9 +23,13 @@
 
 // shapeworks
 #include <Libs/Particles/ParticleFile.h>
+#include <Libs/Particles/ParticleStore.h>
 #include <Project/Project.h>
 
+#include "Libs/Optimize/Domain/GeodesicCacheManager.h"
+#include "Libs/Optimize/Domain/MeshDomain.h"
 #include "Libs/Optimize/Domain/MeshWrapper.h"
+#include "Libs/Optimize/Utils/CheckpointWriter.h"
 #include "Libs/Optimize/Utils/ObjectReader.h"
 #include "Libs/Optimize/Utils/ObjectWriter.h"
 #include "Libs/Optimize/Utils/ParticleGoodBadAssessment.h"
@@ -72,6 +76,10 @@ bool Optimize::Run() {
 
   ShapeWorksUtils::setup_threads();
 
+  // report the geodesic cache statistics of this run only (the manager is process-wide)
+  FlushGeodesicCacheStats();
+  GeodesicCacheManager::Instance().ResetStats();
+
   if (m_python_filename != "") {
 #ifdef _WIN32
     // need to set PYTHONHOME to the same directory as python.exe on Windows
@@ -472,6 +480,8 @@ void Optimize::InitializeSampler() {
     this->GetSampler()->GetParticleSystem()->FlagDomain(this->m_domain_flags[i]);
   }
 
+  m_sampler->GetParticleSystem()->SetBatchPositionEvents(m_batch_position_events);
+
   m_sampler->Initialize();
 
   m_sampler->GetOptimizer()->SetTolerance(0.0);
@@ -854,6 +864,13 @@ void Optimize::RunOptimize() {
   this->WriteCuttingPlanePoints();
   this->WriteParameters();
   if (m_verbosity_level > 0) {
+    if (m_geodesics_enabled) {
+      // the meshes publish their hit counts on a miss, so hits since the last miss are still held locally
+      FlushGeodesicCacheStats();
+      const auto stats = GeodesicCacheManager::Instance().GetStats();
+      SW_LOG("Geodesic cache: {} hits, {} misses, {} evictions, peak {:.1f} MB (budget {} MB)", stats.hits,
+             stats.misses, stats.evictions, stats.peak_bytes / (1024.0 * 1024.0), stats.budget / (1024 * 1024));
+    }
     std::cout << "Finished optimization!!!" << std::endl;
   }
 }
@@ -868,7 +885,11 @@ void Optimize::AbortOptimization() {
 }
 
 //---------------------------------------------------------------------------
-void Optimize::IterateCallback(itk::Object*, const itk::EventObject&) {
+void Optimize::IterateCallback(itk::Object*, const itk::EventObject& e) {
+  if (auto stats_event = dynamic_cast<const IterationStatsEvent*>(&e)) {
+    m_iteration_stats = stats_event->GetStats();
+  }
+
   if (this->iteration_callback_) {
     this->iteration_callback_();
   }
@@ -929,20 +950,33 @@ void Optimize::IterateCallback(itk::Object*, const itk::EventObject&) {
     if (m_checkpoint_counter == (int)m_checkpointing_interval) {
       m_checkpoint_counter = 0;
 
-      this->WritePointFiles();
-      this->WriteTransformFile();
-      this->WriteTransformFiles();
-      this->WritePointFilesWithFeatures();
-      this->WriteModes();
-      this->WriteParameters();
-      this->WriteEnergyFiles();
-
-      if (m_keep_checkpoints) {
-        this->WritePointFiles(this->GetCheckpointDir());
-        this->WritePointFilesWithFeatures(this->GetCheckpointDir());
-        this->WriteTransformFile(this->GetCheckpointDir() + "/transform");
-        this->WriteTransformFiles(this->GetCheckpointDir());
-        this->WriteParameters(this->GetCheckpointDir());
+      if (m_use_async_checkpoints) {
+        // the per domain files go to the I/O thread, the rest is small or only written for regression
+        this->SubmitCheckpoint();
+        this->WriteModes();
+        this->WriteParameters();
+        this->WriteEnergyFiles();
+        if (m_keep_checkpoints && !m_use_particle_store) {
+          this->WriteParameters(this->GetCheckpointDir());
+        }
+      } else {
+        this->WritePointFiles();
+        this->WriteTransformFile();
+        this->WriteTransformFiles();
+        this->WritePointFilesWithFeatures();
+        this->WriteModes();
+        this->WriteParameters();
+        this->WriteEnergyFiles();
+
+        if (m_keep_checkpoints && m_use_particle_store) {
+          this->AppendToParticleStore(this->GetCheckpointName());
+        } else if (m_keep_checkpoints) {
+          this->WritePointFiles(this->GetCheckpointDir());
+          this->WritePointFilesWithFeatures(this->GetCheckpointDir());
+          this->WriteTransformFile(this->GetCheckpointDir() + "/transform");
+          this->WriteTransformFiles(this->GetCheckpointDir());
+          this->WriteParameters(this->GetCheckpointDir());
+        }
       }
     }
   }
@@ -1143,6 +1177,7 @@ void Optimize::WriteTransformFile(std::string iter_prefix) const {
   if (!this->m_file_output_enabled) {
     return;
   }
+  this->WaitForCheckpoint();
 
   std::string output_file = iter_prefix;
 
@@ -1183,6 +1218,7 @@ void Optimize::WriteTransformFiles(std::string iter_prefix) const {
   if (!this->m_file_output_enabled || !this->m_output_transform_files) {
     return;
   }
+  this->WaitForCheckpoint();
 
   this->PrintStartMessage("Writing transform files...\n");
 
@@ -1241,6 +1277,7 @@ void Optimize::WritePointFiles(std::string iter_prefix) {
   if (!this->m_file_output_enabled) {
     return;
   }
+  this->WaitForCheckpoint();
 
   this->PrintStartMessage("Writing point files...\n");
 #ifdef _WIN32
@@ -1318,6 +1355,7 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix) {
   if (!m_mesh_based_attributes) {
     return;
   }
+  this->WaitForCheckpoint();
 
   this->PrintStartMessage("Writing point with attributes files...\n");
   typedef Sampler::PointType PointType;
@@ -1403,6 +1441,116 @@ void Optimize::WritePointFilesWithFeatures(std::string iter_prefix) {
   this->PrintDoneMessage();
 }
 
+//---------------------------------------------------------------------------
+void Optimize::SubmitCheckpoint() {
+  if (!this->m_file_output_enabled) {
+    return;
+  }
+
+  if (!m_checkpoint_writer) {
+    m_checkpoint_writer = std::make_unique<CheckpointWriter>();
+  }
+
+  // the writer reuses its buffers, so the Eigen resizes in FillSnapshot only allocate when the particle counts change
+  auto& snapshot = m_checkpoint_writer->GetSnapshot();
+  snapshot.targets.clear();
+  snapshot.targets.push_back({m_output_dir, m_output_dir + "/" + m_output_transform_file});
+  snapshot.store_file.clear();
+  if (m_keep_checkpoints && m_use_particle_store) {
+    snapshot.store_file = this->GetParticleStoreFile();
+    snapshot.store_name = this->GetCheckpointName();
+  } else if (m_keep_checkpoints) {
+    const auto checkpoint_dir = this->GetCheckpointDir();
+    snapshot.targets.push_back({checkpoint_dir, checkpoint_dir + "/transform"});
+  }
+  this->FillSnapshot(snapshot);
+
+  m_checkpoint_writer->Submit();
+}
+
+//---------------------------------------------------------------------------
+void Optimize::FillSnapshot(CheckpointWriter::Snapshot& snapshot) const {
+  snapshot.particle_format = particle_format_;
+  snapshot.write_transform_files = m_output_transform_files;
+
+  auto ps = m_sampler->GetParticleSystem();
+  const int n = ps->GetNumberOfDomains();
+  snapshot.domains.resize(n);
+  snapshot.transforms.resize(n);
+  for (int i = 0; i < n; i++) {
+    auto& domain = snapshot.domains[i];
+    domain.name = m_filenames[i];
+
+    const int num_particles = ps->GetNumberOfParticles(i);
+    const bool use_normals = m_use_normals[i % m_domains_per_shape];
+    domain.local.resize(num_particles * 3);
+    domain.world.resize(num_particles * 3);
+    if (m_mesh_based_attributes) {
+      domain.features.resize(num_particles, use_normals ? 6 : 3);
+    } else {
+      domain.features.resize(0, 0);
+    }
+
+    const auto transform = ps->GetTransform(i) * ps->GetPrefixTransform(i);
+    for (int j = 0; j < num_particles; j++) {
+      const auto& pos = ps->GetPosition(j, i);
+      const auto wpos = ps->GetTransformedPosition(j, i);
+      for (int k = 0; k < 3; k++) {
+        domain.local(j * 3 + k) = pos[k];
+        domain.world(j * 3 + k) = wpos[k];
+      }
+
+      if (m_mesh_based_attributes) {
+        for (int k = 0; k < 3; k++) {
+          domain.features(j, k) = wpos[k];
+        }
+        if (use_normals) {
+          vnl_vector_fixed<float, DIMENSION> pG = ps->GetDomain(i)->SampleNormalAtPoint(pos, j);
+          VectorType pN;
+          pN[0] = pG[0];
+          pN[1] = pG[1];
+          pN[2] = pG[2];
+          pN = ps->TransformVector(pN, transform);
+          for (int k = 0; k < 3; k++) {
+            domain.features(j, 3 + k) = pN[k];
+          }
+        }
+      }
+    }
+
+    snapshot.transforms[i] = ps->GetTransform(i);
+  }
+}
+
+//---------------------------------------------------------------------------
+std::string Optimize::GetParticleStoreFile() const {
+  return m_output_dir + "/particles" + particles::STORE_EXTENSION;
+}
+
+//---------------------------------------------------------------------------
+void Optimize::AppendToParticleStore(const std::string& name) {
+  if (!this->m_file_output_enabled) {
+    return;
+  }
+  // an asynchronous checkpoint may be appending to the same store
+  this->WaitForCheckpoint();
+
+  this->PrintStartMessage("Writing " + name + " to " + this->GetParticleStoreFile() + "\n");
+  CheckpointWriter::Snapshot snapshot;
+  snapshot.store_file = this->GetParticleStoreFile();
+  snapshot.store_name = name;
+  this->FillSnapshot(snapshot);
+  CheckpointWriter::WriteSnapshot(snapshot);
+  this->PrintDoneMessage();
+}
+
+//---------------------------------------------------------------------------
+void Optimize::WaitForCheckpoint() const {
+  if (m_checkpoint_writer) {
+    m_checkpoint_writer->Wait();
+  }
+}
+
 //---------------------------------------------------------------------------
 void Optimize::WriteEnergyFiles() {
   if (!this->m_file_output_enabled) {
@@ -1469,6 +1617,10 @@ void Optimize::WriteSplitFiles(std::string name) {
     ssp.str("");
   }
   dir_name += name;
+  if (m_use_particle_store) {
+    this->AppendToParticleStore(dir_name);
+    return;
+  }
   std::string out_path = m_output_dir;
   std::string tmp_dir_name = out_path + "/" + dir_name;
 
@@ -1677,6 +1829,15 @@ void Optimize::ReportBadParticles() {
   this->PrintDoneMessage(2);
 }
 
+//---------------------------------------------------------------------------
+void Optimize::FlushGeodesicCacheStats() const {
+  for (unsigned int i = 0; i < m_sampler->GetParticleSystem()->GetNumberOfDomains(); i++) {
+    if (auto domain = dynamic_cast<const MeshDomain*>(m_sampler->GetParticleSystem()->GetDomain(i))) {
+      domain->FlushGeodesicCacheStats();
+    }
+  }
+}
+
 //---------------------------------------------------------------------------
 std::vector<std::vector<itk::Point<double>>> Optimize::GetLocalPoints() { return this->m_local_points; }
 
@@ -1855,26 +2016,46 @@ void Optimize::SetPerformGoodBad(bool perform_good_bad) { this->m_perform_good_b
 void Optimize::SetLogEnergy(bool log_energy) { this->m_log_energy = log_energy; }
 
 //---------------------------------------------------------------------------
-void Optimize::AddImage(ImageType::Pointer image, std::string name) {
-  m_sampler->AddImage(image, this->GetNarrowBand(), name);
+void Optimize::AddImage(ImageType::Pointer image, std::string name) { AddImageDomain(CreateImageDomain(image), name); }
+
+//---------------------------------------------------------------------------
+Sampler::ImageDomainInput Optimize::CreateImageDomain(ImageType::Pointer image) {
+  return Sampler::CreateImageDomain(image, this->GetNarrowBand());
+}
+
+//---------------------------------------------------------------------------
+void Optimize::AddImageDomain(const Sampler::ImageDomainInput& input, std::string name) {
+  m_sampler->AddImageDomain(input, name);
   this->m_num_shapes++;
-  if (image) {
-    this->m_spacing = image->GetSpacing()[0] * 5;
+  if (!input.domain->IsDomainFixed()) {
+    this->m_spacing = input.domain->GetSpacing()[0] * 5;
   }
 }
 
 //---------------------------------------------------------------------------
-void Optimize::AddMesh(vtkSmartPointer<vtkPolyData> poly_data) {
+void Optimize::AddMesh(vtkSmartPointer<vtkPolyData> poly_data) { AddMeshDomain(CreateMeshDomain(poly_data)); }
+
+//---------------------------------------------------------------------------
+std::shared_ptr<MeshDomain> Optimize::CreateMeshDomain(vtkSmartPointer<vtkPolyData> poly_data) {
+  auto domain = std::make_shared<MeshDomain>();
   if (poly_data == nullptr) {
     // fixed domain
-    m_sampler->AddMesh(nullptr);
-  } else {
-    double geodesic_remesh_percent = m_geodesics_enabled ? m_geodesic_remesh_percent : 100;
-
-    const auto mesh =
-        std::make_shared<shapeworks::MeshWrapper>(poly_data, m_geodesics_enabled, m_geodesic_cache_size_multiplier);
-    m_sampler->AddMesh(mesh, geodesic_remesh_percent);
+    return domain;
+  }
+  double geodesic_remesh_percent = m_geodesics_enabled ? m_geodesic_remesh_percent : 100;
+  if (m_geodesics_enabled) {
+    GeodesicCacheManager::Instance().SetBudget(m_geodesic_cache_budget_mb * 1024 * 1024);
   }
+
+  const auto mesh =
+      std::make_shared<shapeworks::MeshWrapper>(poly_data, m_geodesics_enabled, m_geodesic_cache_size_multiplier);
+  domain->SetMesh(mesh, geodesic_remesh_percent);
+  return domain;
+}
+
+//---------------------------------------------------------------------------
+void Optimize::AddMeshDomain(std::shared_ptr<MeshDomain> domain) {
+  m_sampler->AddMeshDomain(domain);
   this->m_num_shapes++;
   this->m_spacing = 0.5;
 }
@@ -2044,7 +2225,7 @@ MatrixContainer Optimize::GetParticleSystem() {
 }
 
 //---------------------------------------------------------------------------
-std::string Optimize::GetCheckpointDir() {
+std::string Optimize::GetCheckpointName() {
   int num_digits = std::to_string(abs(m_total_iterations)).length();
   std::stringstream ss;
   ss << std::setw(num_digits) << std::setfill('0')  // set leading zeros
@@ -2061,6 +2242,11 @@ std::string Optimize::GetCheckpointDir() {
     suffix = "_opt";
   }
 
+  return "p" + ssp.str() + suffix + "_iter" + ss.str();
+}
+
+//---------------------------------------------------------------------------
+std::string Optimize::GetCheckpointDir() {
   std::string out_path = m_output_dir + "/checkpoints";
 
 #ifdef _WIN32
@@ -2069,9 +2255,7 @@ std::string Optimize::GetCheckpointDir() {
   mkdir(out_path.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
 #endif
 
-  out_path = out_path + "/p" + ssp.str() + suffix + "_iter" + ss.str();
-
-  return out_path;
+  return out_path + "/" + this->GetCheckpointName();
 }
 
 //---------------------------------------------------------------------------
@@ -2083,9 +2267,18 @@ void Optimize::SetGeodesicsEnabled(bool is_enabled) { this->m_geodesics_enabled
 //---------------------------------------------------------------------------
 void Optimize::SetGeodesicsCacheSizeMultiplier(size_t n) { this->m_geodesic_cache_size_multiplier = n; }
 
+//---------------------------------------------------------------------------
+void Optimize::SetGeodesicsCacheBudget(size_t megabytes) { this->m_geodesic_cache_budget_mb = megabytes; }
+
 //---------------------------------------------------------------------------
 void Optimize::SetGeodesicsRemeshPercent(double percent) { m_geodesic_remesh_percent = percent; }
 
+//---------------------------------------------------------------------------
+void Optimize::SetBatchPositionEvents(bool enabled) { m_batch_position_events = enabled; }
+
+//---------------------------------------------------------------------------
+void Optimize::SetUseAsyncCheckpoints(bool enabled) { m_use_async_checkpoints = enabled; }
+
 //---------------------------------------------------------------------------
 vnl_vector_fixed<double, 3> Optimize::TransformPoint(int domain, vnl_vector_fixed<double, 3> input) {
   // If initial transform provided, transform cutting plane points
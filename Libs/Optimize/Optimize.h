@@ -5,6 +5,7 @@
 #endif
 
 // std
+#include <memory>
 #include <random>
 #include <string>
 #include <vector>
@@ -20,13 +21,16 @@
 
 #include "Libs/Optimize/Domain/DomainType.h"
 #include "Libs/Optimize/Function/VectorFunction.h"
+#include "Libs/Optimize/Utils/CheckpointWriter.h"
 #include "Libs/Optimize/Utils/OptimizationVisualizer.h"
+#include "IterationStats.h"
 #include "ProcrustesRegistration.h"
 #include "Sampler.h"
 
 namespace shapeworks {
 
 class Project;
+class MeshDomain;
 class ParticleGoodBadAssessment;
 
 class MatrixContainer {
@@ -73,6 +77,9 @@ class Optimize {
   //! Set an iteration callback function to be called after each iteration
   void SetIterationCallbackFunction(const std::function<void(void)>& f) { this->iteration_callback_ = f; }
 
+  //! Statistics of the most recent iteration (step sizes, accepted/rejected steps, time steps)
+  const IterationStats& GetIterationStats() const { return m_iteration_stats; }
+
   //! Abort optimization
   void AbortOptimization();
 
@@ -221,6 +228,18 @@ class Optimize {
   void AddMesh(vtkSmartPointer<vtkPolyData> poly_data);
   void AddContour(vtkSmartPointer<vtkPolyData> poly_data);
 
+  //! Build the domain for a mesh (null for a fixed domain).  This is the expensive part of AddMesh (cleaning, normals,
+  //! locators, geodesics) and may be called concurrently for different meshes once the geodesic settings are made
+  std::shared_ptr<MeshDomain> CreateMeshDomain(vtkSmartPointer<vtkPolyData> poly_data);
+  //! Add a domain built by CreateMeshDomain, domains are numbered in the order they are added
+  void AddMeshDomain(std::shared_ptr<MeshDomain> domain);
+
+  //! Build the narrow band domain for an image (null for a fixed domain) so the image can be released before the
+  //! domain is added.  May be called concurrently for different images once the narrow band is set
+  Sampler::ImageDomainInput CreateImageDomain(ImageType::Pointer image);
+  //! Add a domain built by CreateImageDomain, domains are numbered in the order they are added
+  void AddImageDomain(const Sampler::ImageDomainInput& input, std::string name = "");
+
   //! Set the shape filenames (TODO: details)
   void SetFilenames(const std::vector<std::string>& filenames);
   //! Set starting point files (TODO: details)
@@ -288,9 +307,41 @@ class Optimize {
   //! n * number_of_triangles
   void SetGeodesicsCacheSizeMultiplier(size_t n);
 
+  //! Set the process-wide memory budget (in megabytes) shared by the geodesic caches of all meshes.
+  //! 0 (default) leaves only the per mesh limit set by the cache size multiplier
+  void SetGeodesicsCacheBudget(size_t megabytes);
+
   //! Set the remeshing percent for the mesh used for computing geodesics (0-100)
   void SetGeodesicsRemeshPercent(double percent);
 
+  //! Set whether particle position events are batched once per domain sweep
+  void SetBatchPositionEvents(bool enabled);
+
+  //! Set whether checkpoints are written on a background thread, so that the optimizer does not wait for the
+  //! file system at each checkpoint interval
+  void SetUseAsyncCheckpoints(bool enabled);
+
+  //! Set whether split files and kept checkpoints are appended to a single particle store in the output directory
+  //! (see particles::ParticleStore) instead of a directory of files each
+  void SetUseParticleStore(bool enabled) { m_use_particle_store = enabled; }
+
+  //! Set whether neighborhoods use a hashed uniform grid instead of the octree
+  void SetUseGridNeighborhood(bool enabled) { m_sampler->SetUseGridNeighborhood(enabled); }
+
+  //! Set whether the particles of large mesh domains are also updated in parallel (multi-colored Gauss-Seidel over
+  //! non-interacting particles), in addition to the parallelism across shapes
+  void SetUseIntraShapeParallelism(bool enabled) {
+    m_sampler->GetOptimizer()->SetUseIntraShapeParallelism(enabled);
+  }
+
+  //! Set whether free-form constraints are evaluated from a narrow band voxel cache instead of the mesh
+  void SetUseFFCVoxelCache(bool enabled) { m_sampler->SetUseFFCVoxelCache(enabled); }
+
+  //! Set whether the correspondence term keeps its inverse covariance in factored form instead of a dense matrix
+  void SetUseFactoredCovariance(bool enabled) {
+    m_sampler->GetMeshBasedGeneralEntropyGradientFunction()->SetUseFactoredInverseCovariance(enabled);
+  }
+
   OptimizationVisualizer& GetVisualizer();
   void SetShowVisualizer(bool show);
   bool GetShowVisualizer();
@@ -302,6 +353,7 @@ class Optimize {
 
   void UpdateProgress();
 
+  //! Extension of the particle files written: "particles" (text), "vtk" or "pbin" (binary, see particles::ParticleFileView)
   void set_particle_format(std::string format) { particle_format_ = format; }
 
  protected:
@@ -337,11 +389,28 @@ class Optimize {
   void WritePointFilesWithFeatures(int iter = -1);
   void WritePointFilesWithFeatures(std::string iter_prefix);
   void WriteEnergyFiles();
+
+  //! Snapshot the point files, point files with features and transforms and hand them to the checkpoint writer
+  void SubmitCheckpoint();
+
+  //! Wait for the checkpoint writer, so that a synchronous write is not overwritten by an older checkpoint
+  void WaitForCheckpoint() const;
+
+  //! Copy the particles, features and transforms of all domains into snapshot
+  void FillSnapshot(CheckpointWriter::Snapshot& snapshot) const;
+
+  std::string GetParticleStoreFile() const;
+
+  //! Append the current particles, features and transforms to the particle store as snapshot name
+  void AppendToParticleStore(const std::string& name);
   void WriteSplitFiles(std::string name);
   void WriteCuttingPlanePoints(int iter = -1);
   void WriteParameters(std::string output_dir = "");
   void ReportBadParticles();
 
+  //! Publish the geodesic cache counters that the meshes of all domains still hold locally
+  void FlushGeodesicCacheStats() const;
+
   int SetParameters();
   void WriteModes();
 
@@ -355,6 +424,9 @@ class Optimize {
 
   void UpdateProject();
 
+  // return a checkpoint name (e.g. p128_opt_iter0100) for the current iteration
+  std::string GetCheckpointName();
+
   // return a checkpoint dir for the current iteration
   std::string GetCheckpointDir();
 
@@ -423,7 +495,12 @@ class Optimize {
   std::string m_python_filename;
   bool m_geodesics_enabled = false;             // geodesics disabled by default
   size_t m_geodesic_cache_size_multiplier = 0;  // 0 => MeshWrapper will use a heuristic to determine cache size
+  size_t m_geodesic_cache_budget_mb = 0;         // 0 => no global budget
   double m_geodesic_remesh_percent = 100.0;    // 100% by default (e.g. no remeshing)
+  bool m_batch_position_events = false;
+  bool m_use_async_checkpoints = false;
+  bool m_use_particle_store = false;
+  std::unique_ptr<CheckpointWriter> m_checkpoint_writer;
 
   // m_spacing is used to scale the random update vector for particle splitting.
   double m_spacing = 0;
@@ -451,6 +528,7 @@ class Optimize {
 
   int m_total_iterations = 0;
   int m_iteration_count = 0;
+  IterationStats m_iteration_stats;
   int m_split_number = 0;
 
   int current_particle_iterations_ = 0;
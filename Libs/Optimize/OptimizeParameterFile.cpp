@@ -418,6 +418,46 @@ bool OptimizeParameterFile::set_optimization_parameters(TiXmlHandle* docHandle,
     optimize->SetGeodesicsCacheSizeMultiplier((size_t)atol(elem->GetText()));
   }
 
+  elem = docHandle->FirstChild("batch_position_events").Element();
+  if (elem) {
+    optimize->SetBatchPositionEvents((bool)atoi(elem->GetText()));
+  }
+
+  elem = docHandle->FirstChild("use_grid_neighborhood").Element();
+  if (elem) {
+    optimize->SetUseGridNeighborhood((bool)atoi(elem->GetText()));
+  }
+
+  elem = docHandle->FirstChild("use_factored_covariance").Element();
+  if (elem) {
+    optimize->SetUseFactoredCovariance((bool)atoi(elem->GetText()));
+  }
+
+  elem = docHandle->FirstChild("use_ffc_voxel_cache").Element();
+  if (elem) {
+    optimize->SetUseFFCVoxelCache((bool)atoi(elem->GetText()));
+  }
+
+  elem = docHandle->FirstChild("geodesics_cache_budget_mb").Element();
+  if (elem) {
+    optimize->SetGeodesicsCacheBudget((size_t)atol(elem->GetText()));
+  }
+
+  elem = docHandle->FirstChild("use_intra_shape_parallelism").Element();
+  if (elem) {
+    optimize->SetUseIntraShapeParallelism((bool)atoi(elem->GetText()));
+  }
+
+  elem = docHandle->FirstChild("use_async_checkpoints").Element();
+  if (elem) {
+    optimize->SetUseAsyncCheckpoints((bool)atoi(elem->GetText()));
+  }
+
+  elem = docHandle->FirstChild("use_particle_store").Element();
+  if (elem) {
+    optimize->SetUseParticleStore((bool)atoi(elem->GetText()));
+  }
+
   elem = docHandle->FirstChild("mesh_ffc_mode").Element();
   if (elem) {
     optimize->SetMeshFFCMode((bool)atoi(elem->GetText()));
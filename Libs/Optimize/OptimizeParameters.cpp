@@ -6,10 +6,16 @@
 #include <Particles/ParticleFile.h>
 #include <Utils/StringUtils.h>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <atomic>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <functional>
+#include <mutex>
 
+#include "Libs/Optimize/Domain/MeshDomain.h"
 #include "Optimize.h"
 
 using namespace shapeworks;
@@ -51,6 +57,14 @@ const std::string use_geodesics_to_landmarks = "use_geodesics_to_landmarks";
 const std::string geodesics_to_landmarks_weight = "geodesics_to_landmarks_weight";
 const std::string particle_format = "particle_format";
 const std::string geodesic_remesh_percent = "geodesic_remesh_percent";
+const std::string batch_position_events = "batch_position_events";
+const std::string use_grid_neighborhood = "use_grid_neighborhood";
+const std::string use_factored_covariance = "use_factored_covariance";
+const std::string use_ffc_voxel_cache = "use_ffc_voxel_cache";
+const std::string geodesic_cache_budget_mb = "geodesic_cache_budget_mb";
+const std::string use_intra_shape_parallelism = "use_intra_shape_parallelism";
+const std::string use_async_checkpoints = "use_async_checkpoints";
+const std::string use_particle_store = "use_particle_store";
 }  // namespace Keys
 
 //---------------------------------------------------------------------------
@@ -92,7 +106,15 @@ OptimizeParameters::OptimizeParameters(ProjectHandle project) {
                                          Keys::keep_checkpoints,
                                          Keys::use_disentangled_ssm,
                                          Keys::particle_format,
-                                         Keys::geodesic_remesh_percent};
+                                         Keys::geodesic_remesh_percent,
+                                         Keys::batch_position_events,
+                                         Keys::use_grid_neighborhood,
+                                         Keys::use_factored_covariance,
+                                         Keys::use_ffc_voxel_cache,
+                                         Keys::geodesic_cache_budget_mb,
+                                         Keys::use_intra_shape_parallelism,
+                                         Keys::use_async_checkpoints,
+                                         Keys::use_particle_store};
 
   std::vector<std::string> to_remove;
 
@@ -429,6 +451,14 @@ bool OptimizeParameters::set_up_optimize(Optimize* optimize) {
   optimize->SetMeshFFCMode(get_mesh_ffc_mode());
   optimize->SetUseDisentangledSpatiotemporalSSM(get_use_disentangled_ssm());
   optimize->set_particle_format(get_particle_format());
+  optimize->SetBatchPositionEvents(get_batch_position_events());
+  optimize->SetUseGridNeighborhood(get_use_grid_neighborhood());
+  optimize->SetUseFactoredCovariance(get_use_factored_covariance());
+  optimize->SetUseFFCVoxelCache(get_use_ffc_voxel_cache());
+  optimize->SetGeodesicsCacheBudget(get_geodesic_cache_budget_mb());
+  optimize->SetUseIntraShapeParallelism(get_use_intra_shape_parallelism());
+  optimize->SetUseAsyncCheckpoints(get_use_async_checkpoints());
+  optimize->SetUseParticleStore(get_use_particle_store());
 
   // TODO Remove this once Studio has controls for shared boundary
   optimize->SetSharedBoundaryEnabled(true);
@@ -626,14 +656,21 @@ bool OptimizeParameters::set_up_optimize(Optimize* optimize) {
     }
   }
 
+  // Inputs are loaded in two passes: the domains are read, clipped and set up concurrently, then added to the
+  // optimizer in subject order so that domains are numbered as in the project
+  struct DomainInput {
+    std::shared_ptr<Subject> subject;
+    std::string filename;
+    DomainType domain_type;
+    int domain;
+    std::shared_ptr<MeshDomain> mesh;
+    vtkSmartPointer<vtkPolyData> contour;
+    Sampler::ImageDomainInput image;
+  };
+
   std::vector<std::string> filenames;
-  int count = 0;
-  domain_count = 0;
+  std::vector<DomainInput> inputs;
   for (auto s : subjects) {
-    if (abort_load_) {
-      return false;
-    }
-
     if (s->is_excluded()) {
       continue;
     }
@@ -642,9 +679,6 @@ bool OptimizeParameters::set_up_optimize(Optimize* optimize) {
     if (files.empty()) {
       throw std::invalid_argument("No groomed inputs for optimization");
     }
-    auto transforms = s->get_groomed_transforms();
-    std::vector<std::string> local_particle_filenames;
-    std::vector<std::string> world_particle_filenames;
 
     for (int i = 0; i < files.size(); i++) {
       auto filename = files[i];
@@ -653,13 +687,31 @@ bool OptimizeParameters::set_up_optimize(Optimize* optimize) {
         throw std::invalid_argument("Error, file does not exist: " + filename);
       }
 
-      auto domain_type = project_->get_groomed_domain_types()[i];
       filenames.push_back(filename);
+      DomainInput input;
+      input.subject = s;
+      input.filename = filename;
+      input.domain_type = project_->get_groomed_domain_types()[i];
+      input.domain = inputs.size();
+      inputs.push_back(input);
+    }
+  }
 
-      if (domain_type == DomainType::Mesh) {
+  std::mutex progress_mutex;
+  int subjects_loaded = 0;
+  std::atomic<int> domains_loaded{0};
+  tbb::parallel_for(tbb::blocked_range<size_t>{0, inputs.size(), 1}, [&](const tbb::blocked_range<size_t>& r) {
+    for (size_t index = r.begin(); index < r.end(); index++) {
+      if (abort_load_) {
+        return;
+      }
+      auto& input = inputs[index];
+      const auto& filename = input.filename;
+
+      if (input.domain_type == DomainType::Mesh) {
         Mesh mesh = MeshUtils::threadSafeReadMesh(filename.c_str());
-        if (domain_count < constraints.size()) {
-          Constraints constraint = constraints[domain_count];
+        if (input.domain < constraints.size()) {
+          Constraints constraint = constraints[input.domain];
           constraint.clipMesh(mesh);
           auto poly_data = mesh.getVTKMesh();
           if (poly_data->GetNumberOfCells() == 0) {
@@ -668,7 +720,7 @@ bool OptimizeParameters::set_up_optimize(Optimize* optimize) {
         }
 
         if (get_use_geodesics_to_landmarks()) {
-          auto filenames = s->get_landmarks_filenames();
+          auto filenames = input.subject->get_landmarks_filenames();
           Eigen::VectorXd points;
           if (!ParticleSystemEvaluation::ReadParticleFile(filenames[0], points)) {
             SW_ERROR("Unable to read landmark file: {}", filenames[0]);
@@ -694,29 +746,63 @@ bool OptimizeParameters::set_up_optimize(Optimize* optimize) {
           }
           // TODO This is a HACK for detecting contours
           if (poly_data->GetCell(0)->GetNumberOfPoints() == 2) {
-            optimize->AddContour(poly_data);
+            input.contour = poly_data;
           } else {
-            optimize->AddMesh(poly_data);
+            input.mesh = optimize->CreateMeshDomain(poly_data);
           }
         } else {
           throw std::invalid_argument("Error loading mesh: " + filename);
         }
-      } else if (domain_type == DomainType::Contour) {
+      } else if (input.domain_type == DomainType::Contour) {
         Mesh mesh = MeshUtils::threadSafeReadMesh(filename.c_str());
-        auto poly_data = mesh.getVTKMesh();
-        if (poly_data) {
-          optimize->AddContour(poly_data);
-        } else {
+        input.contour = mesh.getVTKMesh();
+        if (!input.contour) {
           throw std::invalid_argument("Error loading contour: " + filename);
         }
+      } else if (!input.subject->is_fixed()) {
+        // only the narrow band domain is kept, the dense image is released when this task is done with it
+        input.image = optimize->CreateImageDomain(Image(filename));
       } else {
-        Image image(filename);
-        if (s->is_fixed()) {
-          optimize->AddImage(nullptr, filename);
-        } else {
-          optimize->AddImage(image, filename);
+        input.image = optimize->CreateImageDomain(nullptr);
+      }
+
+      // report whole subjects, in whatever order they finish
+      const int loaded = ++domains_loaded / domains_per_shape;
+      if (load_callback_) {
+        std::scoped_lock lock(progress_mutex);
+        if (loaded > subjects_loaded) {
+          subjects_loaded = loaded;
+          load_callback_(subjects_loaded);
         }
       }
+    }
+  });
+
+  if (abort_load_) {
+    return false;
+  }
+
+  domain_count = 0;
+  for (auto s : subjects) {
+    if (s->is_excluded()) {
+      continue;
+    }
+
+    auto transforms = s->get_groomed_transforms();
+    std::vector<std::string> local_particle_filenames;
+    std::vector<std::string> world_particle_filenames;
+
+    for (int i = 0; i < s->get_groomed_filenames().size(); i++) {
+      auto& input = inputs[domain_count];
+      auto filename = input.filename;
+
+      if (input.domain_type == DomainType::Image) {
+        optimize->AddImageDomain(input.image, filename);
+      } else if (input.contour) {
+        optimize->AddContour(input.contour);
+      } else {
+        optimize->AddMeshDomain(input.mesh);
+      }
 
       using TransformType = vnl_matrix_fixed<double, 4, 4>;
       TransformType prefix_transform;
@@ -748,11 +834,6 @@ bool OptimizeParameters::set_up_optimize(Optimize* optimize) {
     }
     s->set_local_particle_filenames(local_particle_filenames);
     s->set_world_particle_filenames(world_particle_filenames);
-
-    count++;
-    if (load_callback_) {
-      load_callback_(count);
-    }
   }
 
   optimize->SetCheckpointingInterval(get_checkpoint_interval());
@@ -850,3 +931,61 @@ double OptimizeParameters::get_geodesic_remesh_percent() { return params_.get(Ke
 void OptimizeParameters::set_geodesic_remesh_percent(double value) {
   params_.set(Keys::geodesic_remesh_percent, value);
 }
+
+//---------------------------------------------------------------------------
+bool OptimizeParameters::get_batch_position_events() { return params_.get(Keys::batch_position_events, false); }
+
+//---------------------------------------------------------------------------
+void OptimizeParameters::set_batch_position_events(bool value) { params_.set(Keys::batch_position_events, value); }
+
+//---------------------------------------------------------------------------
+bool OptimizeParameters::get_use_grid_neighborhood() { return params_.get(Keys::use_grid_neighborhood, false); }
+
+//---------------------------------------------------------------------------
+void OptimizeParameters::set_use_grid_neighborhood(bool value) {
+  params_.set(Keys::use_grid_neighborhood, value);
+}
+
+//---------------------------------------------------------------------------
+bool OptimizeParameters::get_use_factored_covariance() { return params_.get(Keys::use_factored_covariance, false); }
+
+//---------------------------------------------------------------------------
+void OptimizeParameters::set_use_factored_covariance(bool value) {
+  params_.set(Keys::use_factored_covariance, value);
+}
+
+//---------------------------------------------------------------------------
+bool OptimizeParameters::get_use_ffc_voxel_cache() { return params_.get(Keys::use_ffc_voxel_cache, false); }
+
+//---------------------------------------------------------------------------
+void OptimizeParameters::set_use_ffc_voxel_cache(bool value) { params_.set(Keys::use_ffc_voxel_cache, value); }
+
+//---------------------------------------------------------------------------
+int OptimizeParameters::get_geodesic_cache_budget_mb() { return params_.get(Keys::geodesic_cache_budget_mb, 0); }
+
+//---------------------------------------------------------------------------
+void OptimizeParameters::set_geodesic_cache_budget_mb(int value) {
+  params_.set(Keys::geodesic_cache_budget_mb, value);
+}
+
+//---------------------------------------------------------------------------
+bool OptimizeParameters::get_use_intra_shape_parallelism() {
+  return params_.get(Keys::use_intra_shape_parallelism, false);
+}
+
+//---------------------------------------------------------------------------
+void OptimizeParameters::set_use_intra_shape_parallelism(bool value) {
+  params_.set(Keys::use_intra_shape_parallelism, value);
+}
+
+//---------------------------------------------------------------------------
+bool OptimizeParameters::get_use_async_checkpoints() { return params_.get(Keys::use_async_checkpoints, false); }
+
+//---------------------------------------------------------------------------
+void OptimizeParameters::set_use_async_checkpoints(bool value) { params_.set(Keys::use_async_checkpoints, value); }
+
+//---------------------------------------------------------------------------
+bool OptimizeParameters::get_use_particle_store() { return params_.get(Keys::use_particle_store, false); }
+
+//---------------------------------------------------------------------------
+void OptimizeParameters::set_use_particle_store(bool value) { params_.set(Keys::use_particle_store, value); }
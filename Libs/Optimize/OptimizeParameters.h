@@ -132,6 +132,30 @@ class OptimizeParameters {
   double get_geodesic_remesh_percent();
   void set_geodesic_remesh_percent(double value);
 
+  bool get_batch_position_events();
+  void set_batch_position_events(bool value);
+
+  bool get_use_grid_neighborhood();
+  void set_use_grid_neighborhood(bool value);
+
+  bool get_use_factored_covariance();
+  void set_use_factored_covariance(bool value);
+
+  bool get_use_ffc_voxel_cache();
+  void set_use_ffc_voxel_cache(bool value);
+
+  int get_geodesic_cache_budget_mb();
+  void set_geodesic_cache_budget_mb(int value);
+
+  bool get_use_intra_shape_parallelism();
+  void set_use_intra_shape_parallelism(bool value);
+
+  bool get_use_async_checkpoints();
+  void set_use_async_checkpoints(bool value);
+
+  bool get_use_particle_store();
+  void set_use_particle_store(bool value);
+
 
  private:
   std::string get_output_prefix();
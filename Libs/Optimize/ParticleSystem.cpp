@@ -48,6 +48,11 @@ void ParticleSystem::SetNumberOfDomains(unsigned int num) {
     m_InversePrefixTransforms.push_back(transform);
   }
   m_Positions.resize(num);
+  m_PositionStores.resize(num);
+  m_PendingEvents.resize(num);
+  m_PendingEventFlags.resize(num);
+  m_DeferredUpdates.resize(num, 0);
+  m_DeferredDirty.resize(num);
   m_IndexCounters.resize(num);
   m_Neighborhoods.resize(num);
   while (num > this->m_DomainFlags.size()) {
@@ -63,6 +68,9 @@ void ParticleSystem::AddDomain(DomainType::Pointer input) {
     if (!m_Domains[idx]) {
       m_Domains[idx] = input;
       m_Positions[idx] = PointContainerType::New();
+      m_PositionStores[idx] = PositionStoreType::New();
+      m_PendingEvents[idx].clear();
+      m_PendingEventFlags[idx].clear();
       m_IndexCounters[idx] = 0;
       return;
     }
@@ -71,6 +79,7 @@ void ParticleSystem::AddDomain(DomainType::Pointer input) {
   this->SetNumberOfDomains(static_cast<int>(m_Domains.size() + 1));
   m_Domains[static_cast<int>(m_Domains.size()) - 1] = input;
   m_Positions[static_cast<int>(m_Domains.size()) - 1] = PointContainerType::New();
+  m_PositionStores[static_cast<int>(m_Domains.size()) - 1] = PositionStoreType::New();
   m_IndexCounters[static_cast<int>(m_Domains.size() - 1)] = 0;
   m_Neighborhoods[static_cast<int>(m_Domains.size() - 1)] = NeighborhoodType::New();
   m_Transforms[static_cast<int>(m_Domains.size() - 1)].set_identity();
@@ -125,6 +134,7 @@ void ParticleSystem::SetNeighborhood(unsigned int i, NeighborhoodType* N) {
   m_Neighborhoods[i] = N;
   m_Neighborhoods[i]->SetDomain(m_Domains[i]);
   m_Neighborhoods[i]->SetPointContainer(m_Positions[i]);
+  m_Neighborhoods[i]->SetPositionStore(m_PositionStores[i]);
 
   // Notify any observers.
   ParticleNeighborhoodSetEvent e;
@@ -139,7 +149,10 @@ const ParticleSystem::PointType& ParticleSystem::AddPosition(const PointType& p,
   if (m_DomainFlags[d] == false) {  // Not a fixed domain.  Fixed domains won't load the image
     const auto idx = m_IndexCounters[d];
     m_Domains[d]->ApplyConstraints(m_Positions[d]->operator[](idx), idx);
+    m_PositionStores[d]->Set(idx, m_Positions[d]->operator[](idx));
     m_Neighborhoods[d]->AddPosition(m_Positions[d]->operator[](idx), idx);
+  } else {
+    m_PositionStores[d]->Set(m_IndexCounters[d], p);
   }
 
   // Increase the FixedParticleFlag list size if necessary.
@@ -158,15 +171,32 @@ const ParticleSystem::PointType& ParticleSystem::AddPosition(const PointType& p,
 }
 
 const ParticleSystem::PointType& ParticleSystem::SetPosition(const PointType& p, unsigned long int k, unsigned int d) {
+  if (m_DeferredUpdates[d]) {
+    // the neighborhood and the observers are updated by FlushDeferredUpdates
+    if (m_FixedParticleFlags[d % m_DomainsPerShape][k] == false && m_DomainFlags[d] == false) {
+      m_Positions[d]->operator[](k) = p;
+      m_Domains[d]->ApplyConstraints(m_Positions[d]->operator[](k), k);
+    }
+    m_DeferredDirty[d][k] = 1;
+    return m_Positions[d]->operator[](k);
+  }
+
   if (m_FixedParticleFlags[d % m_DomainsPerShape][k] == false) {
     // Potentially modifies position!
     if (m_DomainFlags[d] == false) {
       m_Positions[d]->operator[](k) = p;
       m_Domains[d]->ApplyConstraints(m_Positions[d]->operator[](k), k);
+      m_PositionStores[d]->Set(k, m_Positions[d]->operator[](k));
       m_Neighborhoods[d]->SetPosition(m_Positions[d]->operator[](k), k);
     }
   }
 
+  if (m_BatchPositionEvents) {
+    // observers are notified in one batch by FlushPositionEvents
+    this->AddPendingEvent(k, d);
+    return m_Positions[d]->operator[](k);
+  }
+
   // Notify any observers.
   ParticlePositionSetEvent e;
   e.SetDomainIndex(d);
@@ -177,6 +207,80 @@ const ParticleSystem::PointType& ParticleSystem::SetPosition(const PointType& p,
   return m_Positions[d]->operator[](k);
 }
 
+void ParticleSystem::SetBatchPositionEvents(bool enabled) {
+  if (enabled == m_BatchPositionEvents) {
+    return;
+  }
+  if (!enabled) {
+    // deliver anything still pending
+    this->FlushPositionEvents();
+  }
+  m_BatchPositionEvents = enabled;
+}
+
+void ParticleSystem::FlushPositionEvents(unsigned int d) {
+  if (!m_BatchPositionEvents) {
+    return;
+  }
+
+  ParticlePositionSetEvent e;
+  e.SetDomainIndex(d);
+  for (auto k : m_PendingEvents[d]) {
+    m_PendingEventFlags[d][k] = 0;
+    e.SetPositionIndex(k);
+    this->InvokeEvent(e);
+  }
+  m_PendingEvents[d].clear();
+}
+
+void ParticleSystem::FlushPositionEvents() {
+  for (unsigned int d = 0; d < m_PendingEvents.size(); d++) {
+    this->FlushPositionEvents(d);
+  }
+}
+
+void ParticleSystem::SetDeferredUpdates(unsigned int d, bool deferred) {
+  if (deferred == bool(m_DeferredUpdates[d])) {
+    return;
+  }
+  if (!deferred) {
+    this->FlushDeferredUpdates(d);
+    m_DeferredUpdates[d] = 0;
+    m_DeferredDirty[d].clear();
+    return;
+  }
+  m_DeferredDirty[d].assign(m_Positions[d]->GetSize(), 0);
+  m_DeferredUpdates[d] = 1;
+}
+
+void ParticleSystem::FlushDeferredUpdates(unsigned int d) {
+  if (!m_DeferredUpdates[d]) {
+    return;
+  }
+
+  auto& dirty = m_DeferredDirty[d];
+  ParticlePositionSetEvent e;
+  e.SetDomainIndex(d);
+  for (unsigned long int k = 0; k < dirty.size(); k++) {
+    if (!dirty[k]) {
+      continue;
+    }
+    dirty[k] = 0;
+
+    if (m_FixedParticleFlags[d % m_DomainsPerShape][k] == false && m_DomainFlags[d] == false) {
+      m_PositionStores[d]->Set(k, m_Positions[d]->operator[](k));
+      m_Neighborhoods[d]->SetPosition(m_Positions[d]->operator[](k), k);
+    }
+
+    if (m_BatchPositionEvents) {
+      this->AddPendingEvent(k, d);
+    } else {
+      e.SetPositionIndex(k);
+      this->InvokeEvent(e);
+    }
+  }
+}
+
 void ParticleSystem::AddPositionList(const std::vector<PointType>& p, unsigned int d) {
   // Traverse the list and add each point to the domain.
   for (auto it = p.begin(); it != p.end(); it++) {
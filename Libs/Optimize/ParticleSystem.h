@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "Libs/Optimize/Container/GenericContainer.h"
+#include "Libs/Optimize/Container/ParticlePositionStore.h"
 #include "Libs/Optimize/Domain/ParticleDomain.h"
 #include "Libs/Optimize/Neighborhood/ParticleNeighborhood.h"
 #include "Observer.h"
@@ -68,6 +69,9 @@ class ParticleSystem : public itk::DataObject {
   /** Point container type.  One is associated with each domain.*/
   typedef GenericContainer<PointType> PointContainerType;
 
+  /** Structure-of-arrays position store type.  One is associated with each domain.*/
+  typedef ParticlePositionStore PositionStoreType;
+
   typedef NeighborhoodType::PointVectorType PointVectorType;
 
   /** Defines a transform class type.  One is associated with each
@@ -100,6 +104,9 @@ class ParticleSystem : public itk::DataObject {
         this->SetPosition(this->GetPosition(p, d), p, d);
       }
     }
+    if (m_BatchPositionEvents) {
+      this->FlushPositionEvents();
+    }
   }
 
   /** Returns the number of particles in domain k. */
@@ -120,6 +127,26 @@ class ParticleSystem : public itk::DataObject {
 
   void RemovePosition(unsigned long int k, unsigned int d = 0);
 
+  /** Enable/disable batched position events.  When enabled, SetPosition no longer invokes ParticlePositionSetEvent
+      immediately.  Instead the changed indices are recorded and the events are sent in one batch by
+      FlushPositionEvents, so observers run once per particle per sweep rather than once per SetPosition.  Positions
+      and the neighborhood are still updated immediately. */
+  void SetBatchPositionEvents(bool enabled);
+  bool GetBatchPositionEvents() const { return m_BatchPositionEvents; }
+
+  /** Invoke the deferred ParticlePositionSetEvent for every particle of domain d that was set since the last flush.
+      Does nothing when position events are not batched. */
+  void FlushPositionEvents(unsigned int d);
+  void FlushPositionEvents();
+
+  /** Enable/disable deferred updates of domain d.  While deferred, SetPosition only stores the constrained position
+      and records the index; the neighborhood update and the position event (or its pending batch entry) are applied by
+      FlushDeferredUpdates, in index order.  This lets several threads move different particles of the same domain at
+      once, with queries seeing the neighborhood as it was at the last flush.  Disabling flushes. */
+  void SetDeferredUpdates(unsigned int d, bool deferred);
+  bool GetDeferredUpdates(unsigned int d) const { return m_DeferredUpdates[d]; }
+  void FlushDeferredUpdates(unsigned int d);
+
   /** Return a position with index k from domain d.  Note the order in which the 2
       integers must be specified!   The domain number is specified second and
       the position index within the domain is specified first.  Note that the
@@ -160,6 +187,10 @@ class ParticleSystem : public itk::DataObject {
   inline PointVectorType FindNeighborhoodPoints(const PointType &p, int idx, double r, unsigned int d = 0) const {
     return m_Neighborhoods[d]->FindNeighborhoodPoints(p, idx, r);
   }
+  inline unsigned int FindNeighborhoodPoints(const PointType &p, int idx, double r, PointVectorType &neighbors,
+                                             unsigned int d = 0) const {
+    return m_Neighborhoods[d]->FindNeighborhoodPoints(p, idx, r, neighbors);
+  }
   inline PointVectorType FindNeighborhoodPoints(const PointType &p, int idx, std::vector<double> &w,
                                                 std::vector<double> &distances, double r, unsigned int d = 0) const {
     return m_Neighborhoods[d]->FindNeighborhoodPoints(p, idx, w, distances, r);
@@ -168,6 +199,11 @@ class ParticleSystem : public itk::DataObject {
                                                 unsigned int d = 0) const {
     return m_Neighborhoods[d]->FindNeighborhoodPoints(p, idx, w, r);
   }
+  inline void FindNeighborhoodPoints(const PointType &p, int idx, std::vector<double> &w,
+                                     std::vector<double> &distances, double r, PointVectorType &neighbors,
+                                     unsigned int d = 0) const {
+    m_Neighborhoods[d]->FindNeighborhoodPoints(p, idx, w, distances, r, neighbors);
+  }
   inline PointVectorType FindNeighborhoodPoints(unsigned int idx, double r, unsigned int d = 0) const {
     return m_Neighborhoods[d]->FindNeighborhoodPoints(this->GetPosition(idx, d), idx, r);
   }
@@ -290,6 +326,11 @@ class ParticleSystem : public itk::DataObject {
   const std::vector<PointContainerType::Pointer> &GetPositions() const { return m_Positions; }
   const PointContainerType::Pointer &GetPositions(unsigned int d) const { return m_Positions[d]; }
 
+  /** Return the contiguous x/y/z copy of the positions of domain d.  It holds the positions as the neighborhood of the
+      domain sees them: while updates of the domain are deferred it keeps the values of the last FlushDeferredUpdates,
+      so it may be read by every thread sweeping the domain. */
+  const PositionStoreType *GetPositionStore(unsigned int d = 0) const { return m_PositionStores[d]; }
+
   /** Adds a list of points to the specified domain.  The arguments are the
      std::vector of points and the domain number. */
   void AddPositionList(const std::vector<PointType> &, unsigned int d = 0);
@@ -399,6 +440,31 @@ class ParticleSystem : public itk::DataObject {
       These values may only be modified by the ParticleSystem class itself. */
   std::vector<PointContainerType::Pointer> m_Positions;
 
+  /** Structure-of-arrays copy of m_Positions, per domain, updated along with the neighborhoods. */
+  std::vector<PositionStoreType::Pointer> m_PositionStores;
+
+  /** Per domain particles whose ParticlePositionSetEvent is waiting for FlushPositionEvents, in the order they were
+      first set, plus a flag per particle so each one is sent once.  Only used when m_BatchPositionEvents is set. */
+  std::vector<std::vector<unsigned long int>> m_PendingEvents;
+  std::vector<std::vector<char>> m_PendingEventFlags;
+  bool m_BatchPositionEvents = false;
+
+  void AddPendingEvent(unsigned long int k, unsigned int d) {
+    auto &flags = m_PendingEventFlags[d];
+    if (k >= flags.size()) {
+      flags.resize(k + 1, 0);
+    }
+    if (!flags[k]) {
+      flags[k] = 1;
+      m_PendingEvents[d].push_back(k);
+    }
+  }
+
+  /** Per domain deferred update flag, and the particles set since the last FlushDeferredUpdates.  char instead of
+      bool so that different particles can be marked from different threads. */
+  std::vector<char> m_DeferredUpdates;
+  std::vector<std::vector<char>> m_DeferredDirty;
+
   /** The set of particle domain definitions. */
   std::vector<DomainType::Pointer> m_Domains;
 
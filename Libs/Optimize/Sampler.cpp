@@ -282,12 +282,25 @@ void Sampler::ReInitialize() {
   this->m_MeanCurvatureCache->ZeroAllValues();
 }
 
+ParticleSurfaceNeighborhood::Pointer Sampler::CreateNeighborhood() const {
+  if (m_UseGridNeighborhood) {
+    return ParticleGridNeighborhood::New().GetPointer();
+  }
+  return ParticleSurfaceNeighborhood::New();
+}
+
 void Sampler::AddMesh(std::shared_ptr<shapeworks::MeshWrapper> mesh, double geodesic_remesh_percent) {
   auto domain = std::make_shared<MeshDomain>();
-  m_NeighborhoodList.push_back(ParticleSurfaceNeighborhood::New());
   if (mesh) {
-    this->m_Spacing = 1;
     domain->SetMesh(mesh, geodesic_remesh_percent);
+  }
+  AddMeshDomain(domain);
+}
+
+void Sampler::AddMeshDomain(std::shared_ptr<shapeworks::MeshDomain> domain) {
+  m_NeighborhoodList.push_back(CreateNeighborhood());
+  if (auto mesh = domain->GetMeshWrapper()) {
+    this->m_Spacing = 1;
     this->m_meshes.push_back(mesh->GetPolydata());
     m_NeighborhoodList.back()->SetWeightingEnabled(!mesh->IsGeodesicsEnabled());  // disable weighting for geodesics
   }
@@ -296,7 +309,7 @@ void Sampler::AddMesh(std::shared_ptr<shapeworks::MeshWrapper> mesh, double geod
 
 void Sampler::AddContour(vtkSmartPointer<vtkPolyData> poly_data) {
   auto domain = std::make_shared<ContourDomain>();
-  m_NeighborhoodList.push_back(ParticleSurfaceNeighborhood::New());
+  m_NeighborhoodList.push_back(CreateNeighborhood());
   if (poly_data != nullptr) {
     this->m_Spacing = 1;
     domain->SetPolyLine(poly_data);
@@ -396,20 +409,33 @@ void Sampler::AddFreeFormConstraint(int domain, const FreeFormConstraint& ffc) {
 }
 
 void Sampler::AddImage(ImageType::Pointer image, double narrow_band, std::string name) {
-  auto domain = std::make_shared<ImplicitSurfaceDomain<ImageType::PixelType>>();
+  AddImageDomain(CreateImageDomain(image, narrow_band), name);
+}
 
-  m_NeighborhoodList.push_back(ParticleSurfaceNeighborhood::New());
+Sampler::ImageDomainInput Sampler::CreateImageDomain(ImageType::Pointer image, double narrow_band) {
+  ImageDomainInput input;
+  input.domain = std::make_shared<ImplicitSurfaceDomain<ImageType::PixelType>>();
 
   if (image) {
-    this->m_Spacing = image->GetSpacing()[0];
     // convert narrow band (index space) to world space
     // (e.g. narrow band of 4 means 4 voxels (largest side)
     double narrow_band_world = image->GetSpacing().GetVnlVector().max_value() * narrow_band;
-    domain->SetImage(image, narrow_band_world);
+    input.domain->SetImage(image, narrow_band_world);
 
     // Adding meshes for FFCs
-    vtkSmartPointer<vtkPolyData> mesh = Image(image).toMesh(0.0).getVTKMesh();
-    this->m_meshes.push_back(mesh);
+    input.surface = Image(image).toMesh(0.0).getVTKMesh();
+  }
+  return input;
+}
+
+void Sampler::AddImageDomain(const ImageDomainInput& input, std::string name) {
+  auto domain = input.domain;
+
+  m_NeighborhoodList.push_back(CreateNeighborhood());
+
+  if (!domain->IsDomainFixed()) {
+    this->m_Spacing = domain->GetSpacing()[0];
+    this->m_meshes.push_back(input.surface);
   }
 
   domain->SetDomainID(m_DomainList.size());
@@ -425,6 +451,9 @@ bool Sampler::initialize_ffcs(size_t dom) {
   if (m_FFCs[dom].isSet()) {
     m_DomainList[dom]->GetConstraints()->addFreeFormConstraint(mesh);
     m_FFCs[dom].computeGradientFields(mesh);
+    if (m_UseFFCVoxelCache) {
+      m_DomainList[dom]->GetConstraints()->getFreeformConstraint().bakeVoxelCache();
+    }
   }
 
 #if defined(VIZFFC)
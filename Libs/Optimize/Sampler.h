@@ -16,6 +16,7 @@
 #include "Libs/Optimize/Function/SamplingFunction.h"
 #include "Libs/Optimize/Matrix/LinearRegressionShapeMatrix.h"
 #include "Libs/Optimize/Matrix/MixedEffectsShapeMatrix.h"
+#include "Libs/Optimize/Neighborhood/ParticleGridNeighborhood.h"
 #include "Libs/Optimize/Neighborhood/ParticleSurfaceNeighborhood.h"
 #include "ParticleSystem.h"
 #include "vnl/vnl_matrix_fixed.h"
@@ -93,8 +94,22 @@ class Sampler {
     initial_points_ = initial_points;
   }
 
+  //! An image domain along with the zero level set of its image (used for free-form constraints), so that the image
+  //! itself can be released once the domain is built
+  struct ImageDomainInput {
+    std::shared_ptr<ImplicitSurfaceDomain<PixelType>> domain;
+    vtkSmartPointer<vtkPolyData> surface;
+  };
+
   void AddImage(ImageType::Pointer image, double narrow_band, std::string name = "");
 
+  //! Build the narrow band domain for an image (null for a fixed domain).  Safe to call concurrently for different
+  //! images
+  static ImageDomainInput CreateImageDomain(ImageType::Pointer image, double narrow_band);
+
+  //! Add an image domain built by CreateImageDomain
+  void AddImageDomain(const ImageDomainInput& input, std::string name = "");
+
   void ApplyConstraintsToZeroCrossing() {
     for (size_t i = 0; i < m_DomainList.size(); i++) {
       this->m_DomainList[i]->UpdateZeroCrossingPoint();
@@ -103,6 +118,9 @@ class Sampler {
 
   void AddMesh(std::shared_ptr<shapeworks::MeshWrapper> mesh, double geodesic_remesh_percent = 100);
 
+  //! Add a mesh domain that has already been set up (see Optimize::CreateMeshDomain)
+  void AddMeshDomain(std::shared_ptr<shapeworks::MeshDomain> domain);
+
   void AddContour(vtkSmartPointer<vtkPolyData> poly_data);
 
   void SetFieldAttributes(const std::vector<std::string>& s);
@@ -289,6 +307,12 @@ class Sampler {
 
   void SetMeshFFCMode(bool mesh_ffc_mode) { m_meshFFCMode = mesh_ffc_mode; }
 
+  //! Use a hashed uniform grid instead of the octree for neighborhood queries.  Applies to domains added afterwards.
+  void SetUseGridNeighborhood(bool use_grid_neighborhood) { m_UseGridNeighborhood = use_grid_neighborhood; }
+
+  //! Bake free-form constraint fields into a narrow band voxel grid in initialize_ffcs
+  void SetUseFFCVoxelCache(bool use_ffc_voxel_cache) { m_UseFFCVoxelCache = use_ffc_voxel_cache; }
+
  private:
 
   bool GetInitialized() { return this->m_Initialized; }
@@ -359,6 +383,10 @@ class Sampler {
   std::vector<FreeFormConstraint> m_FFCs;
   std::vector<vtkSmartPointer<vtkPolyData>> m_meshes;
   bool m_meshFFCMode = false;
+  bool m_UseGridNeighborhood = false;
+  bool m_UseFFCVoxelCache = false;
+
+  ParticleSurfaceNeighborhood::Pointer CreateNeighborhood() const;
 
   std::vector<std::string> fieldAttributes_;
 
@@ -0,0 +1,168 @@
+#include "CheckpointWriter.h"
+
+#include <Libs/Particles/ParticleFile.h>
+#include <Libs/Particles/ParticleStore.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+#include "CacheUtils.h"
+#include "Libs/Optimize/Utils/ObjectWriter.h"
+#include "Logging.h"
+
+namespace shapeworks {
+
+//---------------------------------------------------------------------------
+// Calls write(temp_filename) and renames the result over filename.  The temporary file keeps the extension, the
+// particle writers pick the format from it
+template <class Function>
+static void write_atomically(const std::string& filename, Function write) {
+  if (!CacheUtils::write_atomically(filename, [&](const std::string& temp_filename) {
+        write(temp_filename);
+        return true;
+      })) {
+    throw std::runtime_error("Unable to replace file: " + filename);
+  }
+}
+
+//---------------------------------------------------------------------------
+static std::ofstream open_for_writing(const std::string& filename) {
+  std::ofstream out(filename.c_str());
+  if (!out) {
+    throw std::runtime_error("Unable to write file: " + filename);
+  }
+  return out;
+}
+
+//---------------------------------------------------------------------------
+CheckpointWriter::~CheckpointWriter() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_all();
+  thread_.join();
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::Submit() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (pending_) {
+    num_stalls_++;
+    condition_.wait(lock, [this] { return !pending_; });
+  }
+  front_ = 1 - front_;
+  pending_ = true;
+  if (!thread_.joinable()) {
+    thread_ = std::thread(&CheckpointWriter::Run, this);
+  }
+  lock.unlock();
+  condition_.notify_all();
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::Wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock, [this] { return !pending_; });
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    condition_.wait(lock, [this] { return pending_ || stop_; });
+    if (!pending_) {
+      return;  // stopped with nothing left to write
+    }
+
+    // the back buffer is not touched by the optimizer thread until pending_ is cleared
+    const auto& snapshot = buffers_[1 - front_];
+    lock.unlock();
+    try {
+      WriteSnapshot(snapshot);
+    } catch (std::exception& e) {
+      SW_ERROR("Unable to write checkpoint: {}", e.what());
+    } catch (...) {
+      // ObjectWriter throws ints
+      SW_ERROR("Unable to write checkpoint");
+    }
+    lock.lock();
+
+    pending_ = false;
+    condition_.notify_all();
+  }
+}
+
+//---------------------------------------------------------------------------
+void CheckpointWriter::WriteSnapshot(const Snapshot& snapshot) {
+  for (const auto& target : snapshot.targets) {
+    boost::filesystem::create_directories(target.directory);
+
+    for (const auto& domain : snapshot.domains) {
+      const std::string prefix = target.directory + "/" + domain.name;
+      write_atomically(prefix + "_local." + snapshot.particle_format,
+                       [&](const std::string& filename) { particles::write_particles(filename, domain.local); });
+      write_atomically(prefix + "_world." + snapshot.particle_format,
+                       [&](const std::string& filename) { particles::write_particles(filename, domain.world); });
+
+      if (domain.features.size() > 0) {
+        write_atomically(prefix + "_wptsFeatures.particles", [&](const std::string& filename) {
+          auto out = open_for_writing(filename);
+          for (int i = 0; i < domain.features.rows(); i++) {
+            for (int j = 0; j < domain.features.cols(); j++) {
+              out << domain.features(i, j) << " ";
+            }
+            out << std::endl;
+          }
+        });
+      }
+    }
+
+    if (!target.transform_file.empty()) {
+      write_atomically(target.transform_file, [&](const std::string& filename) {
+        ObjectWriter<ParticleSystem::TransformType> writer;
+        writer.SetFileName(filename);
+        writer.SetInput(snapshot.transforms);
+        writer.Update();
+      });
+    }
+
+    if (snapshot.write_transform_files) {
+      for (size_t d = 0; d < snapshot.domains.size(); d++) {
+        const auto& transform = snapshot.transforms[d];
+        write_atomically(target.directory + "/" + snapshot.domains[d].name + ".transform",
+                         [&](const std::string& filename) {
+                           auto out = open_for_writing(filename);
+                           for (int i = 0; i < transform.cols(); i++) {
+                             for (int j = 0; j < transform.rows(); j++) {
+                               out << transform(i, j) << " ";
+                             }
+                           }
+                           out << std::endl;
+                         });
+      }
+    }
+  }
+
+  if (!snapshot.store_file.empty()) {
+    particles::ParticleStoreWriter store(snapshot.store_file);
+    for (size_t d = 0; d < snapshot.domains.size(); d++) {
+      const auto& domain = snapshot.domains[d];
+      store.add(domain.name + "_local", domain.local);
+      store.add(domain.name + "_world", domain.world);
+      if (domain.features.size() > 0) {
+        store.add(domain.name + "_wptsFeatures", domain.features);
+      }
+      // vnl is row major
+      const Eigen::Matrix4d transform =
+          Eigen::Map<const Eigen::Matrix<double, 4, 4, Eigen::RowMajor>>(snapshot.transforms[d].data_block());
+      store.add(domain.name + "_transform", transform);
+    }
+    store.commit(snapshot.store_name);
+  }
+}
+
+}  // namespace shapeworks
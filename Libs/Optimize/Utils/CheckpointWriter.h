@@ -0,0 +1,95 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Libs/Optimize/ParticleSystem.h"
+
+namespace shapeworks {
+
+/**
+ * \class CheckpointWriter
+ * \ingroup Group-Optimize
+ *
+ * Writes optimizer checkpoints (point files, point files with features and transforms) on a dedicated I/O thread.
+ *
+ * The writer owns two snapshot buffers.  The optimizer fills the front buffer with GetSnapshot() and hands it over
+ * with Submit(), which swaps the buffers and returns immediately, so the next checkpoint is filled while the previous
+ * one is written.  If the previous write is still in flight when a new snapshot is submitted, Submit() blocks until it
+ * is done (backpressure), so at most one checkpoint is ever pending.  The buffers are reused, so taking a snapshot does
+ * not allocate once the particle counts are stable.
+ *
+ * Every file is written to a temporary file next to its destination and then renamed over it, so readers never see a
+ * partially written checkpoint file.  Appends to a particle store only become visible once complete.
+ */
+class CheckpointWriter {
+ public:
+  //! Particles of one domain
+  struct DomainSnapshot {
+    std::string name;  //!< file name prefix of the domain
+    Eigen::VectorXd local;
+    Eigen::VectorXd world;
+    //! One row per particle (world position, optionally followed by the world normal).  Empty if not written
+    Eigen::MatrixXd features;
+  };
+
+  //! Where one copy of the checkpoint goes
+  struct Target {
+    std::string directory;
+    std::string transform_file;  //!< empty if the combined transform file is not written
+  };
+
+  struct Snapshot {
+    std::vector<Target> targets;
+    std::string particle_format;
+    bool write_transform_files = false;
+    std::vector<DomainSnapshot> domains;
+    std::vector<ParticleSystem::TransformType> transforms;
+    //! If set, the snapshot is also appended to this particle store as store_name
+    std::string store_file;
+    std::string store_name;
+  };
+
+  CheckpointWriter() = default;
+
+  //! Finishes the pending write, if any
+  ~CheckpointWriter();
+
+  CheckpointWriter(const CheckpointWriter&) = delete;
+  CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+  //! The buffer to fill for the next checkpoint.  Only valid until Submit()
+  Snapshot& GetSnapshot() { return buffers_[front_]; }
+
+  //! Queue the filled snapshot for writing, waiting for the previous write if it is still in flight
+  void Submit();
+
+  //! Block until no write is pending.  Call before writing the same files synchronously
+  void Wait();
+
+  //! Number of times Submit() had to wait for the previous write
+  size_t GetNumStalls() const { return num_stalls_; }
+
+  //! Write a snapshot on the calling thread
+  static void WriteSnapshot(const Snapshot& snapshot);
+
+ private:
+  void Run();
+
+  std::array<Snapshot, 2> buffers_;
+  int front_ = 0;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool pending_ = false;
+  bool stop_ = false;
+  size_t num_stalls_ = 0;
+};
+
+}  // namespace shapeworks
@@ -0,0 +1,93 @@
+#include "NearestShapeIndex.h"
+
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace shapeworks {
+
+//---------------------------------------------------------------------------
+double NearestShapeIndex::distance(const double* a, const double* b, int num_particles) {
+  double sum = 0.0;
+  for (int p = 0; p < num_particles; p++) {
+    const double dx = a[p * 3] - b[p * 3];
+    const double dy = a[p * 3 + 1] - b[p * 3 + 1];
+    const double dz = a[p * 3 + 2] - b[p * 3 + 2];
+    sum += std::sqrt(dx * dx + dy * dy + dz * dz);
+  }
+  return sum;
+}
+
+//---------------------------------------------------------------------------
+NearestShapeIndex::NearestShapeIndex(const Eigen::MatrixXd& shapes, const Eigen::VectorXd& mean,
+                                     const Eigen::MatrixXd& basis)
+    : shapes_(shapes), num_particles_(shapes.rows() / 3) {
+  Eigen::MatrixXd centered = shapes;
+  centered.colwise() -= mean;
+  coordinates_.noalias() = basis.transpose() * centered;
+  squared_norms_ = centered.colwise().squaredNorm().transpose();
+
+  const int n = shapes.cols();
+  shape_distances_.resize(n, n);
+  tbb::parallel_for(0, n, [&](int i) {
+    shape_distances_(i, i) = 0.0;
+    for (int j = i + 1; j < n; j++) {
+      const double d = distance(shapes.col(i).data(), shapes.col(j).data(), num_particles_);
+      shape_distances_(i, j) = d;
+      shape_distances_(j, i) = d;
+    }
+  });
+}
+
+//---------------------------------------------------------------------------
+NearestShapeIndex::Result NearestShapeIndex::find(const Eigen::Ref<const Eigen::VectorXd>& query,
+                                                  const Eigen::Ref<const Eigen::VectorXd>& coefficients) const {
+  const int n = shapes_.cols();
+  const int modes = coefficients.size();
+
+  // |query - shape|^2 = |c|^2 - 2 c . coordinates + |shape - mean|^2, which the particle distance is never below
+  // (the sum of the particle norms is at least the norm of the whole vector).  The slack covers rounding.
+  Eigen::VectorXd squared = squared_norms_ - 2.0 * coordinates_.topRows(modes).transpose() * coefficients;
+  squared.array() += coefficients.squaredNorm();
+  const Eigen::VectorXd lower = squared.cwiseMax(0.0).cwiseSqrt() * (1.0 - 1e-9);
+
+  std::vector<int> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](int a, int b) { return lower(a) < lower(b); });
+
+  Result best;
+  best.distance = std::numeric_limits<double>::max();
+
+  // shapes whose exact distance is known serve as pivots for the rest
+  std::vector<std::pair<int, double>> pivots;
+  for (int candidate : order) {
+    if (lower(candidate) >= best.distance) {
+      break;  // visited in order of the L2 bound, so no later candidate can be closer
+    }
+    bool pruned = false;
+    for (const auto& pivot : pivots) {
+      if (std::abs(pivot.second - shape_distances_(pivot.first, candidate)) >= best.distance) {
+        pruned = true;
+        break;
+      }
+    }
+    if (pruned) {
+      continue;
+    }
+
+    const double d = distance(query.data(), shapes_.col(candidate).data(), num_particles_);
+    num_refinements_.fetch_add(1, std::memory_order_relaxed);
+    pivots.emplace_back(candidate, d);
+    if (d < best.distance) {
+      best.distance = d;
+      best.index = candidate;
+    }
+  }
+  return best;
+}
+
+}  // namespace shapeworks
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <atomic>
+
+namespace shapeworks {
+
+/**
+ * Finds the training shape closest to a query shape, with the distance used by the specificity measure: the sum over
+ * particles of the distance between corresponding particles.
+ *
+ * Queries are shapes in a linear model, mean + basis * coefficients (e.g. shapes sampled from PCA modes).  Their L2
+ * distance to each training shape then follows from the coefficients and the projections of the training shapes onto
+ * the basis in O(modes), and is a lower bound of the particle distance.  Candidates are visited in order of that bound
+ * and refined with the exact distance, and every exact distance also bounds the remaining candidates through the
+ * triangle inequality with the precomputed distances between the training shapes.  Most candidates are rejected
+ * without touching their particles; the result is the same as an exhaustive search.
+ *
+ * find() is const and may be called from several threads at once.
+ */
+class NearestShapeIndex {
+ public:
+  struct Result {
+    int index = -1;         //!< column of the closest training shape
+    double distance = 0.0;  //!< sum of the particle distances to it
+  };
+
+  //! shapes holds one training shape per column and must outlive the index.  The columns of basis must be orthonormal
+  //! or zero
+  NearestShapeIndex(const Eigen::MatrixXd& shapes, const Eigen::VectorXd& mean, const Eigen::MatrixXd& basis);
+
+  //! Closest training shape to query, which must equal mean + basis.leftCols(coefficients.size()) * coefficients
+  Result find(const Eigen::Ref<const Eigen::VectorXd>& query,
+              const Eigen::Ref<const Eigen::VectorXd>& coefficients) const;
+
+  //! Number of exact distances computed by find() so far
+  size_t get_num_refinements() const { return num_refinements_; }
+
+  //! Sum over the particles of the distance between corresponding particles of a and b
+  static double distance(const double* a, const double* b, int num_particles);
+
+ private:
+  const Eigen::MatrixXd& shapes_;
+  int num_particles_ = 0;
+
+  Eigen::MatrixXd coordinates_;      // projections of the training shapes onto the basis, one column per shape
+  Eigen::VectorXd squared_norms_;    // squared L2 distances of the training shapes to the mean
+  Eigen::MatrixXd shape_distances_;  // particle distances between the training shapes
+
+  mutable std::atomic<size_t> num_refinements_{0};
+};
+
+}  // namespace shapeworks
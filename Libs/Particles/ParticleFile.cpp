@@ -8,10 +8,142 @@
 
 #include <StringUtils.h>
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <Logging.h>
+#include <mutex>
+
+#include "ParticleStore.h"
 
 namespace shapeworks::particles {
+
+namespace {
+// On-disk header of a binary particle file, followed by num_columns columns of num_points scalars each
+struct BinaryHeader {
+  char magic[8];
+  uint32_t version;      // also detects a byte order mismatch
+  uint32_t scalar_size;  // 4 or 8
+  uint64_t num_points;
+  uint32_t num_columns;  // x, y, z and the features
+  uint32_t reserved;
+};
+static_assert(sizeof(BinaryHeader) == 32, "binary particle header must be 32 bytes");
+
+constexpr char BINARY_MAGIC[8] = {'S', 'W', 'P', 'A', 'R', 'T', 'S', '\0'};
+constexpr uint32_t BINARY_VERSION = 1;
+}  // namespace
+
+//---------------------------------------------------------------------------
+struct ParticleFileView::Mapping {
+  boost::interprocess::file_mapping file;
+  boost::interprocess::mapped_region region;
+};
+
+//---------------------------------------------------------------------------
+ParticleFileView::ParticleFileView(const std::string& filename) {
+  try {
+    mapping_ = std::make_unique<Mapping>();
+    mapping_->file = boost::interprocess::file_mapping(filename.c_str(), boost::interprocess::read_only);
+    mapping_->region = boost::interprocess::mapped_region(mapping_->file, boost::interprocess::read_only);
+  } catch (boost::interprocess::interprocess_exception& e) {
+    throw std::runtime_error("Unable to read particle file: " + filename + ": " + e.what());
+  }
+
+  const auto base = static_cast<const char*>(mapping_->region.get_address());
+  const size_t size = mapping_->region.get_size();
+
+  BinaryHeader header;
+  if (size < sizeof(header)) {
+    throw std::runtime_error("Invalid binary particle file: " + filename);
+  }
+  std::memcpy(&header, base, sizeof(header));
+  if (std::memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+    throw std::runtime_error("Invalid binary particle file: " + filename);
+  }
+  if (header.version != BINARY_VERSION) {
+    throw std::runtime_error("Unsupported binary particle file version: " + filename);
+  }
+  if ((header.scalar_size != sizeof(float) && header.scalar_size != sizeof(double)) || header.num_columns < 3) {
+    throw std::runtime_error("Invalid binary particle file: " + filename);
+  }
+  if (size - sizeof(header) < header.num_points * header.num_columns * header.scalar_size) {
+    throw std::runtime_error("Truncated binary particle file: " + filename);
+  }
+
+  // the header is 32 bytes and the mapping is page aligned, so the data is aligned for double
+  data_ = base + sizeof(header);
+  num_points_ = header.num_points;
+  num_columns_ = header.num_columns;
+  scalar_size_ = header.scalar_size;
+}
+
+//---------------------------------------------------------------------------
+ParticleFileView::~ParticleFileView() = default;
+
+//---------------------------------------------------------------------------
+Eigen::VectorXd ParticleFileView::get_interleaved_points() const {
+  Eigen::VectorXd points(num_points_ * 3);
+  Eigen::Map<Eigen::Matrix<double, 3, Eigen::Dynamic>> interleaved(points.data(), 3, num_points_);
+  if (is_single_precision()) {
+    interleaved = get_columns<float>().leftCols<3>().transpose().cast<double>();
+  } else {
+    interleaved = get_columns<double>().leftCols<3>().transpose();
+  }
+  return points;
+}
+
+//---------------------------------------------------------------------------
+template <class T>
+static void write_binary_columns(std::ofstream& out, const Eigen::VectorXd& points, const Eigen::MatrixXd& features) {
+  const Eigen::Index num_points = points.size() / 3;
+  Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> columns(num_points, 3 + features.cols());
+  columns.template leftCols<3>() =
+      Eigen::Map<const Eigen::Matrix<double, 3, Eigen::Dynamic>>(points.data(), 3, num_points).transpose().cast<T>();
+  if (features.cols() > 0) {
+    columns.rightCols(features.cols()) = features.cast<T>();
+  }
+  out.write(reinterpret_cast<const char*>(columns.data()), columns.size() * sizeof(T));
+}
+
+//---------------------------------------------------------------------------
+void write_binary_particles(std::string filename, const Eigen::VectorXd& points, const Eigen::MatrixXd& features,
+                            bool single_precision) {
+  const size_t num_points = points.size() / 3;
+  if (features.cols() > 0 && features.rows() != static_cast<Eigen::Index>(num_points)) {
+    throw std::runtime_error("Particle features must have one row per particle: " + filename);
+  }
+
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("Unable to write file: " + filename);
+  }
+
+  BinaryHeader header{};
+  std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  header.version = BINARY_VERSION;
+  header.scalar_size = single_precision ? sizeof(float) : sizeof(double);
+  header.num_points = num_points;
+  header.num_columns = 3 + features.cols();
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  if (single_precision) {
+    write_binary_columns<float>(out, points, features);
+  } else {
+    write_binary_columns<double>(out, points, features);
+  }
+  if (!out) {
+    throw std::runtime_error("Unable to write file: " + filename);
+  }
+}
+
+//---------------------------------------------------------------------------
+bool is_binary_particle_file(const std::string& filename) {
+  return StringUtils::hasSuffix(filename, BINARY_EXTENSION);
+}
+
 //---------------------------------------------------------------------------
 static void write_vtk_particles(std::string filename, const Eigen::VectorXd& points) {
   auto vtk_points = vtkSmartPointer<vtkPoints>::New();
@@ -55,11 +187,32 @@ static Eigen::VectorXd read_vtk_particles(std::string filename) {
   return points;
 }
 
+//---------------------------------------------------------------------------
+// Reading a subject from a store would otherwise parse the whole index, so the last store is kept open until it
+// changes (a new snapshot moves its last index)
+static std::shared_ptr<ParticleStore> open_store(const std::string& filename) {
+  static std::mutex mutex;
+  static std::shared_ptr<ParticleStore> cached;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (cached && cached->get_filename() == filename && ParticleStore::read_version(filename) == cached->get_version()) {
+    return cached;
+  }
+  cached = std::make_shared<ParticleStore>(filename);
+  return cached;
+}
+
 //---------------------------------------------------------------------------
 Eigen::VectorXd read_particles(std::string filename) {
+  std::string store, snapshot, entry;
+  if (ParticleStore::split_path(filename, store, snapshot, entry)) {
+    return open_store(store)->read_particles(snapshot, entry);
+  }
   if (StringUtils::hasSuffix(filename, ".vtk")) {
     return read_vtk_particles(filename);
   }
+  if (is_binary_particle_file(filename)) {
+    return ParticleFileView(filename).get_interleaved_points();
+  }
 
   std::ifstream in(filename);
   if (!in.good()) {
@@ -99,6 +252,10 @@ void write_particles(std::string filename, const Eigen::VectorXd& points) {
     write_vtk_particles(filename, points);
     return;
   }
+  if (is_binary_particle_file(filename)) {
+    write_binary_particles(filename, points);
+    return;
+  }
   std::ofstream out(filename.c_str());
   if (!out) {
     throw std::runtime_error("Unable to write file: " + filename);
@@ -115,6 +272,26 @@ void write_particles(std::string filename, const Eigen::VectorXd& points) {
 
 //---------------------------------------------------------------------------
 std::vector<itk::Point<double, 3> > read_particles_as_vector(std::string filename) {
+  if (is_binary_particle_file(filename)) {
+    // straight from the mapped columns, without the interleaved copy
+    ParticleFileView view(filename);
+    std::vector<itk::Point<double, 3> > points(view.get_num_points());
+    for (int c = 0; c < 3; c++) {
+      if (view.is_single_precision()) {
+        auto column = view.get_columns<float>().col(c);
+        for (size_t i = 0; i < points.size(); i++) {
+          points[i][c] = column[i];
+        }
+      } else {
+        auto column = view.get_columns<double>().col(c);
+        for (size_t i = 0; i < points.size(); i++) {
+          points[i][c] = column[i];
+        }
+      }
+    }
+    return points;
+  }
+
   Eigen::VectorXd particles = read_particles(filename);
 
   int num_points = particles.size() / 3;
@@ -3,11 +3,67 @@
 #include <itkPoint.h>
 
 #include <Eigen/Core>
+#include <memory>
+#include <stdexcept>
+#include <string>
 
 namespace shapeworks {
 
 namespace particles {
 
+//! Extension of the binary particle format.  Files with any other extension (except .vtk) are text
+static constexpr const char* BINARY_EXTENSION = ".pbin";
+
+/**
+ * Read-only view of a binary particle file (.pbin).
+ *
+ * A binary particle file is a 32 byte header followed by the data in columns: all x, all y, all z, then any feature
+ * columns, each with one float64 or float32 value per point.  The header holds a magic string, the format version,
+ * the scalar size in bytes, the number of points and the number of columns.
+ *
+ * The file is memory mapped and get_columns() wraps the mapping without copying, as a (points x columns) column
+ * major matrix.  The view must outlive the maps it hands out.
+ */
+class ParticleFileView {
+ public:
+  //! Map filename.  Throws std::runtime_error if the file can not be mapped or is not a binary particle file
+  explicit ParticleFileView(const std::string& filename);
+  ~ParticleFileView();
+
+  size_t get_num_points() const { return num_points_; }
+  int get_num_features() const { return num_columns_ - 3; }
+  bool is_single_precision() const { return scalar_size_ == sizeof(float); }
+
+  //! All columns (x, y, z, features...).  T must match the precision of the file (double or float)
+  template <class T>
+  Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> get_columns() const {
+    if (sizeof(T) != scalar_size_) {
+      throw std::runtime_error("Particle file precision mismatch");
+    }
+    return Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>>(reinterpret_cast<const T*>(data_),
+                                                                             num_points_, num_columns_);
+  }
+
+  //! Positions interleaved as x0 y0 z0 x1 y1 z1..., the layout of read_particles
+  Eigen::VectorXd get_interleaved_points() const;
+
+ private:
+  struct Mapping;
+  std::unique_ptr<Mapping> mapping_;
+  const char* data_ = nullptr;
+  size_t num_points_ = 0;
+  int num_columns_ = 0;
+  size_t scalar_size_ = 0;
+};
+
+//---------------------------------------------------------------------------
+//! Write a binary particle file.  points are interleaved (x0 y0 z0 x1...), features has one row per point
+void write_binary_particles(std::string filename, const Eigen::VectorXd& points,
+                            const Eigen::MatrixXd& features = Eigen::MatrixXd(), bool single_precision = false);
+
+//---------------------------------------------------------------------------
+bool is_binary_particle_file(const std::string& filename);
+
 //---------------------------------------------------------------------------
 Eigen::VectorXd read_particles(std::string filename);
 
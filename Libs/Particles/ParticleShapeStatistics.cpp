@@ -6,6 +6,8 @@
 #include <Project/Project.h>
 #include <vnl/algo/vnl_symmetric_eigensystem.h>
 
+#include <random>
+
 #include "ExternalLibs/tinyxml/tinyxml.h"
 #include "ShapeEvaluation.h"
 
@@ -76,17 +78,15 @@ int ParticleShapeStatistics::compute_median_shape(const int ID) {
 //---------------------------------------------------------------------------
 double ParticleShapeStatistics::l1_norm(unsigned int a, unsigned int b) {
   double norm = 0.0;
-  for (unsigned int i = 0; i < shapes_.rows(); i++) {
-    norm += fabs(shapes_(i, a) - shapes_(i, b));
+  // the mean cancels, so the centered shapes serve without keeping a second copy of the shapes
+  for (unsigned int i = 0; i < points_minus_mean_.rows(); i++) {
+    norm += fabs(points_minus_mean_(i, a) - points_minus_mean_(i, b));
   }
   return norm;
 }
 
 //---------------------------------------------------------------------------
-int ParticleShapeStatistics::import_points(std::vector<Eigen::VectorXd> points, std::vector<int> group_ids) {
-  // local copy of points
-  points_ = points;
-
+int ParticleShapeStatistics::import_points(const std::vector<Eigen::VectorXd>& points, std::vector<int> group_ids) {
   group_ids_ = group_ids;
   domains_per_shape_ = 1;
 
@@ -126,7 +126,6 @@ int ParticleShapeStatistics::import_points(std::vector<Eigen::VectorXd> points,
 
   points_minus_mean_.resize(num_dimensions_, num_samples_);
   points_minus_mean_.fill(0);
-  shapes_.resize(num_dimensions_, num_samples_);
   mean_.resize(num_dimensions_);
   mean_.fill(0);
 
@@ -149,8 +148,6 @@ int ParticleShapeStatistics::import_points(std::vector<Eigen::VectorXd> points,
         } else {
           mean2_(q * k * values_per_particle_ + j) += points[i][j];
         }
-
-        shapes_(q * k * values_per_particle_ + j, i) = points[i][j];
       }
     }
   }
@@ -417,7 +414,6 @@ int ParticleShapeStatistics::read_point_files(const std::string& s) {
   };
 
   points_minus_mean_.resize(num_dimensions_, num_samples_);
-  shapes_.resize(num_dimensions_, num_samples_);
   mean_.resize(num_dimensions_);
   mean_.fill(0);
 
@@ -449,10 +445,6 @@ int ParticleShapeStatistics::read_point_files(const std::string& s) {
           mean2_(q * k * values_per_particle_ + (values_per_particle_ * j) + 1) += points[j][1];
           mean2_(q * k * values_per_particle_ + (values_per_particle_ * j) + 2) += points[j][2];
         }
-
-        shapes_(q * k * values_per_particle_ + (values_per_particle_ * j) + 0, i) = points[j][0];
-        shapes_(q * k * values_per_particle_ + (values_per_particle_ * j) + 1, i) = points[j][1];
-        shapes_(q * k * values_per_particle_ + (values_per_particle_ * j) + 2, i) = points[j][2];
       }
     }
   }
@@ -495,7 +487,7 @@ ParticleShapeStatistics::ParticleShapeStatistics(std::shared_ptr<Project> projec
 }
 
 //---------------------------------------------------------------------------
-int ParticleShapeStatistics::do_pca(std::vector<std::vector<Point>> global_pts, int domainsPerShape) {
+int ParticleShapeStatistics::do_pca(const std::vector<std::vector<Point>>& global_pts, int domainsPerShape) {
   this->domains_per_shape_ = domainsPerShape;
 
   // Assumes all the same size.
@@ -503,7 +495,6 @@ int ParticleShapeStatistics::do_pca(std::vector<std::vector<Point>> global_pts,
   num_dimensions_ = global_pts[0].size() * values_per_particle_ * domains_per_shape_;
 
   points_minus_mean_.resize(num_dimensions_, num_samples_);
-  shapes_.resize(num_dimensions_, num_samples_);
   mean_.resize(num_dimensions_);
   mean_.fill(0);
 
@@ -516,7 +507,7 @@ int ParticleShapeStatistics::do_pca(std::vector<std::vector<Point>> global_pts,
   for (unsigned int i = 0; i < num_samples_; i++) {
     for (unsigned int k = 0; k < domains_per_shape_; k++) {
       // std::cout << "i*m_domainsPerShape + k = " << i*m_domainsPerShape + k << "-------------\n";
-      std::vector<Point> curDomain = global_pts[i * domains_per_shape_ + k];
+      const std::vector<Point>& curDomain = global_pts[i * domains_per_shape_ + k];
       unsigned int q = curDomain.size();
 
       // std::cout << "q = " << q << "-------------\n";
@@ -527,10 +518,6 @@ int ParticleShapeStatistics::do_pca(std::vector<std::vector<Point>> global_pts,
             points_minus_mean_(q * k * values_per_particle_ + (values_per_particle_ * j) + 1, i) = curDomain[j][1];
         mean_(q * k * values_per_particle_ + (values_per_particle_ * j) + 2) +=
             points_minus_mean_(q * k * values_per_particle_ + (values_per_particle_ * j) + 2, i) = curDomain[j][2];
-
-        shapes_(q * k * values_per_particle_ + (values_per_particle_ * j) + 0, i) = curDomain[j][0];
-        shapes_(q * k * values_per_particle_ + (values_per_particle_ * j) + 1, i) = curDomain[j][1];
-        shapes_(q * k * values_per_particle_ + (values_per_particle_ * j) + 2, i) = curDomain[j][2];
       }
     }
   }
@@ -550,24 +537,162 @@ int ParticleShapeStatistics::do_pca(std::vector<std::vector<Point>> global_pts,
 }
 
 //---------------------------------------------------------------------------
-int ParticleShapeStatistics::do_pca(ParticleSystemEvaluation ParticleSystemEvaluation, int domainsPerShape) {
-  Eigen::MatrixXd p = ParticleSystemEvaluation.Particles();
+int ParticleShapeStatistics::do_pca(const ParticleSystemEvaluation& ParticleSystemEvaluation, int domainsPerShape) {
+  const Eigen::MatrixXd& p = ParticleSystemEvaluation.Particles();
+  domains_per_shape_ = domainsPerShape;
 
-  std::vector<std::vector<Point>> particlePoints;
+  // straight from the particle matrix, in the same order as the point based overload
+  num_samples_ = p.cols() / domains_per_shape_;
+  num_dimensions_ = p.rows() * domains_per_shape_;
 
-  for (int i = 0; i < p.cols(); i++) {
-    std::vector<Point> particle;
-    for (int j = 0; j < p.rows() / 3; j++) {
-      Point point;
-      for (int k = 0; k < 3; k++) {
-        point[k] = p.coeff(j * 3 + k, i);
+  points_minus_mean_.resize(num_dimensions_, num_samples_);
+  mean_ = Eigen::VectorXd::Zero(num_dimensions_);
+  for (unsigned int i = 0; i < num_samples_; i++) {
+    for (unsigned int k = 0; k < domains_per_shape_; k++) {
+      const auto domain = p.col(i * domains_per_shape_ + k);
+      for (unsigned int j = 0; j < p.rows(); j++) {
+        mean_(p.rows() * k + j) += points_minus_mean_(p.rows() * k + j, i) = domain(j);
       }
-      particle.push_back(point);
     }
-    particlePoints.push_back(particle);
   }
+  mean_ /= (double)num_samples_;
+  points_minus_mean_.colwise() -= mean_;
 
-  return do_pca(particlePoints, domainsPerShape);
+  compute_modes();
+  return 0;
+}
+
+//---------------------------------------------------------------------------
+static Eigen::VectorXd read_shape(const std::vector<std::string>& filenames, int shape, int domains_per_shape) {
+  Eigen::VectorXd points;
+  for (int k = 0; k < domains_per_shape; k++) {
+    Eigen::VectorXd domain_points = particles::read_particles(filenames[shape * domains_per_shape + k]);
+    Eigen::VectorXd combined(points.size() + domain_points.size());
+    combined << points, domain_points;
+    points.swap(combined);
+  }
+  return points;
+}
+
+//---------------------------------------------------------------------------
+// The num_modes largest eigenpairs of a symmetric positive semi-definite matrix, in ascending order.  When only a few
+// modes are wanted they come from a randomized subspace iteration and the Rayleigh-Ritz projection onto it, so the
+// eigen solver only sees a small matrix.
+static void largest_eigenpairs(const Eigen::MatrixXd& A, int num_modes, Eigen::VectorXd& eigenvalues,
+                               Eigen::MatrixXd& eigenvectors) {
+  const int n = A.rows();
+  const int subspace = num_modes + 10;
+  if (2 * subspace >= n) {
+    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(A);
+    eigenvalues = solver.eigenvalues().tail(num_modes);
+    eigenvectors = solver.eigenvectors().rightCols(num_modes);
+    return;
+  }
+
+  // a local, fixed seed generator: repeatable, and leaves the global rand() state alone
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  Eigen::MatrixXd Q = Eigen::MatrixXd::NullaryExpr(n, subspace, [&]() { return uniform(generator); });
+  for (int iteration = 0; iteration < 6; iteration++) {
+    Eigen::HouseholderQR<Eigen::MatrixXd> qr(A * Q);
+    Q = qr.householderQ() * Eigen::MatrixXd::Identity(n, subspace);
+  }
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(Q.transpose() * A * Q);
+  eigenvalues = solver.eigenvalues().tail(num_modes);
+  eigenvectors = Q * solver.eigenvectors().rightCols(num_modes);
+}
+
+//---------------------------------------------------------------------------
+int ParticleShapeStatistics::do_streaming_pca(const std::vector<std::string>& filenames, int domains_per_shape,
+                                              int num_modes, int block_size) {
+  domains_per_shape_ = domains_per_shape;
+  num_samples_ = filenames.size() / domains_per_shape_;
+  const int N = num_samples_;
+  if (N < 2) {
+    std::cerr << "Streaming PCA requires at least two shapes." << std::endl;
+    return 1;
+  }
+  if (num_modes <= 0 || num_modes > N) {
+    num_modes = N;
+  }
+  block_size = std::max(1, block_size);
+
+  // Shapes are taken relative to the first one, which leaves the centered Gram matrix unchanged but keeps the raw
+  // products small (absolute positions are much larger than the variation between shapes)
+  const Eigen::VectorXd reference = read_shape(filenames, 0, domains_per_shape_);
+  num_dimensions_ = reference.size();
+  Eigen::VectorXd sum = Eigen::VectorXd::Zero(num_dimensions_);
+
+  auto read = [&](int shape) {
+    Eigen::VectorXd points = read_shape(filenames, shape, domains_per_shape_);
+    if (points.size() != num_dimensions_) {
+      throw std::runtime_error("Shapes must have the same number of particles: " + filenames[shape * domains_per_shape_]);
+    }
+    return Eigen::VectorXd(points - reference);
+  };
+
+  // Gram matrix of the shapes: each block against itself, then the remaining shapes streamed past it
+  Eigen::MatrixXd gram(N, N);
+  Eigen::MatrixXd block(num_dimensions_, std::min(block_size, N));
+  for (int start = 0; start < N; start += block_size) {
+    const int count = std::min(block_size, N - start);
+    for (int i = 0; i < count; i++) {
+      block.col(i) = read(start + i);
+      sum += block.col(i);
+    }
+    const auto X = block.leftCols(count);
+    gram.block(start, start, count, count).noalias() = X.transpose() * X;
+    for (int j = start + count; j < N; j++) {
+      gram.block(start, j, count, 1).noalias() = X.transpose() * read(j);
+      gram.block(j, start, 1, count) = gram.block(start, j, count, 1).transpose();
+    }
+  }
+  block.resize(0, 0);
+
+  // center: G - r 1^T - 1 r^T + s, with r the row means and s the overall mean of G
+  const Eigen::VectorXd row_means = gram.rowwise().mean();
+  const double overall_mean = row_means.mean();
+  gram.rowwise() -= row_means.transpose();
+  gram.colwise() -= row_means;
+  gram.array() += overall_mean;
+  gram /= (double)(N - 1);
+
+  Eigen::VectorXd values;
+  Eigen::MatrixXd V;
+  largest_eigenpairs(gram, num_modes, values, V);
+  values = values.cwiseMax(0.0);
+
+  // eigenvectors in shape space, one more pass over the shapes
+  mean_ = reference + sum / (double)N;
+  const Eigen::VectorXd shift = sum / (double)N;
+  eigenvectors_ = Eigen::MatrixXd::Zero(num_dimensions_, num_modes);
+  for (int i = 0; i < N; i++) {
+    eigenvectors_.noalias() += (read(i) - shift) * V.row(i);
+  }
+  for (int m = 0; m < num_modes; m++) {
+    eigenvectors_.col(m) /= eigenvectors_.col(m).norm() + 1.0e-15;
+  }
+  eigenvalues_.assign(values.data(), values.data() + num_modes);
+
+  // loadings: the projection of centered shape s onto mode m is sqrt((N - 1) * lambda_m) * V(s, m)
+  principals_.resize(N, num_modes);
+  for (int n = 0; n < num_modes; n++) {
+    const int m = num_modes - 1 - n;
+    principals_.col(n) = V.col(m) * std::sqrt(values(m) * (N - 1));
+  }
+
+  const double total = gram.trace();
+  percent_variance_by_mode_.clear();
+  double cumulative = 0.0;
+  for (int n = 0; n < num_modes; n++) {
+    cumulative += eigenvalues_[num_modes - 1 - n];
+    percent_variance_by_mode_.push_back(total > 0 ? cumulative / total : 0.0);
+  }
+
+  // nothing is kept per shape
+  points_minus_mean_.resize(0, 0);
+  matrix_.resize(0, 0);
+  return 0;
 }
 
 //---------------------------------------------------------------------------
@@ -587,16 +712,7 @@ int ParticleShapeStatistics::compute_modes() {
 
   // normalize the eigenvectors
   for (unsigned int i = 0; i < num_samples_; i++) {
-    double total = 0.0f;
-    for (unsigned int j = 0; j < num_dimensions_; j++) {
-      total += eigenvectors_(j, i) * eigenvectors_(j, i);
-    }
-    total = sqrt(total);
-
-    for (unsigned int j = 0; j < num_dimensions_; j++) {
-      eigenvectors_(j, i) = eigenvectors_(j, i) / (total + 1.0e-15);
-    }
-
+    eigenvectors_.col(i) /= eigenvectors_.col(i).norm() + 1.0e-15;
     eigenvalues_[i] = eigenSymEigenD(i);
   }
 
@@ -620,10 +736,18 @@ int ParticleShapeStatistics::compute_modes() {
 }
 
 //---------------------------------------------------------------------------
-int ParticleShapeStatistics::get_num_modes() const { return num_samples_ - 1; }
+int ParticleShapeStatistics::get_num_modes() const {
+  if (!eigenvalues_.empty() && eigenvalues_.size() < num_samples_) {
+    return eigenvalues_.size();  // only the largest modes were computed
+  }
+  return num_samples_ - 1;
+}
 
 //---------------------------------------------------------------------------
 int ParticleShapeStatistics::principal_component_projections() {
+  if (points_minus_mean_.size() == 0) {
+    return 0;  // the streaming PCA computes the loadings itself
+  }
   // Now print the projection of each shape
   principals_.resize(num_samples_, num_samples_);
 
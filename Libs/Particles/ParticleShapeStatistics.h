@@ -22,12 +22,19 @@ class ParticleShapeStatistics {
   ParticleShapeStatistics(std::shared_ptr<Project> project);
   ~ParticleShapeStatistics(){};
 
-  int do_pca(std::vector<std::vector<Point>> global_pts, int domainsPerShape = 1);
+  int do_pca(const std::vector<std::vector<Point>>& global_pts, int domainsPerShape = 1);
 
-  int do_pca(ParticleSystemEvaluation particleSystem, int domainsPerShape = 1);
+  int do_pca(const ParticleSystemEvaluation& particleSystem, int domainsPerShape = 1);
+
+  //! Out-of-core PCA of the shapes in filenames (domains_per_shape consecutive files per shape).  The shapes are never
+  //! all in memory: the Gram matrix is accumulated from blocks of at most block_size shapes read from disk, and only
+  //! the num_modes largest modes are computed (all if num_modes <= 0).  Fills the mean, eigenvectors, eigenvalues,
+  //! loadings and percent variance; the shape matrix (and the evaluation metrics) are not available afterwards.
+  int do_streaming_pca(const std::vector<std::string>& filenames, int domains_per_shape = 1, int num_modes = 0,
+                       int block_size = 1024);
 
   //! Loads a set of point files and pre-computes some statistics.
-  int import_points(std::vector<Eigen::VectorXd> points, std::vector<int> group_ids);
+  int import_points(const std::vector<Eigen::VectorXd>& points, std::vector<int> group_ids);
 
   //! Loads a set of point files and pre-computes statistics for multi-level analysis
   void compute_multi_level_analysis_statistics(std::vector<Eigen::VectorXd> points, unsigned int dps);
@@ -142,7 +149,6 @@ class ParticleShapeStatistics {
   Eigen::VectorXd mean1_;
   Eigen::VectorXd mean2_;
   Eigen::MatrixXd points_minus_mean_;
-  Eigen::MatrixXd shapes_;
 
   std::vector<double> percent_variance_by_mode_;
   Eigen::MatrixXd principals_;
@@ -167,8 +173,6 @@ class ParticleShapeStatistics {
   Eigen::MatrixXd group1_matrix_;
   Eigen::MatrixXd group2_matrix_;
 
-  std::vector<Eigen::VectorXd> points_;
-
   int values_per_particle_ = 3;  // e.g. 3 for x/y/z, 4 for x/y/z/scalar
 };
 
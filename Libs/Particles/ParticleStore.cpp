@@ -0,0 +1,294 @@
+#include "ParticleStore.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace shapeworks::particles {
+
+namespace {
+struct StoreHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t last_index;  // offset of the index of the last committed snapshot, 0 if there is none
+  uint64_t end;         // end of the committed data, anything after it is an interrupted append
+};
+static_assert(sizeof(StoreHeader) == 32, "particle store header must be 32 bytes");
+
+constexpr char STORE_MAGIC[8] = {'S', 'W', 'P', 'S', 'T', 'O', 'R', 'E'};
+constexpr uint32_t STORE_VERSION = 1;
+
+//---------------------------------------------------------------------------
+template <class T>
+void write_value(std::ostream& out, T value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+//---------------------------------------------------------------------------
+void write_string(std::ostream& out, const std::string& str) {
+  write_value<uint32_t>(out, str.size());
+  out.write(str.data(), str.size());
+}
+
+//---------------------------------------------------------------------------
+template <class T>
+T read_value(std::istream& in) {
+  T value{};
+  in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  return value;
+}
+
+//---------------------------------------------------------------------------
+std::string read_string(std::istream& in, uint64_t limit) {
+  const auto size = read_value<uint32_t>(in);
+  if (!in || size > limit) {
+    throw std::runtime_error("Corrupt particle store index");
+  }
+  std::string str(size, '\0');
+  in.read(&str[0], size);
+  return str;
+}
+
+//---------------------------------------------------------------------------
+bool read_header(std::istream& in, StoreHeader& header) {
+  in.seekg(0);
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  return in && std::memcmp(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC)) == 0 && header.version == STORE_VERSION &&
+         header.end >= sizeof(header) && header.last_index < header.end;
+}
+}  // namespace
+
+//---------------------------------------------------------------------------
+ParticleStore::ParticleStore(const std::string& filename) : filename_(filename) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in.good()) {
+    throw std::runtime_error("Unable to read particle store: " + filename);
+  }
+  StoreHeader header;
+  if (!read_header(in, header)) {
+    throw std::runtime_error("Invalid particle store: " + filename);
+  }
+  last_index_ = header.last_index;
+
+  // walk the chain of indices from the newest snapshot back
+  uint64_t index = header.last_index;
+  while (index != 0) {
+    if (index < sizeof(header) || index >= header.end) {
+      throw std::runtime_error("Corrupt particle store index: " + filename);
+    }
+    in.seekg(index);
+    const auto previous = read_value<uint64_t>(in);
+    Snapshot snapshot;
+    snapshot.name = read_string(in, header.end);
+    const auto num_entries = read_value<uint32_t>(in);
+    for (uint32_t i = 0; i < num_entries && in; i++) {
+      Entry entry;
+      entry.name = read_string(in, header.end);
+      entry.rows = read_value<uint64_t>(in);
+      entry.cols = read_value<uint64_t>(in);
+      entry.offset = read_value<uint64_t>(in);
+      if (entry.offset + entry.rows * entry.cols * sizeof(double) > index) {
+        throw std::runtime_error("Corrupt particle store index: " + filename);
+      }
+      snapshot.entries.push_back(std::move(entry));
+    }
+    if (!in || previous >= index) {
+      throw std::runtime_error("Corrupt particle store index: " + filename);
+    }
+    snapshots_.push_back(std::move(snapshot));
+    index = previous;
+  }
+  std::reverse(snapshots_.begin(), snapshots_.end());
+}
+
+//---------------------------------------------------------------------------
+std::vector<std::string> ParticleStore::get_snapshots() const {
+  std::vector<std::string> names;
+  for (const auto& snapshot : snapshots_) {
+    names.push_back(snapshot.name);
+  }
+  return names;
+}
+
+//---------------------------------------------------------------------------
+std::vector<std::string> ParticleStore::get_entries(const std::string& snapshot) const {
+  // a snapshot name may be written more than once (e.g. a resumed run), the last one wins
+  for (auto it = snapshots_.rbegin(); it != snapshots_.rend(); ++it) {
+    if (it->name == snapshot) {
+      std::vector<std::string> names;
+      for (const auto& entry : it->entries) {
+        names.push_back(entry.name);
+      }
+      return names;
+    }
+  }
+  throw std::runtime_error("No snapshot '" + snapshot + "' in particle store: " + filename_);
+}
+
+//---------------------------------------------------------------------------
+const ParticleStore::Entry* ParticleStore::find(const std::string& snapshot, const std::string& entry) const {
+  for (auto it = snapshots_.rbegin(); it != snapshots_.rend(); ++it) {
+    if (!snapshot.empty() && it->name != snapshot) {
+      continue;
+    }
+    for (const auto& e : it->entries) {
+      if (e.name == entry) {
+        return &e;
+      }
+    }
+    if (!snapshot.empty()) {
+      return nullptr;
+    }
+  }
+  return nullptr;
+}
+
+//---------------------------------------------------------------------------
+bool ParticleStore::contains(const std::string& snapshot, const std::string& entry) const {
+  return find(snapshot, entry) != nullptr;
+}
+
+//---------------------------------------------------------------------------
+Eigen::MatrixXd ParticleStore::read(const std::string& snapshot, const std::string& entry) const {
+  const auto e = find(snapshot, entry);
+  if (!e) {
+    throw std::runtime_error("No entry '" + snapshot + "/" + entry + "' in particle store: " + filename_);
+  }
+  std::ifstream in(filename_, std::ios::binary);
+  in.seekg(e->offset);
+  Eigen::MatrixXd values(e->rows, e->cols);
+  in.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(double));
+  if (!in) {
+    throw std::runtime_error("Unable to read particle store: " + filename_);
+  }
+  return values;
+}
+
+//---------------------------------------------------------------------------
+Eigen::VectorXd ParticleStore::read_particles(const std::string& snapshot, const std::string& entry) const {
+  Eigen::MatrixXd values = read(snapshot, entry);
+  if (values.size() % 3 != 0) {
+    throw std::runtime_error("Entry '" + entry + "' of particle store " + filename_ + " does not hold particles");
+  }
+  return Eigen::Map<const Eigen::VectorXd>(values.data(), values.size());
+}
+
+//---------------------------------------------------------------------------
+std::vector<std::string> ParticleStore::get_paths(const std::string& snapshot, const std::string& suffix) const {
+  std::vector<std::string> paths;
+  for (const auto& entry : get_entries(snapshot)) {
+    if (entry.size() >= suffix.size() && entry.compare(entry.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      paths.push_back(filename_ + "#" + snapshot + "/" + entry);
+    }
+  }
+  return paths;
+}
+
+//---------------------------------------------------------------------------
+uint64_t ParticleStore::read_version(const std::string& filename) {
+  std::ifstream in(filename, std::ios::binary);
+  StoreHeader header;
+  if (!read_header(in, header)) {
+    return 0;
+  }
+  return header.last_index;
+}
+
+//---------------------------------------------------------------------------
+bool ParticleStore::split_path(const std::string& path, std::string& store, std::string& snapshot,
+                               std::string& entry) {
+  const std::string marker = std::string(STORE_EXTENSION) + "#";
+  const auto pos = path.rfind(marker);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  store = path.substr(0, pos + marker.size() - 1);
+  const auto name = path.substr(pos + marker.size());
+  const auto slash = name.find('/');
+  if (slash == std::string::npos) {
+    snapshot = "";
+    entry = name;
+  } else {
+    snapshot = name.substr(0, slash);
+    entry = name.substr(slash + 1);
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+ParticleStoreWriter::ParticleStoreWriter(const std::string& filename) : filename_(filename) {
+  file_.open(filename, std::ios::binary | std::ios::in | std::ios::out);
+  if (!file_.is_open()) {
+    // new store
+    file_.clear();
+    file_.open(filename, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    if (!file_.is_open()) {
+      throw std::runtime_error("Unable to write file: " + filename);
+    }
+    StoreHeader header{};
+    std::memcpy(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+    header.version = STORE_VERSION;
+    header.end = sizeof(header);
+    file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file_.flush();
+  }
+
+  StoreHeader header;
+  if (!read_header(file_, header)) {
+    throw std::runtime_error("Invalid particle store: " + filename);
+  }
+  last_index_ = header.last_index;
+  end_ = header.end;
+}
+
+//---------------------------------------------------------------------------
+void ParticleStoreWriter::add(const std::string& name, const Eigen::Ref<const Eigen::MatrixXd>& values) {
+  // anything after the committed end is left over from an interrupted append and is overwritten
+  file_.seekp(end_);
+  if (values.outerStride() == values.rows()) {
+    file_.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+  } else {
+    for (Eigen::Index c = 0; c < values.cols(); c++) {
+      file_.write(reinterpret_cast<const char*>(values.col(c).data()), values.rows() * sizeof(double));
+    }
+  }
+  if (!file_) {
+    throw std::runtime_error("Unable to write file: " + filename_);
+  }
+  entries_.push_back({name, uint64_t(values.rows()), uint64_t(values.cols()), end_});
+  end_ += values.size() * sizeof(double);
+}
+
+//---------------------------------------------------------------------------
+void ParticleStoreWriter::commit(const std::string& snapshot) {
+  const uint64_t index = end_;
+  file_.seekp(index);
+  write_value<uint64_t>(file_, last_index_);
+  write_string(file_, snapshot);
+  write_value<uint32_t>(file_, entries_.size());
+  for (const auto& entry : entries_) {
+    write_string(file_, entry.name);
+    write_value<uint64_t>(file_, entry.rows);
+    write_value<uint64_t>(file_, entry.cols);
+    write_value<uint64_t>(file_, entry.offset);
+  }
+  const uint64_t end = file_.tellp();
+  file_.flush();
+
+  // publish the snapshot only once its data and index are written
+  file_.seekp(offsetof(StoreHeader, last_index));
+  write_value<uint64_t>(file_, index);
+  write_value<uint64_t>(file_, end);
+  file_.flush();
+  if (!file_) {
+    throw std::runtime_error("Unable to write file: " + filename_);
+  }
+
+  last_index_ = index;
+  end_ = end;
+  entries_.clear();
+}
+
+}  // namespace shapeworks::particles
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace shapeworks {
+
+namespace particles {
+
+//! Extension of particle store files
+static constexpr const char* STORE_EXTENSION = ".pstore";
+
+/**
+ * A particle store holds many particle snapshots (e.g. every split and checkpoint of an optimization) in a single
+ * append-only file, instead of one directory with two files per domain for every snapshot.
+ *
+ * A snapshot is a named set of entries, each a named matrix of doubles.  The optimizer writes, per domain,
+ * "<name>_local" and "<name>_world" (interleaved x y z, 3N x 1), "<name>_wptsFeatures" (N x features) and
+ * "<name>_transform" (4 x 4).
+ *
+ * Layout: a 32 byte header, then for each snapshot its data followed by its index (snapshot name, entry names, shapes
+ * and offsets, and the offset of the previous index).  The header holds the offset of the last committed index and
+ * the end of the committed data, and is only updated once a snapshot is completely on disk, so a crash while
+ * appending leaves the store at its previous snapshot.
+ *
+ * Single entries can be read wherever a particle file is accepted with a path of the form
+ * "<store>#<snapshot>/<entry>", or "<store>#<entry>" for the last snapshot that has the entry.
+ */
+class ParticleStore {
+ public:
+  //! Read the index of the store.  Throws std::runtime_error if it is not a valid store
+  explicit ParticleStore(const std::string& filename);
+
+  const std::string& get_filename() const { return filename_; }
+
+  //! Snapshot names, oldest first
+  std::vector<std::string> get_snapshots() const;
+
+  //! Entry names of a snapshot, in the order they were written
+  std::vector<std::string> get_entries(const std::string& snapshot) const;
+
+  bool contains(const std::string& snapshot, const std::string& entry) const;
+
+  //! Read one entry.  An empty snapshot name selects the last snapshot that has the entry
+  Eigen::MatrixXd read(const std::string& snapshot, const std::string& entry) const;
+
+  //! Read one particle entry as interleaved positions (x0 y0 z0 x1...)
+  Eigen::VectorXd read_particles(const std::string& snapshot, const std::string& entry) const;
+
+  //! Paths ("<store>#<snapshot>/<entry>") of the entries of a snapshot whose names end with suffix (e.g. "_world")
+  std::vector<std::string> get_paths(const std::string& snapshot, const std::string& suffix) const;
+
+  //! Offset of the last committed index, which changes whenever a snapshot is appended
+  uint64_t get_version() const { return last_index_; }
+
+  //! Version of the store on disk (0 if it can not be read), to check whether an open store is out of date
+  static uint64_t read_version(const std::string& filename);
+
+  //! Split a store path into its parts.  Returns false if path does not refer to a store entry
+  static bool split_path(const std::string& path, std::string& store, std::string& snapshot, std::string& entry);
+
+ private:
+  struct Entry {
+    std::string name;
+    uint64_t rows = 0;
+    uint64_t cols = 0;
+    uint64_t offset = 0;
+  };
+  struct Snapshot {
+    std::string name;
+    std::vector<Entry> entries;
+  };
+
+  const Entry* find(const std::string& snapshot, const std::string& entry) const;
+
+  std::string filename_;
+  uint64_t last_index_ = 0;
+  std::vector<Snapshot> snapshots_;  // oldest first
+};
+
+/**
+ * Appends one snapshot to a particle store, creating the store if it does not exist.
+ *
+ * Entries are written as they are added; the snapshot becomes visible to readers with commit().  A writer that is
+ * destroyed without commit() leaves the store unchanged.  Only one writer may append to a store at a time.
+ */
+class ParticleStoreWriter {
+ public:
+  explicit ParticleStoreWriter(const std::string& filename);
+
+  //! Add an entry to the snapshot
+  void add(const std::string& name, const Eigen::Ref<const Eigen::MatrixXd>& values);
+
+  //! Write the index of the snapshot and publish it
+  void commit(const std::string& snapshot);
+
+ private:
+  std::string filename_;
+  std::fstream file_;
+  uint64_t last_index_ = 0;
+  uint64_t end_ = 0;
+
+  struct Entry {
+    std::string name;
+    uint64_t rows, cols, offset;
+  };
+  std::vector<Entry> entries_;
+};
+
+}  // namespace particles
+
+}  // namespace shapeworks
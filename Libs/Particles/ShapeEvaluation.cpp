@@ -1,14 +1,74 @@
 #include "ShapeEvaluation.h"
 
+#include <tbb/parallel_for.h>
+
 #include <Eigen/Core>
+#include <Eigen/Eigenvalues>
 #include <Eigen/SVD>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <limits>
+#include <thread>
+
 #include "EvaluationUtil.h"
+#include "NearestShapeIndex.h"
 
 typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowMajorMatrix;
 
 namespace shapeworks {
 
+namespace {
+//---------------------------------------------------------------------------
+// Eigen decomposition of a Gram matrix, largest eigenvalue first
+void decompose_gram(const Eigen::MatrixXd& gram, Eigen::VectorXd& eigenvalues, Eigen::MatrixXd& eigenvectors) {
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(gram);
+  eigenvalues = solver.eigenvalues().reverse();
+  eigenvectors = solver.eigenvectors().rowwise().reverse();
+}
+
+//---------------------------------------------------------------------------
+// Eigenvalues below this are rank deficiency (e.g. the last mode of centered data), not variation
+double rank_tolerance(const Eigen::VectorXd& eigenvalues) {
+  return eigenvalues.size() == 0 ? 0.0 : std::max(eigenvalues(0), 0.0) * eigenvalues.size() * 1e-12;
+}
+
+//---------------------------------------------------------------------------
+// The first num_modes left singular vectors and singular values of the centered D x M matrix Y, from the M x M Gram
+// matrix: Y^T Y = V S^2 V^T and U = Y V S^-1.  Modes beyond the rank of Y get a zero singular value and vector.
+void thin_svd(const Eigen::MatrixXd& Y, int num_modes, Eigen::MatrixXd& U, Eigen::VectorXd& singular_values) {
+  Eigen::VectorXd eigenvalues;
+  Eigen::MatrixXd V;
+  decompose_gram(Y.transpose() * Y, eigenvalues, V);
+  const double tolerance = rank_tolerance(eigenvalues);
+
+  singular_values = Eigen::VectorXd::Zero(num_modes);
+  Eigen::MatrixXd VS = Eigen::MatrixXd::Zero(Y.cols(), num_modes);
+  for (int i = 0; i < num_modes && i < eigenvalues.size(); i++) {
+    if (eigenvalues(i) > tolerance) {
+      singular_values(i) = std::sqrt(eigenvalues(i));
+      VS.col(i) = V.col(i) / singular_values(i);
+    }
+  }
+  U.noalias() = Y * VS;
+}
+
+//---------------------------------------------------------------------------
+// Distance to, and index of, the closest training shape for each sample, where sample i is the index's mean plus its
+// basis times coefficients.col(i)
+void find_closest_training_shapes(const NearestShapeIndex& index, const Eigen::MatrixXd& samples,
+                                  const Eigen::MatrixXd& coefficients, Eigen::VectorXd& distances,
+                                  std::vector<int>& closest) {
+  distances.resize(samples.cols());
+  closest.resize(samples.cols());
+  tbb::parallel_for(0, int(samples.cols()), [&](int i) {
+    const auto result = index.find(samples.col(i), coefficients.col(i));
+    distances(i) = result.distance;
+    closest[i] = result.index;
+  });
+}
+}  // namespace
+
 //---------------------------------------------------------------------------
 double ShapeEvaluation::ComputeCompactness(const ParticleSystemEvaluation& ParticleSystemEvaluation, const int nModes,
                                            const std::string& saveTo) {
@@ -68,30 +128,37 @@ double ShapeEvaluation::ComputeGeneralization(const ParticleSystemEvaluation& Pa
     throw std::invalid_argument("Invalid mode of variation specified");
   }
   // Keep track of the reconstructions so we can visualize them later
-  std::vector<Reconstruction> reconstructions;
+  std::vector<Reconstruction> reconstructions(N);
 
-  double totalDist = 0.0;
-  for (int leave = 0; leave < N; leave++) {
-    Eigen::MatrixXd Y(D, N - 1);
-    Y.leftCols(leave) = P.leftCols(leave);
-    Y.rightCols(N - leave - 1) = P.rightCols(N - leave - 1);
+  // the folds are independent, the thin U of each fold is D x (N - 1)
+  tbb::parallel_for(tbb::blocked_range<int>(0, N), [&](const tbb::blocked_range<int>& r) {
+    for (int leave = r.begin(); leave < r.end(); leave++) {
+      Eigen::MatrixXd Y(D, N - 1);
+      Y.leftCols(leave) = P.leftCols(leave);
+      Y.rightCols(N - leave - 1) = P.rightCols(N - leave - 1);
 
-    const Eigen::VectorXd mu = Y.rowwise().mean();
-    Y.colwise() -= mu;
-    const Eigen::VectorXd Ytest = P.col(leave);
+      const Eigen::VectorXd mu = Y.rowwise().mean();
+      Y.colwise() -= mu;
+      const Eigen::VectorXd Ytest = P.col(leave);
 
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(Y, Eigen::ComputeFullU);
-    const auto epsi = svd.matrixU().block(0, 0, D, nModes);
-    const auto betas = epsi.transpose() * (Ytest - mu);
-    const Eigen::VectorXd rec = epsi * betas + mu;
+      Eigen::JacobiSVD<Eigen::MatrixXd> svd(Y, Eigen::ComputeThinU);
+      const auto epsi = svd.matrixU().block(0, 0, D, nModes);
+      const auto betas = epsi.transpose() * (Ytest - mu);
+      const Eigen::VectorXd rec = epsi * betas + mu;
 
-    const int numParticles = D / VDimension;
-    const Eigen::Map<const RowMajorMatrix> Ytest_reshaped(Ytest.data(), numParticles, VDimension);
-    const Eigen::Map<const RowMajorMatrix> rec_reshaped(rec.data(), numParticles, VDimension);
-    const double dist = (rec_reshaped - Ytest_reshaped).rowwise().norm().sum() / numParticles;
-    totalDist += dist;
+      const int numParticles = D / VDimension;
+      const Eigen::Map<const RowMajorMatrix> Ytest_reshaped(Ytest.data(), numParticles, VDimension);
+      const Eigen::Map<const RowMajorMatrix> rec_reshaped(rec.data(), numParticles, VDimension);
+      const double dist = (rec_reshaped - Ytest_reshaped).rowwise().norm().sum() / numParticles;
 
-    reconstructions.push_back({dist, leave, rec_reshaped});
+      reconstructions[leave] = {dist, leave, rec_reshaped};
+    }
+  });
+
+  // summed in fold order, so the result does not depend on the scheduling
+  double totalDist = 0.0;
+  for (const auto& reconstruction : reconstructions) {
+    totalDist += reconstruction.dist;
   }
   const double generalization = totalDist / N;
 
@@ -114,37 +181,85 @@ Eigen::VectorXd ShapeEvaluation::ComputeFullGeneralization(const ParticleSystemE
     return Eigen::VectorXd();
   }
 
-  Eigen::VectorXd generalizations(N - 1);
-
-  Eigen::VectorXd totalDists = Eigen::VectorXd::Zero(N - 1);
-
-  for (int leave = 0; leave < N; leave++) {
-    if (progress_callback) {
-      progress_callback(static_cast<float>(leave) / static_cast<float>(N));
+  // Each fold is the full data without one shape.  With X the full data centered on its mean and K = X^T X, the
+  // fold's data centered on its own mean is x_i + x_k / M (M = N - 1), so its Gram matrix is K without row and column
+  // k plus a rank two correction, and the projection of the left out shape onto the fold's data is a column of K.
+  // Only the D x N Gram product is computed on the full data; each fold is an M x M eigen problem and one GEMM.
+  const int M = N - 1;
+  const int numParticles = D / VDimension;
+  const Eigen::VectorXd mean = P.rowwise().mean();
+  Eigen::MatrixXd X = P;
+  X.colwise() -= mean;
+  const Eigen::MatrixXd K = X.transpose() * X;
+
+  // dists(mode - 1, leave)
+  Eigen::MatrixXd dists(M, N);
+
+  auto compute_fold = [&](int leave) {
+    std::vector<int> others;
+    for (int i = 0; i < N; i++) {
+      if (i != leave) {
+        others.push_back(i);
+      }
     }
-    Eigen::MatrixXd Y(D, N - 1);
-    Y.leftCols(leave) = P.leftCols(leave);
-    Y.rightCols(N - leave - 1) = P.rightCols(N - leave - 1);
 
-    const Eigen::VectorXd mu = Y.rowwise().mean();
-    Y.colwise() -= mu;
-    const Eigen::VectorXd Ytest = P.col(leave);
+    Eigen::VectorXd k(M);
+    for (int i = 0; i < M; i++) {
+      k(i) = K(others[i], leave);
+    }
+    const double kk = K(leave, leave);
 
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(Y, Eigen::ComputeFullU);
+    Eigen::MatrixXd gram(M, M);
+    for (int j = 0; j < M; j++) {
+      for (int i = 0; i < M; i++) {
+        gram(i, j) = K(others[i], others[j]) + (k(i) + k(j)) / M + kk / (double(M) * M);
+      }
+    }
+    Eigen::VectorXd eigenvalues;
+    Eigen::MatrixXd V;
+    decompose_gram(gram, eigenvalues, V);
+    const double tolerance = rank_tolerance(eigenvalues);
+
+    // Y^T (Ytest - mu)
+    const Eigen::VectorXd projection = (double(N) / M) * (k.array() + kk / M).matrix();
+
+    // the reconstruction with m modes is mu + Y w_m with w_m = sum over the first m modes of v (v . projection) / s^2
+    Eigen::MatrixXd W(M, M);
+    Eigen::VectorXd w = Eigen::VectorXd::Zero(M);
+    for (int mode = 0; mode < M; mode++) {
+      if (eigenvalues(mode) > tolerance) {
+        w += V.col(mode) * (V.col(mode).dot(projection) / eigenvalues(mode));
+      }
+      W.col(mode) = w;
+    }
 
-    for (int mode = 1; mode < N; mode++) {
-      const auto epsi = svd.matrixU().block(0, 0, D, mode);
-      const auto betas = epsi.transpose() * (Ytest - mu);
-      const Eigen::VectorXd rec = epsi * betas + mu;
+    Eigen::MatrixXd Y(D, M);
+    for (int i = 0; i < M; i++) {
+      Y.col(i) = X.col(others[i]);
+    }
+    const Eigen::VectorXd shift = X.col(leave) / M;
+    Y.colwise() += shift;
+
+    // residuals of all reconstructions at once: Y W - (Ytest - mu)
+    Eigen::MatrixXd residuals = Y * W;
+    residuals.colwise() -= X.col(leave) + shift;
+    for (int mode = 0; mode < M; mode++) {
+      const Eigen::Map<const RowMajorMatrix> residual(residuals.col(mode).data(), numParticles, VDimension);
+      dists(mode, leave) = residual.rowwise().norm().sum() / numParticles;
+    }
+  };
 
-      const int numParticles = D / VDimension;
-      const Eigen::Map<const RowMajorMatrix> Ytest_reshaped(Ytest.data(), numParticles, VDimension);
-      const Eigen::Map<const RowMajorMatrix> rec_reshaped(rec.data(), numParticles, VDimension);
-      const double dist = (rec_reshaped - Ytest_reshaped).rowwise().norm().sum() / numParticles;
-      totalDists(mode - 1) += dist;
+  // progress is reported from the calling thread between batches of folds
+  const int batch = std::max<int>(1, std::thread::hardware_concurrency());
+  for (int start = 0; start < N; start += batch) {
+    if (progress_callback) {
+      progress_callback(static_cast<float>(start) / static_cast<float>(N));
     }
+    tbb::parallel_for(start, std::min(start + batch, N), compute_fold);
   }
 
+  Eigen::VectorXd generalizations(M);
+  Eigen::VectorXd totalDists = dists.rowwise().sum();
   generalizations = totalDists / N;
 
   return generalizations;
@@ -165,8 +280,6 @@ double ShapeEvaluation::ComputeSpecificity(const ParticleSystemEvaluation& Parti
   std::vector<Reconstruction> reconstructions;
 
   Eigen::VectorXd meanSpecificity(nModes);
-  Eigen::VectorXd stdSpecificity(nModes);
-  Eigen::MatrixXd spec_store(nModes, 4);
 
   // PCA calculations
   const Eigen::MatrixXd& ptsModels = ParticleSystemEvaluation.Particles();
@@ -175,14 +288,15 @@ double ShapeEvaluation::ComputeSpecificity(const ParticleSystemEvaluation& Parti
 
   Y.colwise() -= mu;
 
-  Eigen::JacobiSVD<Eigen::MatrixXd> svd(Y, Eigen::ComputeFullU);
-  const auto epsi = svd.matrixU().block(0, 0, D, nModes);
-  const auto allEigenValues = svd.singularValues();
-  const auto eigenValues = allEigenValues.head(nModes);
+  Eigen::MatrixXd epsi;
+  Eigen::VectorXd eigenValues;
+  thin_svd(Y, nModes, epsi, eigenValues);
+  const NearestShapeIndex index(ptsModels, mu, epsi);
 
   Eigen::MatrixXd samplingBetas(nModes, nSamples);
   MultiVariateNormalRandom sampling{eigenValues.asDiagonal()};
   for (int modeNumber = 0; modeNumber < nModes; modeNumber++) {
+    // drawn in order, so the samples do not depend on the threading
     for (int i = 0; i < nSamples; i++) {
       samplingBetas.col(i) = sampling();
     }
@@ -190,30 +304,20 @@ double ShapeEvaluation::ComputeSpecificity(const ParticleSystemEvaluation& Parti
     Eigen::MatrixXd samplingPoints = (epsi * samplingBetas).colwise() + mu;
 
     const int numParticles = D / VDimension;
-    const int nTrain = ptsModels.cols();
 
-    Eigen::VectorXd distanceToClosestTrainingSample(nSamples);
-
-    for (int i = 0; i < nSamples; i++) {
-      Eigen::VectorXd pts_m = samplingPoints.col(i);
-      Eigen::MatrixXd ptsDistance_vec = ptsModels.colwise() - pts_m;
-      Eigen::MatrixXd ptsDistance(Eigen::MatrixXd::Constant(1, nTrain, 0.0));
-
-      for (int j = 0; j < nTrain; j++) {
-        Eigen::Map<const RowMajorMatrix> ptsDistance_vec_reshaped(ptsDistance_vec.col(j).data(), numParticles,
-                                                                  VDimension);
-        ptsDistance(j) = (ptsDistance_vec_reshaped).rowwise().norm().sum();
+    Eigen::VectorXd distanceToClosestTrainingSample;
+    std::vector<int> closestIdx;
+    find_closest_training_shapes(index, samplingPoints, samplingBetas, distanceToClosestTrainingSample, closestIdx);
+
+    if (!saveTo.empty()) {
+      for (int i = 0; i < nSamples; i++) {
+        Eigen::Map<const RowMajorMatrix> pts_m_reshaped(samplingPoints.col(i).data(), numParticles, VDimension);
+        reconstructions.push_back(Reconstruction{
+            distanceToClosestTrainingSample(i),
+            closestIdx[i],
+            pts_m_reshaped,
+        });
       }
-
-      int closestIdx, _r;
-      distanceToClosestTrainingSample(i) = ptsDistance.minCoeff(&_r, &closestIdx);
-
-      Eigen::Map<const RowMajorMatrix> pts_m_reshaped(pts_m.data(), numParticles, VDimension);
-      reconstructions.push_back(Reconstruction{
-          distanceToClosestTrainingSample(i),
-          (int)closestIdx,
-          pts_m_reshaped,
-      });
     }
 
     meanSpecificity(modeNumber) = distanceToClosestTrainingSample.mean();
@@ -237,52 +341,46 @@ Eigen::VectorXd ShapeEvaluation::ComputeFullSpecificity(const ParticleSystemEval
   const int numParticles = D / VDimension;
 
   Eigen::VectorXd specificities(N - 1);
+  if (N < 2) {
+    return specificities;
+  }
 
   // PCA calculations
   const Eigen::MatrixXd& ptsModels = ParticleSystemEvaluation.Particles();
-  const int nTrain = ptsModels.cols();
 
   const Eigen::VectorXd mu = ptsModels.rowwise().mean();
   Eigen::MatrixXd Y = ptsModels;
   Y.colwise() -= mu;
-  Eigen::JacobiSVD<Eigen::MatrixXd> svd(Y, Eigen::ComputeFullU);
-  const auto allEigenValues = svd.singularValues();
+  Eigen::MatrixXd U;
+  Eigen::VectorXd allEigenValues;
+  thin_svd(Y, N - 1, U, allEigenValues);
+  const NearestShapeIndex index(ptsModels, mu, U);
+
+  // Every mode count uses the same standard normal draws, scaled by the variance of each mode (the singular value), so
+  // going from m - 1 to m modes only adds mode m to the betas and a rank one update to the sampled shapes
+  const int nSamples = 1000;
+  Eigen::MatrixXd normals(N - 1, nSamples);
+  MultiVariateNormalRandom sampling{Eigen::MatrixXd::Identity(N - 1, N - 1)};
+  for (int i = 0; i < nSamples; i++) {
+    normals.col(i) = sampling();
+  }
+
+  Eigen::MatrixXd samplingBetas(N - 1, nSamples);
+  Eigen::MatrixXd samplingPoints = mu.replicate(1, nSamples);
 
   for (int nModes = 1; nModes < N; nModes++) {
     if (progress_callback) {
       progress_callback(static_cast<float>(nModes) / static_cast<float>(N));
     }
 
-    const int nSamples = 1000;
-
-    Eigen::VectorXd stdSpecificity(nModes);
-    Eigen::MatrixXd spec_store(nModes, 4);
-    const auto eigenValues = allEigenValues.head(nModes);
-    const auto epsi = svd.matrixU().block(0, 0, D, nModes);
-
-    Eigen::MatrixXd samplingBetas(nModes, nSamples);
-    MultiVariateNormalRandom sampling{eigenValues.asDiagonal()};
-    for (int i = 0; i < nSamples; i++) {
-      samplingBetas.col(i) = sampling();
-    }
-
-    Eigen::MatrixXd samplingPoints = (epsi * samplingBetas).colwise() + mu;
-    Eigen::VectorXd distanceToClosestTrainingSample(nSamples);
-
-    for (int i = 0; i < nSamples; i++) {
-      Eigen::VectorXd pts_m = samplingPoints.col(i);
-      Eigen::MatrixXd ptsDistance_vec = ptsModels.colwise() - pts_m;
-      Eigen::MatrixXd ptsDistance(Eigen::MatrixXd::Constant(1, nTrain, 0.0));
-
-      for (int j = 0; j < nTrain; j++) {
-        Eigen::Map<const RowMajorMatrix> ptsDistance_vec_reshaped(ptsDistance_vec.col(j).data(), numParticles,
-                                                                  VDimension);
-        ptsDistance(j) = (ptsDistance_vec_reshaped).rowwise().norm().sum();
-      }
+    const int mode = nModes - 1;
+    samplingBetas.row(mode) = normals.row(mode) * std::sqrt(allEigenValues(mode));
+    samplingPoints.noalias() += U.col(mode) * samplingBetas.row(mode);
 
-      int closestIdx, _r;
-      distanceToClosestTrainingSample(i) = ptsDistance.minCoeff(&_r, &closestIdx);
-    }
+    Eigen::VectorXd distanceToClosestTrainingSample;
+    std::vector<int> closestIdx;
+    find_closest_training_shapes(index, samplingPoints, samplingBetas.topRows(nModes),
+                                 distanceToClosestTrainingSample, closestIdx);
 
     double meanSpecificity = distanceToClosestTrainingSample.mean();
     const double specificity = meanSpecificity / numParticles;
@@ -33,6 +33,7 @@ using namespace pybind11::literals;
 #include "Optimize.h"
 #include "Parameters.h"
 #include "ParticleShapeStatistics.h"
+#include "ParticleStore.h"
 #include "ParticleSystemEvaluation.h"
 #include "Project.h"
 #include "PythonAnalyze.h"
@@ -94,6 +95,12 @@ PYBIND11_MODULE(shapeworks_py, m) {
       .value("NearestNeighbor", Image::InterpolationType::NearestNeighbor)
       .export_values();
 
+  // Image::DistanceTransformType
+  py::enum_<Image::DistanceTransformType>(m, "DistanceTransformType")
+      .value("FastMarching", Image::DistanceTransformType::FastMarching)
+      .value("Exact", Image::DistanceTransformType::Exact)
+      .export_values();
+
   m.def(
       "mean", [](py::array& field) { return mean(pyToArr(field, false /*take_ownership*/)); },
       "incrementally compute (single-component) mean of field");
@@ -323,7 +330,9 @@ PYBIND11_MODULE(shapeworks_py, m) {
            "outerVal"_a = 0.0)
 
       .def("computeDT", &Image::computeDT,
-           "computes signed distance transform volume from an image at the specified isovalue", "isovalue"_a = 0.0)
+           "computes signed distance transform volume from an image at the specified isovalue, by fast marching or "
+           "an exact Euclidean distance transform, clamped to +/- narrowBand if it is positive",
+           "isovalue"_a = 0.0, "type"_a = Image::DistanceTransformType::FastMarching, "narrowBand"_a = 0.0)
 
       .def("applyCurvatureFilter", &Image::applyCurvatureFilter,
            "denoises an image using curvature driven flow using curvature flow image filter", "iterations"_a = 10)
@@ -1162,6 +1171,17 @@ PYBIND11_MODULE(shapeworks_py, m) {
           },
           "Build the mesh from particle positions (matrix [Nx3])", "particles"_a)
 
+      .def(
+          "buildMeshes",
+          [](MeshWarper& w, const std::vector<Eigen::MatrixXd>& particles) -> decltype(auto) {
+            std::vector<Mesh> meshes;
+            for (auto& poly_data : w.build_meshes(particles)) {
+              meshes.push_back(Mesh(poly_data));
+            }
+            return meshes;
+          },
+          "Build meshes from a list of particle positions (matrices [Nx3]) with a single warp", "particles"_a)
+
       .def(
           "extractLandmarks",
           [](MeshWarper& w, const Mesh& warped_mesh) -> decltype(auto) {
@@ -1247,6 +1267,21 @@ PYBIND11_MODULE(shapeworks_py, m) {
 
       .def("EvaluationCompare", &ParticleSystemEvaluation::EvaluationCompare);
 
+  // ParticleStore
+  py::class_<particles::ParticleStore>(m, "ParticleStore")
+
+      .def(py::init<const std::string&>(), "filename"_a)
+
+      .def("snapshots", &particles::ParticleStore::get_snapshots, "snapshot names, oldest first")
+
+      .def("entries", &particles::ParticleStore::get_entries, "entry names of a snapshot", "snapshot"_a)
+
+      .def("read", &particles::ParticleStore::read, "read one entry as a matrix", "snapshot"_a, "entry"_a)
+
+      .def("paths", &particles::ParticleStore::get_paths,
+           "paths of the entries of a snapshot ending with suffix, e.g. to pass to ParticleSystem", "snapshot"_a,
+           "suffix"_a = "_world");
+
   // ShapeEvaluation
   py::class_<ShapeEvaluation>(m, "ShapeEvaluation")
 
@@ -1278,9 +1313,14 @@ PYBIND11_MODULE(shapeworks_py, m) {
 
       .def(py::init<>())
 
-      .def("PCA", py::overload_cast<ParticleSystemEvaluation, int>(&ParticleShapeStatistics::do_pca),
+      .def("PCA", py::overload_cast<const ParticleSystemEvaluation&, int>(&ParticleShapeStatistics::do_pca),
            "calculates the eigen values and eigen vectors of the data", "particleSystem"_a, "domainsPerShape"_a = 1)
 
+      .def("streamingPCA", &ParticleShapeStatistics::do_streaming_pca,
+           "calculates the largest eigen values and eigen vectors of the shapes in the given particle files, reading "
+           "them from disk in blocks",
+           "filenames"_a, "domainsPerShape"_a = 1, "numModes"_a = 0, "blockSize"_a = 1024)
+
       .def("principalComponentProjections", &ParticleShapeStatistics::principal_component_projections,
            "projects the original data on the calculated principal components")
 
@@ -43,6 +43,12 @@ bool Preferences::get_cache_enabled() { return settings_.value("Studio/cache_ena
 //-----------------------------------------------------------------------------
 void Preferences::set_cache_enabled(bool value) { settings_.setValue("Studio/cache_enabled", value); }
 
+//-----------------------------------------------------------------------------
+bool Preferences::get_disk_cache_enabled() { return settings_.value("Studio/disk_cache_enabled", false).toBool(); }
+
+//-----------------------------------------------------------------------------
+void Preferences::set_disk_cache_enabled(bool value) { settings_.setValue("Studio/disk_cache_enabled", value); }
+
 //-----------------------------------------------------------------------------
 bool Preferences::get_parallel_enabled() { return settings_.value("Studio/parallel_enabled", true).toBool(); }
 
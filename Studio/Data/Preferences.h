@@ -41,6 +41,10 @@ class Preferences : public QObject {
   bool get_cache_enabled();
   void set_cache_enabled(bool value);
 
+  //! keep reconstructed meshes on disk across sessions
+  bool get_disk_cache_enabled();
+  void set_disk_cache_enabled(bool value);
+
   bool get_parallel_enabled();
   void set_parallel_enabled(bool value);
 
@@ -61,11 +61,18 @@ void PreferencesWindow::on_mesh_cache_enabled_stateChanged(int state) {
   bool b = ui_->mesh_cache_enabled->isChecked();
   preferences_.set_cache_enabled(b);
   ui_->mesh_cache_memory->setEnabled(b);
+  ui_->mesh_disk_cache_enabled->setEnabled(b);
   ui_->parallel_enabled->setEnabled(b);
   ui_->num_threads->setEnabled(b);
   Q_EMIT clear_cache();
 }
 
+//-----------------------------------------------------------------------------
+void PreferencesWindow::on_mesh_disk_cache_enabled_stateChanged(int state) {
+  preferences_.set_disk_cache_enabled(ui_->mesh_disk_cache_enabled->isChecked());
+  Q_EMIT clear_cache();
+}
+
 //-----------------------------------------------------------------------------
 void PreferencesWindow::on_mesh_cache_memory_valueChanged(int value) {
   preferences_.set_memory_cache_percent(value);
@@ -99,6 +106,7 @@ void PreferencesWindow::restore_defaults() {
 //-----------------------------------------------------------------------------
 void PreferencesWindow::set_values_from_preferences() {
   ui_->mesh_cache_enabled->setChecked(preferences_.get_cache_enabled());
+  ui_->mesh_disk_cache_enabled->setChecked(preferences_.get_disk_cache_enabled());
   ui_->mesh_cache_memory->setValue(preferences_.get_memory_cache_percent());
   ui_->color_scheme->setCurrentIndex(preferences_.get_color_scheme());
   ui_->color_map->setCurrentIndex(preferences_.get_color_map());
@@ -28,6 +28,7 @@ class PreferencesWindow : public QDialog {
 
  public Q_SLOTS:
   void on_mesh_cache_enabled_stateChanged(int state);
+  void on_mesh_disk_cache_enabled_stateChanged(int state);
   void on_mesh_cache_memory_valueChanged(int value);
   void on_color_scheme_currentIndexChanged(int index);
   void on_pca_range_valueChanged(double value);
@@ -14,6 +14,7 @@
 #include <QMenu>
 #include <QMessageBox>
 #include <QProgressDialog>
+#include <QStandardPaths>
 #include <QXmlStreamWriter>
 #include <boost/algorithm/string/join.hpp>
 
@@ -73,6 +74,14 @@ void Session::handle_thread_complete() {
 void Session::handle_clear_cache() {
   mesh_manager_->set_cache_enabled(preferences_.get_cache_enabled());
   mesh_manager_->set_cache_memory_percent(preferences_.get_memory_cache_percent());
+  std::string disk_cache, warp_cache;
+  if (preferences_.get_cache_enabled() && preferences_.get_disk_cache_enabled()) {
+    auto cache_location = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    disk_cache = (cache_location + "/meshes").toStdString();
+    warp_cache = (cache_location + "/warps").toStdString();
+  }
+  mesh_manager_->set_disk_cache_directory(disk_cache);
+  mesh_manager_->set_warp_cache_directory(warp_cache);
   mesh_manager_->set_parallel_enabled(preferences_.get_parallel_enabled());
   mesh_manager_->set_num_threads(preferences_.get_num_threads());
 
@@ -539,7 +548,9 @@ bool Session::load_point_files(std::vector<std::string> local, std::vector<std::
       shapes_.push_back(shape);
     }
 
-    auto base = QString::fromStdString(world[counter]).remove("_world.particles").toStdString();
+    // strip the suffix of any particle format (_world.particles, _world.pbin, ...)
+    auto world_name = QString::fromStdString(world[counter]);
+    auto base = world_name.left(world_name.lastIndexOf("_world.")).toStdString();
     std::vector<std::string> list;
     list.push_back(StringUtils::getFilename(base));
     list.push_back("");
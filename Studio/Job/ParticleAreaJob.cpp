@@ -44,7 +44,7 @@ void ParticleAreaJob::run() {
       for (size_t i = 0; i < meshes.meshes().size(); i++) {
         auto points = shape->get_particles().get_local_points(i);
         auto poly_data = meshes.meshes()[i]->get_poly_data();
-        if (!poly_data) {
+        if (!poly_data || points.empty()) {
           continue;
         }
         ParticleArea::assign_vertex_particles(poly_data, points);
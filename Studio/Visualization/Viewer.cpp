@@ -12,7 +12,6 @@
 #include <vtkLookupTable.h>
 #include <vtkPickingManager.h>
 #include <vtkPointData.h>
-#include <vtkPointLocator.h>
 #include <vtkPolyDataCollection.h>
 #include <vtkPolyDataNormals.h>
 #include <vtkPolyDataPointPlacer.h>
@@ -33,6 +32,7 @@
 
 // shapeworks
 #include <Analyze/ParticleArea.h>
+#include <Analyze/SurfaceInterpolation.h>
 #include <Logging.h>
 #include <Mesh/MeshComputeThickness.h>
 #include <Shape.h>
@@ -394,85 +394,33 @@ void Viewer::compute_surface_differences(vtkSmartPointer<vtkFloatArray> magnitud
     return;
   }
 
+  // one value per glyph, as filled by compute_point_differences
+  const vtkIdType num_particles = glyph_points_->GetNumberOfPoints();
+  if (magnitudes->GetNumberOfTuples() != num_particles || vectors->GetNumberOfTuples() != num_particles) {
+    return;
+  }
+
   for (size_t i = 0; i < mesh_group.meshes().size(); i++) {
     auto poly_data = mesh_group.meshes()[i]->get_poly_data();
     if (!poly_data || poly_data->GetNumberOfPoints() == 0) {
       return;
     }
 
-    vtkSmartPointer<vtkPolyData> point_data = vtkSmartPointer<vtkPolyData>::New();
-    point_data->SetPoints(glyph_points_);
-
-    auto point_locator = vtkSmartPointer<vtkPointLocator>::New();
-    point_locator->SetDataSet(point_data);
-    point_locator->SetDivisions(100, 100, 100);
-    point_locator->BuildLocator();
+    // the neighbors among the correspondence points are found once per topology, so stepping through the
+    // reconstructions of a domain only recomputes the weights, and redrawing the same shape reuses them as well
+    auto interpolation = SurfaceInterpolation::get("difference_" + std::to_string(i), poly_data, glyph_points_);
 
     auto surface_magnitudes = vtkSmartPointer<vtkFloatArray>::New();
     surface_magnitudes->SetName("surface_difference");
     surface_magnitudes->SetNumberOfComponents(1);
     surface_magnitudes->SetNumberOfTuples(poly_data->GetPoints()->GetNumberOfPoints());
+    interpolation->apply(magnitudes->GetPointer(0), 1, surface_magnitudes->GetPointer(0));
 
     auto surface_vectors = vtkSmartPointer<vtkFloatArray>::New();
     surface_vectors->SetNumberOfComponents(3);
     surface_vectors->SetName("surface_vectors");
     surface_vectors->SetNumberOfTuples(poly_data->GetPoints()->GetNumberOfPoints());
-
-    for (vtkIdType i = 0; i < surface_magnitudes->GetNumberOfTuples(); i++) {
-      // find the 8 closest correspondence points the to current vertex
-      auto closest_points = vtkSmartPointer<vtkIdList>::New();
-      point_locator->FindClosestNPoints(8, poly_data->GetPoint(i), closest_points);
-      // assign scalar value based on a weighted scheme
-      float weighted_scalar = 0.0f;
-      float distance_sum = 0.0f;
-      float distance[8];
-
-      bool exactly_on_point = false;
-      float exact_scalar = 0.0f;
-
-      for (vtkIdType p = 0; p < closest_points->GetNumberOfIds(); p++) {
-        // get a particle position
-        vtkIdType id = closest_points->GetId(p);
-
-        // compute distance to current particle
-        double x = poly_data->GetPoint(i)[0] - point_data->GetPoint(id)[0];
-        double y = poly_data->GetPoint(i)[1] - point_data->GetPoint(id)[1];
-        double z = poly_data->GetPoint(i)[2] - point_data->GetPoint(id)[2];
-
-        if (x == 0 && y == 0 && z == 0) {
-          distance[p] = 0;
-          exactly_on_point = true;
-          exact_scalar = magnitudes->GetValue(id);
-        } else {
-          distance[p] = 1.0f / (x * x + y * y + z * z);
-        }
-
-        // multiply scalar value by weight and add to running sum
-        distance_sum += distance[p];
-      }
-
-      float vecX = 0.0f;
-      float vecY = 0.0f;
-      float vecZ = 0.0f;
-
-      for (vtkIdType p = 0; p < closest_points->GetNumberOfIds(); p++) {
-        vtkIdType currID = closest_points->GetId(p);
-        weighted_scalar += distance[p] / distance_sum * magnitudes->GetValue(currID);
-        vecX += distance[p] / distance_sum * vectors->GetComponent(currID, 0);
-        vecY += distance[p] / distance_sum * vectors->GetComponent(currID, 1);
-        vecZ += distance[p] / distance_sum * vectors->GetComponent(currID, 2);
-      }
-
-      if (exactly_on_point) {
-        weighted_scalar = exact_scalar;
-      }
-
-      surface_magnitudes->SetValue(i, weighted_scalar);
-
-      surface_vectors->SetComponent(i, 0, vecX);
-      surface_vectors->SetComponent(i, 1, vecY);
-      surface_vectors->SetComponent(i, 2, vecZ);
-    }
+    interpolation->apply(vectors->GetPointer(0), 3, surface_vectors->GetPointer(0));
 
     // surface coloring
     poly_data->GetPointData()->SetScalars(surface_magnitudes);
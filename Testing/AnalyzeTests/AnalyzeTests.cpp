@@ -0,0 +1,332 @@
+#include <vtkDataArray.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkSphereSource.h>
+
+#include <Eigen/Geometry>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <vector>
+
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "ParticleArea.h"
+#include "SurfaceInterpolation.h"
+#include "Testing.h"
+
+using namespace shapeworks;
+
+//---------------------------------------------------------------------------
+static vtkSmartPointer<vtkPolyData> create_sphere(double radius, int resolution) {
+  auto sphere = vtkSmartPointer<vtkSphereSource>::New();
+  sphere->SetRadius(radius);
+  sphere->SetThetaResolution(resolution);
+  sphere->SetPhiResolution(resolution);
+  sphere->Update();
+  return sphere->GetOutput();
+}
+
+//---------------------------------------------------------------------------
+TEST(AnalyzeTests, surface_interpolation_moves_with_particles) {
+  auto mesh = create_sphere(10.0, 32);
+
+  // particles just off a subset of the vertices, turned a little about a skewed axis so that no two particles are at
+  // the same distance from a vertex, each carrying its x coordinate
+  auto particles = vtkSmartPointer<vtkPoints>::New();
+  const Eigen::AngleAxisd turn(0.05, Eigen::Vector3d(1, 2, 3).normalized());
+  std::vector<Eigen::Vector3d> directions;
+  for (vtkIdType i = 0; i < mesh->GetNumberOfPoints(); i += 19) {
+    double p[3];
+    mesh->GetPoint(i, p);
+    directions.push_back(turn * Eigen::Vector3d(p[0], p[1], p[2]));
+    particles->InsertNextPoint((1.01 * directions.back()).data());
+  }
+  std::vector<float> values(particles->GetNumberOfPoints());
+  for (vtkIdType i = 0; i < particles->GetNumberOfPoints(); i++) {
+    values[i] = particles->GetPoint(i)[0];
+  }
+  const auto num_vertices = mesh->GetNumberOfPoints();
+
+  auto first = SurfaceInterpolation::get("test", mesh, particles);
+  std::vector<float> first_output(num_vertices);
+  first->apply(values.data(), 1, first_output.data());
+
+  // nothing changed, the cached interpolation comes back
+  ASSERT_EQ(first, SurfaceInterpolation::get("test", mesh, particles));
+
+  // move the particles outwards, in place, as a new subject or mode step would.  All particles stay at the same
+  // distance from the center, so each vertex keeps its closest particles but their weights change
+  for (vtkIdType i = 0; i < particles->GetNumberOfPoints(); i++) {
+    particles->SetPoint(i, (1.2 * directions[i]).data());
+  }
+  particles->Modified();
+
+  // the neighbors are reused and the weights recomputed
+  auto second = SurfaceInterpolation::get("test", mesh, particles);
+  ASSERT_NE(first, second);
+  ASSERT_EQ(second, SurfaceInterpolation::get("test", mesh, particles));
+
+  std::vector<float> second_output(num_vertices);
+  second->apply(values.data(), 1, second_output.data());
+
+  SurfaceInterpolation fresh(mesh, particles);
+  std::vector<float> fresh_output(num_vertices);
+  fresh.apply(values.data(), 1, fresh_output.data());
+
+  double max_change = 0;
+  for (vtkIdType i = 0; i < num_vertices; i++) {
+    ASSERT_NEAR(second_output[i], fresh_output[i], 1e-5);
+    max_change = std::max<double>(max_change, std::abs(second_output[i] - first_output[i]));
+  }
+  ASSERT_GT(max_change, 0.5);
+
+  // a mesh with another number of particles gets its own neighbors
+  particles->InsertNextPoint(0, 0, 0);
+  ASSERT_EQ(SurfaceInterpolation::get("test", mesh, particles)->get_num_particles(), particles->GetNumberOfPoints());
+}
+
+//---------------------------------------------------------------------------
+static MeshHandle create_mesh() {
+  MeshHandle mesh(new StudioMesh);
+  mesh->set_poly_data(create_sphere(10.0, 16));
+  return mesh;
+}
+
+//---------------------------------------------------------------------------
+static MeshWorkItem create_item(double value, uint64_t reconstruction_id = 0) {
+  MeshWorkItem item;
+  item.points = Eigen::VectorXd::Constant(6, value);
+  item.reconstruction_id = reconstruction_id;
+  return item;
+}
+
+//---------------------------------------------------------------------------
+TEST(AnalyzeTests, mesh_cache_evicts_at_budget) {
+  MeshCache cache;
+  cache.set_memory_percent(100);
+
+  // every mesh has the same size, allow two and a half of them
+  cache.insert_mesh(create_item(0), create_mesh());
+  const size_t mesh_size = cache.get_memory_size();
+  ASSERT_GT(mesh_size, 0);
+  cache.clear();
+  cache.set_max_memory(mesh_size * 5 / 2);
+
+  const auto a = create_item(1), b = create_item(2), c = create_item(3);
+  cache.insert_mesh(a, create_mesh());
+  cache.insert_mesh(b, create_mesh());
+  ASSERT_EQ(cache.get_memory_size(), 2 * mesh_size);
+
+  // the least recently used goes
+  cache.insert_mesh(c, create_mesh());
+  ASSERT_EQ(cache.get_memory_size(), 2 * mesh_size);
+  ASSERT_FALSE(cache.get_mesh(a));
+  ASSERT_TRUE(cache.get_mesh(b));
+  ASSERT_TRUE(cache.get_mesh(c));
+}
+
+//---------------------------------------------------------------------------
+TEST(AnalyzeTests, mesh_cache_promotes_on_hit) {
+  MeshCache cache;
+  cache.set_memory_percent(100);
+  cache.insert_mesh(create_item(0), create_mesh());
+  const size_t mesh_size = cache.get_memory_size();
+  cache.clear();
+  cache.set_max_memory(mesh_size * 5 / 2);
+
+  const auto a = create_item(1), b = create_item(2), c = create_item(3);
+  auto mesh_a = create_mesh();
+  cache.insert_mesh(a, mesh_a);
+  cache.insert_mesh(b, create_mesh());
+
+  // a hit makes a the most recently used, so b is evicted instead
+  ASSERT_EQ(cache.get_mesh(a), mesh_a);
+  cache.insert_mesh(c, create_mesh());
+  ASSERT_FALSE(cache.get_mesh(b));
+  ASSERT_EQ(cache.get_mesh(a), mesh_a);
+  ASSERT_TRUE(cache.get_mesh(c));
+}
+
+//---------------------------------------------------------------------------
+TEST(AnalyzeTests, mesh_cache_disk_round_trip) {
+  const std::string directory = TestUtils::Instance().get_output_dir("mesh_cache_disk_round_trip");
+  const auto item = create_item(1, 42);
+  const auto mesh = create_mesh();
+
+  {
+    MeshCache cache;
+    cache.set_disk_cache_directory(directory);
+    cache.insert_mesh(item, mesh);
+    // destruction waits for the background write
+  }
+  const auto filename = directory + "/" + MeshCache::compute_key(item).to_string() + ".vtp";
+  ASSERT_TRUE(boost::filesystem::exists(filename));
+
+  // a new cache, as after restarting, finds it on disk
+  MeshCache cache;
+  cache.set_disk_cache_directory(directory);
+  auto loaded = cache.get_mesh(item);
+  ASSERT_TRUE(loaded);
+  ASSERT_NE(loaded, mesh);
+  ASSERT_EQ(loaded->get_poly_data()->GetNumberOfPoints(), mesh->get_poly_data()->GetNumberOfPoints());
+  ASSERT_EQ(loaded->get_poly_data()->GetNumberOfCells(), mesh->get_poly_data()->GetNumberOfCells());
+
+  // items without a reconstruction id never go to disk
+  const auto unidentified = create_item(2);
+  cache.insert_mesh(unidentified, mesh);
+  cache.set_disk_cache_directory("");
+  ASSERT_FALSE(boost::filesystem::exists(directory + "/" + MeshCache::compute_key(unidentified).to_string() + ".vtp"));
+}
+
+//---------------------------------------------------------------------------
+TEST(AnalyzeTests, mesh_cache_unreadable_file) {
+  const std::string directory = TestUtils::Instance().get_output_dir("mesh_cache_unreadable_file");
+  const auto corrupt = create_item(1, 42), partial = create_item(2, 42);
+  const auto corrupt_filename = directory + "/" + MeshCache::compute_key(corrupt).to_string() + ".vtp";
+  const auto partial_filename = directory + "/" + MeshCache::compute_key(partial).to_string() + ".vtp";
+
+  {
+    MeshCache cache;
+    cache.set_disk_cache_directory(directory);
+    cache.insert_mesh(partial, create_mesh());
+  }
+
+  // garbage for one, the first half of a valid file for the other
+  std::ofstream(corrupt_filename) << "not a mesh";
+  const auto size = boost::filesystem::file_size(partial_filename);
+  boost::filesystem::resize_file(partial_filename, size / 2);
+
+  {
+    // both are misses, and the files are removed so that the meshes are written again
+    MeshCache cache;
+    cache.set_disk_cache_directory(directory);
+    ASSERT_FALSE(cache.get_mesh(corrupt));
+    ASSERT_FALSE(cache.get_mesh(partial));
+    ASSERT_FALSE(boost::filesystem::exists(corrupt_filename));
+    ASSERT_FALSE(boost::filesystem::exists(partial_filename));
+    cache.insert_mesh(corrupt, create_mesh());
+    cache.insert_mesh(partial, create_mesh());
+  }
+
+  MeshCache cache;
+  cache.set_disk_cache_directory(directory);
+  ASSERT_TRUE(cache.get_mesh(corrupt));
+  ASSERT_TRUE(cache.get_mesh(partial));
+}
+
+//---------------------------------------------------------------------------
+static std::vector<itk::Point<double>> create_sphere_particles(double radius, int num_particles) {
+  // a Fibonacci lattice, evenly spread over the sphere
+  std::vector<itk::Point<double>> particles(num_particles);
+  for (int i = 0; i < num_particles; i++) {
+    const double z = 1.0 - 2.0 * (i + 0.5) / num_particles;
+    const double r = std::sqrt(1.0 - z * z);
+    const double phi = i * M_PI * (3.0 - std::sqrt(5.0));
+    particles[i][0] = radius * r * std::cos(phi);
+    particles[i][1] = radius * r * std::sin(phi);
+    particles[i][2] = radius * z;
+  }
+  return particles;
+}
+
+//---------------------------------------------------------------------------
+TEST(AnalyzeTests, particle_area_sphere) {
+  auto poly_data = create_sphere(10.0, 64);
+  const int num_particles = 32;
+  const auto particles = create_sphere_particles(10.0, num_particles);
+
+  ParticleArea::assign_vertex_particles(poly_data, particles);
+  const auto areas = ParticleArea::compute_particle_triangle_areas(poly_data, particles);
+
+  // areas are in percent of an equal share, evenly spread particles get about 100 each
+  ASSERT_EQ(areas.size(), num_particles);
+  ASSERT_NEAR(areas.sum(), 100.0 * num_particles, 1e-6);
+  for (int i = 0; i < num_particles; i++) {
+    ASSERT_NEAR(areas[i], 100.0, 20.0) << "particle " << i;
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(AnalyzeTests, particle_area_labels) {
+  auto poly_data = create_sphere(10.0, 24);
+  const auto particles = create_sphere_particles(10.0, 12);
+  ParticleArea::assign_vertex_particles(poly_data, particles);
+  auto labels = poly_data->GetPointData()->GetArray("closest_particle");
+  ASSERT_TRUE(labels);
+
+  // brute force: a separate Dijkstra along the mesh edges for each particle, seeded the same way (the vertices of the
+  // face the particle lies on, at their distance from the particle projected onto that face)
+  Mesh mesh(poly_data);
+  Eigen::MatrixXd V;
+  Eigen::MatrixXi F;
+  mesh.getIGLMesh(V, F);
+  const int num_vertices = V.rows();
+  std::vector<std::vector<int>> adjacency(num_vertices);
+  for (int f = 0; f < F.rows(); f++) {
+    for (int k = 0; k < 3; k++) {
+      adjacency[F(f, k)].push_back(F(f, (k + 1) % 3));
+      adjacency[F(f, k)].push_back(F(f, (k + 2) % 3));
+    }
+  }
+
+  std::vector<double> closest(num_vertices, std::numeric_limits<double>::infinity());
+  std::vector<int> expected(num_vertices, -1);
+  for (int i = 0; i < particles.size(); i++) {
+    std::vector<double> distances(num_vertices, std::numeric_limits<double>::infinity());
+    using QueueEntry = std::pair<double, int>;
+    std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+
+    const int face = mesh.getClosestFace(particles[i]);
+    ASSERT_GE(face, 0);
+    const auto bary =
+        mesh.computeBarycentricCoordinates(Eigen::Vector3d(particles[i][0], particles[i][1], particles[i][2]), face);
+    const Eigen::RowVector3d on_face =
+        bary[0] * V.row(F(face, 0)) + bary[1] * V.row(F(face, 1)) + bary[2] * V.row(F(face, 2));
+    for (int k = 0; k < 3; k++) {
+      const int vertex = F(face, k);
+      distances[vertex] = (V.row(vertex) - on_face).norm();
+      queue.push({distances[vertex], vertex});
+    }
+
+    while (!queue.empty()) {
+      const auto entry = queue.top();
+      queue.pop();
+      if (entry.first > distances[entry.second]) {
+        continue;
+      }
+      for (int neighbor : adjacency[entry.second]) {
+        const double distance = entry.first + (V.row(neighbor) - V.row(entry.second)).norm();
+        if (distance < distances[neighbor]) {
+          distances[neighbor] = distance;
+          queue.push({distance, neighbor});
+        }
+      }
+    }
+
+    for (int j = 0; j < num_vertices; j++) {
+      if (distances[j] < closest[j]) {
+        closest[j] = distances[j];
+        expected[j] = i;
+      }
+    }
+  }
+
+  for (int j = 0; j < num_vertices; j++) {
+    ASSERT_EQ(labels->GetTuple1(j), expected[j]) << "vertex " << j;
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(AnalyzeTests, particle_area_no_particles) {
+  auto poly_data = create_sphere(10.0, 16);
+  std::vector<itk::Point<double>> particles;
+  ASSERT_THROW(ParticleArea::assign_vertex_particles(poly_data, particles), std::runtime_error);
+  ASSERT_THROW(ParticleArea::compute_particle_triangle_areas(poly_data, particles), std::runtime_error);
+}
@@ -1,7 +1,12 @@
 #include "Testing.h"
 
+#include <itkImageRegionIteratorWithIndex.h>
+
+#include <chrono>
+
 #include "Exception.h"
 #include "Image.h"
+#include "ImageExpression.h"
 #include "VectorImage.h"
 #include "ImageUtils.h"
 #include "Mesh.h"
@@ -371,6 +376,64 @@ TEST(ImageTests, computedtTest2)
   ASSERT_TRUE(image == ground_truth);
 }
 
+// signed distance to a sphere of radius 12 sampled on a 40^3 grid, negative inside
+static Image sphereDistance()
+{
+  Dims dims;
+  dims[0] = 40; dims[1] = 40; dims[2] = 40;
+  Image image(dims);
+  Image::PixelType* data = image.getITKImage()->GetBufferPointer();
+  for (size_t z = 0; z < dims[2]; z++) {
+    for (size_t y = 0; y < dims[1]; y++) {
+      for (size_t x = 0; x < dims[0]; x++) {
+        double distance = std::sqrt(std::pow(x - 19.5, 2) + std::pow(y - 20.25, 2) + std::pow(z - 20.0, 2));
+        data[x + dims[0] * (y + dims[1] * z)] = distance - 12.0;
+      }
+    }
+  }
+  return image;
+}
+
+TEST(ImageTests, computedtExactTest)
+{
+  Image truth = sphereDistance();
+  Image exact = sphereDistance();
+  exact.computeDT(0.0, Image::Exact);
+  Image fastMarching = sphereDistance();
+  fastMarching.computeDT(0.0, Image::FastMarching);
+
+  const Image::PixelType* truthData = truth.getITKImage()->GetBufferPointer();
+  const Image::PixelType* exactData = exact.getITKImage()->GetBufferPointer();
+  const Image::PixelType* fastMarchingData = fastMarching.getITKImage()->GetBufferPointer();
+  size_t farInside = 0, farOutside = 0;
+  for (size_t i = 0; i < 40 * 40 * 40; i++) {
+    if (std::abs(truthData[i]) < 3.0) {
+      ASSERT_NEAR(exactData[i], truthData[i], 0.5);
+      ASSERT_NEAR(exactData[i], fastMarchingData[i], 1.0);
+    } else {
+      // away from the surface the distance is still exact, up to the surface estimate from the samples
+      ASSERT_NEAR(exactData[i], truthData[i], 0.5);
+      truthData[i] < 0.0 ? farInside++ : farOutside++;
+    }
+  }
+  ASSERT_GT(farInside, 0);
+  ASSERT_GT(farOutside, 0);
+}
+
+TEST(ImageTests, computedtNarrowBandTest)
+{
+  Image full = sphereDistance();
+  full.computeDT(0.0, Image::Exact);
+  Image banded = sphereDistance();
+  banded.computeDT(0.0, Image::Exact, 2.0);
+
+  const Image::PixelType* fullData = full.getITKImage()->GetBufferPointer();
+  const Image::PixelType* bandedData = banded.getITKImage()->GetBufferPointer();
+  for (size_t i = 0; i < 40 * 40 * 40; i++) {
+    ASSERT_FLOAT_EQ(bandedData[i], std::max(-2.0f, std::min(fullData[i], 2.0f)));
+  }
+}
+
 TEST(ImageTests, curvatureTest)
 {
   Image image(std::string(TEST_DATA_DIR) + "/1x2x2.nrrd");
@@ -1061,6 +1124,103 @@ TEST(ImageTests, divideTest2)
   ASSERT_TRUE(image == baseline);
 }
 
+TEST(ImageTests, expressionTest1)
+{
+  Image a(std::string(TEST_DATA_DIR) + "/1x2x2.nrrd");
+  Image b(std::string(TEST_DATA_DIR) + "/computedt1.nrrd");
+  Image fused = (expr(a) + b) * 0.5 - a / 2.0;
+  Image eager = (a + b) * 0.5 - a / 2.0;
+
+  ASSERT_TRUE(fused == eager);
+
+  Image orig_image(std::string(TEST_DATA_DIR) + "/1x2x2.nrrd");
+  ASSERT_TRUE(a == orig_image);
+}
+
+TEST(ImageTests, expressionTest2)
+{
+  Image a(std::string(TEST_DATA_DIR) + "/1x2x2.nrrd");
+  Image b(std::string(TEST_DATA_DIR) + "/computedt1.nrrd");
+  Image eager = -(b * 2.0) + a;
+  assign(a, -expr(b) * 2.0 + a);
+
+  ASSERT_TRUE(a == eager);
+}
+
+TEST(ImageTests, expressionTest3)
+{
+  Image a(std::string(TEST_DATA_DIR) + "/1x2x2.nrrd");
+  Image b(std::string(TEST_DATA_DIR) + "/la-bin.nrrd");
+
+  ASSERT_THROW(Image(expr(a) + b), std::invalid_argument);
+}
+
+//---------------------------------------------------------------------------
+static Image benchmarkImage(size_t size, Image::PixelType offset)
+{
+  Dims dims;
+  dims[0] = size; dims[1] = size; dims[2] = size;
+  Image image(dims);
+  Image::PixelType* data = image.getITKImage()->GetBufferPointer();
+  for (size_t i = 0; i < size * size * size; i++) {
+    data[i] = offset + static_cast<Image::PixelType>(i % 1000);
+  }
+  return image;
+}
+
+//---------------------------------------------------------------------------
+// (a + b) * s - c the way the operators used to compute it: a deep copy and one indexed, single threaded pass each
+static Image legacyChain(const Image& a, const Image& b, Image::PixelType s, const Image& c)
+{
+  using Iterator = itk::ImageRegionIteratorWithIndex<Image::ImageType>;
+  Image ret(a);
+  Iterator iter(ret.getITKImage(), ret.getITKImage()->GetLargestPossibleRegion());
+  Iterator bIter(b.getITKImage(), b.getITKImage()->GetLargestPossibleRegion());
+  for (; !iter.IsAtEnd(); ++iter, ++bIter) {
+    iter.Set(iter.Value() + bIter.Value());
+  }
+  Image scaled(ret);
+  Iterator scaledIter(scaled.getITKImage(), scaled.getITKImage()->GetLargestPossibleRegion());
+  for (; !scaledIter.IsAtEnd(); ++scaledIter) {
+    scaledIter.Set(scaledIter.Value() * s);
+  }
+  Image result(scaled);
+  Iterator resultIter(result.getITKImage(), result.getITKImage()->GetLargestPossibleRegion());
+  Iterator cIter(c.getITKImage(), c.getITKImage()->GetLargestPossibleRegion());
+  for (; !resultIter.IsAtEnd(); ++resultIter, ++cIter) {
+    resultIter.Set(resultIter.Value() - cIter.Value());
+  }
+  return result;
+}
+
+//---------------------------------------------------------------------------
+// Benchmark, run manually with --gtest_also_run_disabled_tests
+TEST(ImageTests, DISABLED_expressionBenchmark)
+{
+  for (size_t size : {256, 512}) {
+    Image a = benchmarkImage(size, 1.0);
+    Image b = benchmarkImage(size, 2.0);
+    Image c = benchmarkImage(size, 3.0);
+    const Image::PixelType s = 0.5;
+
+    auto start = std::chrono::steady_clock::now();
+    Image legacy = legacyChain(a, b, s, c);
+    auto legacyEnd = std::chrono::steady_clock::now();
+    Image eager = (a + b) * s - c;
+    auto eagerEnd = std::chrono::steady_clock::now();
+    Image fused = (expr(a) + b) * s - c;
+    auto fusedEnd = std::chrono::steady_clock::now();
+
+    auto ms = [](auto from, auto to) { return std::chrono::duration<double, std::milli>(to - from).count(); };
+    std::cerr << size << "^3 legacy operators: " << ms(start, legacyEnd) << " ms\n";
+    std::cerr << size << "^3 operators: " << ms(legacyEnd, eagerEnd) << " ms\n";
+    std::cerr << size << "^3 fused expression: " << ms(eagerEnd, fusedEnd) << " ms\n";
+
+    ASSERT_TRUE(fused == legacy);
+    ASSERT_TRUE(fused == eager);
+  }
+}
+
 TEST(ImageTests, resampleTest1)
 {
   Image image(std::string(TEST_DATA_DIR) + "/1x2x2.nrrd");
@@ -1,5 +1,7 @@
 #include <igl/point_mesh_squared_distance.h>
 
+#include <boost/filesystem.hpp>
+
 #include "Image.h"
 #include "Mesh.h"
 #include "MeshUtils.h"
@@ -739,6 +741,61 @@ TEST(MeshTests, warpTest3) {
                  "/mesh_warp/mesh_warp3_baseline.vtk");
 }
 
+TEST(MeshTests, warpBatchTest) {
+  std::vector<std::string> paths{std::string(TEST_DATA_DIR) + "/ellipsoid_0.particles",
+                                 std::string(TEST_DATA_DIR) + "/ellipsoid_1.particles"};
+  ParticleSystemEvaluation particlesystem(paths);
+  std::vector<Eigen::MatrixXd> points;
+  for (int i = 0; i < 2; i++) {
+    Eigen::MatrixXd shape = particlesystem.Particles().col(i);
+    shape.resize(3, shape.size() / 3);
+    points.push_back(shape.transpose());
+  }
+  // a stale set of particles gets an empty mesh
+  points.push_back(Eigen::MatrixXd::Zero(3, 3));
+
+  Mesh reference(std::string(TEST_DATA_DIR) + "/ellipsoid_0.ply");
+  MeshWarper warper;
+  warper.set_reference_mesh(reference.getVTKMesh(), points[0]);
+  ASSERT_TRUE(warper.get_warp_available());
+
+  auto meshes = warper.build_meshes(points);
+  ASSERT_EQ(meshes.size(), 3);
+  ASSERT_TRUE(Mesh(meshes[0]) == Mesh(warper.build_mesh(points[0])));
+  ASSERT_TRUE(Mesh(meshes[1]) == Mesh(std::string(TEST_DATA_DIR) + "/ellipsoid_warped.ply"));
+  ASSERT_EQ(meshes[2]->GetNumberOfPoints(), 0);
+
+  // every mesh has a cell array of its own, so that they can be traversed from different threads
+  ASSERT_NE(meshes[0]->GetPolys(), meshes[1]->GetPolys());
+  ASSERT_EQ(meshes[0]->GetNumberOfCells(), meshes[1]->GetNumberOfCells());
+}
+
+TEST(MeshTests, warpCacheTest) {
+  std::vector<std::string> paths{std::string(TEST_DATA_DIR) + "/ellipsoid_0.particles"};
+  ParticleSystemEvaluation particlesystem(paths);
+  Eigen::MatrixXd points = particlesystem.Particles().col(0);
+  points.resize(3, points.size() / 3);
+  points.transposeInPlace();
+  Mesh reference(std::string(TEST_DATA_DIR) + "/ellipsoid_0.ply");
+
+  auto directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  MeshWarper warper;
+  warper.set_cache_directory(directory.string());
+  warper.set_reference_mesh(reference.getVTKMesh(), points);
+  ASSERT_TRUE(warper.generate_warp());
+  ASSERT_FALSE(boost::filesystem::is_empty(directory));
+
+  // a second warper of the same reference reads the matrix instead of computing it
+  MeshWarper cached;
+  cached.set_cache_directory(directory.string());
+  cached.set_reference_mesh(reference.getVTKMesh(), points);
+  ASSERT_TRUE(cached.generate_warp());
+  ASSERT_TRUE(cached.get_warp_matrix() == warper.get_warp_matrix());
+  ASSERT_TRUE(Mesh(cached.build_mesh(points)) == Mesh(warper.build_mesh(points)));
+
+  boost::filesystem::remove_all(directory);
+}
+
 TEST(MeshTests, warpTest4) {
   mesh_warp_test("/mesh_warp/lv_shared1.vtk", "/mesh_warp/lv_shared1.particles", "/mesh_warp/lv_shared1.particles",
                  "/mesh_warp/lv_shared1_baseline.vtk");
@@ -1,13 +1,29 @@
+#include <Libs/Particles/ParticleFile.h>
 #include <Mesh/MeshUtils.h>
 #include <Optimize/OptimizeParameters.h>
 #include <Project/Project.h>
 #include <itkApproximateSignedDistanceMapImageFilter.h>
 #include <itkImageFileReader.h>
 #include <itkImageFileWriter.h>
+#include <tbb/parallel_for.h>
 
-#include <cstdio>
+#include <boost/filesystem.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <random>
+
+#include "Libs/Optimize/Constraints/FreeFormConstraintCache.h"
+#include "Libs/Optimize/Domain/ContourGeodesics.h"
+#include "Libs/Optimize/Domain/GeodesicCacheManager.h"
+#include "Libs/Optimize/Domain/MeshDomain.h"
 #include "Libs/Optimize/Domain/MeshWrapper.h"
+#include "Libs/Optimize/Function/CorrespondenceFunction.h"
+#include "Libs/Optimize/Neighborhood/ParticleGridNeighborhood.h"
+#include "Libs/Optimize/Utils/CheckpointWriter.h"
 #include "Optimize.h"
 #include "OptimizeParameterFile.h"
 #include "ParticleShapeStatistics.h"
@@ -354,6 +370,27 @@ TEST(OptimizeTests, contour_domain_test) {
   ASSERT_LT(values[values.size() - 2], 1.0);
 }
 
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, contour_geodesics_test) {
+  // a branch point with three arms, and a separate closed square
+  Eigen::MatrixXd points(10, 3);
+  points << 0, 0, 0, 1, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 3, 10, 0, 0, 11, 0, 0, 11, 1, 0, 10, 1, 0;
+  std::vector<std::array<int, 2>> lines{{0, 1}, {1, 2}, {0, 3}, {4, 0}, {4, 5}, {6, 7}, {7, 8}, {8, 9}, {9, 6}};
+  ContourGeodesics geodesics(points, lines);
+
+  ASSERT_EQ(geodesics.NumberOfJunctions(), 5);
+  ASSERT_DOUBLE_EQ(geodesics.Distance(2, 2), 0.0);
+  ASSERT_DOUBLE_EQ(geodesics.Distance(1, 2), 1.0);
+  ASSERT_DOUBLE_EQ(geodesics.Distance(1, 3), 2.0);
+  ASSERT_DOUBLE_EQ(geodesics.Distance(2, 5), 5.0);
+  ASSERT_DOUBLE_EQ(geodesics.Distance(5, 2), 5.0);
+  // around the square, whichever way is shorter
+  ASSERT_DOUBLE_EQ(geodesics.Distance(6, 8), 2.0);
+  ASSERT_DOUBLE_EQ(geodesics.Distance(6, 9), 1.0);
+  ASSERT_DOUBLE_EQ(geodesics.Distance(7, 9), 2.0);
+  ASSERT_TRUE(std::isinf(geodesics.Distance(0, 6)));
+}
+
 //---------------------------------------------------------------------------
 TEST(OptimizeTests, procrustes_disabled_test) {
   prep_temp("/optimize/procrustes", "procrustes_disabled_test");
@@ -481,11 +518,7 @@ TEST(OptimizeTests, procrustes_scale_only_test) {
 
 // TODO Move this to mesh tests?
 //---------------------------------------------------------------------------
-TEST(OptimizeTests, mesh_geodesics_test) {
-  const std::string sphere_mesh_path = std::string(TEST_DATA_DIR) + "/sphere_highres.ply";
-  const auto sw_mesh = MeshUtils::threadSafeReadMesh(sphere_mesh_path);
-  MeshWrapper mesh(sw_mesh.getVTKMesh(), true, 1000000);
-
+static void check_sphere_geodesics(const MeshWrapper &mesh) {
   auto polar2cart = [](double theta, double phi) {
     const double x = sin(theta) * cos(phi);
     const double y = sin(theta) * sin(phi);
@@ -516,6 +549,178 @@ TEST(OptimizeTests, mesh_geodesics_test) {
   }
 }
 
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, mesh_geodesics_test) {
+  const std::string sphere_mesh_path = std::string(TEST_DATA_DIR) + "/sphere_highres.ply";
+  const auto sw_mesh = MeshUtils::threadSafeReadMesh(sphere_mesh_path);
+  MeshWrapper mesh(sw_mesh.getVTKMesh(), true, 1000000);
+
+  check_sphere_geodesics(mesh);
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, mesh_geodesics_budget_test) {
+  const std::string sphere_mesh_path = std::string(TEST_DATA_DIR) + "/sphere_highres.ply";
+  const auto sw_mesh = MeshUtils::threadSafeReadMesh(sphere_mesh_path);
+
+  auto &manager = GeodesicCacheManager::Instance();
+  const size_t budget = 1024 * 1024;
+  manager.SetBudget(budget);
+  manager.ResetStats();
+
+  {
+    // two meshes share the budget, so each is limited to half of it
+    MeshWrapper mesh_a(sw_mesh.getVTKMesh(), true, 1000000);
+    MeshWrapper mesh_b(sw_mesh.getVTKMesh(), true, 1000000);
+    ASSERT_EQ(manager.GetStats().num_meshes, 2);
+
+    // the results must not change when entries are evicted
+    check_sphere_geodesics(mesh_a);
+    check_sphere_geodesics(mesh_b);
+
+    const auto stats = manager.GetStats();
+    ASSERT_GT(stats.misses, 0);
+    ASSERT_GT(stats.evictions, 0);
+
+    // one full entry (3 doubles per vertex) may be kept per mesh beyond its share
+    const size_t full_entry = 3 * sizeof(double) * sw_mesh.numPoints();
+    ASSERT_LE(stats.bytes_in_use, budget + 2 * full_entry);
+
+    // hits since the last miss are only held by the meshes until they are flushed
+    mesh_a.FlushGeodesicCacheStats();
+    mesh_b.FlushGeodesicCacheStats();
+    const auto flushed = manager.GetStats();
+    ASSERT_GE(flushed.hits, stats.hits);
+    ASSERT_GT(flushed.hits, 0);
+  }
+
+  // destroyed meshes return their memory
+  const auto stats = manager.GetStats();
+  ASSERT_EQ(stats.num_meshes, 0);
+  ASSERT_EQ(stats.bytes_in_use, 0);
+  ASSERT_GT(stats.hits, 0);
+
+  manager.SetBudget(0);
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, mesh_concurrent_queries_test) {
+  const std::string sphere_mesh_path = std::string(TEST_DATA_DIR) + "/sphere_highres.ply";
+  const auto sw_mesh = MeshUtils::threadSafeReadMesh(sphere_mesh_path);
+  MeshWrapper serial_mesh(sw_mesh.getVTKMesh(), true, 1000000);
+  MeshWrapper shared_mesh(sw_mesh.getVTKMesh(), true, 1000000);
+
+  // one particle per query point, walked a little so that the per particle caches are exercised
+  const int num_particles = 400;
+  std::vector<MeshWrapper::PointType> points(num_particles);
+  MeshWrapper::VectorType step;
+  step[0] = 0.01;
+  step[1] = 0.02;
+  step[2] = -0.01;
+  for (int i = 0; i < num_particles; i++) {
+    const double theta = M_2PI * (i % 20) / 20.0;
+    const double phi = M_2PI * (i / 20) / 20.0;
+    MeshWrapper::PointType pt;
+    pt[0] = sin(theta) * cos(phi);
+    pt[1] = sin(theta) * sin(phi);
+    pt[2] = cos(theta);
+    points[i] = serial_mesh.GeodesicWalk(serial_mesh.SnapToMesh(pt, i), i, step);
+  }
+
+  std::vector<double> serial_distances(num_particles * num_particles);
+  std::vector<MeshWrapper::NormalType> serial_normals(num_particles);
+  for (int i = 0; i < num_particles; i++) {
+    serial_normals[i] = serial_mesh.SampleNormalAtPoint(points[i], i);
+    for (int j = 0; j < num_particles; j++) {
+      serial_distances[i * num_particles + j] = serial_mesh.ComputeDistance(points[i], i, points[j], j);
+    }
+  }
+
+  // the same queries against a single mesh from all threads, each particle walked by the thread that owns it
+  std::vector<double> distances(num_particles * num_particles);
+  std::vector<MeshWrapper::NormalType> normals(num_particles);
+  std::vector<MeshWrapper::PointType> walked(num_particles);
+  tbb::parallel_for(tbb::blocked_range<int>{0, num_particles, 1}, [&](const tbb::blocked_range<int>& r) {
+    for (int i = r.begin(); i < r.end(); i++) {
+      walked[i] = shared_mesh.GeodesicWalk(shared_mesh.SnapToMesh(points[i], i), i, step);
+      normals[i] = shared_mesh.SampleNormalAtPoint(points[i], i);
+      for (int j = 0; j < num_particles; j++) {
+        distances[i * num_particles + j] = shared_mesh.ComputeDistance(points[i], i, points[j], j);
+      }
+    }
+  });
+
+  for (int i = 0; i < num_particles; i++) {
+    const auto expected_walk = serial_mesh.GeodesicWalk(serial_mesh.SnapToMesh(points[i], i), i, step);
+    for (int d = 0; d < 3; d++) {
+      ASSERT_NEAR(walked[i][d], expected_walk[d], 1e-9);
+      ASSERT_NEAR(normals[i][d], serial_normals[i][d], 1e-9);
+    }
+    for (int j = 0; j < num_particles; j++) {
+      ASSERT_NEAR(distances[i * num_particles + j], serial_distances[i * num_particles + j], 1e-9);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+static void run_intra_shape_parallelism(bool parallel, std::vector<std::vector<itk::Point<double>>>& points,
+                                        double& energy) {
+  // make sure we clean out at least one necessary file to make sure we re-run
+  std::remove("optimize_particles/hemisphere00_world.particles");
+
+  Optimize app;
+  ProjectHandle project = std::make_shared<Project>();
+  ASSERT_TRUE(project->load("optimize.swproj"));
+  OptimizeParameters params(project);
+  // enough particles per domain for the sweep to be split into colors and blocks
+  params.set_number_of_particles({128});
+  params.set_use_intra_shape_parallelism(parallel);
+  ASSERT_TRUE(params.set_up_optimize(&app));
+  app.Run();
+
+  points = app.GetLocalPoints();
+  energy = app.GetIterationStats().energy;
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, intra_shape_parallelism_test) {
+  prep_temp("/optimize/hemisphere", "intra_shape_parallelism");
+
+  std::vector<std::vector<itk::Point<double>>> serial_points, parallel_points;
+  double serial_energy = 0.0, parallel_energy = 0.0;
+  run_intra_shape_parallelism(false, serial_points, serial_energy);
+  run_intra_shape_parallelism(true, parallel_points, parallel_energy);
+
+  std::cerr << "Serial energy: " << serial_energy << ", parallel energy: " << parallel_energy << "\n";
+  ASSERT_NEAR(parallel_energy, serial_energy, 0.05 * std::abs(serial_energy));
+
+  // the parallel sweep visits the particles in a different order, so the particles are compared against the spacing
+  // of the serial result rather than exactly
+  ASSERT_EQ(parallel_points.size(), serial_points.size());
+  for (size_t d = 0; d < serial_points.size(); d++) {
+    const auto& expected = serial_points[d];
+    const auto& actual = parallel_points[d];
+    ASSERT_EQ(actual.size(), expected.size());
+
+    double spacing = 0.0;
+    double squared_error = 0.0;
+    for (size_t i = 0; i < expected.size(); i++) {
+      double nearest = std::numeric_limits<double>::max();
+      for (size_t j = 0; j < expected.size(); j++) {
+        if (i != j) {
+          nearest = std::min(nearest, expected[i].EuclideanDistanceTo(expected[j]));
+        }
+      }
+      spacing += nearest;
+      squared_error += expected[i].SquaredEuclideanDistanceTo(actual[i]);
+    }
+    spacing /= expected.size();
+    const double rms_error = std::sqrt(squared_error / expected.size());
+    std::cerr << "Domain " << d << ": particle spacing " << spacing << ", rms difference " << rms_error << "\n";
+    ASSERT_LT(rms_error, 0.25 * spacing);
+  }
+}
+
 // Constraint tests
 //---------------------------------------------------------------------------
 TEST(OptimizeTests, cutting_plane_test) {
@@ -703,3 +908,544 @@ TEST(OptimizeTests, vtk_output) {
   double value = values[values.size() - 1];
   ASSERT_LT(value, 100);
 }
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, grid_neighborhood_test) {
+  prep_temp("/optimize/sphere", "grid_neighborhood");
+
+  // make sure we clean out at least one necessary file to make sure we re-run
+  std::remove("optimize_particles/sphere10_DT_world.particles");
+
+  Optimize app;
+  ProjectHandle project = std::make_shared<Project>();
+  ASSERT_TRUE(project->load("optimize.swproj"));
+  OptimizeParameters params(project);
+  params.set_use_grid_neighborhood(true);
+  ASSERT_TRUE(params.set_up_optimize(&app));
+  app.Run();
+
+  // compute stats
+  ParticleShapeStatistics stats;
+  stats.read_point_files("analyze.xml");
+  stats.compute_modes();
+  stats.principal_component_projections();
+
+  // print out eigenvalues (for debugging)
+  auto values = stats.get_eigen_values();
+  for (int i = 0; i < values.size(); i++) {
+    std::cerr << "Eigenvalue " << i << " : " << values[i] << "\n";
+  }
+
+  // check the first mode of variation, should match the octree neighborhood (see 'sample' test)
+  double value = values[values.size() - 1];
+  ASSERT_LT(value, 100);
+}
+
+//---------------------------------------------------------------------------
+static void check_neighborhood_parity(const ParticleSurfaceNeighborhood::Pointer& octree,
+                                      const ParticleGridNeighborhood::Pointer& grid,
+                                      const std::vector<ParticleSurfaceNeighborhood::PointType>& points,
+                                      const std::vector<bool>& present) {
+  using PointVectorType = ParticleSurfaceNeighborhood::PointVectorType;
+  auto indices = [](const PointVectorType& neighbors) {
+    std::vector<unsigned int> result;
+    for (const auto& neighbor : neighbors) {
+      result.push_back(neighbor.Index);
+    }
+    return result;
+  };
+
+  for (double radius : {0.05, 0.2, 0.5, 1.5}) {
+    for (int idx = 0; idx < static_cast<int>(points.size()); idx++) {
+      if (!present[idx]) {
+        continue;
+      }
+
+      // plain distance based neighborhood
+      auto expected = indices(octree->FindNeighborhoodPoints(points[idx], idx, radius));
+      auto actual = indices(grid->FindNeighborhoodPoints(points[idx], idx, radius));
+      std::sort(expected.begin(), expected.end());
+      std::sort(actual.begin(), actual.end());
+      ASSERT_EQ(actual, expected) << "radius " << radius << ", particle " << idx;
+
+      // with normal based weights and distances, matched up by index since the order differs
+      std::vector<double> expected_weights, expected_distances, weights, distances;
+      PointVectorType expected_neighbors, neighbors;
+      octree->FindNeighborhoodPoints(points[idx], idx, expected_weights, expected_distances, radius,
+                                     expected_neighbors);
+      grid->FindNeighborhoodPoints(points[idx], idx, weights, distances, radius, neighbors);
+      ASSERT_EQ(neighbors.size(), expected_neighbors.size()) << "radius " << radius << ", particle " << idx;
+      for (size_t i = 0; i < neighbors.size(); i++) {
+        size_t j = 0;
+        while (j < expected_neighbors.size() && expected_neighbors[j].Index != neighbors[i].Index) {
+          j++;
+        }
+        ASSERT_LT(j, expected_neighbors.size()) << "radius " << radius << ", particle " << idx;
+        ASSERT_DOUBLE_EQ(weights[i], expected_weights[j]);
+        ASSERT_DOUBLE_EQ(distances[i], expected_distances[j]);
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, grid_neighborhood_parity_test) {
+  const std::string sphere_mesh_path = std::string(TEST_DATA_DIR) + "/sphere_highres.ply";
+  const auto sw_mesh = MeshUtils::threadSafeReadMesh(sphere_mesh_path);
+  auto mesh = std::make_shared<MeshWrapper>(sw_mesh.getVTKMesh(), true, 1000000);
+  auto domain = std::make_shared<MeshDomain>();
+  domain->SetMesh(mesh, 100.0);
+
+  auto octree = ParticleSurfaceNeighborhood::New();
+  auto grid = ParticleGridNeighborhood::New();
+  octree->SetDomain(domain);
+  grid->SetDomain(domain);
+
+  // particles spread over the unit sphere (a Fibonacci lattice), snapped to the mesh
+  const int num_particles = 300;
+  auto sphere_point = [](double i, double n) {
+    const double z = 1.0 - 2.0 * (i + 0.5) / n;
+    const double r = std::sqrt(1.0 - z * z);
+    const double phi = i * M_PI * (3.0 - std::sqrt(5.0));
+    ParticleSurfaceNeighborhood::PointType pt;
+    pt[0] = r * cos(phi);
+    pt[1] = r * sin(phi);
+    pt[2] = z;
+    return pt;
+  };
+  std::vector<ParticleSurfaceNeighborhood::PointType> points(num_particles);
+  std::vector<bool> present(num_particles, true);
+  for (int i = 0; i < num_particles; i++) {
+    points[i] = mesh->SnapToMesh(sphere_point(i, num_particles), i);
+    octree->AddPosition(points[i], i);
+    grid->AddPosition(points[i], i);
+  }
+  check_neighborhood_parity(octree, grid, points, present);
+
+  // move every third particle to a lattice point of a coarser lattice, across cells of both structures
+  for (int i = 0; i < num_particles; i += 3) {
+    domain->InvalidateParticlePosition(i);
+    points[i] = mesh->SnapToMesh(sphere_point(i / 3, num_particles / 3), i);
+    octree->SetPosition(points[i], i);
+    grid->SetPosition(points[i], i);
+  }
+  check_neighborhood_parity(octree, grid, points, present);
+
+  // and remove some
+  for (int i = 1; i < num_particles; i += 7) {
+    present[i] = false;
+    octree->RemovePosition(i);
+    grid->RemovePosition(i);
+  }
+  check_neighborhood_parity(octree, grid, points, present);
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, particle_position_store_test) {
+  const std::string sphere_mesh_path = std::string(TEST_DATA_DIR) + "/sphere_highres.ply";
+  const auto sw_mesh = MeshUtils::threadSafeReadMesh(sphere_mesh_path);
+  auto mesh = std::make_shared<MeshWrapper>(sw_mesh.getVTKMesh(), false, 0);
+  auto domain = std::make_shared<MeshDomain>();
+  domain->SetMesh(mesh, 100.0);
+
+  auto system = ParticleSystem::New();
+  system->SetDomainsPerShape(1);
+  system->AddDomain(domain);
+  auto grid = ParticleGridNeighborhood::New();
+  system->SetNeighborhood(0, grid);
+  ASSERT_EQ(grid->GetPositionStore(), system->GetPositionStore(0));
+
+  const int num_particles = 200;
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+  for (int i = 0; i < num_particles; i++) {
+    ParticleSystem::PointType point;
+    for (int n = 0; n < 3; n++) {
+      point[n] = distribution(generator);
+    }
+    system->AddPosition(point, 0);
+  }
+
+  // the store holds the constrained positions, and the grid finds its neighbors from it
+  auto check_store = [&](const std::vector<ParticleSystem::PointType>& expected) {
+    const auto store = system->GetPositionStore(0);
+    ASSERT_EQ(store->GetSize(), static_cast<size_t>(num_particles));
+    for (int k = 0; k < num_particles; k++) {
+      for (int n = 0; n < 3; n++) {
+        ASSERT_DOUBLE_EQ(store->Get(k)[n], expected[k][n]) << "particle " << k;
+      }
+    }
+    for (int k = 0; k < num_particles; k++) {
+      for (const auto& neighbor : grid->FindNeighborhoodPoints(expected[k], k, 0.5)) {
+        ASSERT_LT(neighbor.Point.EuclideanDistanceTo(expected[neighbor.Index]), 1e-12);
+      }
+    }
+  };
+  auto positions = [&]() {
+    std::vector<ParticleSystem::PointType> result;
+    for (int k = 0; k < num_particles; k++) {
+      result.push_back(system->GetPosition(k, 0));
+    }
+    return result;
+  };
+  const auto initial = positions();
+  check_store(initial);
+
+  // deferred moves are published to the store with the neighborhood, at the flush
+  system->SetDeferredUpdates(0, true);
+  for (int k = 0; k < num_particles; k += 2) {
+    auto point = system->GetPosition(k, 0);
+    point[0] += 0.01;
+    system->SetPosition(point, k, 0);
+  }
+  check_store(initial);
+  system->FlushDeferredUpdates(0);
+  check_store(positions());
+  system->SetDeferredUpdates(0, false);
+
+  // immediate moves are visible right away
+  for (int k = 1; k < num_particles; k += 2) {
+    auto point = system->GetPosition(k, 0);
+    point[1] -= 0.01;
+    system->SetPosition(point, k, 0);
+  }
+  check_store(positions());
+}
+
+//---------------------------------------------------------------------------
+static double run_batch_position_events_benchmark(bool batch_position_events, bool use_grid_neighborhood = false) {
+  Optimize app;
+  ProjectHandle project = std::make_shared<Project>();
+  project->load("optimize.swproj");
+  OptimizeParameters params(project);
+  params.set_batch_position_events(batch_position_events);
+  params.set_use_grid_neighborhood(use_grid_neighborhood);
+  params.set_up_optimize(&app);
+
+  int iterations = 0;
+  app.SetIterationCallbackFunction([&]() { iterations++; });
+
+  auto start = std::chrono::steady_clock::now();
+  app.Run();
+  auto end = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(end - start).count();
+  return iterations / seconds;
+}
+
+//---------------------------------------------------------------------------
+// Benchmark, run manually with --gtest_also_run_disabled_tests
+TEST(OptimizeTests, DISABLED_batch_position_events_benchmark) {
+  prep_temp("/optimize/sphere", "batch_position_events_benchmark");
+
+  double immediate_rate = run_batch_position_events_benchmark(false);
+  double batched_rate = run_batch_position_events_benchmark(true);
+  // grid neighborhood, which scans the structure-of-arrays position store
+  double store_rate = run_batch_position_events_benchmark(true, true);
+
+  std::cerr << "Immediate position events: " << immediate_rate << " iterations/sec\n";
+  std::cerr << "Batched position events: " << batched_rate << " iterations/sec\n";
+  std::cerr << "Batched position events, position store neighborhood: " << store_rate << " iterations/sec\n";
+
+  ASSERT_GT(immediate_rate, 0);
+  ASSERT_GT(batched_rate, 0);
+  ASSERT_GT(store_rate, 0);
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, iteration_stats_test) {
+  prep_temp("/optimize/sphere", "iteration_stats");
+
+  Optimize app;
+  ProjectHandle project = std::make_shared<Project>();
+  ASSERT_TRUE(project->load("optimize.swproj"));
+  OptimizeParameters params(project);
+  ASSERT_TRUE(params.set_up_optimize(&app));
+
+  std::vector<IterationStats> history;
+  app.SetIterationCallbackFunction([&]() { history.push_back(app.GetIterationStats()); });
+  app.Run();
+
+  ASSERT_FALSE(history.empty());
+  for (const auto& stats : history) {
+    ASSERT_GT(stats.num_particles, 0);
+    // every particle ends its update with exactly one accepted step
+    ASSERT_EQ(stats.num_accepted, stats.num_particles);
+    ASSERT_LE(stats.mean_step, stats.max_step + 1e-12);
+    ASSERT_LE(stats.min_time_step, stats.max_time_step);
+
+    size_t binned = 0;
+    for (auto count : stats.time_step_histogram) {
+      binned += count;
+    }
+    ASSERT_EQ(binned, stats.num_particles);
+
+    // the gradient function clones and their scratch buffers are kept from one iteration to the next
+    if (stats.iteration > 1) {
+      ASSERT_EQ(stats.workspace_allocations, 0);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, factored_covariance_test) {
+  prep_temp("/optimize/mesh_use_normals", "factored_covariance");
+
+  // make sure we clean out at least one output file
+  std::remove("optimize_particles/sphere_00_world.particles");
+
+  Optimize app;
+  ProjectHandle project = std::make_shared<Project>();
+  ASSERT_TRUE(project->load("optimize.swproj"));
+  OptimizeParameters params(project);
+  params.set_use_factored_covariance(true);
+  ASSERT_TRUE(params.set_up_optimize(&app));
+  app.Run();
+
+  // compute stats
+  ParticleShapeStatistics stats;
+  stats.read_point_files("analyze.xml");
+  stats.compute_modes();
+  stats.principal_component_projections();
+
+  // print out eigenvalues (for debugging)
+  auto values = stats.get_eigen_values();
+  for (int i = 0; i < values.size(); i++) {
+    std::cerr << "Eigenvalue " << i << " : " << values[i] << "\n";
+  }
+
+  // same expectations as the dense inverse covariance (see 'mesh_use_normals_test')
+  ASSERT_GT(values[values.size() - 1], 750.0);
+  ASSERT_LT(values[values.size() - 2], 10);
+}
+
+//---------------------------------------------------------------------------
+static ParticleSystem::Pointer create_correspondence_system(int num_particles, int num_shapes) {
+  // particle system with one domain per shape.  The domains are flagged while positions are added so that the
+  // (empty) mesh domains are never queried, ComputeUpdates only needs the particle counts.
+  auto system = ParticleSystem::New();
+  system->SetDomainsPerShape(1);
+  for (int i = 0; i < num_shapes; i++) {
+    system->AddDomain(std::make_shared<MeshDomain>());
+  }
+  system->SetDomainFlags();
+  ParticleSystem::PointType point;
+  point.Fill(0.0);
+  for (int i = 0; i < num_shapes; i++) {
+    for (int p = 0; p < num_particles; p++) {
+      system->AddPosition(point, i);
+    }
+  }
+  system->ResetDomainFlags();
+  return system;
+}
+
+//---------------------------------------------------------------------------
+static CorrespondenceFunction::Pointer create_correspondence_function(ParticleSystem::Pointer system,
+                                                                      int num_particles, int num_shapes,
+                                                                      bool factored) {
+  std::mt19937 generator(42);
+  std::normal_distribution<double> distribution;
+
+  auto shape_data = ShapeMatrix::New();
+  shape_data->set_size(3 * num_particles, num_shapes);
+  for (size_t i = 0; i < shape_data->size(); i++) {
+    shape_data->data_block()[i] = distribution(generator);
+  }
+
+  auto shape_gradient = ShapeGradientMatrix::New();
+  shape_gradient->set_size(3 * num_particles, 3 * num_shapes);
+  for (size_t i = 0; i < shape_gradient->size(); i++) {
+    shape_gradient->data_block()[i] = distribution(generator);
+  }
+
+  auto function = CorrespondenceFunction::New();
+  function->SetShapeData(shape_data);
+  function->SetShapeGradient(shape_gradient);
+  function->SetDomainsPerShape(1);
+  function->SetAttributesPerDomain(std::vector<int>(1, 0));
+  function->SetXYZ(0, true);
+  function->SetNormals(0, false);
+  function->UseEntropy();
+  function->SetUseFactoredInverseCovariance(factored);
+  function->SetParticleSystem(system);
+  return function;
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, factored_covariance_updates_test) {
+  const int num_particles = 32;
+  const int num_shapes = 20;
+  auto system = create_correspondence_system(num_particles, num_shapes);
+
+  // same shape data and gradients for both
+  auto dense = create_correspondence_function(system, num_particles, num_shapes, false);
+  auto factored = create_correspondence_function(system, num_particles, num_shapes, true);
+  dense->BeforeIteration();  // calls ComputeUpdates
+  factored->BeforeIteration();
+
+  // the updates, energies and time step bound of every particle, relative to the largest of each
+  std::vector<CorrespondenceFunction::VectorType> dense_updates, factored_updates;
+  std::vector<double> dense_energies, factored_energies;
+  double max_update = 0.0, max_energy = 0.0;
+  for (int d = 0; d < num_shapes; d++) {
+    for (int p = 0; p < num_particles; p++) {
+      double dense_dt, dense_energy, factored_dt, factored_energy;
+      dense_updates.push_back(dense->Evaluate(p, d, system, dense_dt, dense_energy));
+      factored_updates.push_back(factored->Evaluate(p, d, system, factored_dt, factored_energy));
+      dense_energies.push_back(dense_energy);
+      factored_energies.push_back(factored_energy);
+      ASSERT_NEAR(factored_dt, dense_dt, 1e-8 * std::abs(dense_dt));
+      max_update = std::max(max_update, dense_updates.back().magnitude());
+      max_energy = std::max(max_energy, std::abs(dense_energy));
+    }
+  }
+  ASSERT_GT(max_update, 0.0);
+  ASSERT_GT(max_energy, 0.0);
+
+  for (size_t i = 0; i < dense_updates.size(); i++) {
+    for (int k = 0; k < 3; k++) {
+      ASSERT_NEAR(factored_updates[i][k], dense_updates[i][k], 1e-6 * max_update) << "particle " << i;
+    }
+    ASSERT_NEAR(factored_energies[i], dense_energies[i], 1e-6 * max_energy) << "particle " << i;
+  }
+}
+
+//---------------------------------------------------------------------------
+static double run_compute_updates_benchmark(int num_particles, int num_shapes) {
+  // the dense inverse covariance would be 12k x 12k at 4096 particles, so the factored form is used
+  auto system = create_correspondence_system(num_particles, num_shapes);
+  auto function = create_correspondence_function(system, num_particles, num_shapes, true);
+
+  const int repetitions = 5;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repetitions; i++) {
+    function->BeforeIteration();  // calls ComputeUpdates
+  }
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() / repetitions;
+}
+
+//---------------------------------------------------------------------------
+// Benchmark, run manually with --gtest_also_run_disabled_tests
+TEST(OptimizeTests, DISABLED_compute_updates_benchmark) {
+  for (int num_shapes : {100, 500}) {
+    for (int num_particles : {256, 1024, 4096}) {
+      double ms = run_compute_updates_benchmark(num_particles, num_shapes);
+      std::cerr << "ComputeUpdates " << num_particles << " particles x " << num_shapes << " shapes: " << ms
+                << " ms\n";
+      ASSERT_GT(ms, 0);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, mesh_ffc_voxel_cache_test) {
+  prep_temp("/optimize/mesh_constraints_aug_lag", "mesh_ffc_voxel_cache_test");
+
+  // make sure we clean out at least one output file
+  std::remove("optimize_particles/sphere10_world.particles");
+  std::remove("optimize_particles/sphere20_world.particles");
+  std::remove("optimize_particles/sphere30_world.particles");
+  std::remove("optimize_particles/sphere40_world.particles");
+
+  Optimize app;
+  ProjectHandle project = std::make_shared<Project>();
+  ASSERT_TRUE(project->load("optimize.swproj"));
+  OptimizeParameters params(project);
+  params.set_use_ffc_voxel_cache(true);
+  ASSERT_TRUE(params.set_up_optimize(&app));
+  app.Run();
+
+  // same tolerance as the exact mesh queries (see 'mesh_ffc_test_aug_lag')
+  bool good = check_constraint_violations(app, 20.0e-1);
+  ASSERT_TRUE(good);
+
+  // the cached fields match the direct mesh queries, on and half a voxel off the surface
+  int num_caches = 0;
+  const auto system = app.GetSampler()->GetParticleSystem();
+  for (unsigned int d = 0; d < system->GetNumberOfDomains(); d++) {
+    auto& ffc = system->GetDomain(d)->GetConstraints()->getFreeformConstraint();
+    const auto cache = ffc.getVoxelCache();
+    if (!cache) {
+      continue;
+    }
+    num_caches++;
+    // the optimization itself was served by the cache
+    ASSERT_GT(cache->getNumHits(), 0);
+
+    const auto mesh = ffc.getMesh();
+    const double voxel = cache->getVoxelSize();
+    const auto center = mesh->center();
+    const int stride = std::max(1, mesh->numPoints() / 12);
+    int num_samples = 0;
+    double gradient_error = 0.0, gradient_norm = 0.0;
+    for (int i = 0; i < mesh->numPoints(); i += stride) {
+      const auto p = mesh->getPoint(i);
+      const Eigen::Vector3d surface(p[0], p[1], p[2]);
+      const Eigen::Vector3d normal = (surface - Eigen::Vector3d(center[0], center[1], center[2])).normalized();
+      for (double offset : {0.0, -0.5 * voxel, 0.5 * voxel}) {
+        const Eigen::Vector3d pt = surface + offset * normal;
+        double value;
+        Eigen::Vector3d gradient;
+        ASSERT_TRUE(cache->sampleValue(pt, value));
+        ASSERT_TRUE(cache->sampleGradient(pt, gradient));
+        ASSERT_NEAR(value, mesh->getFFCValue(pt), voxel);
+
+        // the mesh gradient is constant per face, so the interpolated one is compared over all samples
+        const Eigen::Vector3d expected = mesh->getFFCGradient(pt);
+        gradient_error += (gradient - expected).norm();
+        gradient_norm += expected.norm();
+        num_samples++;
+      }
+    }
+    ASSERT_GE(num_samples, 24);
+    ASSERT_LT(gradient_error, 0.25 * gradient_norm);
+  }
+  ASSERT_GT(num_caches, 0);
+}
+
+//---------------------------------------------------------------------------
+TEST(OptimizeTests, checkpoint_writer_test) {
+  prep_temp("/optimize/sphere", "checkpoint_writer");
+
+  CheckpointWriter writer;
+  std::vector<Eigen::VectorXd> expected;
+  for (int checkpoint = 0; checkpoint < 3; checkpoint++) {
+    auto& snapshot = writer.GetSnapshot();
+    snapshot.targets = {{"checkpoint", "checkpoint/transform"}};
+    snapshot.particle_format = "particles";
+    snapshot.write_transform_files = true;
+    snapshot.domains.resize(2);
+    snapshot.transforms.resize(2);
+    expected.clear();
+    for (int d = 0; d < 2; d++) {
+      auto& domain = snapshot.domains[d];
+      domain.name = "domain" + std::to_string(d);
+      domain.local = Eigen::VectorXd::Constant(30, checkpoint + d);
+      domain.world = Eigen::VectorXd::Constant(30, checkpoint + d + 0.5);
+      snapshot.transforms[d].set_identity();
+      expected.push_back(domain.world);
+    }
+    // returns immediately, waiting only for the previous checkpoint
+    writer.Submit();
+  }
+  writer.Wait();
+
+  // the last checkpoint wins, with all 10 particles of each domain
+  for (int d = 0; d < 2; d++) {
+    const auto prefix = "checkpoint/domain" + std::to_string(d);
+    const auto local = particles::read_particles(prefix + "_local.particles");
+    const auto world = particles::read_particles(prefix + "_world.particles");
+    ASSERT_EQ(local.size(), 30);
+    ASSERT_EQ(world.size(), 30);
+    ASSERT_TRUE(world.isApprox(expected[d]));
+    ASSERT_TRUE(std::ifstream(prefix + ".transform").good());
+  }
+  ASSERT_TRUE(std::ifstream("checkpoint/transform").good());
+
+  // and no temporary files are left behind
+  for (const auto& entry : boost::filesystem::directory_iterator("checkpoint")) {
+    ASSERT_NE(entry.path().filename().string().rfind(".tmp_", 0), 0) << entry.path();
+  }
+}
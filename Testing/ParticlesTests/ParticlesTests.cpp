@@ -1,9 +1,13 @@
+#include <random>
 #include <string>
 #include <vector>
 
 #include "Libs/Optimize/Domain/MeshWrapper.h"
+#include "NearestShapeIndex.h"
+#include "ParticleFile.h"
 #include "ParticleNormalEvaluation.h"
 #include "ParticleShapeStatistics.h"
+#include "ParticleStore.h"
 #include "ParticleSystemEvaluation.h"
 #include "ReconstructSurface.h"
 #include "ShapeEvaluation.h"
@@ -74,6 +78,83 @@ TEST(ParticlesTests, pca)
   ASSERT_TRUE(((pcaVec - ground_truth).norm() < 1E-4));
 }
 
+TEST(ParticlesTests, streaming_pca)
+{
+  ParticleSystemEvaluation ParticleSystemEvaluation(filenames);
+  ParticleShapeStatistics stats;
+  stats.do_pca(ParticleSystemEvaluation);
+  stats.principal_component_projections();
+
+  // small blocks so that the Gram matrix is assembled from several of them
+  const int num_modes = 3;
+  ParticleShapeStatistics streaming;
+  ASSERT_EQ(streaming.do_streaming_pca(filenames, 1, num_modes, 4), 0);
+  ASSERT_EQ(streaming.get_num_modes(), num_modes);
+  ASSERT_TRUE((streaming.get_mean() - stats.get_mean()).norm() < 1e-9);
+
+  const int N = filenames.size();
+  for (int m = 0; m < num_modes; m++) {
+    // ascending, so the largest modes are the last ones
+    const int full = N - num_modes + m;
+    ASSERT_NEAR(streaming.get_eigen_values()[m], stats.get_eigen_values()[full], 1e-8);
+    const double dot = streaming.get_eigen_vectors().col(m).dot(stats.get_eigen_vectors().col(full));
+    ASSERT_NEAR(std::abs(dot), 1.0, 1e-8);
+
+    const int n = num_modes - 1 - m;
+    const double sign = dot < 0 ? -1.0 : 1.0;
+    ASSERT_TRUE((sign * streaming.get_pca_loadings().col(n) - stats.get_pca_loadings().col(n)).norm() < 1e-6);
+    ASSERT_NEAR(streaming.get_percent_variance_by_mode()[n], stats.get_percent_variance_by_mode()[n], 1e-5);
+  }
+}
+
+TEST(ParticlesTests, streaming_pca_many_shapes)
+{
+  // enough shapes (well above 2 * (num_modes + 10)) that the modes come from the randomized subspace iteration rather
+  // than the dense fallback: a base shape plus three modes of decreasing strength and a little noise
+  const int num_shapes = 60;
+  const int num_points = 200;
+  const int num_modes = 3;
+  const double mode_scales[num_modes] = {4.0, 2.0, 1.0};
+
+  std::mt19937 generator(7);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  const Eigen::VectorXd base = Eigen::VectorXd::NullaryExpr(3 * num_points, [&]() { return 20.0 * normal(generator); });
+  const Eigen::MatrixXd modes =
+      Eigen::MatrixXd::NullaryExpr(3 * num_points, num_modes, [&]() { return normal(generator); });
+
+  const std::string output_dir = TestUtils::Instance().get_output_dir("streaming_pca_many_shapes");
+  Eigen::MatrixXd shapes(3 * num_points, num_shapes);
+  std::vector<std::string> shape_files;
+  for (int i = 0; i < num_shapes; i++) {
+    Eigen::VectorXd shape = base;
+    for (int m = 0; m < num_modes; m++) {
+      shape += mode_scales[m] * normal(generator) * modes.col(m);
+    }
+    shape += Eigen::VectorXd::NullaryExpr(3 * num_points, [&]() { return 0.02 * normal(generator); });
+    shapes.col(i) = shape;
+    shape_files.push_back(output_dir + "/shape_" + std::to_string(i) + particles::BINARY_EXTENSION);
+    particles::write_binary_particles(shape_files.back(), shape);
+  }
+
+  ParticleSystemEvaluation dense_system(shapes);
+  ParticleShapeStatistics dense;
+  dense.do_pca(dense_system);
+
+  ParticleShapeStatistics streaming;
+  ASSERT_EQ(streaming.do_streaming_pca(shape_files, 1, num_modes, 16), 0);
+  ASSERT_EQ(streaming.get_num_modes(), num_modes);
+  ASSERT_TRUE((streaming.get_mean() - dense.get_mean()).norm() < 1e-9);
+
+  for (int m = 0; m < num_modes; m++) {
+    // ascending, so the largest modes are the last ones
+    const int full = num_shapes - num_modes + m;
+    const double value = dense.get_eigen_values()[full];
+    ASSERT_NEAR(streaming.get_eigen_values()[m], value, 1e-8 * value);
+    const double dot = streaming.get_eigen_vectors().col(m).dot(dense.get_eigen_vectors().col(full));
+    ASSERT_NEAR(std::abs(dot), 1.0, 1e-8);
+  }
+}
+
 TEST(ParticlesTests, compactness)
 {
   ParticleSystemEvaluation ParticleSystemEvaluation(filenames);
@@ -88,6 +169,17 @@ TEST(ParticlesTests, generalization)
   ASSERT_DOUBLE_EQ(generalization, 0.19815116412998687);
 }
 
+TEST(ParticlesTests, full_generalization)
+{
+  // the folds of the full evaluation come from the Gram matrix of all shapes, check them against per fold SVDs
+  ParticleSystemEvaluation ParticleSystemEvaluation(filenames);
+  const auto generalization = ShapeEvaluation::ComputeFullGeneralization(ParticleSystemEvaluation);
+  ASSERT_EQ(generalization.size(), filenames.size() - 1);
+  for (int mode : {1, 2, 5}) {
+    ASSERT_NEAR(generalization(mode - 1), ShapeEvaluation::ComputeGeneralization(ParticleSystemEvaluation, mode), 1e-10);
+  }
+}
+
 TEST(ParticlesTests, specificity)
 {
   ParticleSystemEvaluation ParticleSystemEvaluation(filenames);
@@ -95,6 +187,44 @@ TEST(ParticlesTests, specificity)
   ASSERT_NEAR(specificity, 0.262809, 1e-1f);
 }
 
+TEST(ParticlesTests, nearest_shape_index)
+{
+  ParticleSystemEvaluation ParticleSystemEvaluation(filenames);
+  const Eigen::MatrixXd& shapes = ParticleSystemEvaluation.Particles();
+  const int N = shapes.cols();
+  const int num_particles = shapes.rows() / 3;
+
+  const Eigen::VectorXd mean = shapes.rowwise().mean();
+  Eigen::MatrixXd centered = shapes.colwise() - mean;
+  Eigen::JacobiSVD<Eigen::MatrixXd> svd(centered, Eigen::ComputeThinU);
+  const Eigen::MatrixXd basis = svd.matrixU().leftCols(N - 1);
+  NearestShapeIndex index(shapes, mean, basis);
+
+  // must agree with an exhaustive search for any number of modes
+  srand(42);
+  const int num_queries = 200;
+  for (int i = 0; i < num_queries; i++) {
+    const int modes = 1 + i % (N - 1);
+    const Eigen::VectorXd coefficients = Eigen::VectorXd::Random(modes) * (1 + i % 5) * 5;
+    const Eigen::VectorXd query = mean + basis.leftCols(modes) * coefficients;
+
+    int closest = -1;
+    double closest_distance = std::numeric_limits<double>::max();
+    for (int j = 0; j < N; j++) {
+      const double distance = NearestShapeIndex::distance(query.data(), shapes.col(j).data(), num_particles);
+      if (distance < closest_distance) {
+        closest_distance = distance;
+        closest = j;
+      }
+    }
+
+    auto result = index.find(query, coefficients);
+    ASSERT_EQ(result.index, closest);
+    ASSERT_NEAR(result.distance, closest_distance, 1e-9);
+  }
+  ASSERT_LT(index.get_num_refinements(), size_t(num_queries * N));
+}
+
 TEST(ParticlesTests, reconstructsurfaceTestRBFS)
 {
   ReconstructSurface<RBFSSparseTransform> reconstructor(denseFile, sparseFile, goodPointsFile);
@@ -295,3 +425,86 @@ TEST(ParticlesTests, particle_normal_evaluation_test)
 }
 //---------------------------------------------------------------------------
 
+
+//---------------------------------------------------------------------------
+TEST(ParticlesTests, binary_particle_file_test)
+{
+  auto temp_dir = TestUtils::Instance().get_output_dir("binary_particle_file_test");
+  auto points = particles::read_particles(filenames[0]);
+  const int num_points = points.size() / 3;
+  Eigen::MatrixXd features = Eigen::MatrixXd::Random(num_points, 2);
+
+  // double precision through the generic writer/reader round trips exactly
+  std::string filename = temp_dir + "/ellipsoid_0_world" + particles::BINARY_EXTENSION;
+  particles::write_particles(filename, points);
+  ASSERT_TRUE(particles::read_particles(filename) == points);
+  auto vector = particles::read_particles_as_vector(filename);
+  ASSERT_EQ(vector.size(), num_points);
+  ASSERT_EQ(vector[num_points - 1][2], points[points.size() - 1]);
+
+  // single precision with features, read through the mapped columns
+  std::string features_filename = temp_dir + "/ellipsoid_0_features" + particles::BINARY_EXTENSION;
+  particles::write_binary_particles(features_filename, points, features, true);
+  particles::ParticleFileView view(features_filename);
+  ASSERT_EQ(view.get_num_points(), num_points);
+  ASSERT_EQ(view.get_num_features(), 2);
+  ASSERT_TRUE(view.is_single_precision());
+  ASSERT_THROW(view.get_columns<double>(), std::runtime_error);
+  auto columns = view.get_columns<float>();
+  for (int i = 0; i < num_points; i++) {
+    for (int c = 0; c < 3; c++) {
+      ASSERT_EQ(columns(i, c), static_cast<float>(points[i * 3 + c]));
+    }
+    ASSERT_EQ(columns(i, 3), static_cast<float>(features(i, 0)));
+    ASSERT_EQ(columns(i, 4), static_cast<float>(features(i, 1)));
+  }
+  ASSERT_TRUE(view.get_interleaved_points().isApprox(points, 1e-6));
+
+  // a text file is not a binary particle file
+  ASSERT_THROW(particles::ParticleFileView view(filenames[0]), std::runtime_error);
+}
+
+//---------------------------------------------------------------------------
+TEST(ParticlesTests, particle_store_test)
+{
+  auto temp_dir = TestUtils::Instance().get_output_dir("particle_store_test");
+  std::string store_file = temp_dir + "/particles" + particles::STORE_EXTENSION;
+  std::remove(store_file.c_str());
+
+  std::vector<Eigen::VectorXd> points;
+  for (int i = 0; i < 3; i++) {
+    points.push_back(particles::read_particles(filenames[i]));
+  }
+
+  // two snapshots, the second one moved
+  for (int snapshot = 0; snapshot < 2; snapshot++) {
+    particles::ParticleStoreWriter writer(store_file);
+    for (int i = 0; i < 3; i++) {
+      Eigen::VectorXd moved = points[i].array() + snapshot;
+      writer.add("shape" + std::to_string(i) + "_world", moved);
+      writer.add("shape" + std::to_string(i) + "_transform", Eigen::Matrix4d::Identity());
+    }
+    writer.commit("snapshot" + std::to_string(snapshot));
+  }
+
+  // an interrupted append is not visible
+  {
+    particles::ParticleStoreWriter writer(store_file);
+    writer.add("shape0_world", points[0]);
+  }
+
+  particles::ParticleStore store(store_file);
+  ASSERT_EQ(store.get_snapshots(), std::vector<std::string>({"snapshot0", "snapshot1"}));
+  ASSERT_EQ(store.get_entries("snapshot1").size(), 6);
+  ASSERT_TRUE(store.read("snapshot0", "shape2_transform") == Eigen::Matrix4d::Identity());
+  ASSERT_THROW(store.read("snapshot2", "shape0_world"), std::runtime_error);
+
+  // entries are readable as particle files, without a snapshot name the last one is used
+  ASSERT_TRUE(particles::read_particles(store_file + "#snapshot0/shape1_world") == points[1]);
+  Eigen::VectorXd last = points[1].array() + 1;
+  ASSERT_TRUE(particles::read_particles(store_file + "#shape1_world") == last);
+
+  ParticleSystemEvaluation from_store(store.get_paths("snapshot0", "_world"));
+  ParticleSystemEvaluation from_files(std::vector<std::string>(filenames.begin(), filenames.begin() + 3));
+  ASSERT_TRUE(from_store.Particles() == from_files.Particles());
+}